@@ -1,75 +1,44 @@
+#include <cstdlib>
 #include <iostream>
-#include <QCoreApplication>
 #include "spdlog/spdlog.h"
 
-#include "src/host/RT_object.h"
-#include "src/host/RT_scene.h"
-#include "src/host/RT_camera.h"
-
-#include <optix.h>
-#include <optixu/optixpp_namespace.h>
-#include <optixu/optixu_math_stream_namespace.h>
-#include <optixu_math_namespace.h>
-
-#include <zmq.hpp>
-#include <string>
+#include "src/host/RT_server.h"
+#include "src/host/RT_coordinator.h"
 
 const char *const SAMPLE_NAME = "nslaift";
 
-void parse_data(RT_scene* scene, QString& zmq_rec_data);
-
-int main() {
+int main(int argc, char **argv) {
     spdlog::set_level(spdlog::level::debug);
     spdlog::info("Starting raytracing application");
-    auto Scene = new RT_scene();
-
-    //  Prepare our context and socket
-    zmq::context_t zmq_context(1);
-    zmq::socket_t socket(zmq_context, ZMQ_REP);
-    socket.bind("tcp://*:5555");
-    QString zmq_request;
-
-    while (std::cin.good()) {
-        zmq::message_t request;
-
-        //  Wait for next request from client
-        socket.recv(&request);
-        zmq_request = QString::fromStdString(std::string(static_cast<char*>(request.data()), request.size()));
-        spdlog::debug("Received String via ZMQ: \"{}\"", zmq_request.toUtf8().constData());
-
-        parse_data(Scene, zmq_request);
 
-        zmq::message_t reply(1);
-        memcpy((void *) reply.data(), "0", 1);
-        socket.send(reply);
-    }
-
-    return 0;
-}
-
-void parse_data(RT_scene* scene, QString& zmq_rec_data)
-{
-    QStringList sList = zmq_rec_data.split(";");
-    if (0 == sList.at(0).compare("createObject", Qt::CaseInsensitive)){
-        scene->createObject(sList.at(1), sList.at(2));
-    } else if (0 == sList.at(0).compare("manipulateObject", Qt::CaseInsensitive)){
-        if (0 == sList.at(2).compare("setMaterialParameter", Qt::CaseInsensitive)){
-            QString param_extended = sList.at(3);
-            param_extended.append(";");
-            param_extended.append(sList.at(4));
-            scene->manipulateObject(sList.at(1), sList.at(2), param_extended);
+    // --endpoint and --stream move the sockets, e.g. to run several workers on one host; --coordinator
+    // distributes the render work over the given refloid processes instead of rendering, --worker-timeout
+    // is the time in ms it waits for the reply of a worker. An optional scene file (JSON or binary) every
+    // session starts with.
+    std::string endpoint = "tcp://*:5555";
+    std::string stream_endpoint = "tcp://*:5556";
+    QStringList workers;
+    long worker_timeout_ms = 60000;
+    std::string scene_file;
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--endpoint" && i + 1 < argc) {
+            endpoint = argv[++i];
+        } else if (arg == "--stream" && i + 1 < argc) {
+            stream_endpoint = argv[++i];
+        } else if (arg == "--coordinator" && i + 1 < argc) {
+            workers = QString::fromUtf8(argv[++i]).split(",");
+            workers.removeAll(QString());
+        } else if (arg == "--worker-timeout" && i + 1 < argc) {
+            worker_timeout_ms = std::atol(argv[++i]);
         } else {
-            scene->manipulateObject(sList.at(1), sList.at(2), sList.at(3));
-        }
-    } else if (0 == sList.at(0).compare("render", Qt::CaseInsensitive)) {
-        if (scene->updateCaches() > -1) {
-            scene->render();
+            scene_file = arg;
         }
-    } else if (0 == sList.at(0).compare("deleteObject", Qt::CaseInsensitive)){
-        scene->deleteObject(sList.at(1));
-    } else if (0 == sList.at(0).compare("setMaterial", Qt::CaseInsensitive)){
-        scene->manipulateObject(sList.at(0), sList.at(1), sList.at(2));
-    } else if (0 == sList.at(0).compare("clear", Qt::CaseInsensitive)) {
-        scene->clear();
     }
+    if (!workers.isEmpty()) {
+        RT_coordinator coordinator(endpoint, workers, worker_timeout_ms);
+        return coordinator.run();
+    }
+    RT_server server(endpoint, stream_endpoint, 4, 1024, RT_server::Reject, RT_server::AckOnApply, scene_file);
+    return server.run();
 }
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "spdlog/spdlog.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+#include "src/host/RT_helper.h"
+#include "src/host/RT_numberParser.h"
+
+const char *const SAMPLE_NAME = "refloid_parse_bench";
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    ///< the parsing before rtparse: a QStringList per command and a conversion per field
+    int qtParseFloats(const QString &str, float *values, int count)
+    {
+        QStringList sList = str.split(",");
+        if (sList.count() != count) {
+            return -2;
+        }
+        bool ok = false;
+        for (int i=0; i<count; i++) {
+            values[i] = sList.at(i).toFloat(&ok);
+            if (!ok) {
+                return -3 - i;
+            }
+        }
+        return 0;
+    }
+
+    /**
+      @brief    time a parser and print the mean duration per call
+      @param    name        label of the row
+      @param    repetitions number of calls
+      @param    parse       parser, returns 0 on success
+      **/
+    template<typename Parse>
+    void run(const char *name, int repetitions, Parse parse)
+    {
+        int failed = 0;
+        auto start = Clock::now();
+        for (int i=0; i<repetitions; i++) {
+            failed += (parse() != 0);
+        }
+        double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / static_cast<double>(repetitions);
+        std::printf("%-40s %10.1f ns%s\n", name, ns, failed ? "  (errors)" : "");
+    }
+}
+
+/**
+  Times the parsing of "manipulateObject" parameters: rtparse against QString::split() + toFloat() on a
+  float3 ("translate") and a 4x4 matrix ("setTransformationMatrix"), with the number of calls as the
+  optional argument (1000000 by default).
+**/
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::warn);
+    int repetitions = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+    if (repetitions < 1) {
+        std::fprintf(stderr, "usage: %s [repetitions]\n", argv[0]);
+        return 1;
+    }
+
+    const QString float3 = "0.125,-0.1,2.0";
+    const QString matrix = "0.866025,-0.5,0,0.1,0.5,0.866025,0,-0.25,0,0,1,2.5,0,0,0,1";
+    const QByteArray float3_bytes = float3.toUtf8();
+    const QByteArray matrix_bytes = matrix.toUtf8();
+    float values[16];
+    optix::Matrix4x4 mat;
+
+    std::printf("%d calls each\n", repetitions);
+    run("float3   QString::split + toFloat", repetitions, [&]() { return qtParseFloats(float3, values, 3); });
+    run("float3   rtparse::parseFloats (QString)", repetitions, [&]() { return rtparse::parseFloats(float3, values, 3).error; });
+    run("float3   rtparse::parseFloats (bytes)", repetitions, [&]() {
+        return rtparse::parseFloats(float3_bytes.constData(), float3_bytes.constData() + float3_bytes.size(), values, 3).error;
+    });
+    run("float3   RT_parse_float3", repetitions, [&]() { return rthelpers::RT_parse_float3(float3, &values[0], &values[1], &values[2]); });
+    run("matrix   QString::split + toFloat", repetitions, [&]() { return qtParseFloats(matrix, values, 16); });
+    run("matrix   rtparse::parseFloats (QString)", repetitions, [&]() { return rtparse::parseFloats(matrix, values, 16).error; });
+    run("matrix   rtparse::parseFloats (bytes)", repetitions, [&]() {
+        return rtparse::parseFloats(matrix_bytes.constData(), matrix_bytes.constData() + matrix_bytes.size(), values, 16).error;
+    });
+    run("matrix   RT_parse_matrix", repetitions, [&]() { return rthelpers::RT_parse_matrix(matrix, &mat); });
+    return 0;
+}
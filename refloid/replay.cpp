@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+#include "src/host/RT_scene.h"
+#include "src/host/RT_journal.h"
+#include "src/host/RT_binaryProtocol.h"
+
+const char *const SAMPLE_NAME = "refloid_replay";
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+    typedef std::map< std::string, std::vector<double> > Samples;     ///< durations in microseconds per command type
+
+    double micros(Clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1000.0;
+    }
+
+    double percentile(const std::vector<double> &sorted, double p)
+    {
+        std::size_t idx = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(idx, sorted.size() - 1)];
+    }
+
+    /**
+      @brief    replay of "render": update the caches and launch all cameras synchronously
+      **/
+    int render(RT_scene *scene, int iterations, bool launch, Samples &replayed)
+    {
+        auto start = Clock::now();
+        int ret = scene->updateCaches();
+        replayed["render/updateCaches"].push_back(micros(Clock::now() - start));
+        if (ret < 0 || !launch) {
+            return ret;
+        }
+        start = Clock::now();
+        std::vector<unsigned char> img_data;
+        for (int i=0; i<scene->countCameras(); i++) {
+            RT_camera *cam = scene->camera(i);
+            scene->launchCamera(cam->m_iCameraIdx, cam->m_iWidth, cam->m_iHeight, iterations, img_data);
+        }
+        replayed["render/launch"].push_back(micros(Clock::now() - start));
+        return 1;
+    }
+
+    std::string commandType(const QStringList &sList)
+    {
+        std::string type = sList.at(0).toStdString();
+        if (0 == sList.at(0).compare("manipulateObject", Qt::CaseInsensitive) && sList.size() > 2) {
+            type += ";" + sList.at(2).toStdString();
+        }
+        return type;
+    }
+
+    void printTable(const char *title, Samples &samples)
+    {
+        std::printf("\n%s\n", title);
+        std::printf("%-36s %8s %12s %10s %10s %10s %10s\n", "command", "count", "total [ms]", "p50 [us]", "p90 [us]", "p99 [us]", "max [us]");
+        for (auto it = samples.begin(); it != samples.end(); ++it) {
+            std::vector<double> &v = it->second;
+            std::sort(v.begin(), v.end());
+            double total = 0.0;
+            for (std::size_t i=0; i<v.size(); i++) {
+                total += v[i];
+            }
+            std::printf("%-36s %8zu %12.3f %10.1f %10.1f %10.1f %10.1f\n", it->first.c_str(), v.size(), total / 1000.0,
+                        percentile(v, 0.5), percentile(v, 0.9), percentile(v, 0.99), v.back());
+        }
+    }
+}
+
+/**
+  Replays a command journal written with "setJournal;<path>" against a local scene as fast as possible
+  and prints latency percentiles per command type, for the replay and as recorded by the server.
+
+  Usage: refloid_replay <journal> [--no-launch]
+
+  "render" is replayed synchronously; its updateCaches() and launches are listed separately. With
+  --no-launch only the caches are updated. Job and server setting commands are not replayed.
+**/
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <journal> [--no-launch]\n", argv[0]);
+        return 1;
+    }
+    bool launch = !(argc > 2 && std::string(argv[2]) == "--no-launch");
+    spdlog::set_level(spdlog::level::warn);
+
+    QVector<RT_journal::Record> records;
+    int ret = RT_journal::read(QString::fromLocal8Bit(argv[1]), records);
+    if (ret < 0 && ret != -3) {
+        return 1;
+    }
+    if (ret == -3) {
+        spdlog::warn("The journal ends with a truncated record, replaying the {} complete ones", records.size());
+    }
+
+    RT_scene scene;
+    scene.setImageDirectory(QString());
+    Samples replayed;
+    Samples recorded;
+    int skipped = 0;
+
+    auto replay_start = Clock::now();
+    for (int i=0; i<records.size(); i++) {
+        const RT_journal::Record &rec = records.at(i);
+        std::string type;
+        auto start = Clock::now();
+        try {
+            if (rec.kind == RT_journal::Binary) {
+                type = "binary";
+                QByteArray reply;
+                rtbinary::execute(&scene, rec.data.constData(), rec.data.size(), reply,
+                                  [&](int iterations) { return render(&scene, iterations, launch, replayed); });
+            } else {
+                QStringList sList = QString::fromUtf8(rec.data).split(";");
+                type = commandType(sList);
+                if (0 == sList.at(0).compare("render", Qt::CaseInsensitive)) {
+                    int iterations = (sList.size() > 1) ? sList.at(1).toInt() : 1;
+                    render(&scene, iterations > 0 ? iterations : 1, launch, replayed);
+                } else if (0 == sList.at(0).compare("status", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("wait", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("fetch", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("stop", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("cancel", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("renderFor", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("imageStats", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("sweep", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("optimizeViewpoint", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("renderTrajectory", Qt::CaseInsensitive)
+                           || (0 == sList.at(0).compare("cameras", Qt::CaseInsensitive) && sList.size() == 1)
+                           || 0 == sList.at(0).compare("openShm", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("closeShm", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("shmAlloc", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("shmRelease", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("uploadMesh", Qt::CaseInsensitive)
+                           || (0 == sList.at(0).compare("syncScene", Qt::CaseInsensitive) && sList.size() == 1)
+                           || 0 == sList.at(0).compare("stats", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("setStatsDump", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("setStream", Qt::CaseInsensitive)
+                           || 0 == sList.at(0).compare("setCache", Qt::CaseInsensitive)) {
+                    skipped++;
+                    continue;
+                } else {
+                    scene.executeCommand(sList);
+                }
+            }
+        } catch (const std::exception &e) {
+            spdlog::error("Record {} failed: {}", i, e.what());
+        }
+        replayed[type].push_back(micros(Clock::now() - start));
+        recorded[type].push_back(rec.duration / 1000.0);
+    }
+    double replay_ms = micros(Clock::now() - replay_start) / 1000.0;
+
+    double recorded_ms = 0.0;
+    if (!records.isEmpty()) {
+        recorded_ms = (records.last().timestamp - records.first().timestamp) / 1e6;
+    }
+    std::printf("Replayed %d records (%d skipped) in %.3f ms, the recorded session took %.3f ms\n",
+                records.size(), skipped, replay_ms, recorded_ms);
+    printTable("Replay:", replayed);
+    printTable("Recorded by the server (render only queued the job):", recorded);
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**
+  @file     RT_actionTable.h
+  @brief    hashed dispatch of the manipulateObject actions
+
+  Every class with actions builds one static table that maps the action keywords (case insensitive)
+  to typed handlers. A derived class table starts with all entries of its base class table, so
+  parseActions() needs a single hash lookup, whatever the depth of the class hierarchy and the number
+  of registered actions. The tables are built once on first use and only read afterwards, so they are
+  shared by all sessions.
+**/
+
+#ifndef NSLAIFT_RT_ACTIONTABLE_H
+#define NSLAIFT_RT_ACTIONTABLE_H
+
+#include <QHash>
+#include <QString>
+
+#include <functional>
+#include <initializer_list>
+
+///< action keyword, compared and hashed case insensitively without converting the string
+struct RT_actionKey
+{
+    QString name;
+
+    bool operator==(const RT_actionKey &other) const
+    {
+        return 0 == name.compare(other.name, Qt::CaseInsensitive);
+    }
+};
+
+inline uint qHash(const RT_actionKey &key, uint seed = 0)
+{
+    uint hash = seed;
+    const QChar *c = key.name.constData();
+    for (int i=0; i<key.name.size(); i++) {
+        hash = 31 * hash + c[i].toCaseFolded().unicode();
+    }
+    return hash;
+}
+
+/**
+  @brief    action keyword table of class T
+  @tparam   T       class the handlers operate on
+  @tparam   Args    handler arguments following the object, usually the action parameters
+**/
+template<class T, class... Args>
+class RT_actionTable
+{
+public:
+    typedef std::function<int(T&, Args...)> Handler;
+
+    RT_actionTable() {}
+
+    ///< start with all actions of the table of a base class
+    template<class Base>
+    explicit RT_actionTable(const RT_actionTable<Base, Args...> &base)
+    {
+        for (auto it = base.m_handlers.constBegin(); it != base.m_handlers.constEnd(); ++it) {
+            m_handlers.insert(it.key(), Handler(it.value()));
+        }
+    }
+
+    ///< register a handler for an action and its aliases, replaces handlers of the base class
+    void add(std::initializer_list<const char*> keywords, const Handler &handler)
+    {
+        for (const char *keyword : keywords) {
+            m_handlers.insert(RT_actionKey{QString(keyword)}, handler);
+        }
+    }
+
+    /**
+      @brief    execute the handler of an action
+      @return   the return value of the handler, 1 if the action is not known
+      **/
+    int dispatch(const QString &action, T &object, Args... args) const
+    {
+        auto it = m_handlers.constFind(RT_actionKey{action});
+        if (it == m_handlers.constEnd()) {
+            return 1;
+        }
+        return it.value()(object, args...);
+    }
+
+    bool contains(const QString &action) const
+    {
+        return m_handlers.contains(RT_actionKey{action});
+    }
+
+private:
+    template<class, class...> friend class RT_actionTable;
+
+    QHash<RT_actionKey, Handler> m_handlers;
+};
+
+#endif //NSLAIFT_RT_ACTIONTABLE_H
@@ -0,0 +1,274 @@
+/**
+  @file     RT_binaryProtocol.cpp
+  @brief    binary scene command protocol
+
+  See RT_binaryProtocol.h for the frame layout
+**/
+
+#include "RT_binaryProtocol.h"
+#include "RT_scene.h"
+
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const char Magic[4] = {'R', 'F', 'B', '1'};
+
+    /**
+      @brief    read count little-endian floats from the message into dst
+      @param    src     first byte of the float payload within the message
+      @param    count   number of floats to read
+      @param    dst     target array (at least count elements)
+      **/
+    void readFloats(const uchar *src, int count, float *dst)
+    {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        memcpy(dst, src, sizeof(float) * count);
+#else
+        for (int i=0; i<count; i++) {
+            quint32 raw = qFromLittleEndian<quint32>(src + i * sizeof(float));
+            memcpy(&dst[i], &raw, sizeof(float));
+        }
+#endif
+    }
+
+    ///< check that a float converts to int without undefined behaviour, 2147483648.0f is the first float above INT_MAX
+    bool isIntRange(float value)
+    {
+        return std::isfinite(value) && value >= -2147483648.0f && value < 2147483648.0f;
+    }
+
+    void appendUInt32(QByteArray &dst, quint32 value)
+    {
+        uchar buf[4];
+        qToLittleEndian<quint32>(value, buf);
+        dst.append(reinterpret_cast<const char*>(buf), 4);
+    }
+
+    /**
+      @brief    apply a single binary record to an object
+      @param    object  object the record refers to
+      @param    opcode  record opcode (see rtbinary::Opcode)
+      @param    values  float payload
+      @param    count   number of floats in payload
+      @return   0 on success, the error codes of executeRecord() otherwise; the object is unchanged on error
+      **/
+    int applyRecord(RT_object *object, quint16 opcode, float *values, int count)
+    {
+        switch (opcode) {
+            case rtbinary::OpReset:
+                object->reset();
+                return 0;
+            case rtbinary::OpTranslate:
+                if (count != 3) return -2;
+                object->translate(values[0], values[1], values[2]);
+                return 0;
+            case rtbinary::OpMove:
+                if (count != 3) return -2;
+                object->move(values[0], values[1], values[2]);
+                return 0;
+            case rtbinary::OpSetPosition:
+                if (count != 3) return -2;
+                object->setPosition(values[0], values[1], values[2]);
+                return 0;
+            case rtbinary::OpSpin:
+                if (count != 3) return -2;
+                object->spin(values[0], values[1], values[2]);
+                return 0;
+            case rtbinary::OpRotate:
+                if (count != 3) return -2;
+                object->rotate(values[0], values[1], values[2]);
+                return 0;
+            case rtbinary::OpTransform: {
+                if (count != 16) return -2;
+                optix::Matrix4x4 mat(values);
+                object->transform(mat);
+                return 0;
+            }
+            case rtbinary::OpSetTransformationMatrix:
+                if (count != 16) return -2;
+                object->setTransformationMatrix(optix::Matrix4x4(values));
+                return 0;
+            case rtbinary::OpSetVisible:
+                if (count != 1) return -2;
+                object->setVisible(values[0] != 0.0f);
+                return 0;
+            case rtbinary::OpSetColor: {
+                if (count != 3) return -2;
+                RT_lightSource *light = dynamic_cast<RT_lightSource*>(object);
+                if (light == nullptr) return -3;
+                light->setColor(values[0], values[1], values[2]);
+                return 0;
+            }
+            case rtbinary::OpSetPower: {
+                if (count != 1) return -2;
+                RT_lightSource *light = dynamic_cast<RT_lightSource*>(object);
+                if (light == nullptr) return -3;
+                light->setPower(values[0]);
+                return 0;
+            }
+            case rtbinary::OpSetRadius: {
+                if (count != 1) return -2;
+                RT_sphere *sphere = dynamic_cast<RT_sphere*>(object);
+                if (sphere == nullptr) return -3;
+                sphere->setRadius(values[0]);
+                return 0;
+            }
+            case rtbinary::OpSetResolution: {
+                if (count != 2) return -2;
+                RT_camera *cam = dynamic_cast<RT_camera*>(object);
+                if (cam == nullptr) return -3;
+                if (!isIntRange(values[0]) || !isIntRange(values[1]) || values[0] < 0.0f || values[1] < 0.0f) return -11;
+                return cam->setResolution(static_cast<unsigned int>(values[0]), static_cast<unsigned int>(values[1]));
+            }
+            case rtbinary::OpSetIntrinsics: {
+                if (count != 16) return -2;
+                RT_camera *cam = dynamic_cast<RT_camera*>(object);
+                if (cam == nullptr) return -3;
+                return cam->setIntrinsics(optix::Matrix4x4(values));
+            }
+            default:
+                spdlog::error("Binary opcode {} is not known", opcode);
+                return -10;
+        }
+    }
+
+    /**
+      @brief    apply a single binary record to the scene
+      @param    scene   scene to manipulate
+      @param    opcode  record opcode (see rtbinary::Opcode)
+      @param    handle  object handle the record refers to
+      @param    values  float payload
+      @param    count   number of floats in payload
+      @param    render  queues a render job with the given iterations, returns its id
+      @return   0 on success (the render job id for OpRender)
+                -1 if no object with the given handle exists
+                -2 if the payload size does not match the opcode
+                -3 if the opcode cannot be applied to the object type
+                -10 if the opcode is not known
+                -11 if the iterations of OpRender or the resolution of OpSetResolution are NaN, infinite or
+                    beyond the range of int
+      **/
+    int executeRecord(RT_scene *scene, quint16 opcode, quint32 handle, float *values, int count,
+                      const std::function<int(int)> &render)
+    {
+        if (opcode == rtbinary::OpRender) {
+            if (count > 1) {
+                return -2;
+            }
+            float value = (count == 1) ? values[0] : 1.0f;
+            if (!isIntRange(value)) {
+                spdlog::error("Binary render record with invalid iterations {}", value);
+                return -11;
+            }
+            return render(value >= 1.0f ? static_cast<int>(value) : 1);
+        }
+
+        RT_object *object = scene->findObject(handle);
+        if (object == nullptr) {
+            spdlog::error("Binary record with opcode {} refers to unknown object handle {}", opcode, handle);
+            return -1;
+        }
+        int ret = applyRecord(object, opcode, values, count);
+        // Pose records are buffered by the object and flushed with the next cache upload, the others
+        // are marked once they were applied
+        if (ret == 0 && opcode > rtbinary::OpSetTransformationMatrix) {
+            scene->markChanged(object);
+        }
+        return ret;
+    }
+}
+
+/**
+  @brief    check whether a received message is a binary command frame
+  @param    data    pointer to the message data
+  @param    size    size of the message in bytes
+  @return   true if the message starts with the binary protocol magic
+  **/
+bool rtbinary::isBinaryFrame(const void *data, std::size_t size)
+{
+    return size >= HeaderSize && 0 == memcmp(data, Magic, sizeof(Magic));
+}
+
+/**
+  @brief    execute all records of a binary frame on the scene
+  @param    scene   scene to manipulate
+  @param    data    pointer to the message data, read in place
+  @param    size    size of the message in bytes
+  @param    reply   binary reply holding one status per record
+  @param    render  queues a render job with the given iterations, returns its id
+  @return   0 if the frame was well-formed, -1 if it was truncated
+
+  Records following a truncated record are not executed and get the status -12.
+  **/
+int rtbinary::execute(RT_scene *scene, const void *data, std::size_t size, QByteArray &reply,
+                      const std::function<int(int)> &render)
+{
+    const uchar *bytes = static_cast<const uchar*>(data);
+    quint32 record_count = qFromLittleEndian<quint32>(bytes + 4);
+    spdlog::debug("Received binary frame with {} records", record_count);
+
+    reply.clear();
+    if (record_count > (size - HeaderSize) / RecordHeaderSize) {
+        // Cannot possibly hold that many records, do not trust the header at all
+        spdlog::error("Binary frame of {} bytes announces {} records", size, record_count);
+        reply.append(Magic, sizeof(Magic));
+        appendUInt32(reply, 0);
+        return -1;
+    }
+    reply.reserve(static_cast<int>(HeaderSize + 4 * record_count));
+    reply.append(Magic, sizeof(Magic));
+    appendUInt32(reply, record_count);
+
+    int ret = 0;
+    std::size_t offset = HeaderSize;
+    float values[MaxFloatCount];
+    for (quint32 rec=0; rec<record_count; rec++) {
+        int status = -12;
+        if (ret == 0 && offset + RecordHeaderSize <= size) {
+            quint16 opcode = qFromLittleEndian<quint16>(bytes + offset);
+            quint16 float_count = qFromLittleEndian<quint16>(bytes + offset + 2);
+            quint32 handle = qFromLittleEndian<quint32>(bytes + offset + 4);
+            std::size_t payload_size = sizeof(float) * float_count;
+            if (offset + RecordHeaderSize + payload_size <= size) {
+                if (float_count <= MaxFloatCount) {
+                    readFloats(bytes + offset + RecordHeaderSize, float_count, values);
+                    status = executeRecord(scene, opcode, handle, values, float_count, render);
+                } else {
+                    status = -2;
+                }
+                offset += RecordHeaderSize + payload_size;
+            } else {
+                spdlog::error("Binary frame is truncated at record {} of {}", rec, record_count);
+                ret = -1;
+            }
+        } else if (ret == 0) {
+            spdlog::error("Binary frame is truncated at record {} of {}", rec, record_count);
+            ret = -1;
+        }
+        appendUInt32(reply, static_cast<quint32>(status));
+    }
+    return ret;
+}
+
+/**
+  @brief    build the reply for a frame that cannot be executed at all
+  @param    data    pointer to the message data
+  @param    size    size of the message in bytes
+  @param    status  status reported for every record
+  @param    reply   binary reply
+  **/
+void rtbinary::reject(const void *data, std::size_t size, int status, QByteArray &reply)
+{
+    quint32 record_count = qFromLittleEndian<quint32>(static_cast<const uchar*>(data) + 4);
+    if (record_count > (size - HeaderSize) / RecordHeaderSize) {
+        record_count = 0;
+    }
+    reply.clear();
+    reply.append(Magic, sizeof(Magic));
+    appendUInt32(reply, record_count);
+    for (quint32 rec=0; rec<record_count; rec++) {
+        appendUInt32(reply, static_cast<quint32>(status));
+    }
+}
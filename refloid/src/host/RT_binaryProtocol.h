@@ -0,0 +1,61 @@
+/**
+  @file     RT_binaryProtocol.h
+  @brief    binary scene command protocol
+
+  Binary frames are an alternative to the ";"-separated text commands for high rate updates
+  (e.g. thousands of setTransformationMatrix calls). A frame is parsed in place from the received
+  ZMQ message, no strings are built. All values are little-endian.
+
+  frame:    char     magic[4]       "RFB1"
+            uint32   record_count
+            record   records[record_count]
+
+  record:   uint16   opcode         see rtbinary::Opcode
+            uint16   float_count    number of floats following the record header (at most 16)
+            uint32   handle         object handle (see command "getHandle"), ignored by scene-wide opcodes
+            float32  payload[float_count]
+
+  reply:    char     magic[4]       "RFB1"
+            uint32   record_count
+            int32    status[record_count]   0 on success, negative on error
+**/
+
+#ifndef NSLAIFT_RT_BINARYPROTOCOL_H
+#define NSLAIFT_RT_BINARYPROTOCOL_H
+
+#include <QByteArray>
+#include <cstddef>
+#include <functional>
+
+class RT_scene;
+
+namespace rtbinary {
+    enum Opcode {
+        OpReset                     = 1,    ///< 0 floats
+        OpTranslate                 = 2,    ///< 3 floats x, y, z
+        OpMove                      = 3,    ///< 3 floats x, y, z
+        OpSetPosition               = 4,    ///< 3 floats x, y, z
+        OpSpin                      = 5,    ///< 3 floats rX, rY, rZ in degrees
+        OpRotate                    = 6,    ///< 3 floats rX, rY, rZ in degrees
+        OpTransform                 = 7,    ///< 16 floats, row major
+        OpSetTransformationMatrix   = 8,    ///< 16 floats, row major
+        OpSetVisible                = 9,    ///< 1 float, 0 = hidden
+        OpSetColor                  = 20,   ///< 3 floats r, g, b (light sources)
+        OpSetPower                  = 21,   ///< 1 float (light sources)
+        OpSetRadius                 = 30,   ///< 1 float (spheres)
+        OpSetResolution             = 40,   ///< 2 floats width, height (cameras), -11 if negative, NaN, inf or > INT_MAX
+        OpSetIntrinsics             = 41,   ///< 16 floats, row major (cameras)
+        OpRender                    = 100   ///< 0 or 1 float (iterations), scene-wide, status is the render job id, -11 for NaN, inf or > INT_MAX
+    };
+
+    static const std::size_t HeaderSize = 8;
+    static const std::size_t RecordHeaderSize = 8;
+    static const int MaxFloatCount = 16;
+
+    bool isBinaryFrame(const void *data, std::size_t size);
+    int execute(RT_scene *scene, const void *data, std::size_t size, QByteArray &reply,
+                const std::function<int(int)> &render);
+    void reject(const void *data, std::size_t size, int status, QByteArray &reply);
+}
+
+#endif //NSLAIFT_RT_BINARYPROTOCOL_H
@@ -141,6 +141,20 @@ int RT_camera::setUndistortion(const float undist[5]) {
     return 0;
 }
 
+/**
+  @brief    add the projection, the resolution and the distortion to a hash, see RT_object::hashState()
+  **/
+void RT_camera::hashState(QCryptographicHash &hash) const {
+    RT_object::hashState(hash);
+    rthelpers::hashData(hash, &m_iType, sizeof(m_iType));
+    rthelpers::hashData(hash, &m_iCameraIdx, sizeof(m_iCameraIdx));
+    rthelpers::hashData(hash, m_K.getData(), 16 * sizeof(float));
+    rthelpers::hashData(hash, m_distortion, sizeof(m_distortion));
+    rthelpers::hashData(hash, m_undistortion, sizeof(m_undistortion));
+    rthelpers::hashData(hash, &m_iWidth, sizeof(m_iWidth));
+    rthelpers::hashData(hash, &m_iHeight, sizeof(m_iHeight));
+}
+
 /**
   @brief    update cached matrices that are used for raytracing
   @return   0 on success, non-zero on error
@@ -179,6 +193,19 @@ int RT_camera::updateCache() {
     }
 }
 
+/**
+  @brief    upload only the pose of the camera, the intrinsics and distortion buffers are kept
+  @return   0 on success, non-zero on error
+  **/
+int RT_camera::updateTransformCache() {
+    if (m_iType != TypePinhole) {
+        return updateCache();
+    }
+    m_ray_gen_pgrm["Rt"]->setMatrix4x4fv(false, m_transform.getData());
+    m_ray_gen_pgrm["Rt_inv"]->setMatrix4x4fv(false, m_transform.inverse().getData());
+    return 0;
+}
+
 /**
   @param    get camera center position
   @return   camera centre in world frame
@@ -186,7 +213,8 @@ int RT_camera::updateCache() {
   origin of the principalAxis() -ray is returned (cached variable)
   **/
 optix::float3 RT_camera::centerPosition() {
-    return optix::make_float3(m_transform[3], m_transform[7], m_transform[11]);
+    const optix::Matrix4x4 &transform = currentTransform();
+    return optix::make_float3(transform[3], transform[7], transform[11]);
 }
 
 /**
@@ -196,7 +224,61 @@ optix::float3 RT_camera::centerPosition() {
  Principle axis is actually the z-axis
   **/
 optix::float3 RT_camera::principalAxis() {
-    return optix::make_float3(m_transform[2], m_transform[6], m_transform[10]);
+    const optix::Matrix4x4 &transform = currentTransform();
+    return optix::make_float3(transform[2], transform[6], transform[10]);
+}
+
+/**
+  @brief    actions of camera objects
+  @return   the action table, starting with all actions of RT_object
+  **/
+const RT_camera::ActionTable& RT_camera::actions() {
+    static const ActionTable table = [] {
+        ActionTable t(RT_object::actions());
+        t.add({"setResolution", "resolution"}, [](RT_camera &cam, const QString &parameters) {
+            int width, height;
+            if (0 == rthelpers::RT_parse2int(parameters, &width, &height, 'x')) {
+                cam.setResolution(width, height);
+            }
+            return 0;
+        });
+        t.add({"setIntrinsics", "K"}, [](RT_camera &cam, const QString &parameters) {
+            // 3x3 camera matrix or the complete 4x4 matrix, row major
+            QStringList fields = parameters.split(",");
+            if (fields.size() != 9 && fields.size() != 16) {
+                return -1;
+            }
+            optix::Matrix4x4 K = optix::Matrix4x4::identity();
+            for (int i=0; i<fields.size(); i++) {
+                bool ok = false;
+                float value = fields.at(i).toFloat(&ok);
+                if (!ok) {
+                    return -1;
+                }
+                K[(fields.size() == 9) ? (i / 3) * 4 + i % 3 : i] = value;
+            }
+            return cam.setIntrinsics(K);
+        });
+        t.add({"setDistortion", "distortion"}, [](RT_camera &cam, const QString &parameters) {
+            // k1,k2,p1,p2,k3 as in OpenCV, the undistortion coefficients are derived from them
+            QStringList fields = parameters.split(",");
+            float dist[5];
+            if (fields.size() != 5) {
+                return -1;
+            }
+            for (int i=0; i<5; i++) {
+                bool ok = false;
+                dist[i] = fields.at(i).toFloat(&ok);
+                if (!ok) {
+                    return -1;
+                }
+            }
+            cam.setDistortion(dist);
+            return cam.setUndistortion();
+        });
+        return t;
+    }();
+    return table;
 }
 
 /**
@@ -205,21 +287,10 @@ optix::float3 RT_camera::principalAxis() {
   @param    params  action parameters
   @return   0 on success, negative on error, positive if action not found (use child class action)
 
-  first all "local" actions are looked up, if none found then base class RTobject::parseActions() is called
+  the action table of the class also holds the actions of its base classes, see actions()
   **/
 int RT_camera::parseActions(const QString &action, const QString &parameters) {
     spdlog::debug("Parsing parameter {0} for action {1} on camera object {2}", parameters.toUtf8().constData(),
                   action.toUtf8().constData(), m_strName.toUtf8().constData());
-    if((0 == action.compare("setResolution", Qt::CaseInsensitive)) || (0 == action.compare("resolution", Qt::CaseInsensitive)))
-    {
-        int width, height;
-        if (0 == rthelpers::RT_parse2int(parameters, &width, &height, "x"))
-        {
-            setResolution(width, height);
-        }
-    } else {
-        int ret = RT_object::parseActions(action, parameters);
-        return ret;
-    }
-    return 0;
+    return actions().dispatch(action, *this, parameters);
 }
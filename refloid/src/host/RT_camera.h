@@ -15,6 +15,8 @@
 
 class RT_camera : virtual public RT_object {
 public:
+    typedef RT_actionTable<RT_camera, const QString&> ActionTable;
+
     static const int TypeGeneric = 0;            ///<    General projective camera, using A, Rt, D
     static const int TypePinhole = 1;            ///<    projective camera at origin (Rt = 0) looking into Z-direction, only using m_K; note that m_transform (from ancestor RTobject) remains!
 
@@ -63,8 +65,12 @@ public:
     virtual int setUndistortion(const float undist[5]);
 
     virtual int parseActions(const QString &action, const QString &parameters);
+    static const ActionTable& actions();
 
     virtual int updateCache();
+    virtual void hashState(QCryptographicHash &hash) const;
+
+    virtual int updateTransformCache();
 
     virtual optix::float3 centerPosition();
 
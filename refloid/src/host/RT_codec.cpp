@@ -0,0 +1,423 @@
+/**
+  @file     RT_codec.cpp
+  @brief    fast lossless compression of images and meshes sent over ZMQ
+
+  See RT_codec.h for the format
+**/
+
+#include "RT_codec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+const RT_codec::Layout RT_codec::Rgb8 = {1, 3};
+const RT_codec::Layout RT_codec::Rgb32f = {4, 3};
+const RT_codec::Layout RT_codec::Vec3 = {4, 3};
+const std::size_t RT_codec::DefaultBlockSize;
+const std::size_t RT_codec::HeaderSize;
+
+namespace {
+    const char Magic[4] = {'R', 'F', 'Z', '1'};
+    const std::uint32_t StoredFlag = 0x80000000u;
+    const std::size_t MaxBlockSize = 1 << 30;
+
+    // Limits of the LZ4 block format
+    const int MinMatch = 4;
+    const int LastLiterals = 5;             ///< the last bytes of a block are always literals
+    const int MatchFindLimit = 12;          ///< no match starts in the last bytes of a block
+    const int MaxOffset = 65535;
+    const int HashBits = 14;
+
+    inline std::uint32_t read32(const unsigned char *p)
+    {
+        std::uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline unsigned int hash(std::uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HashBits);
+    }
+
+    void putLittleEndian(unsigned char *dst, std::uint64_t value, int bytes)
+    {
+        for (int i=0; i<bytes; i++) {
+            dst[i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+    }
+
+    std::uint64_t getLittleEndian(const unsigned char *src, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i=0; i<bytes; i++) {
+            value |= static_cast<std::uint64_t>(src[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    ///< append the 255-continuation of a literal or match length of at least 15
+    void putLength(unsigned char *&op, std::size_t length)
+    {
+        for (; length >= 255; length -= 255) {
+            *op++ = 255;
+        }
+        *op++ = static_cast<unsigned char>(length);
+    }
+
+    ///< read the 255-continuation of a length, false if the input ends in it
+    bool getLength(const unsigned char *&ip, const unsigned char *ip_end, std::size_t &length)
+    {
+        unsigned char b;
+        do {
+            if (ip >= ip_end) {
+                return false;
+            }
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    }
+
+    /**
+      @brief    append one sequence of the LZ4 block format, i.e. literals followed by a match
+      @param    match_length    0 for the last sequence, which has literals only
+      @return   false if dst has no room for the sequence
+      **/
+    bool putSequence(const unsigned char *literals, std::size_t literal_length, int offset, std::size_t match_length,
+                     unsigned char *&op, const unsigned char *op_end)
+    {
+        std::size_t worst_case = 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1;
+        if (worst_case > static_cast<std::size_t>(op_end - op)) {
+            return false;
+        }
+        unsigned char *token = op++;
+        *token = static_cast<unsigned char>(std::min<std::size_t>(literal_length, 15) << 4);
+        if (literal_length >= 15) {
+            putLength(op, literal_length - 15);
+        }
+        memcpy(op, literals, literal_length);
+        op += literal_length;
+        if (match_length == 0) {
+            return true;
+        }
+        *op++ = static_cast<unsigned char>(offset & 0xff);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+        std::size_t length = match_length - MinMatch;
+        *token |= static_cast<unsigned char>(std::min<std::size_t>(length, 15));
+        if (length >= 15) {
+            putLength(op, length - 15);
+        }
+        return true;
+    }
+
+    ///< run work(first, step) for blocks first, first + step, ... on up to count threads
+    template <typename F>
+    void forEachBlock(std::size_t count, F work)
+    {
+        std::size_t threads = std::min<std::size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::thread> workers;
+        for (std::size_t t=1; t<threads; t++) {
+            workers.emplace_back(work, t, threads);
+        }
+        work(0, std::max<std::size_t>(threads, 1));
+        for (std::size_t i=0; i<workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+}
+
+/**
+  @brief    compress a payload
+  @param    data        raw bytes, e.g. the pixels of an image
+  @param    size        number of raw bytes
+  @param    layout      element size and stride of the payload, e.g. Rgb8
+  @param    block_size  raw bytes per block, rounded down to a multiple of element size * stride
+  @return   the compressed payload with its header, see RT_codec.h
+  **/
+std::vector<unsigned char> RT_codec::compress(const void *data, std::size_t size, const Layout &layout, std::size_t block_size)
+{
+    const unsigned char *src = static_cast<const unsigned char*>(data);
+    std::size_t group = layout.elementSize * layout.stride;
+    block_size = std::max(group, std::min(block_size, MaxBlockSize) / group * group);
+    std::size_t count = (size + block_size - 1) / block_size;
+
+    std::vector< std::vector<unsigned char> > blocks(count);
+    std::vector<std::uint32_t> sizes(count);
+    forEachBlock(count, [&](std::size_t first, std::size_t step) {
+        std::vector<unsigned char> filtered;
+        for (std::size_t b=first; b<count; b+=step) {
+            std::size_t raw_size = std::min(block_size, size - b * block_size);
+            filtered.resize(raw_size);
+            filter(src + b * block_size, raw_size, layout, filtered.data());
+            // A block must get smaller to be worth decompressing
+            blocks[b].resize(raw_size);
+            int compressed = compressBlock(filtered.data(), static_cast<int>(raw_size), blocks[b].data(), static_cast<int>(raw_size) - 1);
+            if (compressed < 0) {
+                blocks[b].swap(filtered);
+                sizes[b] = static_cast<std::uint32_t>(raw_size) | StoredFlag;
+            } else {
+                blocks[b].resize(compressed);
+                sizes[b] = static_cast<std::uint32_t>(compressed);
+            }
+        }
+    });
+
+    std::size_t total = HeaderSize + 4 * count;
+    for (std::size_t b=0; b<count; b++) {
+        total += blocks[b].size();
+    }
+    std::vector<unsigned char> out(total);
+    unsigned char *op = out.data();
+    memcpy(op, Magic, 4);
+    op[4] = static_cast<unsigned char>(layout.elementSize);
+    op[5] = static_cast<unsigned char>(layout.stride);
+    putLittleEndian(op + 6, 0, 2);
+    putLittleEndian(op + 8, block_size, 4);
+    putLittleEndian(op + 12, size, 8);
+    putLittleEndian(op + 20, count, 4);
+    op += HeaderSize;
+    for (std::size_t b=0; b<count; b++, op += 4) {
+        putLittleEndian(op, sizes[b], 4);
+    }
+    for (std::size_t b=0; b<count; b++) {
+        memcpy(op, blocks[b].data(), blocks[b].size());
+        op += blocks[b].size();
+    }
+    return out;
+}
+
+/**
+  @brief    decompress a payload created by compress()
+  @param    data    compressed payload with its header
+  @param    size    number of compressed bytes
+  @param    raw     receives the raw bytes
+  @return   0 on success, -22 if the payload is truncated or corrupt
+  **/
+int RT_codec::decompress(const void *data, std::size_t size, std::vector<unsigned char> &raw)
+{
+    const unsigned char *src = static_cast<const unsigned char*>(data);
+    if (!isCompressed(data, size)) {
+        return -22;
+    }
+    Layout layout = {src[4], src[5]};
+    std::size_t block_size = getLittleEndian(src + 8, 4);
+    std::uint64_t raw_size = getLittleEndian(src + 12, 8);
+    std::size_t count = getLittleEndian(src + 20, 4);
+    // LZ4 expands at most 255 times, which bounds the allocation of corrupt headers
+    if (layout.elementSize == 0 || layout.stride == 0 || block_size == 0 || block_size > MaxBlockSize
+        || raw_size > static_cast<std::uint64_t>(size) * 255 || count != (raw_size + block_size - 1) / block_size
+        || count > (size - HeaderSize) / 4) {
+        return -22;
+    }
+    std::vector<std::size_t> offsets(count + 1);
+    offsets[0] = HeaderSize + 4 * count;
+    for (std::size_t b=0; b<count; b++) {
+        offsets[b + 1] = offsets[b] + (getLittleEndian(src + HeaderSize + 4 * b, 4) & ~StoredFlag);
+        if (offsets[b + 1] > size) {
+            return -22;
+        }
+    }
+
+    raw.resize(raw_size);
+    std::atomic<int> ret(0);
+    forEachBlock(count, [&](std::size_t first, std::size_t step) {
+        std::vector<unsigned char> filtered;
+        for (std::size_t b=first; b<count && ret == 0; b+=step) {
+            std::size_t raw_block = std::min<std::uint64_t>(block_size, raw_size - b * block_size);
+            const unsigned char *block = src + offsets[b];
+            std::size_t block_bytes = offsets[b + 1] - offsets[b];
+            if (getLittleEndian(src + HeaderSize + 4 * b, 4) & StoredFlag) {
+                if (block_bytes != raw_block) {
+                    ret = -22;
+                    break;
+                }
+            } else {
+                filtered.resize(raw_block);
+                if (0 != decompressBlock(block, static_cast<int>(block_bytes), filtered.data(), static_cast<int>(raw_block))) {
+                    ret = -22;
+                    break;
+                }
+                block = filtered.data();
+            }
+            unfilter(block, raw_block, layout, raw.data() + b * block_size);
+        }
+    });
+    return ret;
+}
+
+/**
+  @brief    state if data starts with the header of a compressed payload
+  **/
+bool RT_codec::isCompressed(const void *data, std::size_t size)
+{
+    return size >= HeaderSize && 0 == memcmp(data, Magic, 4);
+}
+
+/**
+  @brief    split a block into byte planes and replace every byte by its difference to the previous element
+  @param    src     raw block
+  @param    size    bytes of the block
+  @param    layout  element size and stride of the payload
+  @param    dst     filtered block, size bytes
+  **/
+void RT_codec::filter(const unsigned char *src, std::size_t size, const Layout &layout, unsigned char *dst)
+{
+    std::size_t e = layout.elementSize;
+    std::size_t s = layout.stride;
+    std::size_t n = size / e;
+    for (std::size_t k=0; k<e; k++) {
+        unsigned char *plane = dst + k * n;
+        const unsigned char *p = src + k;
+        for (std::size_t i=0; i<std::min(s, n); i++) {
+            plane[i] = p[i * e];
+        }
+        for (std::size_t i=s; i<n; i++) {
+            plane[i] = static_cast<unsigned char>(p[i * e] - p[(i - s) * e]);
+        }
+    }
+    for (std::size_t i=n*e; i<size; i++) {
+        dst[i] = static_cast<unsigned char>(src[i] - ((i > n * e) ? src[i - 1] : 0));
+    }
+}
+
+/**
+  @brief    undo filter()
+  @param    src     filtered block
+  @param    size    bytes of the block
+  @param    layout  element size and stride of the payload
+  @param    dst     raw block, size bytes
+  **/
+void RT_codec::unfilter(const unsigned char *src, std::size_t size, const Layout &layout, unsigned char *dst)
+{
+    std::size_t e = layout.elementSize;
+    std::size_t s = layout.stride;
+    std::size_t n = size / e;
+    for (std::size_t k=0; k<e; k++) {
+        const unsigned char *plane = src + k * n;
+        unsigned char *p = dst + k;
+        for (std::size_t i=0; i<std::min(s, n); i++) {
+            p[i * e] = plane[i];
+        }
+        for (std::size_t i=s; i<n; i++) {
+            p[i * e] = static_cast<unsigned char>(plane[i] + p[(i - s) * e]);
+        }
+    }
+    for (std::size_t i=n*e; i<size; i++) {
+        dst[i] = static_cast<unsigned char>(src[i] + ((i > n * e) ? dst[i - 1] : 0));
+    }
+}
+
+/**
+  @brief    compress a block in the LZ4 block format
+  @param    src         filtered block
+  @param    size        bytes of the block
+  @param    dst         compressed block
+  @param    capacity    room in dst
+  @return   bytes written to dst, -1 if the block does not fit into capacity
+
+  Greedy matching with a hash table of the last position of every 4-byte sequence. Runs of bytes
+  without a match are skipped in growing steps, so incompressible data costs little time.
+  **/
+int RT_codec::compressBlock(const unsigned char *src, int size, unsigned char *dst, int capacity)
+{
+    if (capacity <= 0) {
+        return -1;
+    }
+    unsigned char *op = dst;
+    const unsigned char *op_end = dst + capacity;
+    std::vector<int> table(1 << HashBits, -1);
+    int ip = 0;
+    int anchor = 0;
+    while (ip < size - MatchFindLimit) {
+        std::uint32_t sequence = read32(src + ip);
+        unsigned int h = hash(sequence);
+        int ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > MaxOffset || read32(src + ref) != sequence) {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        int length = MinMatch;
+        while (ip + length < size - LastLiterals && src[ref + length] == src[ip + length]) {
+            length++;
+        }
+        while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+            ip--;
+            ref--;
+            length++;
+        }
+        if (!putSequence(src + anchor, ip - anchor, ip - ref, length, op, op_end)) {
+            return -1;
+        }
+        ip += length;
+        anchor = ip;
+        if (ip < size - MatchFindLimit) {
+            table[hash(read32(src + ip - 2))] = ip - 2;
+        }
+    }
+    if (!putSequence(src + anchor, size - anchor, 0, 0, op, op_end)) {
+        return -1;
+    }
+    return static_cast<int>(op - dst);
+}
+
+/**
+  @brief    decompress a block in the LZ4 block format
+  @param    src         compressed block
+  @param    size        bytes of the compressed block
+  @param    dst         raw block
+  @param    raw_size    bytes of the raw block
+  @return   0 on success, -1 if the block is corrupt or does not decompress to exactly raw_size bytes
+  **/
+int RT_codec::decompressBlock(const unsigned char *src, int size, unsigned char *dst, int raw_size)
+{
+    const unsigned char *ip = src;
+    const unsigned char *ip_end = src + size;
+    unsigned char *op = dst;
+    unsigned char *op_end = dst + raw_size;
+    while (ip < ip_end) {
+        unsigned char token = *ip++;
+        std::size_t literal_length = token >> 4;
+        if (literal_length == 15 && !getLength(ip, ip_end, literal_length)) {
+            return -1;
+        }
+        if (literal_length > static_cast<std::size_t>(ip_end - ip) || literal_length > static_cast<std::size_t>(op_end - op)) {
+            return -1;
+        }
+        memcpy(op, ip, literal_length);
+        op += literal_length;
+        ip += literal_length;
+        if (ip == ip_end) {
+            break;
+        }
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<std::size_t>(op - dst)) {
+            return -1;
+        }
+        std::size_t match_length = token & 15;
+        if (match_length == 15 && !getLength(ip, ip_end, match_length)) {
+            return -1;
+        }
+        match_length += MinMatch;
+        if (match_length > static_cast<std::size_t>(op_end - op)) {
+            return -1;
+        }
+        // Overlapping matches repeat the last offset bytes, copied in chunks that double in size
+        for (std::size_t distance=offset; match_length > 0; ) {
+            std::size_t chunk = std::min(distance, match_length);
+            memcpy(op, op - distance, chunk);
+            op += chunk;
+            match_length -= chunk;
+            distance += chunk;
+        }
+    }
+    return (op == op_end) ? 0 : -1;
+}
@@ -0,0 +1,58 @@
+/**
+  @file     RT_codec.h
+  @brief    fast lossless compression of images and meshes sent over ZMQ
+
+  Payloads are split into independent blocks that are compressed by several threads. Every block is
+  first filtered so that LZ matching finds more repetitions: the bytes are split into planes (byte k
+  of every element, e.g. of every float), and every byte of a plane is replaced by its difference to
+  the byte <stride> elements before it, i.e. to the same channel of the previous pixel or the same
+  coordinate of the previous vertex. The filtered block is then compressed in the LZ4 block format,
+  so clients can decode it with any LZ4 library (e.g. lz4.block.decompress in Python). Blocks that do
+  not get smaller are stored filtered but uncompressed.
+
+  All values are little endian:
+
+    header  "RFZ1", uint8 element size, uint8 stride, uint16 reserved (0), uint32 block size,
+            uint64 raw size, uint32 block count, uint32 size per block (bit 31 set: stored uncompressed)
+    blocks  the blocks one after another, each holding min(block size, rest) raw bytes
+
+  The block size is a multiple of element size * stride, so every block starts at an element with
+  the same channel. Trailing bytes of a block that do not fill a whole element are not split into
+  planes but delta coded on their own.
+**/
+
+#ifndef NSLAIFT_RT_CODEC_H
+#define NSLAIFT_RT_CODEC_H
+
+#include <cstddef>
+#include <vector>
+
+class RT_codec
+{
+public:
+    ///< how a payload is filtered before compression
+    struct Layout {
+        unsigned int elementSize;   ///< bytes per value, 1 for RGB8 and 4 for floats and indices
+        unsigned int stride;        ///< values per pixel or vertex, the distance of the prediction
+    };
+
+    static const Layout Rgb8;
+    static const Layout Rgb32f;
+    static const Layout Vec3;       ///< float or uint32 triples, i.e. vertices, normals and triangles
+
+    static std::vector<unsigned char> compress(const void *data, std::size_t size, const Layout &layout,
+                                               std::size_t block_size = DefaultBlockSize);
+    static int decompress(const void *data, std::size_t size, std::vector<unsigned char> &raw);
+    static bool isCompressed(const void *data, std::size_t size);
+
+    static const std::size_t DefaultBlockSize = 1 << 20;
+    static const std::size_t HeaderSize = 24;
+
+private:
+    static void filter(const unsigned char *src, std::size_t size, const Layout &layout, unsigned char *dst);
+    static void unfilter(const unsigned char *src, std::size_t size, const Layout &layout, unsigned char *dst);
+    static int compressBlock(const unsigned char *src, int size, unsigned char *dst, int capacity);
+    static int decompressBlock(const unsigned char *src, int size, unsigned char *dst, int raw_size);
+};
+
+#endif //NSLAIFT_RT_CODEC_H
@@ -0,0 +1,873 @@
+/**
+  @file     RT_coordinator.cpp
+  @brief    front end that distributes the render work of a scene over several refloid processes
+**/
+
+#include "RT_coordinator.h"
+#include "RT_binaryProtocol.h"
+#include "RT_metrics.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    bool isCommand(const QStringList &sList, const char *name)
+    {
+        return 0 == sList.at(0).compare(name, Qt::CaseInsensitive);
+    }
+
+    ///< status code of a reply, 0 for replies that are no status code (e.g. a job state or JSON)
+    int status(const QByteArray &reply)
+    {
+        bool ok = false;
+        int value = reply.split(';').at(0).trimmed().toInt(&ok);
+        return (ok && value < 0) ? value : 0;
+    }
+}
+
+const long RT_coordinator::WaitPollMs;
+
+/**
+  @brief    bind the client socket and connect to the workers
+  @param    endpoint            ZMQ endpoint clients connect to, e.g. "tcp://*:5555"
+  @param    workers             endpoints of the worker processes, e.g. "tcp://render1:5555"
+  @param    reply_timeout_ms    time to wait for the reply of a worker, -1 to wait forever
+  **/
+RT_coordinator::RT_coordinator(const std::string &endpoint, const QStringList &workers, long reply_timeout_ms) :
+        m_zmqContext(1),
+        m_socket(m_zmqContext, ZMQ_ROUTER),
+        m_workerEndpoints(workers),
+        m_replyTimeout(reply_timeout_ms),
+        m_nextJobId(1),
+        m_nextWorker(0),
+        m_nextPoll(std::chrono::steady_clock::now()),
+        m_commandTimes("command/"),
+        m_commandErrors("command/", "/errors")
+{
+    m_workers.resize(m_workerEndpoints.size());
+    for (int i=0; i<m_workerEndpoints.size(); i++) {
+        connectWorker(i);
+    }
+    m_socket.bind(endpoint);
+    spdlog::info("Coordinating {} workers, listening for commands on {}", m_workerEndpoints.size(), endpoint);
+}
+
+/**
+  @brief    serve requests until stdin is closed
+  @return   0, or -1 if there are no workers
+  **/
+int RT_coordinator::run()
+{
+    if (m_workers.empty()) {
+        spdlog::error("The coordinator needs at least one worker");
+        return -1;
+    }
+    while (std::cin.good()) {
+        zmq::pollitem_t items[] = {
+                {static_cast<void*>(m_socket), 0, ZMQ_POLLIN, 0}
+        };
+        zmq::poll(items, 1, pollTimeout());
+        resumeParked();
+        if (items[0].revents & ZMQ_POLLIN) {
+            std::unique_ptr<RT_session::Request> req = receiveRequest();
+            if (!serve(*req)) {
+                m_parked.push_back(std::move(req));
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+  @brief    ask the workers again for the jobs of the parked requests and send the replies that are complete
+
+  The workers are asked at most every WaitPollMs, a request whose "wait" timed out is answered at once.
+  **/
+void RT_coordinator::resumeParked()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool poll_due = (now >= m_nextPoll);
+    for (auto it = m_parked.begin(); it != m_parked.end(); ) {
+        bool timed_out = (*it)->waitTimed && now >= (*it)->waitDeadline;
+        if ((poll_due || timed_out) && process(**it)) {
+            it = m_parked.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (poll_due) {
+        m_nextPoll = now + std::chrono::milliseconds(WaitPollMs);
+    }
+}
+
+/**
+  @brief    time until the parked requests have to be resumed
+  @return   poll timeout in milliseconds, -1 to wait for the next request if nothing is parked
+  **/
+long RT_coordinator::pollTimeout() const
+{
+    if (m_parked.empty()) {
+        return -1;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto next = m_nextPoll;
+    for (auto it = m_parked.begin(); it != m_parked.end(); ++it) {
+        if ((*it)->waitTimed && (*it)->waitDeadline < next) {
+            next = (*it)->waitDeadline;
+        }
+    }
+    long timeout = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count());
+    return (timeout > 0) ? timeout : 0;
+}
+
+/**
+  @brief    receive all frames of the next request on the client socket
+  @return   the request with its routing envelope, its command frame, its data frames and its session
+  **/
+std::unique_ptr<RT_session::Request> RT_coordinator::receiveRequest()
+{
+    std::vector<zmq::message_t> frames;
+    do {
+        frames.emplace_back();
+        m_socket.recv(&frames.back());
+    } while (frames.back().more());
+
+    // REQ clients put an empty delimiter between routing id and payload, DEALER clients may not
+    std::size_t body = 1;
+    for (std::size_t i=0; i<frames.size(); i++) {
+        if (frames[i].size() == 0) {
+            body = i + 1;
+            break;
+        }
+    }
+
+    std::unique_ptr<RT_session::Request> req(new RT_session::Request);
+    req->received = std::chrono::steady_clock::now();
+    for (std::size_t i=0; i<body && i<frames.size(); i++) {
+        req->envelope << QByteArray(static_cast<const char*>(frames[i].data()), static_cast<int>(frames[i].size()));
+    }
+    if (body < frames.size()) {
+        req->payload = std::move(frames[body]);
+    }
+    for (std::size_t i=body+1; i<frames.size(); i++) {
+        req->frames.push_back(std::move(frames[i]));
+    }
+    req->session = RT_session::sessionName(req->payload.data(), req->payload.size(), req->prefixSize);
+    return req;
+}
+
+/**
+  @brief    execute a request and send its reply
+  @param    req the request
+  @return   true if the reply was sent; false if the request has to be parked, see process()
+
+  Binary frames and frames with data frames (e.g. "uploadMesh", "syncScene") are sent to every worker
+  as they are, since the data frames belong to the commands of the frame. The reply of the first
+  worker in sync is sent back, see checkReplicas(). Other frames are executed command by command like
+  in RT_session::process().
+  **/
+bool RT_coordinator::serve(RT_session::Request &req)
+{
+    const char *data = static_cast<const char*>(req.payload.data());
+    req.binary = rtbinary::isBinaryFrame(data + req.prefixSize, req.payload.size() - req.prefixSize);
+    if (req.binary || !req.frames.empty()) {
+        QByteArray payload(data, static_cast<int>(req.payload.size()));
+        QVector<int> workers;
+        QVector<QByteArray> commands;
+        for (int i=0; i<static_cast<int>(m_workers.size()); i++) {
+            workers << i;
+            commands << payload;
+        }
+        bool any_in_sync = !replicas(req.session).isEmpty();
+        std::vector<Reply> replies;
+        ask(workers, commands, replies, &req.frames);
+        QString first = req.binary ? QString() : QString::fromUtf8(data + req.prefixSize, static_cast<int>(req.payload.size() - req.prefixSize))
+                .section('\n', 0, 0).section(';', 0, 0).trimmed();
+        bool resync = (0 == first.compare("syncScene", Qt::CaseInsensitive) || 0 == first.compare("closeSession", Qt::CaseInsensitive));
+        int reference = checkReplicas(req.session, replies, resync);
+        if (reference < 0) {
+            RT_session::reject(m_socket, req, (any_in_sync || resync) ? -23 : -24);
+            return true;
+        }
+        RT_session::sendReply(m_socket, req, replies[reference].text);
+        return true;
+    }
+
+    req.commands = RT_session::splitCommands(req);
+    return process(req);
+}
+
+/**
+  @brief    execute the text commands of a request from req.next on
+  @param    req the request
+  @return   true if the reply was sent; false if a "wait" has to wait for its job, the request continues
+            with that command once it is resumed, see resumeParked()
+  **/
+bool RT_coordinator::process(RT_session::Request &req)
+{
+    while (req.next < req.commands.size()) {
+        QString command = req.commands.at(req.next);
+        std::size_t prefix_size = 0;
+        QByteArray utf8 = command.toUtf8();
+        QString session = RT_session::sessionName(utf8.constData(), utf8.size(), prefix_size);
+        if (prefix_size > 0) {
+            if (session != req.session) {
+                spdlog::error("Command \"{}\" does not belong to session \"{}\"", utf8.constData(), req.session.toUtf8().constData());
+                req.replies << QString::number(-14);
+                req.next++;
+                continue;
+            }
+            command = QString::fromUtf8(utf8.constData() + prefix_size, static_cast<int>(utf8.size() - prefix_size));
+        }
+        QStringList sList = command.split(";");
+        auto start = std::chrono::steady_clock::now();
+        bool parked = false;
+        QString reply = execute(req, command, sList, parked);
+        if (parked) {
+            return false;
+        }
+        req.waitJob = 0;
+        const QString &metrics_name = RT_session::metricsName(sList.at(0), reply);
+        m_commandTimes.histogram(metrics_name)->record(std::chrono::steady_clock::now() - start);
+        if (reply.startsWith("-")) {
+            m_commandErrors.counter(metrics_name)->fetch_add(1, std::memory_order_relaxed);
+        }
+        req.replies << reply;
+        req.next++;
+    }
+    RT_session::sendReply(m_socket, req, req.replies.join("\n").toUtf8());
+    return true;
+}
+
+/**
+  @brief    execute a single text command
+  @param    req     request the command belongs to
+  @param    command the command without session prefix
+  @param    sList   command split into its fields
+  @param    parked  set to true if a "wait" has to wait for its job
+  @return   reply of the command, -10 for commands that are not available through the coordinator
+  **/
+QString RT_coordinator::execute(RT_session::Request &req, const QString &command, const QStringList &sList, bool &parked)
+{
+    bool is_render = isCommand(sList, "render") || isCommand(sList, "renderFor");
+    bool is_sweep = isCommand(sList, "sweep");
+    if (is_render || is_sweep || isCommand(sList, "optimizeViewpoint") || isCommand(sList, "renderTrajectory")) {
+        QString reply = is_render ? submitRender(req.session, sList)
+                                  : (is_sweep ? submitSweep(req.session, sList) : submitSingle(req.session, command));
+        unsigned int id = reply.section(';', 0, 0).toUInt();
+        if (id > 0) {
+            req.lastJob = id;
+        }
+        return reply;
+    }
+    if (isCommand(sList, "status") || isCommand(sList, "wait") || isCommand(sList, "fetch") || isCommand(sList, "stop")
+            || isCommand(sList, "cancel") || isCommand(sList, "imageStats")) {
+        return executeJobCommand(req, sList, parked);
+    }
+    if (isCommand(sList, "stats")) {
+        return stats(req.session, command, sList);
+    }
+    if (isCommand(sList, "setStatsDump")) {
+        QString path = (sList.size() > 1) ? sList.at(1) : QString();
+        double interval = (sList.size() > 2) ? sList.at(2).toDouble() : 10.0;
+        int interval_ms = static_cast<int>(((interval > 0.0) ? interval : 10.0) * 1000.0);
+        return QString::number(RT_metrics::instance().setDump(path, interval_ms));
+    }
+    if (isCommand(sList, "openShm") || isCommand(sList, "closeShm") || isCommand(sList, "shmAlloc")
+            || isCommand(sList, "shmRelease") || isCommand(sList, "setAck")) {
+        spdlog::error("\"{}\" is not available through the coordinator", sList.at(0).toUtf8().constData());
+        return QString::number(-10);
+    }
+    return replicate(req.session, command);
+}
+
+/**
+  @brief    execute "status", "wait", "fetch", "stop", "cancel" and "imageStats" on the workers of all shards of a job
+  @param    req     request the command belongs to, receives the images of "fetch;<job>;data"
+  @param    sList   command split into its fields, the job id is replaced by the one of each shard
+  @param    parked  set to true if a "wait" has to wait for its job
+  @return   the merged reply, see RT_session::process()
+
+  "wait" is sent as "wait;<job>;0", which the workers answer at once. While a shard is not finished the
+  request is parked until the timeout of the client's "wait" (if any) has passed, see resumeParked().
+  **/
+QString RT_coordinator::executeJobCommand(RT_session::Request &req, const QStringList &sList, bool &parked)
+{
+    unsigned int id = (sList.size() > 1 && !sList.at(1).isEmpty()) ? sList.at(1).toUInt() : req.lastJob;
+    if (id == 0 && isCommand(sList, "cancel")) {
+        // Every job of the session, on every worker
+        QVector<int> workers;
+        QVector<QByteArray> commands;
+        for (int i=0; i<static_cast<int>(m_workers.size()); i++) {
+            workers << i;
+            commands << prefixed(req.session, "cancel");
+        }
+        std::vector<Reply> replies;
+        int ret = ask(workers, commands, replies);
+        if (ret < 0) {
+            return QString::number(ret);
+        }
+        int count = 0;
+        for (std::size_t i=0; i<replies.size(); i++) {
+            count += std::max(0, replies[i].text.trimmed().toInt());
+        }
+        return QString::number(count);
+    }
+    if (id == 0) {
+        return QString::number(-11);
+    }
+    if (!m_jobs.contains(id)) {
+        spdlog::error("Render job {} is not known", id);
+        return QString::number(-1);
+    }
+    bool is_fetch = isCommand(sList, "fetch");
+    if (is_fetch && sList.size() > 2 && 0 == sList.at(2).compare("shm", Qt::CaseInsensitive)) {
+        // The rings live on the worker hosts
+        return QString::number(-16);
+    }
+    bool is_wait = isCommand(sList, "wait");
+    if (is_wait && req.waitJob != id) {
+        req.waitJob = id;
+        req.waitTimed = (sList.size() > 2 && !sList.at(2).isEmpty());
+        if (req.waitTimed) {
+            req.waitDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(sList.at(2).toInt());
+        }
+    }
+    const Job job = m_jobs.value(id);
+    QVector<int> workers;
+    QVector<QByteArray> commands;
+    for (int i=0; i<job.shards.size(); i++) {
+        QStringList fields = sList;
+        if (fields.size() < 2) {
+            fields << QString();
+        }
+        fields[1] = QString::number(job.shards.at(i).job);
+        if (is_wait) {
+            fields = fields.mid(0, 2);
+            fields << QString::number(0);
+        }
+        workers << job.shards.at(i).worker;
+        commands << prefixed(job.session, fields.join(";"));
+    }
+    std::vector<Reply> replies;
+    int ret = ask(workers, commands, replies);
+    if (ret < 0) {
+        return QString::number(ret);
+    }
+
+    if (isCommand(sList, "stop") || isCommand(sList, "cancel")) {
+        // Stopped or cancelled as soon as one shard was still running
+        for (std::size_t i=0; i<replies.size(); i++) {
+            if (status(replies[i].text) == 0) {
+                return QString::number(0);
+            }
+        }
+        return QString::fromUtf8(replies[0].text);
+    }
+    for (std::size_t i=0; i<replies.size(); i++) {
+        if (status(replies[i].text) < 0) {
+            return QString::fromUtf8(replies[i].text);
+        }
+    }
+    if (isCommand(sList, "imageStats")) {
+        return mergeImageStats(job, id, replies);
+    }
+    if (is_fetch) {
+        if (sList.size() > 2 && 0 == sList.at(2).compare("data", Qt::CaseInsensitive)) {
+            return QString::number(gatherImages(req, job, replies));
+        }
+        QStringList parts;
+        for (std::size_t i=0; i<replies.size(); i++) {
+            if (!replies[i].text.isEmpty()) {
+                parts << QString::fromUtf8(replies[i].text);
+            }
+        }
+        return parts.join(";");
+    }
+    QString state = mergeStates(replies);
+    if (is_wait && state == "timeout" && (!req.waitTimed || std::chrono::steady_clock::now() < req.waitDeadline)) {
+        parked = true;
+        return QString();
+    }
+    return state;
+}
+
+/**
+  @brief    send a scene or session command to every worker
+  @param    session session the command belongs to
+  @param    command the command without session prefix
+  @return   reply of the first worker in sync, see checkReplicas(); -23 if no worker in sync replied in time,
+            -24 if no worker of the session is in sync
+  **/
+QString RT_coordinator::replicate(const QString &session, const QString &command)
+{
+    QVector<int> workers;
+    QVector<QByteArray> commands;
+    for (int i=0; i<static_cast<int>(m_workers.size()); i++) {
+        workers << i;
+        commands << prefixed(session, command);
+    }
+    bool any_in_sync = !replicas(session).isEmpty();
+    std::vector<Reply> replies;
+    ask(workers, commands, replies);
+    QString name = command.section(';', 0, 0);
+    bool resync = (0 == name.compare("syncScene", Qt::CaseInsensitive) || 0 == name.compare("closeSession", Qt::CaseInsensitive));
+    int reference = checkReplicas(session, replies, resync);
+    if (reference < 0) {
+        return QString::number((any_in_sync || resync) ? -23 : -24);
+    }
+    return QString::fromUtf8(replies[reference].text);
+}
+
+/**
+  @brief    compare the replies of all workers to a replicated command and take the workers whose scene
+            may differ from the others out of the sharding of the session
+  @param    session session the command belongs to
+  @param    replies reply per worker, in worker order
+  @param    resync  the command replaces the whole scene ("syncScene", "closeSession"): a worker that
+                    executed it successfully is in sync again, one that failed is not
+  @return   index of the reply to send back, the first worker in sync; -1 if none of them replied
+
+  Otherwise a worker in sync that did not reply in time or replied differently than the first one is
+  marked as diverged, since the command may have changed its scene in another way.
+  **/
+int RT_coordinator::checkReplicas(const QString &session, const std::vector<Reply> &replies, bool resync)
+{
+    QSet<int> diverged = m_diverged.value(session);
+    int count = static_cast<int>(replies.size());
+    if (resync) {
+        for (int i=0; i<count; i++) {
+            bool ok = replies[i].received && status(replies[i].text) == 0;
+            if (ok && diverged.contains(i)) {
+                diverged.remove(i);
+                spdlog::info("Worker {} is in sync with session \"{}\" again", i, session.toUtf8().constData());
+            } else if (!ok && !diverged.contains(i)) {
+                diverged.insert(i);
+                spdlog::warn("Worker {} could not resync session \"{}\", it is not used for the session", i, session.toUtf8().constData());
+                RT_metrics::instance().increment("coordinator/diverged");
+            }
+        }
+    }
+    int reference = -1;
+    for (int i=0; i<count && reference<0; i++) {
+        if (replies[i].received && !diverged.contains(i)) {
+            reference = i;
+        }
+    }
+    for (int i=0; i<count && !resync; i++) {
+        if (i == reference || diverged.contains(i)) {
+            continue;
+        }
+        if (reference < 0 || !replies[i].received || replies[i].text != replies[reference].text) {
+            diverged.insert(i);
+            spdlog::warn("Worker {} replied \"{}\" instead of \"{}\", it is not used for session \"{}\" until it is resynced", i,
+                         replies[i].text.constData(), (reference < 0) ? "" : replies[reference].text.constData(), session.toUtf8().constData());
+            RT_metrics::instance().increment("coordinator/diverged");
+        }
+    }
+    if (diverged.isEmpty()) {
+        m_diverged.remove(session);
+    } else {
+        m_diverged.insert(session, diverged);
+    }
+    return reference;
+}
+
+/**
+  @brief    workers whose replica of a session is in sync, the render work of the session is sharded over them
+  **/
+QVector<int> RT_coordinator::replicas(const QString &session) const
+{
+    QSet<int> diverged = m_diverged.value(session);
+    QVector<int> workers;
+    for (int i=0; i<static_cast<int>(m_workers.size()); i++) {
+        if (!diverged.contains(i)) {
+            workers << i;
+        }
+    }
+    return workers;
+}
+
+/**
+  @brief    "render[;iterations[;format[;<cameras>]]]" or "renderFor;<ms>[;format[;<cameras>]]", every worker renders
+            a contiguous range of the cameras
+  @param    session session the command belongs to
+  @param    sList   command split into its fields; without <cameras> all cameras of the scene are rendered
+  @return   the job id, followed by ";cached" if every shard came from the render caches, or the first error;
+            -11 if the time budget of "renderFor" is missing, -24 if no worker of the session is in sync
+  **/
+QString RT_coordinator::submitRender(const QString &session, const QStringList &sList)
+{
+    bool timed = isCommand(sList, "renderFor");
+    if (timed && sList.size() < 2) {
+        return QString::number(-11);
+    }
+    QVector<int> in_sync = replicas(session);
+    if (in_sync.isEmpty()) {
+        return QString::number(-24);
+    }
+    QStringList cameras;
+    if (sList.size() > 3) {
+        cameras = sList.at(3).split(",");
+    } else {
+        std::vector<Reply> replies;
+        int ret = ask(QVector<int>() << in_sync.at(0), QVector<QByteArray>() << prefixed(session, "cameras"), replies);
+        if (ret < 0) {
+            return QString::number(ret);
+        }
+        cameras = QString::fromUtf8(replies[0].text).split(";");
+    }
+    cameras.removeAll(QString());
+
+    QString iterations = (sList.size() > 1) ? sList.at(1) : QString::number(1);
+    QString format = (sList.size() > 2) ? sList.at(2) : QString(RT_renderJob::formatName(RT_renderJob::RGB8));
+    int count = std::max(1, std::min(in_sync.size(), cameras.size()));
+    Job job;
+    job.session = session;
+    QVector<int> workers;
+    QVector<QByteArray> commands;
+    for (int i=0; i<count; i++) {
+        int first = cameras.size() * i / count;
+        int last = cameras.size() * (i + 1) / count;
+        QStringList range = cameras.mid(first, last - first);
+        QString command = QString("%1;%2;%3").arg(QString(timed ? "renderFor" : "render")).arg(iterations).arg(format);
+        if (!range.isEmpty()) {
+            command += ";" + range.join(",");
+        }
+        Shard shard;
+        shard.worker = in_sync.at(i);
+        shard.job = 0;
+        shard.firstPose = 0;
+        job.shards << shard;
+        workers << shard.worker;
+        commands << prefixed(session, command);
+    }
+    std::vector<Reply> replies;
+    int ret = ask(workers, commands, replies);
+    if (ret < 0) {
+        return QString::number(ret);
+    }
+    return addJob(job, replies);
+}
+
+/**
+  @brief    "sweep;<object>;<action>;<poses>[;iterations[;format]]", every worker renders a contiguous range of the poses
+  @param    session session the command belongs to
+  @param    sList   command split into its fields, see RT_session::submitSweep()
+  @return   the job id, followed by ";cached" if every shard came from the render caches, or the first error;
+            -11 if fields are missing, -15 if the poses cannot be parsed, -24 if no worker of the session is in sync
+  **/
+QString RT_coordinator::submitSweep(const QString &session, const QStringList &sList)
+{
+    if (sList.size() < 4) {
+        return QString::number(-11);
+    }
+    QStringList poses;
+    if (RT_session::parsePoses(sList.at(3), poses) < 0) {
+        spdlog::error("Could not parse the poses \"{}\" of the sweep", sList.at(3).toUtf8().constData());
+        return QString::number(-15);
+    }
+    QVector<int> in_sync = replicas(session);
+    if (in_sync.isEmpty()) {
+        return QString::number(-24);
+    }
+    int count = std::min(in_sync.size(), poses.size());
+    Job job;
+    job.session = session;
+    job.sweep = true;
+    QVector<int> workers;
+    QVector<QByteArray> commands;
+    for (int i=0; i<count; i++) {
+        int first = poses.size() * i / count;
+        int last = poses.size() * (i + 1) / count;
+        QStringList fields = sList;
+        fields[3] = poses.mid(first, last - first).join("|");
+        Shard shard;
+        shard.worker = in_sync.at(i);
+        shard.job = 0;
+        shard.firstPose = first;
+        job.shards << shard;
+        workers << shard.worker;
+        commands << prefixed(session, fields.join(";"));
+    }
+    std::vector<Reply> replies;
+    int ret = ask(workers, commands, replies);
+    if (ret < 0) {
+        return QString::number(ret);
+    }
+    return addJob(job, replies);
+}
+
+/**
+  @brief    queue a job that is not split, "optimizeViewpoint" or "renderTrajectory", on the next worker in turn
+  @param    session session the command belongs to
+  @param    command the command without session prefix
+  @return   the job id or the error of the worker, -24 if no worker of the session is in sync
+  **/
+QString RT_coordinator::submitSingle(const QString &session, const QString &command)
+{
+    QVector<int> in_sync = replicas(session);
+    if (in_sync.isEmpty()) {
+        return QString::number(-24);
+    }
+    // The next worker in turn that is in sync
+    int worker = in_sync.at(0);
+    for (int i=0; i<in_sync.size(); i++) {
+        if (in_sync.at(i) >= m_nextWorker) {
+            worker = in_sync.at(i);
+            break;
+        }
+    }
+    m_nextWorker = (worker + 1) % static_cast<int>(m_workers.size());
+    Job job;
+    job.session = session;
+    Shard shard;
+    shard.worker = worker;
+    shard.job = 0;
+    shard.firstPose = 0;
+    job.shards << shard;
+    std::vector<Reply> replies;
+    int ret = ask(QVector<int>() << worker, QVector<QByteArray>() << prefixed(session, command), replies);
+    if (ret < 0) {
+        return QString::number(ret);
+    }
+    return addJob(job, replies);
+}
+
+/**
+  @brief    register a job with the job ids the workers replied for its shards
+  @param    job     the job, its shards in the order of the replies
+  @param    replies "<job>[;cached]" or an error per shard
+  @return   id of the job, followed by ";cached" if every shard was cached; the first error of a shard
+            (the other shards are stopped then)
+  **/
+QString RT_coordinator::addJob(Job job, const std::vector<Reply> &replies)
+{
+    bool cached = true;
+    int failed = -1;
+    for (int i=0; i<job.shards.size(); i++) {
+        QList<QByteArray> fields = replies[i].text.split(';');
+        int id = fields.at(0).toInt();
+        if (id <= 0) {
+            failed = (failed < 0) ? i : failed;
+            continue;
+        }
+        job.shards[i].job = static_cast<unsigned int>(id);
+        cached = cached && fields.size() > 1 && fields.at(1) == "cached";
+    }
+    if (failed >= 0) {
+        QVector<int> workers;
+        QVector<QByteArray> commands;
+        for (int i=0; i<job.shards.size(); i++) {
+            if (job.shards.at(i).job > 0) {
+                workers << job.shards.at(i).worker;
+                commands << prefixed(job.session, QString("stop;%1").arg(job.shards.at(i).job));
+            }
+        }
+        std::vector<Reply> stopped;
+        if (!workers.isEmpty()) {
+            ask(workers, commands, stopped);
+        }
+        return QString::fromUtf8(replies[failed].text);
+    }
+
+    unsigned int id = m_nextJobId++;
+    m_jobs.insert(id, job);
+    m_jobOrder.push_back(id);
+    while (m_jobOrder.size() > MaxJobs) {
+        m_jobs.remove(m_jobOrder.front());
+        m_jobOrder.pop_front();
+    }
+    static std::atomic<quint64> *const shards = RT_metrics::instance().counter("coordinator/shards");
+    shards->fetch_add(static_cast<quint64>(job.shards.size()), std::memory_order_relaxed);
+    spdlog::info("Job {} runs in {} shards", id, job.shards.size());
+    return QString::number(id) + (cached ? ";cached" : "");
+}
+
+/**
+  @brief    state of a job from the states of its shards
+  @param    replies reply of "status" or "wait" per shard
+  @return   "timeout", "running" or "queued" while a shard is not finished, "failed" if a shard failed, "cancelled" if a shard was cancelled, "done" otherwise
+  **/
+QString RT_coordinator::mergeStates(const std::vector<Reply> &replies)
+{
+    static const char *const order[] = {"timeout", "running", "queued", "failed", "cancelled"};
+    for (const char *state : order) {
+        for (std::size_t i=0; i<replies.size(); i++) {
+            if (replies[i].text == state) {
+                return QString(state);
+            }
+        }
+    }
+    return QString(RT_renderJob::stateName(RT_renderJob::Done));
+}
+
+/**
+  @brief    join the image statistics of the shards of a job
+  @param    job     the job
+  @param    id      id of the job on the coordinator
+  @param    replies JSON of "imageStats" per shard, see RT_session::imageStats()
+  @return   one line of JSON, the pose indices of sweeps counted over the whole sweep
+  **/
+QString RT_coordinator::mergeImageStats(const Job &job, unsigned int id, const std::vector<Reply> &replies)
+{
+    QJsonArray images;
+    for (int i=0; i<job.shards.size(); i++) {
+        QJsonArray shard_images = QJsonDocument::fromJson(replies[i].text).object().value("images").toArray();
+        for (int k=0; k<shard_images.size(); k++) {
+            QJsonObject entry = shard_images.at(k).toObject();
+            entry.insert("pose", entry.value("pose").toInt() + job.shards.at(i).firstPose);
+            images.append(entry);
+        }
+    }
+    QJsonObject json;
+    json.insert("job", static_cast<double>(id));
+    json.insert("images", images);
+    return QString::fromUtf8(QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+/**
+  @brief    attach the images the shards of a job sent for "fetch;<job>;data[;lz]" to the reply
+  @param    req     request the images are sent with
+  @param    job     the job
+  @param    replies number of images and the header and pixel frames per shard, the pixel frames are moved
+  @return   number of attached images
+
+  Shards hold contiguous ranges of cameras or poses, so the images are in the order a single process
+  sends them. The pose field of sweep headers is shifted by the first pose of the shard.
+  **/
+int RT_coordinator::gatherImages(RT_session::Request &req, const Job &job, std::vector<Reply> &replies)
+{
+    int count = 0;
+    for (int i=0; i<job.shards.size(); i++) {
+        std::vector<zmq::message_t> &frames = replies[i].frames;
+        for (std::size_t f=0; f+1<frames.size(); f+=2) {
+            if (job.sweep || job.shards.at(i).firstPose > 0) {
+                QStringList fields = QString::fromUtf8(static_cast<const char*>(frames[f].data()), static_cast<int>(frames[f].size())).split(";");
+                if (fields.size() > 4) {
+                    fields[4] = QString::number(fields.at(4).toInt() + job.shards.at(i).firstPose);
+                }
+                QByteArray header = fields.join(";").toUtf8();
+                req.attachments.emplace_back(header.constData(), header.size());
+            } else {
+                req.attachments.push_back(std::move(frames[f]));
+            }
+            req.attachments.push_back(std::move(frames[f + 1]));
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+  @brief    "stats[;reset]" of the coordinator and of every worker
+  @param    session session the command belongs to
+  @param    command the command without session prefix
+  @param    sList   command split into its fields
+  @return   one line of JSON {"coordinator": metrics, "workers": [metrics]}, see RT_metrics::toJson()
+  **/
+QString RT_coordinator::stats(const QString &session, const QString &command, const QStringList &sList)
+{
+    QVector<int> workers;
+    QVector<QByteArray> commands;
+    for (int i=0; i<static_cast<int>(m_workers.size()); i++) {
+        workers << i;
+        commands << prefixed(session, command);
+    }
+    std::vector<Reply> replies;
+    int ret = ask(workers, commands, replies);
+    if (ret < 0) {
+        return QString::number(ret);
+    }
+    bool reset = (sList.size() > 1 && 0 == sList.at(1).compare("reset", Qt::CaseInsensitive));
+    QJsonArray worker_metrics;
+    for (std::size_t i=0; i<replies.size(); i++) {
+        worker_metrics.append(QJsonDocument::fromJson(replies[i].text).object());
+    }
+    QJsonObject json;
+    json.insert("coordinator", QJsonDocument::fromJson(RT_metrics::instance().dump(reset)).object());
+    json.insert("workers", worker_metrics);
+    return QString::fromUtf8(QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+/**
+  @brief    send one command to each of some workers and collect their replies
+  @param    workers     indices of the workers, each at most once
+  @param    commands    command frame per worker
+  @param    replies     receives the reply per worker, in the order of workers
+  @param    frames      data frames sent after every command frame (copied per worker), nullptr for none
+  @return   0 on success, -23 if a worker did not reply in time (its socket is reconnected)
+
+  All commands are sent before the first reply is read, so the workers execute them in parallel.
+  **/
+int RT_coordinator::ask(const QVector<int> &workers, const QVector<QByteArray> &commands, std::vector<Reply> &replies,
+                        const std::vector<zmq::message_t> *frames)
+{
+    static RT_histogram *const ask_times = RT_metrics::instance().histogram("coordinator/ask");
+    RT_metrics::Timer timer(ask_times);
+    std::size_t frame_count = (frames != nullptr) ? frames->size() : 0;
+    for (int i=0; i<workers.size(); i++) {
+        zmq::socket_t &socket = *m_workers[workers.at(i)];
+        zmq::message_t command(commands.at(i).constData(), commands.at(i).size());
+        socket.send(command, (frame_count > 0) ? ZMQ_SNDMORE : 0);
+        for (std::size_t f=0; f<frame_count; f++) {
+            zmq::message_t frame;
+            frame.copy(&(*frames)[f]);
+            socket.send(frame, (f + 1 < frame_count) ? ZMQ_SNDMORE : 0);
+        }
+    }
+
+    int ret = 0;
+    replies.clear();
+    replies.resize(workers.size());
+    for (int i=0; i<workers.size(); i++) {
+        int worker = workers.at(i);
+        zmq::pollitem_t items[] = {
+                {static_cast<void*>(*m_workers[worker]), 0, ZMQ_POLLIN, 0}
+        };
+        if (zmq::poll(items, 1, m_replyTimeout) <= 0) {
+            spdlog::error("Worker {} ({}) did not reply within {} ms", worker, m_workerEndpoints.at(worker).toUtf8().constData(), m_replyTimeout);
+            RT_metrics::instance().increment("coordinator/timeouts");
+            // A REQ socket without its reply cannot send again
+            connectWorker(worker);
+            ret = -23;
+            continue;
+        }
+        std::vector<zmq::message_t> received;
+        do {
+            received.emplace_back();
+            m_workers[worker]->recv(&received.back());
+        } while (received.back().more());
+        replies[i].received = true;
+        replies[i].text = QByteArray(static_cast<const char*>(received[0].data()), static_cast<int>(received[0].size()));
+        for (std::size_t f=1; f<received.size(); f++) {
+            replies[i].frames.push_back(std::move(received[f]));
+        }
+    }
+    return ret;
+}
+
+/**
+  @brief    (re)connect the socket of a worker
+  @param    worker  index of the worker
+  **/
+void RT_coordinator::connectWorker(int worker)
+{
+    m_workers[worker].reset(new zmq::socket_t(m_zmqContext, ZMQ_REQ));
+    int linger = 0;
+    m_workers[worker]->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    m_workers[worker]->connect(m_workerEndpoints.at(worker).toStdString());
+}
+
+/**
+  @brief    put the session prefix in front of a command
+  @return   "@<session>;<command>", just the command for the default session
+  **/
+QByteArray RT_coordinator::prefixed(const QString &session, const QString &command)
+{
+    return (session.isEmpty() ? command : "@" + session + ";" + command).toUtf8();
+}
@@ -0,0 +1,121 @@
+/**
+  @file     RT_coordinator.h
+  @brief    front end that distributes the render work of a scene over several refloid processes
+
+  The coordinator speaks the client protocol of RT_server on its own ZMQ_ROUTER socket and holds no
+  scene. Every worker process (a normal refloid server, local or remote) keeps a replica of each
+  session: scene commands, uploaded data frames and binary frames are sent to all workers, which must
+  reply the same. Render work is sharded:
+    - "render" splits the cameras of the scene into one contiguous range per worker, every worker
+      renders its range with "render;<iterations>;<format>;<cameras>"; "renderFor" is split the same
+      way, every worker gets the whole time budget
+    - "sweep" splits the poses into one contiguous range per worker
+    - "optimizeViewpoint" and "renderTrajectory" run on one worker, the workers take turns
+  The coordinator hands out its own job ids. "status", "wait", "stop", "cancel", "fetch" and "imageStats" are
+  sent to the workers of all shards and their replies are merged: images come in the order a single
+  process sends them, with the pose indices of sweeps counted over the whole sweep. Image paths name
+  files on the worker hosts.
+
+  A worker that fails or times out on a replicated command, or replies differently than the first worker
+  in sync, may hold another scene than the others. It is taken out of the sharding of that session until
+  a "syncScene" with the whole scene (or "closeSession") succeeds on it; while no worker of a session is
+  in sync, its render commands get -24.
+
+  Requests are served one after another; the workers of one command run in parallel, a command is
+  answered when all of them replied. A "wait" for an unfinished job does not block the other clients:
+  its request is parked and the workers are asked again every WaitPollMs until the job is finished or
+  the wait timed out. Shared memory rings, previews and "setAck" are not available
+  through the coordinator.
+**/
+
+#ifndef NSLAIFT_RT_COORDINATOR_H
+#define NSLAIFT_RT_COORDINATOR_H
+
+#include "RT_session.h"
+#include "RT_metrics.h"
+
+#include <zmq.hpp>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+class RT_coordinator
+{
+public:
+    RT_coordinator(const std::string &endpoint, const QStringList &workers, long reply_timeout_ms = -1);
+
+    int run();
+
+    static const int MaxJobs = 256;         ///< jobs that can still be queried before they are dropped
+    static const long WaitPollMs = 50;      ///< interval in which parked "wait" commands ask the workers again
+
+private:
+    ///< part of a job that runs on one worker
+    struct Shard {
+        int worker;
+        unsigned int job;                   ///< job id on the worker
+        int firstPose;                      ///< index of the first pose of the shard in the whole sweep
+    };
+
+    struct Job {
+        QString session;
+        bool sweep = false;
+        QVector<Shard> shards;
+    };
+
+    ///< reply frame of a worker and the frames attached to it
+    struct Reply {
+        QByteArray text;
+        std::vector<zmq::message_t> frames;
+        bool received = false;              ///< false if the worker did not reply in time
+    };
+
+    std::unique_ptr<RT_session::Request> receiveRequest();
+    bool serve(RT_session::Request &req);
+    bool process(RT_session::Request &req);
+    void resumeParked();
+    long pollTimeout() const;
+    QString execute(RT_session::Request &req, const QString &command, const QStringList &sList, bool &parked);
+    QString executeJobCommand(RT_session::Request &req, const QStringList &sList, bool &parked);
+    QString replicate(const QString &session, const QString &command);
+    int checkReplicas(const QString &session, const std::vector<Reply> &replies, bool resync);
+    QVector<int> replicas(const QString &session) const;
+    QString submitRender(const QString &session, const QStringList &sList);
+    QString submitSweep(const QString &session, const QStringList &sList);
+    QString submitSingle(const QString &session, const QString &command);
+    QString addJob(Job job, const std::vector<Reply> &replies);
+    static QString mergeStates(const std::vector<Reply> &replies);
+    static QString mergeImageStats(const Job &job, unsigned int id, const std::vector<Reply> &replies);
+    static int gatherImages(RT_session::Request &req, const Job &job, std::vector<Reply> &replies);
+    QString stats(const QString &session, const QString &command, const QStringList &sList);
+    int ask(const QVector<int> &workers, const QVector<QByteArray> &commands, std::vector<Reply> &replies,
+            const std::vector<zmq::message_t> *frames = nullptr);
+    void connectWorker(int worker);
+    static QByteArray prefixed(const QString &session, const QString &command);
+
+    zmq::context_t m_zmqContext;
+    zmq::socket_t m_socket;                             ///< ZMQ_ROUTER socket the clients connect to
+    QStringList m_workerEndpoints;
+    std::vector< std::unique_ptr<zmq::socket_t> > m_workers;    ///< ZMQ_REQ socket per worker
+    long m_replyTimeout;                                ///< milliseconds to wait for a worker, -1 to wait forever
+    QHash<unsigned int, Job> m_jobs;
+    std::deque<unsigned int> m_jobOrder;                ///< ids of m_jobs, oldest first
+    std::deque< std::unique_ptr<RT_session::Request> > m_parked;   ///< requests waiting for a job, oldest first
+    std::chrono::steady_clock::time_point m_nextPoll;   ///< time the parked requests ask the workers again
+    unsigned int m_nextJobId;
+    int m_nextWorker;                                   ///< worker of the next single shard job
+    QHash<QString, QSet<int> > m_diverged;              ///< per session the workers whose replica may differ from the others
+    RT_metrics::NameCache m_commandTimes;               ///< "command/<command>" histograms
+    RT_metrics::NameCache m_commandErrors;              ///< "command/<command>/errors" counters
+};
+
+#endif //NSLAIFT_RT_COORDINATOR_H
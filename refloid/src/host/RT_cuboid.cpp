@@ -55,6 +55,12 @@ RT_cuboid::~RT_cuboid() {
     // TODO: There is still something wrong when deleting this object
 }
 
+void RT_cuboid::hashState(QCryptographicHash &hash) const {
+    RT_object::hashState(hash);
+    float extents[6] = {m_left, m_right, m_bottom, m_top, m_back, m_front};
+    rthelpers::hashData(hash, extents, sizeof(extents));
+}
+
 int RT_cuboid::updateCache() {
     spdlog::debug("Updating caches of cuboid object {}", m_strName.toUtf8().constData());
     // Thinking about making averything triangle based
@@ -71,6 +77,14 @@ int RT_cuboid::updateCache() {
     m_cuboid["indicesBuffer"]->setBuffer(m_indicesBuffer);
 }
 
+int RT_cuboid::updateTransformCache() {
+    // The vertices are in object coordinates, only the top level acceleration has to be rebuilt
+    m_transform_optix->setMatrix(false, m_transform.getData(), m_transform.inverse().getData());
+    m_rootGroup->getAcceleration()->markDirty();
+    m_geom_inst["Rt"]->setMatrix4x4fv(false, m_transform.getData());
+    return 0;
+}
+
 int RT_cuboid::parseActions(const QString &action, const QString &parameters) {
     // TODO parsing minmax for cuboid object
     return RT_object::parseActions(action, parameters);
@@ -18,6 +18,8 @@ public:
 
 public:
     int updateCache();
+    void hashState(QCryptographicHash &hash) const override;
+    int updateTransformCache();
     int parseActions(const QString &action, const QString &parameters) override;
 
     void create_verticies();
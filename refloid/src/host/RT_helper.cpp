@@ -3,6 +3,12 @@
 //
 
 #include "RT_helper.h"
+#include "RT_numberParser.h"
+
+#include <QCryptographicHash>
+
+#include <tiff.h>
+#include <tiffio.h>
 
 /**
   @brief    parse a comma separated string 3-vector of the form "1.2,43, -12.455" into  its 3 float values
@@ -12,28 +18,26 @@
   @param    z   target for third element
   @return   returns 0 on success, non-zero on errors
   **/
-int rthelpers::RT_parse_float3(const QString &str, float *x, float *y, float *z, const QString& delimiter /*=QString(","*/)
+int rthelpers::RT_parse_float3(const QString &str, float *x, float *y, float *z, char delimiter /*=','*/)
 {
     if(x == nullptr || y == nullptr || z == nullptr)
         return -1;
 
-    QStringList sList = str.split(delimiter);
-    if (sList.count() != 3) {
+    float values[3] = {0, 0, 0};
+    rtparse::Result result = rtparse::parseFloats(str, values, 3, delimiter);
+    if (result.error == -2) {
         *x = 0;
         *y = 0;
         *z = 0;
         return -2;
     }
-    bool ok = false;
-    *x = sList.at(0).toFloat(&ok);
-    if (!ok)
-        return -3;
-    *y = sList.at(1).toFloat(&ok);
-    if (!ok)
-        return -4;
-    *z = sList.at(2).toFloat(&ok);
-    if (!ok)
-        return -5;
+    *x = values[0];
+    *y = values[1];
+    *z = values[2];
+    if (result.error != 0) {
+        spdlog::debug("Cannot parse \"{}\", field {} is no number (character {})", str.toUtf8().constData(), result.field, result.position);
+        return -3 - result.field;
+    }
     return 0;
 }
 
@@ -41,27 +45,22 @@ int rthelpers::RT_parse_float3(const QString &str, float *x, float *y, float *z,
  @brief parse a comma separated string 4x4 Matrix of the form "23.0, 2344.34, ... , 3.46, 65.235"
  @param str string to decompose
  @param mat resulting matrix parsed by string
- @return returns 0 on success, non-zero on errors
+ @return returns 0 on success, -2 if there are not 16 numbers, -3 - i if number i is malformed
  **/
-int rthelpers::RT_parse_matrix(const QString &str, optix::Matrix4x4 *mat, const QString& delimiter /*=QString(","*/)
+int rthelpers::RT_parse_matrix(const QString &str, optix::Matrix4x4 *mat, char delimiter /*=','*/)
 {
     if (mat == nullptr)
         return -1;
 
-    QStringList sList = str.split(delimiter);
-    if (sList.count() != 16) {
+    rtparse::Result result = rtparse::parseFloats(str, mat->getData(), 16, delimiter);
+    if (result.error == -2) {
         *mat = optix::Matrix4x4::identity();
         return -2;
     }
-
-    bool ok = false;
-    for (int i=0; i<16; i++)
-    {
-        (*mat)[i] = sList.at(i).toFloat(&ok);
-        if (!ok)
-            return -i;
+    if (result.error != 0) {
+        spdlog::debug("Cannot parse matrix \"{}\", field {} is no number (character {})", str.toUtf8().constData(), result.field, result.position);
+        return -3 - result.field;
     }
-
     return 0;
 }
 
@@ -85,6 +84,19 @@ std::vector<unsigned char> rthelpers::writeBufferToPipe(optix::Buffer buffer)
 }
 
 std::vector<unsigned char> rthelpers::writeBufferToPipe(RTbuffer buffer)
+{
+    std::vector<unsigned char> pix;
+    readBuffer(buffer, pix);
+    return pix;
+}
+
+/**
+  @brief    read back an output buffer into host memory, rows from top to bottom
+  @param    buffer  RT_FORMAT_UNSIGNED_BYTE4 buffer (read as RGB8) or RT_FORMAT_FLOAT4 buffer (read as RGB32F)
+  @param    pix     target, resized to fit the image; reusing a vector of the same size does not allocate
+  @return   bytes per pixel (3 or 12), 0 if the buffer format is not supported
+  **/
+int rthelpers::readBuffer(RTbuffer buffer, std::vector<unsigned char> &pix)
 {
     int width, height;
     RTsize buffer_width, buffer_height;
@@ -96,13 +108,14 @@ std::vector<unsigned char> rthelpers::writeBufferToPipe(RTbuffer buffer)
     width = static_cast<int>(buffer_width);
     height = static_cast<int>(buffer_height);
 
-    std::vector<unsigned char> pix(width * height * 3);
-
     RTformat buffer_format;
     RT_CHECK_ERROR(rtBufferGetFormat(buffer, &buffer_format));
 
+    int pixel_size = 0;
     switch (buffer_format) {
         case RT_FORMAT_UNSIGNED_BYTE4:
+            pixel_size = 3;
+            pix.resize(width * height * pixel_size);
             // Data is BGRA and upside down, so we need to swizzle to RGB
             for (int j = height - 1; j >= 0; --j) {
                 unsigned char *dst = &pix[0] + (3 * width * (height - 1 - j));
@@ -115,13 +128,131 @@ std::vector<unsigned char> rthelpers::writeBufferToPipe(RTbuffer buffer)
                 }
             }
             break;
+        case RT_FORMAT_FLOAT4:
+            pixel_size = 3 * sizeof(float);
+            pix.resize(width * height * pixel_size);
+            // Accumulated radiance is RGBA and upside down, the alpha channel is dropped
+            for (int j = height - 1; j >= 0; --j) {
+                float *dst = reinterpret_cast<float*>(&pix[0] + (pixel_size * width * (height - 1 - j)));
+                const float *src = ((const float *) imageData) + (4 * width * j);
+                for (int i = 0; i < width; i++) {
+                    *dst++ = *(src + 0);
+                    *dst++ = *(src + 1);
+                    *dst++ = *(src + 2);
+                    src += 4;
+                }
+            }
+            break;
         default:
-            spdlog::error("Unrecognized buffer data type. Currently only RT_FORMAT_UNSIGNED_BYTE4 is supported");
+            spdlog::error("Unrecognized buffer data type. Currently only RT_FORMAT_UNSIGNED_BYTE4 and RT_FORMAT_FLOAT4 are supported");
+            pix.clear();
             break;
     }
     // Now unmap the buffer
     RT_CHECK_ERROR(rtBufferUnmap(buffer));
-    return pix;
+    return pixel_size;
+}
+
+/**
+  @brief    shrink an RGB8 image by averaging blocks of factor x factor pixels
+  @param    src         RGB8 pixel data
+  @param    width       width of src in pixels
+  @param    height      height of src in pixels
+  @param    factor      downsampling factor, 1 copies the image
+  @param    dst         target, resized to dst_width * dst_height * 3
+  @param    dst_width   width of dst, the last incomplete block column is dropped
+  @param    dst_height  height of dst, the last incomplete block row is dropped
+  **/
+void rthelpers::downsampleRGB8(const std::vector<unsigned char> &src, unsigned int width, unsigned int height, unsigned int factor,
+                               std::vector<unsigned char> &dst, unsigned int &dst_width, unsigned int &dst_height)
+{
+    factor = (factor > 0) ? factor : 1;
+    dst_width = width / factor;
+    dst_height = height / factor;
+    dst.resize(dst_width * dst_height * 3);
+
+    unsigned int block = factor * factor;
+    for (unsigned int y = 0; y < dst_height; y++) {
+        for (unsigned int x = 0; x < dst_width; x++) {
+            unsigned int sum[3] = {0, 0, 0};
+            for (unsigned int by = 0; by < factor; by++) {
+                const unsigned char *p = &src[0] + 3 * ((y * factor + by) * width + x * factor);
+                for (unsigned int bx = 0; bx < factor; bx++) {
+                    sum[0] += *p++;
+                    sum[1] += *p++;
+                    sum[2] += *p++;
+                }
+            }
+            unsigned char *d = &dst[0] + 3 * (y * dst_width + x);
+            d[0] = static_cast<unsigned char>(sum[0] / block);
+            d[1] = static_cast<unsigned char>(sum[1] / block);
+            d[2] = static_cast<unsigned char>(sum[2] / block);
+        }
+    }
+}
+
+/**
+  @brief    save 8 bit RGB image data as tiff image
+  @param    path        file path of the tiff image
+  @param    img_data    RGB pixel data as returned by writeBufferToPipe
+  @param    width       image width in pixels
+  @param    height      image height in pixels
+  @return   returns 0 on success, non-zero on errors
+  **/
+int rthelpers::writeTiff(const QString &path, const std::vector<unsigned char> &img_data, unsigned int width, unsigned int height)
+{
+    TIFF* out = TIFFOpen(path.toStdString().c_str(), "w");
+    if (!out) {
+        spdlog::error("Was not able to open tiff file with path: {}", path.toUtf8().constData());
+        return -1;
+    }
+    int ret = writeTiffPage(out, img_data, width, height);
+    TIFFClose(out);
+    return ret;
+}
+
+/**
+  @brief    write an RGB8 image as one page (directory) of an opened tiff file
+  @param    out         tiff file opened for writing
+  @param    img_data    pixels, 3 bytes each, rows from top to bottom
+  @param    width       image width
+  @param    height      image height
+  @param    page        page number for multi-page files
+  @param    pages       total number of pages, 1 for a single image
+  @return   0 on success, -2 if a line could not be written
+  **/
+int rthelpers::writeTiffPage(TIFF *out, const std::vector<unsigned char> &img_data, unsigned int width, unsigned int height, int page, int pages)
+{
+    int sampleperpixel = 3;
+    TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, sampleperpixel);
+    TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_BOTLEFT);
+    TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    if (pages > 1) {
+        TIFFSetField(out, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+        TIFFSetField(out, TIFFTAG_PAGENUMBER, static_cast<uint16>(page), static_cast<uint16>(pages));
+    }
+    tsize_t linebytes = sampleperpixel * width;
+    unsigned char *buf_out = nullptr;
+    buf_out =(unsigned char *)_TIFFmalloc(linebytes);
+    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(out, width * sampleperpixel));
+    int ret = 0;
+    for (uint32 row = 0; row < height; row++) {
+        memcpy(buf_out, &img_data[(height - row - 1) * linebytes], linebytes);    // check the index here, and figure out why not using h*linebytes
+        if (TIFFWriteScanline(out, buf_out, row, 0) < 0) {
+            ret = -2;
+            break;
+        }
+    }
+    if (pages > 1 && ret == 0 && !TIFFWriteDirectory(out)) {
+        ret = -2;
+    }
+    if (buf_out)
+        _TIFFfree(buf_out);
+    return ret;
 }
 
 /**
@@ -131,25 +262,21 @@ std::vector<unsigned char> rthelpers::writeBufferToPipe(RTbuffer buffer)
   @param    y   target for second element
   @return   returns 0 on success, non-zero on errors
   **/
-int rthelpers::RT_parse2double(const QString &str, double *x, double *y, const QString &delimiter /*= QString(",")*/)
+int rthelpers::RT_parse2double(const QString &str, double *x, double *y, char delimiter /*=','*/)
 {
     if(x == nullptr || y == nullptr)
         return -1;
 
-    QStringList sList = str.split(delimiter);
-    if (sList.count() != 2) {
+    double values[2] = {0, 0};
+    rtparse::Result result = rtparse::parseDoubles(str, values, 2, delimiter);
+    if (result.error == -2) {
         *x = 0;
         *y = 0;
         return -2;
     }
-    bool ok = false;
-    *x = sList.at(0).toDouble(&ok);
-    if (!ok)
-        return -3;
-    *y = sList.at(1).toDouble(&ok);
-    if (!ok)
-        return -4;
-    return 0;
+    *x = values[0];
+    *y = values[1];
+    return (result.error != 0) ? -3 - result.field : 0;
 }
 
 /**
@@ -160,25 +287,41 @@ int rthelpers::RT_parse2double(const QString &str, double *x, double *y, const Q
   @param    z   target for third element
   @return   returns 0 on success, non-zero on errors
   **/
-int rthelpers::RT_parse2int(const QString &str, int *x, int *y, const QString &delimiter /*= QString(",")*/)
+int rthelpers::RT_parse2int(const QString &str, int *x, int *y, char delimiter /*=','*/)
 {
     if(x == nullptr || y == nullptr)
         return -1;
 
-    QStringList sList = str.split(delimiter);
-    if (sList.count() != 2) {
+    int values[2] = {0, 0};
+    rtparse::Result result = rtparse::parseInts(str, values, 2, delimiter);
+    if (result.error == -2) {
         *x = 0;
         *y = 0;
         return -2;
     }
-    bool ok = false;
-    *x = sList.at(0).toInt(&ok);
-    if (!ok)
-        return -3;
+    *x = values[0];
+    *y = values[1];
+    return (result.error != 0) ? -3 - result.field : 0;
+}
 
-    *y = sList.at(1).toInt(&ok);
-    if (!ok)
-        return -4;
+/**
+  @brief    add the bytes of a value to a hash, e.g. of a float or a matrix
+  @param    hash    hash of a scene state, see RT_scene::stateHash()
+  @param    data    the value
+  @param    size    size of the value in bytes
+  **/
+void rthelpers::hashData(QCryptographicHash &hash, const void *data, std::size_t size)
+{
+    hash.addData(static_cast<const char*>(data), static_cast<int>(size));
+}
 
-    return 0;
+/**
+  @brief    add a string to a hash, prefixed with its length so consecutive strings cannot run into each other
+  **/
+void rthelpers::hashString(QCryptographicHash &hash, const QString &str)
+{
+    QByteArray utf8 = str.toUtf8();
+    int size = utf8.size();
+    hashData(hash, &size, sizeof(size));
+    hash.addData(utf8);
 }
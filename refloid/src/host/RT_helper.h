@@ -38,15 +38,27 @@
 
 extern const char *const SAMPLE_NAME;
 
+// libtiff handle, see tiffio.h
+typedef struct tiff TIFF;
+
+class QCryptographicHash;
+
 namespace rthelpers{
-    int RT_parse_float3(const QString &str, float *x, float *y, float *z, const QString& delimiter = QString(","));
-    int RT_parse_matrix(const QString &str, optix::Matrix4x4 *matconst, const QString& delimiter = QString(","));
+    int RT_parse_float3(const QString &str, float *x, float *y, float *z, char delimiter = ',');
+    int RT_parse_matrix(const QString &str, optix::Matrix4x4 *mat, char delimiter = ',');
     std::string ptxPath(const std::string &cuda_file);
     std::string printMat4x4(optix::Matrix4x4 &mat);
     std::vector<unsigned char> writeBufferToPipe(optix::Buffer buffer);
     std::vector<unsigned char> writeBufferToPipe(RTbuffer buffer);
-    int RT_parse2double(const QString &str, double *x, double *y, const QString &delimiter /*= QString(",")*/);
-    int RT_parse2int(const QString &str, int *x, int *y, const QString &delimiter /*= QString(",")*/);
+    int readBuffer(RTbuffer buffer, std::vector<unsigned char> &pix);
+    void downsampleRGB8(const std::vector<unsigned char> &src, unsigned int width, unsigned int height, unsigned int factor,
+                        std::vector<unsigned char> &dst, unsigned int &dst_width, unsigned int &dst_height);
+    int writeTiff(const QString &path, const std::vector<unsigned char> &img_data, unsigned int width, unsigned int height);
+    int writeTiffPage(TIFF *out, const std::vector<unsigned char> &img_data, unsigned int width, unsigned int height, int page = 0, int pages = 1);
+    int RT_parse2double(const QString &str, double *x, double *y, char delimiter = ',');
+    int RT_parse2int(const QString &str, int *x, int *y, char delimiter = ',');
+    void hashData(QCryptographicHash &hash, const void *data, std::size_t size);
+    void hashString(QCryptographicHash &hash, const QString &str);
 }
 
 #endif //NSLAIFT_RT_HELPER_H
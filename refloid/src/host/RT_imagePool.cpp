@@ -0,0 +1,88 @@
+/**
+  @file     RT_imagePool.cpp
+  @brief    pool of reusable image buffers
+**/
+
+#include "RT_imagePool.h"
+
+/**
+  @brief    constructor
+  @param    max_free_buffers    number of returned buffers that are kept for reuse, further ones are freed
+  **/
+RT_imagePool::RT_imagePool(std::size_t max_free_buffers) :
+        m_store(new Store)
+{
+    m_store->maxFree = max_free_buffers;
+}
+
+/**
+  @brief    get a buffer of the given size, reusing a returned buffer if possible
+  @param    size    buffer size in bytes
+  @return   buffer that is returned to the pool once the last reference is gone
+  **/
+RT_imageBufferPtr RT_imagePool::acquire(std::size_t size)
+{
+    RT_imageBuffer *buffer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_store->mutex);
+        // Prefer a buffer that is large enough already, resize() then does not allocate
+        for (std::size_t i=0; i<m_store->free.size(); i++) {
+            if (m_store->free[i]->capacity() >= size) {
+                buffer = m_store->free[i];
+                m_store->free.erase(m_store->free.begin() + i);
+                break;
+            }
+        }
+        if (buffer == nullptr && !m_store->free.empty()) {
+            buffer = m_store->free.back();
+            m_store->free.pop_back();
+        }
+    }
+    if (buffer == nullptr) {
+        buffer = new RT_imageBuffer();
+    }
+    buffer->resize(size);
+
+    std::shared_ptr<Store> store = m_store;
+    return RT_imageBufferPtr(buffer, [store](RT_imageBuffer *b) { RT_imagePool::release(store, b); });
+}
+
+/**
+  @brief    number of buffers currently waiting for reuse
+  **/
+std::size_t RT_imagePool::freeBuffers() const
+{
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    return m_store->free.size();
+}
+
+void RT_imagePool::release(const std::shared_ptr<Store> &store, RT_imageBuffer *buffer)
+{
+    std::lock_guard<std::mutex> lock(store->mutex);
+    if (store->free.size() < store->maxFree) {
+        store->free.push_back(buffer);
+    } else {
+        delete buffer;
+    }
+}
+
+/**
+  @brief    hint for zmq_msg_init_data that keeps a buffer alive while ZMQ sends it
+  @param    buffer  buffer that is sent without copying
+  @return   hint to pass together with zmqFree()
+  **/
+void* RT_imagePool::zmqHint(const RT_imageBufferPtr &buffer)
+{
+    return new RT_imageBufferPtr(buffer);
+}
+
+/**
+  @brief    free function for zmq_msg_init_data, drops the reference taken by zmqHint()
+
+  Called by ZMQ from its I/O thread once the message is sent
+  **/
+void RT_imagePool::zmqFree(void *data, void *hint)
+{
+    (void) data;
+    delete static_cast<RT_imageBufferPtr*>(hint);
+}
@@ -0,0 +1,44 @@
+/**
+  @file     RT_imagePool.h
+  @brief    pool of reusable image buffers
+
+  Rendered images are read back into pooled buffers, handed out as shared pointers. When the last
+  reference is dropped (e.g. by ZMQ after a zero-copy send) the buffer goes back to the pool instead
+  of being freed, so rendering the same resolution again does not allocate.
+**/
+
+#ifndef NSLAIFT_RT_IMAGEPOOL_H
+#define NSLAIFT_RT_IMAGEPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+typedef std::vector<unsigned char> RT_imageBuffer;
+typedef std::shared_ptr<RT_imageBuffer> RT_imageBufferPtr;
+
+class RT_imagePool
+{
+public:
+    RT_imagePool(std::size_t max_free_buffers = 8);
+
+    RT_imageBufferPtr acquire(std::size_t size);
+    std::size_t freeBuffers() const;
+
+    static void zmqFree(void *data, void *hint);
+    static void* zmqHint(const RT_imageBufferPtr &buffer);
+
+private:
+    ///< shared with the deleters of all buffers, so it outlives the pool if buffers are still in flight
+    struct Store {
+        std::mutex mutex;
+        std::vector<RT_imageBuffer*> free;
+        std::size_t maxFree;
+    };
+    static void release(const std::shared_ptr<Store> &store, RT_imageBuffer *buffer);
+
+    std::shared_ptr<Store> m_store;
+};
+
+#endif //NSLAIFT_RT_IMAGEPOOL_H
@@ -0,0 +1,226 @@
+/**
+  @file     RT_imageStats.cpp
+  @brief    intensity statistics of rendered images, computed on the server
+**/
+
+#include "RT_imageStats.h"
+
+#include <QJsonArray>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace {
+    const unsigned int MinPixelsPerThread = 1u << 18;
+
+    ///< statistics of a band of rows, merged into the statistics of the region
+    struct Partial {
+        double min = std::numeric_limits<double>::max();
+        double max = std::numeric_limits<double>::lowest();
+        double sum = 0.0;
+        quint64 saturated = 0;
+        std::vector<quint64> histogram;
+    };
+
+    /**
+      @brief    reduce the rows [row_begin, row_end) of the region of an RGB8 image
+      The sums of the three channels (0..765) are reduced as integers and scaled once at the end.
+      **/
+    void reduceRgb8(const unsigned char *data, unsigned int width, const RT_roi &roi, unsigned int row_begin, unsigned int row_end,
+                    int bins, Partial &partial)
+    {
+        unsigned int lo = 765;
+        unsigned int hi = 0;
+        quint64 sum = 0;
+        quint64 saturated = 0;
+        quint64 *histogram = partial.histogram.data();
+        for (unsigned int row=row_begin; row<row_end; row++) {
+            const unsigned char *px = data + (static_cast<std::size_t>(row) * width + roi.x) * 3;
+            for (unsigned int i=0; i<roi.width; i++, px += 3) {
+                unsigned int s = px[0] + px[1] + px[2];
+                sum += s;
+                lo = std::min(lo, s);
+                hi = std::max(hi, s);
+                saturated += (px[0] == 255) | (px[1] == 255) | (px[2] == 255);
+                histogram[s * bins / 766]++;
+            }
+        }
+        partial.min = lo / 3.0;
+        partial.max = hi / 3.0;
+        partial.sum = sum / 3.0;
+        partial.saturated = saturated;
+    }
+
+    ///< reduce the rows [row_begin, row_end) of the region of an RGB32F image
+    void reduceRgb32f(const unsigned char *data, unsigned int width, const RT_roi &roi, unsigned int row_begin, unsigned int row_end,
+                      int bins, Partial &partial)
+    {
+        float lo = std::numeric_limits<float>::max();
+        float hi = std::numeric_limits<float>::lowest();
+        double sum = 0.0;
+        quint64 saturated = 0;
+        quint64 *histogram = partial.histogram.data();
+        std::vector<float> line(3 * roi.width);
+        for (unsigned int row=row_begin; row<row_end; row++) {
+            // The buffer is not float aligned for sure, so each row is copied once
+            memcpy(line.data(), data + (static_cast<std::size_t>(row) * width + roi.x) * 3 * sizeof(float), line.size() * sizeof(float));
+            float row_sum = 0.0f;
+            for (unsigned int i=0; i<roi.width; i++) {
+                const float *px = &line[3 * i];
+                float f = (px[0] + px[1] + px[2]) * (1.0f / 3.0f);
+                row_sum += f;
+                lo = std::min(lo, f);
+                hi = std::max(hi, f);
+                saturated += (px[0] >= 1.0f) | (px[1] >= 1.0f) | (px[2] >= 1.0f);
+                // Clamped before the conversion, HDR radiance (or inf) times bins does not fit into an int; NaN goes to bin 0
+                int bin = (f >= 1.0f) ? bins - 1 : (f > 0.0f ? static_cast<int>(f * bins) : 0);
+                histogram[std::min(bin, bins - 1)]++;
+            }
+            sum += row_sum;
+        }
+        partial.min = lo;
+        partial.max = hi;
+        partial.sum = sum;
+        partial.saturated = saturated;
+    }
+}
+
+const int RT_imageStats::DefaultBins;
+const int RT_imageStats::MaxBins;
+
+/**
+  @brief    compute the statistics of a region of an image
+  @param    image   pixels of a render job, rows from top to bottom
+  @param    width   image width in pixels
+  @param    height  image height in pixels
+  @param    format  pixel format of the image
+  @param    roi     region, clipped to the image; a width or height of 0 extends it to the image border
+  @param    bins    number of histogram bins, 1..MaxBins
+  @return   the statistics, with 0 pixels if the region is outside of the image
+  **/
+RT_imageStats RT_imageStats::compute(const RT_imageBuffer &image, unsigned int width, unsigned int height,
+                                     RT_renderJob::Format format, RT_roi roi, int bins)
+{
+    RT_imageStats stats;
+    bins = std::max(1, std::min(bins, MaxBins));
+    stats.histogram = QVector<quint64>(bins, 0);
+    std::size_t pixel_size = (format == RT_renderJob::RGB32F) ? 3 * sizeof(float) : 3;
+    if (image.size() < static_cast<std::size_t>(width) * height * pixel_size || roi.x >= width || roi.y >= height) {
+        stats.roi = roi;
+        return stats;
+    }
+    roi.width = (roi.width == 0 || roi.width > width - roi.x) ? width - roi.x : roi.width;
+    roi.height = (roi.height == 0 || roi.height > height - roi.y) ? height - roi.y : roi.height;
+    stats.roi = roi;
+    stats.pixels = static_cast<quint64>(roi.width) * roi.height;
+
+    // Bands of whole rows, one per thread, only for regions that are worth starting threads for
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int bands = static_cast<unsigned int>(std::min<quint64>(hardware, std::max<quint64>(1, stats.pixels / MinPixelsPerThread)));
+    bands = std::min(bands, roi.height);
+    std::vector<Partial> partials(bands);
+    auto reduce = [&](unsigned int band) {
+        Partial &partial = partials[band];
+        partial.histogram.assign(bins, 0);
+        unsigned int row_begin = roi.y + static_cast<unsigned int>(static_cast<quint64>(roi.height) * band / bands);
+        unsigned int row_end = roi.y + static_cast<unsigned int>(static_cast<quint64>(roi.height) * (band + 1) / bands);
+        if (format == RT_renderJob::RGB32F) {
+            reduceRgb32f(image.data(), width, roi, row_begin, row_end, bins, partial);
+        } else {
+            reduceRgb8(image.data(), width, roi, row_begin, row_end, bins, partial);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int band=1; band<bands; band++) {
+        threads.emplace_back(reduce, band);
+    }
+    reduce(0);
+    for (std::size_t i=0; i<threads.size(); i++) {
+        threads[i].join();
+    }
+
+    double sum = 0.0;
+    stats.min = partials[0].min;
+    stats.max = partials[0].max;
+    for (unsigned int band=0; band<bands; band++) {
+        const Partial &partial = partials[band];
+        stats.min = std::min(stats.min, partial.min);
+        stats.max = std::max(stats.max, partial.max);
+        sum += partial.sum;
+        stats.saturated += partial.saturated;
+        for (int bin=0; bin<bins; bin++) {
+            stats.histogram[bin] += partial.histogram[bin];
+        }
+    }
+    stats.mean = sum / stats.pixels;
+    return stats;
+}
+
+/**
+  @brief    the statistics as JSON
+  @return   {"roi": [x, y, width, height], "pixels", "min", "max", "mean", "saturated", "histogram": [counts]}
+  **/
+QJsonObject RT_imageStats::toJson() const
+{
+    QJsonArray rect;
+    rect.append(static_cast<int>(roi.x));
+    rect.append(static_cast<int>(roi.y));
+    rect.append(static_cast<int>(roi.width));
+    rect.append(static_cast<int>(roi.height));
+    QJsonArray counts;
+    for (int i=0; i<histogram.size(); i++) {
+        counts.append(static_cast<double>(histogram.at(i)));
+    }
+    QJsonObject json;
+    json.insert("roi", rect);
+    json.insert("pixels", static_cast<double>(pixels));
+    if (pixels > 0) {
+        json.insert("min", min);
+        json.insert("max", max);
+        json.insert("mean", mean);
+    }
+    json.insert("saturated", static_cast<double>(saturated));
+    json.insert("histogram", counts);
+    return json;
+}
+
+/**
+  @brief    parse regions of interest
+  @param    str     "x,y,w,h" rectangles separated by ":", e.g. "0,0,100,100:200,200,50,50"; empty for the whole image
+  @param    rois    receives the regions
+  @return   0 on success, -11 if a rectangle does not have four non-negative integers
+  **/
+int RT_imageStats::parseRois(const QString &str, QVector<RT_roi> &rois)
+{
+    rois.clear();
+    if (str.trimmed().isEmpty()) {
+        rois.append(RT_roi());
+        return 0;
+    }
+    QStringList rects = str.split(":");
+    for (int i=0; i<rects.size(); i++) {
+        QStringList fields = rects.at(i).split(",");
+        if (fields.size() != 4) {
+            return -11;
+        }
+        unsigned int values[4];
+        for (int f=0; f<4; f++) {
+            bool ok = false;
+            values[f] = fields.at(f).trimmed().toUInt(&ok);
+            if (!ok) {
+                return -11;
+            }
+        }
+        RT_roi roi;
+        roi.x = values[0];
+        roi.y = values[1];
+        roi.width = values[2];
+        roi.height = values[3];
+        rois.append(roi);
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+/**
+  @file     RT_imageStats.h
+  @brief    intensity statistics of rendered images, computed on the server
+
+  Answers the "imageStats" command with a few numbers per region of interest instead of the whole
+  image: minimum, maximum and mean intensity, a histogram and the number of saturated pixels. The
+  intensity of a pixel is the mean of its three channels, in 0..255 for RGB8 images and in radiance
+  units for RGB32F images (the histogram covers 0..1 there, brighter pixels fall into the last bin).
+  A pixel is saturated if any channel is 255 (RGB8) or at least 1.0 (RGB32F). Large regions are
+  split into bands of rows that are reduced by several threads.
+**/
+
+#ifndef NSLAIFT_RT_IMAGESTATS_H
+#define NSLAIFT_RT_IMAGESTATS_H
+
+#include "RT_renderJob.h"
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+///< rectangle of an image in pixels, origin at the top left corner
+struct RT_roi
+{
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int width = 0;
+    unsigned int height = 0;
+};
+
+struct RT_imageStats
+{
+    RT_roi roi;                     ///< region the statistics were computed for, clipped to the image
+    quint64 pixels = 0;
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    quint64 saturated = 0;
+    QVector<quint64> histogram;
+
+    QJsonObject toJson() const;
+
+    static RT_imageStats compute(const RT_imageBuffer &image, unsigned int width, unsigned int height,
+                                 RT_renderJob::Format format, RT_roi roi, int bins);
+    static int parseRois(const QString &str, QVector<RT_roi> &rois);
+
+    static const int DefaultBins = 16;
+    static const int MaxBins = 256;
+};
+
+#endif //NSLAIFT_RT_IMAGESTATS_H
@@ -0,0 +1,143 @@
+/**
+  @file     RT_journal.cpp
+  @brief    binary journal of the commands received by the server
+**/
+
+#include "RT_journal.h"
+
+#include <QtEndian>
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+
+namespace {
+    const char JournalMagic[4] = {'R', 'F', 'J', '1'};
+}
+
+RT_journal::RT_journal() :
+        m_file(nullptr)
+{
+}
+
+RT_journal::~RT_journal()
+{
+    close();
+}
+
+/**
+  @brief    start a new journal, an existing file is overwritten
+  @param    path    journal file
+  @return   0 on success, -1 if the file cannot be opened
+  **/
+int RT_journal::open(const QString &path)
+{
+    close();
+    m_file = new QFile(path);
+    if (!m_file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        spdlog::error("Could not open journal {}: {}", path.toUtf8().constData(), m_file->errorString().toUtf8().constData());
+        delete m_file;
+        m_file = nullptr;
+        return -1;
+    }
+    m_file->write(JournalMagic, sizeof(JournalMagic));
+    m_lastFlush = std::chrono::steady_clock::now();
+    spdlog::info("Writing command journal to {}", path.toUtf8().constData());
+    return 0;
+}
+
+/**
+  @brief    flush and close the journal
+  **/
+void RT_journal::close()
+{
+    if (m_file != nullptr) {
+        m_file->close();
+        delete m_file;
+        m_file = nullptr;
+    }
+}
+
+bool RT_journal::isOpen() const
+{
+    return m_file != nullptr;
+}
+
+/**
+  @brief    append a command to the journal, does nothing if no journal is open
+  @param    kind        text command or binary frame
+  @param    data        command data
+  @param    size        size of data in bytes
+  @param    start       time the command was executed at
+  @param    duration    processing time of the command
+
+  The file is buffered by QFile and flushed at most once per second
+  **/
+void RT_journal::append(Kind kind, const char *data, int size, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::duration duration)
+{
+    if (m_file == nullptr) {
+        return;
+    }
+    quint64 timestamp = static_cast<quint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count());
+    long long duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    quint32 duration_sat = (duration_ns > 0xffffffffLL) ? 0xffffffffu : static_cast<quint32>(duration_ns > 0 ? duration_ns : 0);
+
+    uchar header[HeaderSize];
+    memset(header, 0, sizeof(header));
+    qToLittleEndian<quint64>(timestamp, header);
+    qToLittleEndian<quint32>(duration_sat, header + 8);
+    header[12] = static_cast<uchar>(kind);
+    qToLittleEndian<quint32>(static_cast<quint32>(size), header + 16);
+    m_file->write(reinterpret_cast<const char*>(header), HeaderSize);
+    m_file->write(data, size);
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_lastFlush > std::chrono::seconds(1)) {
+        m_file->flush();
+        m_lastFlush = now;
+    }
+}
+
+/**
+  @brief    read all records of a journal
+  @param    path    journal file
+  @param    records target for the records
+  @return   0 on success
+            -1 if the file cannot be opened
+            -2 if it is no journal
+            -3 if the last record is truncated (the complete records are still returned)
+  **/
+int RT_journal::read(const QString &path, QVector<Record> &records)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        spdlog::error("Could not open journal {}", path.toUtf8().constData());
+        return -1;
+    }
+    QByteArray content = file.readAll();
+    file.close();
+    if (content.size() < static_cast<int>(sizeof(JournalMagic)) || memcmp(content.constData(), JournalMagic, sizeof(JournalMagic)) != 0) {
+        spdlog::error("{} is no command journal", path.toUtf8().constData());
+        return -2;
+    }
+
+    const uchar *p = reinterpret_cast<const uchar*>(content.constData()) + sizeof(JournalMagic);
+    const uchar *end = reinterpret_cast<const uchar*>(content.constData()) + content.size();
+    while (p < end) {
+        if (end - p < HeaderSize) {
+            return -3;
+        }
+        Record rec;
+        rec.timestamp = qFromLittleEndian<quint64>(p);
+        rec.duration = qFromLittleEndian<quint32>(p + 8);
+        rec.kind = static_cast<Kind>(p[12]);
+        quint32 size = qFromLittleEndian<quint32>(p + 16);
+        p += HeaderSize;
+        if (static_cast<quint64>(end - p) < size) {
+            return -3;
+        }
+        rec.data = QByteArray(reinterpret_cast<const char*>(p), static_cast<int>(size));
+        p += size;
+        records.push_back(rec);
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+/**
+  @file     RT_journal.h
+  @brief    binary journal of the commands received by the server
+
+  The journal starts with the magic "RFJ1" followed by one record per command, all values little endian:
+
+    uint64  timestamp   steady clock time the command was executed at, in ns
+    uint32  duration    processing time of the command in ns, saturated at 0xffffffff
+    uint8   kind        0: text command, 1: binary frame (see RT_binaryProtocol.h)
+    uint8   reserved[3]
+    uint32  size        number of data bytes
+    uint8   data[size]  the command without trailing newline, or the complete binary frame
+
+  Journals are written with "setJournal;<path>" and replayed offline with the refloid_replay tool.
+**/
+
+#ifndef NSLAIFT_RT_JOURNAL_H
+#define NSLAIFT_RT_JOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include <chrono>
+
+class RT_journal
+{
+public:
+    enum Kind {
+        Text = 0,
+        Binary = 1
+    };
+
+    struct Record {
+        quint64 timestamp;
+        quint32 duration;
+        Kind kind;
+        QByteArray data;
+    };
+
+    RT_journal();
+    ~RT_journal();
+
+    int open(const QString &path);
+    void close();
+    bool isOpen() const;
+    void append(Kind kind, const char *data, int size, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::duration duration);
+
+    static int read(const QString &path, QVector<Record> &records);
+
+    static const int HeaderSize = 20;       ///< size of a record without its data
+
+private:
+    QFile *m_file;
+    std::chrono::steady_clock::time_point m_lastFlush;
+};
+
+#endif //NSLAIFT_RT_JOURNAL_H
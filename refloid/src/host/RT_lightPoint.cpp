@@ -42,27 +42,42 @@ float RT_lightPoint::decayRadius()
     return m_decayRadius;
 }
 
+/**
+  @brief    actions of point lights
+  @return   the action table, starting with all actions of RT_lightSource
+  **/
+const RT_lightPoint::ActionTable& RT_lightPoint::actions() {
+    static const ActionTable table = [] {
+        ActionTable t(RT_lightSource::actions());
+        t.add({"decayradius", "setdecayradius"}, [](RT_lightPoint &light, const QString &parameters) {
+            bool ok;
+            float r = parameters.toFloat(&ok);
+            if (!ok) {
+                return -1;
+            }
+            light.setDecayRadius(r);
+            return 0;
+        });
+        return t;
+    }();
+    return table;
+}
+
 /**
   @brief    parse parameters
   @param    action  string describing action to perform
   @param    params  action parameters
   @return   0 on success, negative on error, positive if action not found (use child class action)
 
-  first all "local" actions are looked up, if none found then base class RTlightSource::parseActions() is called
+  the action table of the class also holds the actions of its base classes, see actions()
   **/
 int RT_lightPoint::parseActions(const QString &action, const QString &parameters) {
-    if((0 == action.compare("decayradius", Qt::CaseInsensitive)) || (0 == action.compare("setdecayradius", Qt::CaseInsensitive))) {
-        bool ok;
-        float r = parameters.toFloat(&ok);
-        if (ok) {
-            setDecayRadius(r);
-            return 0;
-        }
-        return -1;
-    } else {
-        int ret = RT_lightSource::parseActions(action, parameters);
-        return ret;
-    }
+    return actions().dispatch(action, *this, parameters);
+}
+
+void RT_lightPoint::hashState(QCryptographicHash &hash) const {
+    RT_lightSource::hashState(hash);
+    rthelpers::hashData(hash, &m_decayRadius, sizeof(m_decayRadius));
 }
 
 /**
@@ -73,13 +88,14 @@ int RT_lightPoint::updateCache() {
     m_point_light_prgm["Rt"]->setMatrix4x4fv(false, m_transform.getData());
     m_point_light_prgm["Rt_inv"]->setMatrix4x4fv(false, m_transform.inverse().getData());
     m_point_light_prgm["color"]->setFloat(m_baseColor * m_power);
-
-    optix::Buffer LightsBuffer = m_context["sysLightBuffer"]->getBuffer();
-
-    int* sampleLight = (int*) LightsBuffer->map(0, RT_BUFFER_MAP_READ_WRITE);
-    sampleLight[m_light_idx] = m_point_light_prgm->getId();
-    LightsBuffer->unmap();
-    m_context["light_count"]->setUint(m_light_count);
-
+    // The light buffer is written by RT_scene::updateCaches() for all light sources at once
     return 0;
 }
+
+/**
+  @brief    id of the point light program
+  @return   program id
+  **/
+int RT_lightPoint::programId() const {
+    return m_point_light_prgm->getId();
+}
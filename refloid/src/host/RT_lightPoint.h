@@ -9,6 +9,8 @@
 class RT_lightPoint : public RT_lightSource
 {
 public:
+    typedef RT_actionTable<RT_lightPoint, const QString&> ActionTable;
+
     RT_lightPoint(optix::Context &context, RT_object *parent = nullptr);
     virtual ~RT_lightPoint();
 
@@ -16,7 +18,10 @@ public:
     virtual float decayRadius();
 
     virtual int parseActions(const QString &action, const QString &parameters);
+    static const ActionTable& actions();
     virtual int updateCache();
+    virtual void hashState(QCryptographicHash &hash) const;
+    virtual int programId() const;
 
 public:
     float m_decayRadius;
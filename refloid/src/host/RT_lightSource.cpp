@@ -12,26 +12,15 @@ RT_lightSource::RT_lightSource(optix::Context &context, RT_object *parent /*NULL
     m_ObjType = "light";
     m_baseColor = optix::make_float3(1.0f);     ///< multiplicator of color
     m_power = 1.0f;                         ///< base color
-    if (!m_isBufferInitialized)
-    {
-        m_context["sysLightBuffer"]->setBuffer(m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_PROGRAM_ID, 1000));
-        m_isBufferInitialized = true;
-    }
-    RT_lightSource::m_light_count++;
-    m_light_idx = RT_lightSource::m_light_count - 1;
+    m_light_idx = 0;                        ///< assigned by RT_scene::addLightSource()
 }
 
 /**
   @brief    lazy destructor
   **/
 RT_lightSource::~RT_lightSource() {
-    RT_lightSource::m_light_count--;
 }
 
-bool RT_lightSource::m_isBufferInitialized = false;
-
-unsigned int RT_lightSource::m_light_count = 0;
-
 /**
   @brief    set light source power
   @param    pow power to set
@@ -78,33 +67,54 @@ optix::float3 RT_lightSource::color() const {
     return m_baseColor;
 }
 
+/**
+  @brief    actions of light sources
+  @return   the action table, starting with all actions of RT_object
+  **/
+const RT_lightSource::ActionTable& RT_lightSource::actions() {
+    static const ActionTable table = [] {
+        ActionTable t(RT_object::actions());
+        t.add({"setColor", "color"}, [](RT_lightSource &light, const QString &parameters) {
+            float r,g,b;
+            if (0 != rthelpers::RT_parse_float3(parameters, &r, &g, &b)) {
+                return -1;
+            }
+            light.setColor(r, g, b);
+            return 0;
+        });
+        t.add({"setPower", "power"}, [](RT_lightSource &light, const QString &parameters) {
+            bool ok = true;
+            float power = parameters.toFloat(&ok);
+            if (!ok) {
+                return -1;
+            }
+            light.setPower(power);
+            return 0;
+        });
+        return t;
+    }();
+    return table;
+}
+
 /**
   @brief    parse parameters
   @param    action  string describing action to perform
   @param    params  action parameters
   @return   0 on success, negative on error, positive if action not found (use child class action)
 
-  first all "local" actions are looked up, if none found then base class RTobject::parseActions() is called
+  the action table of the class also holds the actions of its base classes, see actions()
   **/
 int RT_lightSource::parseActions(const QString &action, const QString &parameters) {
-    if((0 == action.compare("setColor", Qt::CaseInsensitive)) || (0 == action.compare("color", Qt::CaseInsensitive))) {
-        float r,g,b;
-        if(0 == rthelpers::RT_parse_float3(parameters, &r, &g, &b)) {
-            setColor(r, g, b);
-            return 0;
-        }
-        return -1;
-    } else if((0 == action.compare("setPower", Qt::CaseInsensitive)) || (0 == action.compare("power", Qt::CaseInsensitive))) {
-        bool ok = true;
-        float power = parameters.toFloat(&ok);
-        if (ok) {
-            setPower(power);
-            return 0;
-        }
-        return -1;
-    } else {
-        return RT_object::parseActions(action, parameters);
-    }
+    return actions().dispatch(action, *this, parameters);
+}
+
+/**
+  @brief    add the color and the power to a hash, see RT_object::hashState()
+  **/
+void RT_lightSource::hashState(QCryptographicHash &hash) const {
+    RT_object::hashState(hash);
+    rthelpers::hashData(hash, &m_baseColor, sizeof(m_baseColor));
+    rthelpers::hashData(hash, &m_power, sizeof(m_power));
 }
 
 /**
@@ -115,3 +125,11 @@ int RT_lightSource::updateCache() {
     // Dummy implementation
     return 0; ///> This function should be overloaded by classes which inherit from this class e.g. RT_lightPoint
 }
+
+/**
+  @brief    id of the light program, written to the "sysLightBuffer" slot m_light_idx by the scene
+  @return   program id, 0 (no program) for the dummy light source
+  **/
+int RT_lightSource::programId() const {
+    return 0;
+}
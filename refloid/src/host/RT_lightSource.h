@@ -9,6 +9,8 @@
 class RT_lightSource : virtual public RT_object
 {
 public:
+    typedef RT_actionTable<RT_lightSource, const QString&> ActionTable;
+
     RT_lightSource(optix::Context &context, RT_object* parent = nullptr);
     virtual ~RT_lightSource();
 
@@ -20,15 +22,16 @@ public:
     virtual optix::float3 color() const;
 
     virtual int parseActions(const QString &action, const QString &parameters);
+    static const ActionTable& actions();
     virtual int updateCache();
+    virtual void hashState(QCryptographicHash &hash) const;
+    virtual int programId() const;
 
 public:
     optix::float3 m_baseColor;
     float m_power;
 
-    static bool m_isBufferInitialized; ///< The buffer has to be initialized once only! So its is defined as static
-    static unsigned int m_light_count; ///< This is the counter for all light sources that are assigned to the scene
-    unsigned int m_light_idx; ///< This variable holds the index of the light source. Classes which inherit from this class need to explicitly set this variable
+    unsigned int m_light_idx; ///< Index of the light source in the "sysLightBuffer" of its context, set by the scene the light is added to
 };
 
 
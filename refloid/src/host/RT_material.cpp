@@ -1,4 +1,5 @@
 #include "RT_material.h"
+#include "RT_metrics.h"
 
 RT_material::RT_material(optix::Context &context) :
 m_context(context)
@@ -58,50 +59,149 @@ void RT_material::setBRDF(QString mat_type) {
     setBRDF(mat_type, dummy_str);
 }
 
+/**
+  @brief    actions of a material
+  @return   the action table, the handlers get the parameters and the delimiter of the parameter fields
+  **/
+const RT_material::ActionTable& RT_material::actions() {
+    static const ActionTable table = [] {
+        ActionTable t;
+        t.add({"setMaterialType", "setBRDF", "materialType", "brdf", "setMaterial", "Material"},
+              [](RT_material &mat, const QString &parameters, const QString &delimiter) { return mat.setMaterialTypeAction(parameters, delimiter); });
+        t.add({"setMaterialParameter", "materialParameter"},
+              [](RT_material &mat, const QString &parameters, const QString &delimiter) { return mat.setMaterialParameterAction(parameters, delimiter); });
+        return t;
+    }();
+    return table;
+}
+
 int RT_material::parseActions(const QString &action, const QString &parameters, const QString &delimiter/*=QString(";"*/) {
+    int ret = actions().dispatch(action, *this, parameters, delimiter);
+    // Unknown actions are ignored, like before the action table existed
+    return (ret > 0) ? 0 : ret;
+}
+
+/**
+  @brief    "setMaterialType;<type>", switch to another closest hit program
+  @param    parameters  material type, e.g. "phong"
+  @param    delimiter   separator of the parameter fields, parameters with several fields are ignored
+  @return   0 on success, -1 if the value is malformed
+
+  The programs are created by the next flushPending(), so only the last of several types counts.
+  **/
+int RT_material::setMaterialTypeAction(const QString &parameters, const QString &delimiter) {
+    QStringList sList = parameters.split(delimiter);
+    if (sList.size() == 1) {
+        bufferChange(0 != sList.at(0).compare(m_mat_type, Qt::CaseInsensitive));
+        m_mat_type = sList.at(0);
+    }
+    return 0;
+}
+
+/**
+  @brief    "setMaterialParameter;<name>;<value>", set a parameter of the material
+  @param    parameters  parameter name ("color", "Kd", "Ks" or "spec_exp") and value
+  @param    delimiter   separator of name and value
+  @return   0
+
+  The material is rebuilt once by the next flushPending(), a parameter set again before replaces the
+  earlier value and setting the current value is elided.
+  **/
+int RT_material::setMaterialParameterAction(const QString &parameters, const QString &delimiter) {
     QStringList sList = parameters.split(delimiter);
-    if (sList.size() == 1)
+    if (sList.size() < 2) {
+        return 0;
+    }
+    bool changed = false;
+    if (0 == sList.at(0).compare("color", Qt::CaseInsensitive))
     {
-        if (0 == action.compare("setMaterialType", Qt::CaseInsensitive) ||
-            0 == action.compare("setBRDF", Qt::CaseInsensitive) ||
-            0 == action.compare("materialType", Qt::CaseInsensitive) ||
-            0 == action.compare("brdf", Qt::CaseInsensitive) ||
-            0 == action.compare("setMaterial", Qt::CaseInsensitive) |
-            0 == action.compare("Material", Qt::CaseInsensitive))
-        {
-            setMaterialType(sList.at(0));
+        float x, y, z;
+        if (0 != rthelpers::RT_parse_float3(sList.at(1), &x, &y, &z)) {
+            spdlog::error("Malformed material parameter \"{}\"", sList.at(1).toUtf8().constData());
+            return -1;
         }
-    } else {
-        if (0 == action.compare("setMaterialParameter", Qt::CaseInsensitive) ||
-            0 == action.compare("materialParameter", Qt::CaseInsensitive))
-        {
-            if (0 == sList.at(0).compare("color", Qt::CaseInsensitive))
-            {
-                float x, y, z;
-                rthelpers::RT_parse_float3(sList.at(1), &x, &y, &z);
-                m_color = optix::make_float3(x, y, z);
-                spdlog::debug("Setting material parameter color to: {}, {}, {}", m_color.x, m_color.y, m_color.z);
-            } else if (0 == sList.at(0).compare("Kd", Qt::CaseInsensitive))
-            {
-                float x, y, z;
-                rthelpers::RT_parse_float3(sList.at(1), &x, &y, &z);
-                m_Kd = optix::make_float3(x, y, z);
-                spdlog::debug("Setting material parameter Kd to: {}, {}, {}", m_Kd.x, m_Kd.y, m_Kd.z);
-            } else if (0 == sList.at(0).compare("Ks", Qt::CaseInsensitive))
-            {
-                float x, y, z;
-                rthelpers::RT_parse_float3(sList.at(1), &x, &y, &z);
-                m_Ks = optix::make_float3(x, y, z);
-                spdlog::debug("Setting material parameter Ks to: {}, {}, {}", m_Ks.x, m_Ks.y, m_Ks.z);
-            } else if (0 == sList.at(0).compare("spec_exp", Qt::CaseInsensitive)) {
-                bool ok = false;
-                m_spec_exp = sList.at(1).toFloat(&ok);
-                spdlog::debug("Setting material parameter specular exponent to {}", m_spec_exp);
-            } else {
-                spdlog::error("Was not able to set material parameters");
-            }
-            setMaterialType(m_mat_type);
+        changed = (m_color.x != x || m_color.y != y || m_color.z != z);
+        m_color = optix::make_float3(x, y, z);
+        spdlog::debug("Setting material parameter color to: {}, {}, {}", m_color.x, m_color.y, m_color.z);
+    } else if (0 == sList.at(0).compare("Kd", Qt::CaseInsensitive))
+    {
+        float x, y, z;
+        if (0 != rthelpers::RT_parse_float3(sList.at(1), &x, &y, &z)) {
+            spdlog::error("Malformed material parameter \"{}\"", sList.at(1).toUtf8().constData());
+            return -1;
+        }
+        changed = (m_Kd.x != x || m_Kd.y != y || m_Kd.z != z);
+        m_Kd = optix::make_float3(x, y, z);
+        spdlog::debug("Setting material parameter Kd to: {}, {}, {}", m_Kd.x, m_Kd.y, m_Kd.z);
+    } else if (0 == sList.at(0).compare("Ks", Qt::CaseInsensitive))
+    {
+        float x, y, z;
+        if (0 != rthelpers::RT_parse_float3(sList.at(1), &x, &y, &z)) {
+            spdlog::error("Malformed material parameter \"{}\"", sList.at(1).toUtf8().constData());
+            return -1;
         }
+        changed = (m_Ks.x != x || m_Ks.y != y || m_Ks.z != z);
+        m_Ks = optix::make_float3(x, y, z);
+        spdlog::debug("Setting material parameter Ks to: {}, {}, {}", m_Ks.x, m_Ks.y, m_Ks.z);
+    } else if (0 == sList.at(0).compare("spec_exp", Qt::CaseInsensitive)) {
+        bool ok = false;
+        float spec_exp = sList.at(1).toFloat(&ok);
+        if (!ok) {
+            spdlog::error("Malformed material parameter \"{}\"", sList.at(1).toUtf8().constData());
+            return -1;
+        }
+        changed = (m_spec_exp != spec_exp);
+        m_spec_exp = spec_exp;
+        spdlog::debug("Setting material parameter specular exponent to {}", m_spec_exp);
+    } else {
+        spdlog::error("Was not able to set material parameters");
     }
+    bufferChange(changed);
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+  @brief    count an action, a rebuild is needed if it changed the material
+  @param    changed the action changed the type or a parameter
+  **/
+void RT_material::bufferChange(bool changed) {
+    m_bufferedOps++;
+    if (changed) {
+        m_bRebuildPending = true;
+        m_pendingOps++;
+    } else {
+        RT_metrics::elidedCounter()->fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+  @brief    rebuild the programs after the type or parameters were changed by actions
+  @return   1 if the material was rebuilt, 0 if nothing changed
+  **/
+int RT_material::flushPending() {
+    if (!m_bRebuildPending) {
+        return 0;
+    }
+    if (m_pendingOps > 1) {
+        RT_metrics::elidedCounter()->fetch_add(static_cast<quint64>(m_pendingOps - 1), std::memory_order_relaxed);
+    }
+    m_bRebuildPending = false;
+    m_pendingOps = 0;
+    setMaterialType(m_mat_type);
+    return 1;
+}
+
+unsigned int RT_material::bufferedOperations() const {
+    return m_bufferedOps;
+}
+
+/**
+  @brief    add the type and the parameters of the material to a hash, see RT_object::hashState()
+  **/
+void RT_material::hashState(QCryptographicHash &hash) const {
+    rthelpers::hashString(hash, m_mat_type);
+    rthelpers::hashData(hash, &m_color, sizeof(m_color));
+    rthelpers::hashData(hash, &m_Kd, sizeof(m_Kd));
+    rthelpers::hashData(hash, &m_Ks, sizeof(m_Ks));
+    rthelpers::hashData(hash, &m_spec_exp, sizeof(m_spec_exp));
+}
@@ -5,12 +5,16 @@
 #include <optix_world.h>
 #include <spdlog.h>
 #include <RT_helper.h>
+#include "RT_actionTable.h"
 
 
+#include <QCryptographicHash>
 #include <QString>
 
 class RT_material {
 public:
+    typedef RT_actionTable<RT_material, const QString&, const QString&> ActionTable;
+
     RT_material(optix::Context &context);
     ~RT_material();
 
@@ -19,17 +23,29 @@ public:
     void setMaterialType(QString &mat_type, QString& parameters);
     void setMaterialType(QString mat_type);
     int parseActions(const QString &action, const QString &parameters, const QString &delimiter=";");
+    int setMaterialTypeAction(const QString &parameters, const QString &delimiter=";");
+    int setMaterialParameterAction(const QString &parameters, const QString &delimiter=";");
+    static const ActionTable& actions();
+    int flushPending();
+    unsigned int bufferedOperations() const;
+    void hashState(QCryptographicHash &hash) const;
 
 public:
     optix::Context& m_context;
     optix::Material m_material_optix;
 
 private:
+    void bufferChange(bool changed);
+
     QString m_mat_type = "phong"; ///< Default material is set to rendering phong
     optix::float3 m_color = optix::make_float3(0.6f);
     optix::float3 m_Kd = optix::make_float3(0.4f, 0.4f, 0.4f);
     optix::float3 m_Ks = optix::make_float3(0.2f, 0.2f, 0.2f);
     float m_spec_exp = 2;
+
+    bool m_bRebuildPending = false;     ///< type or parameters changed by actions, the programs are rebuilt by flushPending()
+    int m_pendingOps = 0;               ///< actions since the last rebuild
+    unsigned int m_bufferedOps = 0;     ///< actions buffered or elided since construction
 };
 
 
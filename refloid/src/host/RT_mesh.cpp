@@ -1,6 +1,14 @@
 #include "RT_mesh.h"
 #include <spdlog.h>
 
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+namespace {
+    std::atomic<quint64> geometryRevisions(0);     ///< revisions handed out to the geometries of all meshes
+}
+
 RT_mesh::RT_mesh(optix::Context &context, optix::Group &root_group, RT_object *parent) :
         RT_object(context, parent),
         m_rootGroup(root_group){
@@ -17,12 +25,12 @@ RT_mesh::RT_mesh(optix::Context &context, optix::Group &root_group, RT_object *p
     m_optix_mesh.bounds = m_bounding_box_program;
     m_optix_mesh.intersection = m_intersection_program;
     m_optix_mesh.material = m_material->m_material_optix;
-    this->loadMeshPly("/home/melchert/Desktop/Projects/raytracing/refloid/res/data/turbineblade_axis_translated.ply");
 
     spdlog::debug("Creating geometry group for mesh object");
     m_geom_group = m_context->createGeometryGroup();
     m_geom_group->setAcceleration(m_context->createAcceleration("Trbvh"));
-    m_geom_group->addChild(m_optix_mesh.geom_instance);
+    // Starts without triangles, the data is uploaded with "uploadMesh" or loaded with "load_mesh"
+    setMeshData(nullptr, 0, nullptr, 0);
 
     spdlog::debug("Creating transform for mesh object");
     m_transform_optix = m_context->createTransform();
@@ -36,7 +44,9 @@ RT_mesh::RT_mesh(optix::Context &context, optix::Group &root_group, RT_object *p
 RT_mesh::~RT_mesh() {
     spdlog::debug("Deleting mesh object: \"{}\"", m_strName.toUtf8().constData());
     int idx = m_rootGroup->getChildIndex(m_transform_optix);
-    m_mesh->destroy();
+    if (m_mesh) {
+        m_mesh->destroy();
+    }
     m_optix_mesh.geom_instance->destroy();
     m_geom_group->destroy();
     m_rootGroup->removeChild(idx);
@@ -44,7 +54,117 @@ RT_mesh::~RT_mesh() {
 
 void RT_mesh::loadMeshPly(const QString &file_name) {
     spdlog::debug("Loading Mesh PLY-file \"{}\"", file_name.toStdString());
+    optix::GeometryInstance previous = m_optix_mesh.geom_instance;
     loadMesh(file_name.toStdString(), m_optix_mesh);
+    std::swap(previous, m_optix_mesh.geom_instance);
+    setGeometryInstance(previous);
+    m_geometryRevision = ++geometryRevisions;
+    // The PLY file comes with its own geometry and buffers
+    if (m_mesh) {
+        m_mesh->destroy();
+        m_mesh = optix::Geometry();
+    }
+}
+
+/**
+  @brief    build the mesh from triangle data in memory, e.g. sent by a client
+  @param    vertices        vertex_count float triples (x, y, z) in object coordinates
+  @param    vertex_count    number of vertices
+  @param    indices         triangle_count uint32 triples indexing the vertices
+  @param    triangle_count  number of triangles
+  @param    normals         vertex_count float triples, nullptr to shade with the geometric normals
+  @return   0 on success, -18 if an index is out of range
+
+  The arrays do not need to be aligned. Buffers of the same size are reused, so deforming a mesh only
+  copies the vertices; the acceleration structure of the mesh is rebuilt on the next launch.
+  **/
+int RT_mesh::setMeshData(const void *vertices, std::size_t vertex_count, const void *indices, std::size_t triangle_count,
+                         const void *normals) {
+    const unsigned char *index_data = static_cast<const unsigned char*>(indices);
+    for (std::size_t i=0; i<3 * triangle_count; i++) {
+        quint32 idx;
+        memcpy(&idx, index_data + i * sizeof(idx), sizeof(idx));
+        if (idx >= vertex_count) {
+            spdlog::error("Mesh {}: index {} of triangle {} exceeds the {} vertices", m_strName.toUtf8().constData(), idx, i / 3, vertex_count);
+            return -18;
+        }
+    }
+    spdlog::debug("Uploading {} vertices and {} triangles to mesh object {}", vertex_count, triangle_count, m_strName.toUtf8().constData());
+
+    // Reuses a buffer if it has the right size, otherwise replaces it
+    auto upload = [this](optix::Buffer &buffer, RTformat format, std::size_t count, std::size_t element_size, const void *data) {
+        RTsize size = 0;
+        if (buffer) {
+            buffer->getSize(size);
+        }
+        if (!buffer || size != count) {
+            if (buffer) {
+                buffer->destroy();
+            }
+            buffer = m_context->createBuffer(RT_BUFFER_INPUT, format, count);
+        }
+        if (count > 0) {
+            void *dst = buffer->map(0, RT_BUFFER_MAP_WRITE_DISCARD);
+            if (data) {
+                memcpy(dst, data, count * element_size);
+            } else {
+                memset(dst, 0, count * element_size);
+            }
+            buffer->unmap();
+        }
+    };
+    upload(m_vertexBuffer, RT_FORMAT_FLOAT3, vertex_count, 3 * sizeof(float), vertices);
+    upload(m_normalBuffer, RT_FORMAT_FLOAT3, normals ? vertex_count : 0, 3 * sizeof(float), normals);
+    upload(m_indexBuffer, RT_FORMAT_INT3, triangle_count, 3 * sizeof(quint32), indices);
+    // Single material, the material index of every triangle is 0
+    upload(m_materialBuffer, RT_FORMAT_INT, triangle_count, sizeof(int), nullptr);
+
+    if (!m_mesh) {
+        m_mesh = m_context->createGeometry();
+        m_mesh->setBoundingBoxProgram(m_bounding_box_program);
+        m_mesh->setIntersectionProgram(m_intersection_program);
+        m_mesh["texcoord_buffer"]->setBuffer(m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT2, 0));
+        optix::GeometryInstance instance = m_context->createGeometryInstance();
+        instance->setGeometry(m_mesh);
+        instance->addMaterial(m_material->m_material_optix);
+        setGeometryInstance(instance);
+    }
+    m_mesh["vertex_buffer"]->setBuffer(m_vertexBuffer);
+    m_mesh["normal_buffer"]->setBuffer(m_normalBuffer);
+    m_mesh["index_buffer"]->setBuffer(m_indexBuffer);
+    m_mesh["material_buffer"]->setBuffer(m_materialBuffer);
+    m_mesh->setPrimitiveCount(static_cast<unsigned int>(triangle_count));
+    m_geom_group->getAcceleration()->markDirty();
+    m_geometryRevision = ++geometryRevisions;
+    return 0;
+}
+
+/**
+  @brief    show another geometry instance, the current one is destroyed
+  @param    instance    new geometry instance of the mesh
+  **/
+void RT_mesh::setGeometryInstance(optix::GeometryInstance instance) {
+    if (m_geom_group->getChildCount() == 0) {
+        m_geom_group->addChild(instance);
+    } else {
+        m_geom_group->setChild(0, instance);
+    }
+    if (m_optix_mesh.geom_instance && m_optix_mesh.geom_instance != instance) {
+        m_optix_mesh.geom_instance->destroy();
+    }
+    m_optix_mesh.geom_instance = instance;
+    m_geom_group->getAcceleration()->markDirty();
+}
+
+/**
+  @brief    add the geometry revision to a hash, see RT_object::hashState()
+
+  The triangles are not hashed themselves, which would cost as much as uploading them. Uploading the
+  same triangles again therefore counts as a new scene state.
+  **/
+void RT_mesh::hashState(QCryptographicHash &hash) const {
+    RT_object::hashState(hash);
+    rthelpers::hashData(hash, &m_geometryRevision, sizeof(m_geometryRevision));
 }
 
 int RT_mesh::updateCache() {
@@ -55,23 +175,44 @@ int RT_mesh::updateCache() {
     m_optix_mesh.geom_instance->setMaterial(0, m_material->m_material_optix); //TODO
 }
 
+int RT_mesh::updateTransformCache() {
+    // The vertices are in object coordinates, only the top level acceleration has to be rebuilt
+    m_transform_optix->setMatrix(false, m_transform.getData(), m_transform.inverse().getData());
+    m_rootGroup->getAcceleration()->markDirty();
+    return 0;
+}
+
+/**
+  @brief    actions of mesh objects
+  @return   the action table, starting with all actions of RT_object
+  **/
+const RT_mesh::ActionTable& RT_mesh::actions() {
+    static const ActionTable table = [] {
+        ActionTable t(RT_object::actions());
+        t.add({"load_mesh", "set_mesh"}, [](RT_mesh &mesh, const QString &parameters) {
+            try {
+                mesh.loadMeshPly(parameters);
+            } catch (const std::exception &e) {
+                spdlog::error("Could not load mesh {}: {}", parameters.toUtf8().constData(), e.what());
+                return -1;
+            }
+            return 0;
+        });
+        return t;
+    }();
+    return table;
+}
+
 /**
   @brief    parse parameters
   @param    action  string describing action to perform
   @param    params  action parameters
   @return   0 on success, negative on error, positive if action not found (use child class action)
 
-  first all "local" actions are looked up, if none found then base class RTobject::parseActions() is called
+  the action table of the class also holds the actions of its base classes, see actions()
   **/
 int RT_mesh::parseActions(const QString &action, const QString &parameters) {
     spdlog::debug("Parsing parameter {0} for action {1} on mesh object {2}", parameters.toUtf8().constData(),
                   action.toUtf8().constData(), m_strName.toUtf8().constData());
-    if((0 == action.compare("load_mesh", Qt::CaseInsensitive)) || (0 == action.compare("set_mesh", Qt::CaseInsensitive)))
-    {
-        this->loadMeshPly(parameters);
-    } else {
-        int ret = RT_object::parseActions(action, parameters);
-        return ret;
-    }
-    return 0;
+    return actions().dispatch(action, *this, parameters);
 }
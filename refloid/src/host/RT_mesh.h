@@ -7,19 +7,34 @@
 #include <sutil.h>
 #include <OptiXMesh.h>
 
+#include <cstddef>
+
 
 class RT_mesh : virtual  public RT_object {
 public:
+    typedef RT_actionTable<RT_mesh, const QString&> ActionTable;
+
     RT_mesh(optix::Context &context, optix::Group &root_group, RT_object *parent = nullptr);
     ~RT_mesh();
 
 public:
     int updateCache() override;
+    void hashState(QCryptographicHash &hash) const override;
+    int updateTransformCache() override;
     int parseActions(const QString &action, const QString &parameters) override;
+    static const ActionTable& actions();
     void loadMeshPly(const QString &file_name);
+    int setMeshData(const void *vertices, std::size_t vertex_count, const void *indices, std::size_t triangle_count,
+                    const void *normals = nullptr);
 
 private:
-    optix::Geometry m_mesh;
+    void setGeometryInstance(optix::GeometryInstance instance);
+
+    optix::Geometry m_mesh;             ///< geometry of uploaded mesh data, null while a PLY file is loaded
+    optix::Buffer m_vertexBuffer;
+    optix::Buffer m_normalBuffer;
+    optix::Buffer m_indexBuffer;
+    optix::Buffer m_materialBuffer;
     optix::Group &m_rootGroup;
     optix::Program m_intersection_program;
     optix::Program m_bounding_box_program;
@@ -27,6 +42,7 @@ private:
     optix::GeometryGroup m_geom_group;
     optix::Transform m_transform_optix;
     OptiXMesh m_optix_mesh;
+    quint64 m_geometryRevision = 0;     ///< changes with every loaded or uploaded geometry, stands for the triangles in hashState()
 };
 
 #endif //NSLAIFT_RT_MESH_H
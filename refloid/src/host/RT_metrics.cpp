@@ -0,0 +1,390 @@
+/**
+  @file     RT_metrics.cpp
+  @brief    process wide counters and latency histograms of the render server
+**/
+
+#include "RT_metrics.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QtAlgorithms>
+#include <spdlog/spdlog.h>
+
+#include <limits>
+
+namespace {
+    const char *const OtherMetric = "other";
+
+    ///< position of the highest set bit, value must not be 0
+    int highestBit(quint64 value)
+    {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(value);
+#else
+        int bit = 0;
+        while (value >>= 1) {
+            bit++;
+        }
+        return bit;
+#endif
+    }
+
+    double micros(double ns)
+    {
+        return ns / 1000.0;
+    }
+}
+
+RT_histogram::RT_histogram()
+{
+    reset();
+}
+
+/**
+  @brief    add a value to the histogram
+  @param    value   duration in ns
+  **/
+void RT_histogram::record(quint64 value)
+{
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    quint64 current = m_min.load(std::memory_order_relaxed);
+    while (value < current && !m_min.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+    current = m_max.load(std::memory_order_relaxed);
+    while (value > current && !m_max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void RT_histogram::reset()
+{
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(std::numeric_limits<quint64>::max(), std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+    for (int i=0; i<BucketCount; i++) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+quint64 RT_histogram::count() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+/**
+  @brief    summarize the histogram
+  @return   {"count", "mean_us", "min_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us"}
+  **/
+QJsonObject RT_histogram::toJson() const
+{
+    static const double Percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    static const char *const Names[] = {"p50_us", "p90_us", "p99_us", "p999_us"};
+
+    // Values recorded while reading may be missing in some buckets, the percentiles use what was read
+    quint64 buckets[BucketCount];
+    quint64 total = 0;
+    for (int i=0; i<BucketCount; i++) {
+        buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += buckets[i];
+    }
+    quint64 count = m_count.load(std::memory_order_relaxed);
+    QJsonObject json;
+    json.insert("count", static_cast<double>(count));
+    if (count == 0 || total == 0) {
+        return json;
+    }
+    json.insert("mean_us", micros(static_cast<double>(m_sum.load(std::memory_order_relaxed)) / count));
+    json.insert("min_us", micros(static_cast<double>(m_min.load(std::memory_order_relaxed))));
+    int bucket = 0;
+    quint64 seen = buckets[0];
+    for (int p=0; p<4; p++) {
+        quint64 rank = static_cast<quint64>(Percentiles[p] * total + 0.5);
+        rank = (rank > 0) ? rank : 1;
+        while (seen < rank && bucket + 1 < BucketCount) {
+            seen += buckets[++bucket];
+        }
+        json.insert(Names[p], micros(static_cast<double>(bucketValue(bucket))));
+    }
+    json.insert("max_us", micros(static_cast<double>(m_max.load(std::memory_order_relaxed))));
+    return json;
+}
+
+/**
+  @brief    bucket of a value: values below 16 have their own bucket, larger ones share a bucket with
+            the values of the same power of two and the same 4 bits below the highest set bit
+  **/
+int RT_histogram::bucketIndex(quint64 value)
+{
+    if (value < SubBuckets) {
+        return static_cast<int>(value);
+    }
+    int exponent = highestBit(value);
+    int sub = static_cast<int>(value >> (exponent - 4)) - SubBuckets;
+    return SubBuckets + (exponent - 4) * SubBuckets + sub;
+}
+
+/**
+  @brief    value reported for a bucket, the middle of its range
+  **/
+quint64 RT_histogram::bucketValue(int index)
+{
+    if (index < SubBuckets) {
+        return static_cast<quint64>(index);
+    }
+    int exponent = (index - SubBuckets) / SubBuckets + 4;
+    quint64 sub = static_cast<quint64>((index - SubBuckets) % SubBuckets);
+    quint64 width = static_cast<quint64>(1) << (exponent - 4);
+    return (SubBuckets + sub) * width + width / 2;
+}
+
+void RT_histogram::record(std::chrono::steady_clock::duration duration)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    record(static_cast<quint64>(ns > 0 ? ns : 0));
+}
+
+RT_metrics::Timer::Timer(RT_histogram *histogram) :
+        m_histogram(histogram),
+        m_start(std::chrono::steady_clock::now())
+{
+}
+
+RT_metrics::Timer::Timer(const QString &name) :
+        m_histogram(RT_metrics::instance().histogram(name)),
+        m_start(std::chrono::steady_clock::now())
+{
+}
+
+RT_metrics::Timer::~Timer()
+{
+    m_histogram->record(std::chrono::steady_clock::now() - m_start);
+}
+
+RT_metrics::NameCache::NameCache(const QString &prefix, const QString &suffix) :
+        m_prefix(prefix),
+        m_suffix(suffix)
+{
+}
+
+/**
+  @brief    get the histogram "<prefix><name><suffix>", only the first use of a name takes the registry mutex
+  **/
+RT_histogram* RT_metrics::NameCache::histogram(const QString &name)
+{
+    RT_histogram *h = m_histograms.value(name, nullptr);
+    if (h == nullptr) {
+        h = RT_metrics::instance().histogram(m_prefix + name + m_suffix);
+        if (m_histograms.size() < MaxMetrics) {     // names beyond are "other" in the registry anyway
+            m_histograms.insert(name, h);
+        }
+    }
+    return h;
+}
+
+/**
+  @brief    get the counter "<prefix><name><suffix>", see histogram()
+  **/
+std::atomic<quint64>* RT_metrics::NameCache::counter(const QString &name)
+{
+    std::atomic<quint64> *c = m_counters.value(name, nullptr);
+    if (c == nullptr) {
+        c = RT_metrics::instance().counter(m_prefix + name + m_suffix);
+        if (m_counters.size() < MaxMetrics) {
+            m_counters.insert(name, c);
+        }
+    }
+    return c;
+}
+
+RT_metrics::RT_metrics() :
+        m_since(std::chrono::steady_clock::now()),
+        m_dumpInterval(0),
+        m_dumpStop(false)
+{
+}
+
+RT_metrics::~RT_metrics()
+{
+    setDump(QString(), 0);
+    qDeleteAll(m_histograms);
+    qDeleteAll(m_counters);
+}
+
+/**
+  @brief    the registry shared by all sessions and threads
+  **/
+RT_metrics& RT_metrics::instance()
+{
+    static RT_metrics metrics;
+    return metrics;
+}
+
+/**
+  @brief    "coalesce/elided", object and material changes dropped because they had no effect or were
+            superseded before the caches were uploaded, see RT_object and RT_material
+  **/
+std::atomic<quint64>* RT_metrics::elidedCounter()
+{
+    static std::atomic<quint64> *counter = instance().counter("coalesce/elided");
+    return counter;
+}
+
+/**
+  @brief    get a histogram, it is created on first use
+  @param    name    metric name, e.g. "command/render" or "camera/cam1/launch"
+  @return   the histogram, valid until the end of the process; the "other" histogram if there are too many metrics
+  **/
+RT_histogram* RT_metrics::histogram(const QString &name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RT_histogram *h = m_histograms.value(name, nullptr);
+    if (h == nullptr) {
+        QString key = (m_histograms.size() + m_counters.size() < MaxMetrics) ? name : QString(OtherMetric);
+        h = m_histograms.value(key, nullptr);
+        if (h == nullptr) {
+            h = new RT_histogram();
+            m_histograms.insert(key, h);
+        }
+    }
+    return h;
+}
+
+/**
+  @brief    get a counter, it is created on first use
+  @param    name    metric name, e.g. "jobs/failed"
+  @return   the counter, valid until the end of the process; the "other" counter if there are too many metrics
+  **/
+std::atomic<quint64>* RT_metrics::counter(const QString &name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::atomic<quint64> *c = m_counters.value(name, nullptr);
+    if (c == nullptr) {
+        QString key = (m_histograms.size() + m_counters.size() < MaxMetrics) ? name : QString(OtherMetric);
+        c = m_counters.value(key, nullptr);
+        if (c == nullptr) {
+            c = new std::atomic<quint64>(0);
+            m_counters.insert(key, c);
+        }
+    }
+    return c;
+}
+
+/**
+  @brief    add a duration to a histogram
+  @param    name        metric name
+  @param    duration    measured duration
+  **/
+void RT_metrics::record(const QString &name, std::chrono::steady_clock::duration duration)
+{
+    histogram(name)->record(duration);
+}
+
+void RT_metrics::increment(const QString &name, quint64 value)
+{
+    counter(name)->fetch_add(value, std::memory_order_relaxed);
+}
+
+/**
+  @brief    summarize all metrics
+  @return   {"since_s": seconds since the last reset, "counters": {name: value}, "histograms": {name: summary}}
+  **/
+QJsonObject RT_metrics::toJson() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QJsonObject counters;
+    for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+        counters.insert(it.key(), static_cast<double>(it.value()->load(std::memory_order_relaxed)));
+    }
+    QJsonObject histograms;
+    for (auto it = m_histograms.constBegin(); it != m_histograms.constEnd(); ++it) {
+        if (it.value()->count() > 0) {
+            histograms.insert(it.key(), it.value()->toJson());
+        }
+    }
+    QJsonObject json;
+    json.insert("since_s", std::chrono::duration<double>(std::chrono::steady_clock::now() - m_since).count());
+    json.insert("counters", counters);
+    json.insert("histograms", histograms);
+    return json;
+}
+
+/**
+  @brief    summarize all metrics as a single line of JSON
+  @param    reset   start a new recording afterwards
+  @return   JSON without newlines, see toJson()
+  **/
+QByteArray RT_metrics::dump(bool reset)
+{
+    QJsonObject json = toJson();
+    json.insert("timestamp_ms", static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()));
+    if (reset) {
+        this->reset();
+    }
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+/**
+  @brief    set all counters and histograms to zero, the metrics are kept
+  **/
+void RT_metrics::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_counters.begin(); it != m_counters.end(); ++it) {
+        it.value()->store(0, std::memory_order_relaxed);
+    }
+    for (auto it = m_histograms.begin(); it != m_histograms.end(); ++it) {
+        it.value()->reset();
+    }
+    m_since = std::chrono::steady_clock::now();
+}
+
+/**
+  @brief    append the metrics to a file periodically, one line of JSON per interval
+  @param    path        file the lines are appended to, empty to stop dumping
+  @param    interval_ms time between two lines
+  @return   0 on success, -1 if the file cannot be opened
+  **/
+int RT_metrics::setDump(const QString &path, int interval_ms)
+{
+    std::lock_guard<std::mutex> control(m_dumpControl);
+    {
+        std::lock_guard<std::mutex> lock(m_dumpMutex);
+        m_dumpStop = true;
+    }
+    m_dumpCondition.notify_all();
+    if (m_dumpThread.joinable()) {
+        m_dumpThread.join();
+    }
+    if (path.isEmpty()) {
+        return 0;
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        spdlog::error("Could not open the stats file {}", path.toUtf8().constData());
+        return -1;
+    }
+    m_dumpPath = path;
+    m_dumpInterval = (interval_ms > 0) ? interval_ms : 1;
+    m_dumpStop = false;
+    m_dumpThread = std::thread(&RT_metrics::runDump, this);
+    spdlog::info("Writing stats to {} every {} ms", path.toUtf8().constData(), m_dumpInterval);
+    return 0;
+}
+
+void RT_metrics::runDump()
+{
+    std::unique_lock<std::mutex> lock(m_dumpMutex);
+    while (!m_dumpStop) {
+        if (m_dumpCondition.wait_for(lock, std::chrono::milliseconds(m_dumpInterval), [this]() { return m_dumpStop; })) {
+            break;
+        }
+        QFile file(m_dumpPath);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            file.write(dump());
+            file.write("\n");
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/**
+  @file     RT_metrics.h
+  @brief    process wide counters and latency histograms of the render server
+
+  Metrics are always recorded, by the workers (one histogram per command type) and by the render
+  threads (updateCaches, validate and per camera launch, readback and tiff write). Looking a metric
+  up by name (histogram(), counter(), record(), increment() and Timer(name)) takes the registry mutex,
+  so hot paths resolve their metrics once, into static pointers for fixed names or into a NameCache
+  per session or render thread for names built at run time, and record through the pointers: that
+  is lock free and costs a few relaxed atomic increments. Histograms use HDR style log-linear buckets
+  with 16 sub-buckets per power of two, i.e. percentiles are accurate to about 6%.
+
+  The metrics are read with the "stats" command as one line of JSON and can be appended to a file
+  periodically with "setStatsDump". All durations are reported in microseconds.
+**/
+
+#ifndef NSLAIFT_RT_METRICS_H
+#define NSLAIFT_RT_METRICS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+#include <QtGlobal>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class RT_histogram
+{
+public:
+    RT_histogram();
+
+    void record(quint64 value);
+    void record(std::chrono::steady_clock::duration duration);
+    void reset();
+    quint64 count() const;
+    QJsonObject toJson() const;
+
+    static const int SubBuckets = 16;
+    static const int BucketCount = SubBuckets + (64 - 4) * SubBuckets;    ///< values 0..2^64-1 in ns
+
+private:
+    static int bucketIndex(quint64 value);
+    static quint64 bucketValue(int index);
+
+    std::atomic<quint64> m_count;
+    std::atomic<quint64> m_sum;
+    std::atomic<quint64> m_min;
+    std::atomic<quint64> m_max;
+    std::atomic<quint64> m_buckets[BucketCount];
+};
+
+class RT_metrics
+{
+public:
+    ///< records the time from its construction to its destruction in a histogram
+    class Timer {
+    public:
+        explicit Timer(RT_histogram *histogram);
+        explicit Timer(const QString &name);
+        ~Timer();
+    private:
+        RT_histogram *m_histogram;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    ///< metrics named "<prefix><name><suffix>", e.g. "command/<command>/errors", resolved once per name;
+    ///< not thread safe, a cache belongs to one session or thread
+    class NameCache {
+    public:
+        explicit NameCache(const QString &prefix, const QString &suffix = QString());
+        RT_histogram* histogram(const QString &name);
+        std::atomic<quint64>* counter(const QString &name);
+    private:
+        QString m_prefix;
+        QString m_suffix;
+        QHash<QString, RT_histogram*> m_histograms;
+        QHash<QString, std::atomic<quint64>*> m_counters;
+    };
+
+    static RT_metrics& instance();
+    static std::atomic<quint64>* elidedCounter();
+
+    RT_histogram* histogram(const QString &name);
+    std::atomic<quint64>* counter(const QString &name);
+    void record(const QString &name, std::chrono::steady_clock::duration duration);
+    void increment(const QString &name, quint64 value = 1);
+
+    QJsonObject toJson() const;
+    QByteArray dump(bool reset = false);
+    void reset();
+    int setDump(const QString &path, int interval_ms);
+
+    static const int MaxMetrics = 512;      ///< further names, e.g. of unknown commands, are recorded as "other"
+
+private:
+    RT_metrics();
+    ~RT_metrics();
+    void runDump();
+
+    mutable std::mutex m_mutex;
+    QHash<QString, RT_histogram*> m_histograms;         ///< never removed, callers may keep the pointers
+    QHash<QString, std::atomic<quint64>*> m_counters;
+    std::chrono::steady_clock::time_point m_since;      ///< start of the recording, set by reset()
+
+    std::mutex m_dumpControl;                           ///< serializes setDump() calls of different workers
+    std::mutex m_dumpMutex;
+    std::condition_variable m_dumpCondition;
+    std::thread m_dumpThread;
+    QString m_dumpPath;
+    int m_dumpInterval;
+    bool m_dumpStop;
+};
+
+#endif //NSLAIFT_RT_METRICS_H
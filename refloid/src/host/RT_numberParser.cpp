@@ -0,0 +1,288 @@
+/**
+  @file     RT_numberParser.cpp
+  @brief    parser for delimited lists of numbers in command parameters, e.g. "1.5,-2,3e-2"
+**/
+
+#include "RT_numberParser.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+    const double PowersOfTen[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const int MaxSignificantDigits = 19;        ///< digits that fit into the 64 bit mantissa
+    const int MaxExponent = 100000;             ///< larger exponents over- or underflow anyway
+
+    inline unsigned int code(char c) { return static_cast<unsigned char>(c); }
+    inline unsigned int code(ushort c) { return c; }
+    inline bool isSpace(unsigned int c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+    inline bool isDigit(unsigned int c) { return c >= '0' && c <= '9'; }
+    inline unsigned int toLower(unsigned int c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+    template<typename Char>
+    void skipSpace(const Char *&pos, const Char *end)
+    {
+        while (pos < end && isSpace(code(*pos))) {
+            pos++;
+        }
+    }
+
+    ///< match a lower case word case-insensitively and move behind it
+    template<typename Char>
+    bool matchWord(const Char *&pos, const Char *end, const char *word)
+    {
+        const Char *p = pos;
+        for (; *word; word++, p++) {
+            if (p == end || toLower(code(*p)) != code(*word)) {
+                return false;
+            }
+        }
+        pos = p;
+        return true;
+    }
+
+    ///< add a digit to the mantissa, digits beyond the precision of the mantissa only scale it
+    inline void addDigit(unsigned int digit, bool fraction, unsigned long long &mantissa, int &significant, int &exponent)
+    {
+        if (mantissa == 0 && digit == 0) {
+            exponent -= fraction ? 1 : 0;
+        } else if (significant < MaxSignificantDigits) {
+            mantissa = mantissa * 10 + digit;
+            significant++;
+            exponent -= fraction ? 1 : 0;
+        } else {
+            exponent += fraction ? 0 : 1;
+        }
+    }
+
+    /**
+      @brief    value of mantissa * 10^exponent
+
+      Mantissas up to 2^53 with exponents up to 22 are exact doubles, the result is rounded once. Other
+      values are converted by strtod() from a string without decimal point, which does not depend on
+      the locale either.
+      **/
+    double scale(unsigned long long mantissa, int exponent)
+    {
+        if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+            double value = static_cast<double>(mantissa);
+            return (exponent < 0) ? value / PowersOfTen[-exponent] : value * PowersOfTen[exponent];
+        }
+        char buffer[48];
+        std::snprintf(buffer, sizeof(buffer), "%llue%d", mantissa, exponent);
+        return std::strtod(buffer, nullptr);
+    }
+
+    /**
+      @brief    read a number
+      @param    pos     first character of the number, moved behind it, or to the first character that
+                        could not be parsed
+      @param    end     end of the characters
+      @param    value   receives the number
+      @return   true on success, false if the characters are no number or the number overflows
+      **/
+    template<typename Char>
+    bool readDouble(const Char *&pos, const Char *end, double &value)
+    {
+        const Char *start = pos;
+        bool negative = false;
+        if (pos < end && (code(*pos) == '+' || code(*pos) == '-')) {
+            negative = (code(*pos) == '-');
+            pos++;
+        }
+        if (pos < end && !isDigit(code(*pos)) && code(*pos) != '.') {
+            if (matchWord(pos, end, "infinity") || matchWord(pos, end, "inf")) {
+                value = negative ? -HUGE_VAL : HUGE_VAL;
+                return true;
+            }
+            if (matchWord(pos, end, "nan")) {
+                value = std::numeric_limits<double>::quiet_NaN();
+                return true;
+            }
+            return false;
+        }
+
+        unsigned long long mantissa = 0;
+        int significant = 0;
+        int exponent = 0;
+        bool digits = false;
+        for (; pos < end && isDigit(code(*pos)); pos++) {
+            digits = true;
+            addDigit(code(*pos) - '0', false, mantissa, significant, exponent);
+        }
+        if (pos < end && code(*pos) == '.') {
+            pos++;
+            for (; pos < end && isDigit(code(*pos)); pos++) {
+                digits = true;
+                addDigit(code(*pos) - '0', true, mantissa, significant, exponent);
+            }
+        }
+        if (!digits) {
+            return false;
+        }
+        if (pos < end && toLower(code(*pos)) == 'e') {
+            pos++;
+            bool negative_exponent = false;
+            if (pos < end && (code(*pos) == '+' || code(*pos) == '-')) {
+                negative_exponent = (code(*pos) == '-');
+                pos++;
+            }
+            if (pos == end || !isDigit(code(*pos))) {
+                return false;
+            }
+            int e = 0;
+            for (; pos < end && isDigit(code(*pos)); pos++) {
+                e = (e < MaxExponent) ? e * 10 + static_cast<int>(code(*pos) - '0') : e;
+            }
+            exponent += negative_exponent ? -e : e;
+        }
+
+        value = scale(mantissa, exponent);
+        value = negative ? -value : value;
+        if (std::isinf(value)) {
+            pos = start;
+            return false;
+        }
+        return true;
+    }
+
+    template<typename Char>
+    bool readFloat(const Char *&pos, const Char *end, float &value)
+    {
+        const Char *start = pos;
+        double d = 0;
+        if (!readDouble(pos, end, d)) {
+            return false;
+        }
+        if (std::isfinite(d) && std::fabs(d) > FLT_MAX) {
+            pos = start;
+            return false;
+        }
+        value = static_cast<float>(d);
+        return true;
+    }
+
+    template<typename Char>
+    bool readInt(const Char *&pos, const Char *end, int &value)
+    {
+        const Char *start = pos;
+        bool negative = false;
+        if (pos < end && (code(*pos) == '+' || code(*pos) == '-')) {
+            negative = (code(*pos) == '-');
+            pos++;
+        }
+        if (pos == end || !isDigit(code(*pos))) {
+            return false;
+        }
+        const long long limit = negative ? -static_cast<long long>(std::numeric_limits<int>::min())
+                                         : std::numeric_limits<int>::max();
+        long long v = 0;
+        for (; pos < end && isDigit(code(*pos)); pos++) {
+            v = v * 10 + (code(*pos) - '0');
+            if (v > limit) {
+                pos = start;
+                return false;
+            }
+        }
+        value = static_cast<int>(negative ? -v : v);
+        return true;
+    }
+
+    /**
+      @brief    parse a list of exactly count numbers
+      @param    read    reads one number, see readDouble()
+      **/
+    template<typename Char, typename T>
+    rtparse::Result parseList(const Char *begin, const Char *end, T *values, int count, char delimiter,
+                              bool (*read)(const Char *&, const Char *, T &))
+    {
+        rtparse::Result result;
+        const Char *pos = begin;
+        for (int i=0; i<count; i++) {
+            result.field = i;
+            if (i > 0) {
+                if (pos == end) {
+                    result.error = -2;
+                    result.position = static_cast<int>(pos - begin);
+                    return result;
+                }
+                pos++;      // the delimiter, see below
+            }
+            skipSpace(pos, end);
+            if (!read(pos, end, values[i])) {
+                result.error = -3;
+                result.position = static_cast<int>(pos - begin);
+                return result;
+            }
+            skipSpace(pos, end);
+            if (pos < end && code(*pos) != code(delimiter)) {
+                result.error = -3;
+                result.position = static_cast<int>(pos - begin);
+                return result;
+            }
+        }
+        if (pos != end) {
+            result.error = -2;
+            result.field = count;
+            result.position = static_cast<int>(pos - begin);
+            return result;
+        }
+        result.field = -1;
+        return result;
+    }
+}
+
+/**
+  @brief    parse a list of floats
+  @param    begin       first character of the list
+  @param    end         end of the list
+  @param    values      receives the numbers, the fields before an error are written
+  @param    count       number of fields the list must have
+  @param    delimiter   character between the fields
+  @return   error code, field and position of the first error
+  **/
+rtparse::Result rtparse::parseFloats(const char *begin, const char *end, float *values, int count, char delimiter)
+{
+    return parseList(begin, end, values, count, delimiter, &readFloat<char>);
+}
+
+rtparse::Result rtparse::parseFloats(const QString &str, float *values, int count, char delimiter)
+{
+    const ushort *data = str.utf16();
+    return parseList(data, data + str.size(), values, count, delimiter, &readFloat<ushort>);
+}
+
+/**
+  @brief    parse a list of doubles, see parseFloats()
+  **/
+rtparse::Result rtparse::parseDoubles(const char *begin, const char *end, double *values, int count, char delimiter)
+{
+    return parseList(begin, end, values, count, delimiter, &readDouble<char>);
+}
+
+rtparse::Result rtparse::parseDoubles(const QString &str, double *values, int count, char delimiter)
+{
+    const ushort *data = str.utf16();
+    return parseList(data, data + str.size(), values, count, delimiter, &readDouble<ushort>);
+}
+
+/**
+  @brief    parse a list of decimal ints, see parseFloats()
+  **/
+rtparse::Result rtparse::parseInts(const char *begin, const char *end, int *values, int count, char delimiter)
+{
+    return parseList(begin, end, values, count, delimiter, &readInt<char>);
+}
+
+rtparse::Result rtparse::parseInts(const QString &str, int *values, int count, char delimiter)
+{
+    const ushort *data = str.utf16();
+    return parseList(data, data + str.size(), values, count, delimiter, &readInt<ushort>);
+}
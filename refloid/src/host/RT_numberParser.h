@@ -0,0 +1,32 @@
+/**
+  @file     RT_numberParser.h
+  @brief    parser for delimited lists of numbers in command parameters, e.g. "1.5,-2,3e-2"
+
+  The lists are parsed in place from the characters of the command, either a QString or a raw byte
+  span, straight into the target values: no token strings are built and nothing is allocated. Numbers
+  are read independently of the locale of the process, with "." as decimal point. Like
+  QString::toFloat(), white space around a number is ignored and "inf" and "nan" are accepted.
+**/
+
+#ifndef NSLAIFT_RT_NUMBERPARSER_H
+#define NSLAIFT_RT_NUMBERPARSER_H
+
+#include <QString>
+
+namespace rtparse {
+    ///< outcome of parsing a list
+    struct Result {
+        int error = 0;          ///< 0 on success, -2 if the list has the wrong number of fields, -3 if a field is no number
+        int field = -1;         ///< index of the field the error was found in
+        int position = -1;      ///< offset in characters of the first character that could not be parsed
+    };
+
+    Result parseFloats(const char *begin, const char *end, float *values, int count, char delimiter = ',');
+    Result parseFloats(const QString &str, float *values, int count, char delimiter = ',');
+    Result parseDoubles(const char *begin, const char *end, double *values, int count, char delimiter = ',');
+    Result parseDoubles(const QString &str, double *values, int count, char delimiter = ',');
+    Result parseInts(const char *begin, const char *end, int *values, int count, char delimiter = ',');
+    Result parseInts(const QString &str, int *values, int count, char delimiter = ',');
+}
+
+#endif //NSLAIFT_RT_NUMBERPARSER_H
@@ -10,6 +10,16 @@
 **/
 
 #include "RT_object.h"
+#include "RT_metrics.h"
+
+#include <algorithm>
+
+namespace {
+    bool isZero(float x, float y, float z)
+    {
+        return x == 0.0f && y == 0.0f && z == 0.0f;
+    }
+}
 
 /**
   @brief    basic constructor
@@ -26,8 +36,12 @@ m_context(context)
 
     m_transform = optix::Matrix4x4::identity();
     m_bTransformCacheUpToDate = false;
+    m_bTransformPending = false;
+    m_pendingOps = 0;
+    m_bufferedOps = 0;
 
     m_strName.setNum(reinterpret_cast<size_t> (this), 16);
+    m_handle = 0;
     m_bVisible = true;
 }
 
@@ -101,6 +115,18 @@ bool RT_object::isVisible() const {
 }
 
 
+/**
+  @brief    upload a changed transformation matrix to optix
+  @return   0 on success
+
+  Used when only the pose of an object changed, e.g. between the poses of a sweep. Objects whose
+  geometry does not depend on the transformation override this to keep their acceleration structure,
+  the default updates the complete cache.
+  **/
+int RT_object::updateTransformCache() {
+    return updateCache();
+}
+
 /**
   @brief    determine if object's caches are up to date
   @return   content of m_bTransformCacheUpToDate
@@ -117,8 +143,7 @@ bool RT_object::upToDate() const {
 void RT_object::reset()                             //move relative to current location
 {
     spdlog::info("Resetting poision of RT_object {0}", m_strName.toUtf8().constData());
-    m_transform = optix::Matrix4x4::identity();
-    m_bTransformCacheUpToDate = false;
+    supersedeTransform() = optix::Matrix4x4::identity();
 }
 
 /**
@@ -130,10 +155,13 @@ void RT_object::reset()                             //move relative to current l
   **/
 void RT_object::translate(optix::float3 &v) {
     spdlog::debug("Translating RT_object {0} in its global world coordinate system by {1}, {2}, {3}", m_strName.toUtf8().constData(), v.x, v.y, v.z);
+    if (isZero(v.x, v.y, v.z)) {
+        elideOperation();
+        return;
+    }
     optix::Matrix4x4 trans = optix::Matrix4x4::translate(v);
-    m_transform = trans * m_transform;
-    m_bTransformCacheUpToDate = false;
-
+    optix::Matrix4x4 &pending = bufferTransform();
+    pending = trans * pending;
 }
 
 /**
@@ -158,9 +186,12 @@ void RT_object::translate(float x, float y, float z) {
   **/
 void RT_object::move(optix::float3 &v) {
     spdlog::debug("Moving RT_object {0} in its local coordinate system by {1}, {2}, {3}", m_strName.toUtf8().constData(), v.x, v.y, v.z);
+    if (isZero(v.x, v.y, v.z)) {
+        elideOperation();
+        return;
+    }
     optix::Matrix4x4 trans = optix::Matrix4x4::translate(v);
-    m_transform *= trans;
-    m_bTransformCacheUpToDate = false;
+    bufferTransform() *= trans;
 }
 
 /**
@@ -186,10 +217,10 @@ void RT_object::move(float x, float y, float z) {
   **/
 void RT_object::setPosition(float x, float y, float z) {
     spdlog::debug("Setting RT_object {0} to {1}, {2}, {3} in world coordinates", m_strName.toUtf8().constData(), x, y, z);
-    m_transform[3] = x;
-    m_transform[7] = y;
-    m_transform[11] = z;
-    m_bTransformCacheUpToDate = false;
+    optix::Matrix4x4 &pending = bufferTransform();
+    pending[3] = x;
+    pending[7] = y;
+    pending[11] = z;
 }
 
 /**
@@ -216,8 +247,12 @@ void RT_object::spin(float rX, float rY, float rZ) {
     float pitch = rY * M_PIf / 180.0f;
     float roll = rZ * M_PIf / 180.0f;
 
-    m_transform = m_transform * mhelpers::rotation(yaw, pitch, roll);
-    m_bTransformCacheUpToDate = false;
+    if (isZero(rX, rY, rZ)) {
+        elideOperation();
+        return;
+    }
+    optix::Matrix4x4 &pending = bufferTransform();
+    pending = pending * mhelpers::rotation(yaw, pitch, roll);
 }
 
 /**
@@ -245,8 +280,12 @@ void RT_object::rotate(float rX, float rY, float rZ) {
     float pitch = rY * M_PIf / 180.0f;
     float roll = rZ * M_PIf / 180.0f;
 
-    m_transform = mhelpers::rotation(yaw, pitch, roll) * m_transform;
-    m_bTransformCacheUpToDate = false;
+    if (isZero(rX, rY, rZ)) {
+        elideOperation();
+        return;
+    }
+    optix::Matrix4x4 &pending = bufferTransform();
+    pending = mhelpers::rotation(yaw, pitch, roll) * pending;
 }
 
 /**
@@ -267,9 +306,8 @@ void RT_object::rotate(optix::float3 &r) {
   **/
 void RT_object::transform(optix::Matrix4x4 &mat) {
     spdlog::debug("Performing transformation on RT_object {0}", m_strName.toUtf8().constData());
-
-    m_transform = mat * m_transform;
-    m_bTransformCacheUpToDate = false;
+    optix::Matrix4x4 &pending = bufferTransform();
+    pending = mat * pending;
 }
 
 /**
@@ -278,32 +316,203 @@ void RT_object::transform(optix::Matrix4x4 &mat) {
   **/
 void RT_object::setTransformationMatrix(const optix::Matrix4x4 &mat) {
     spdlog::debug("Setting new tranformation matrix for RT_object {0}", m_strName.toUtf8().constData());
-    m_transform = mat;
-    m_bTransformCacheUpToDate = false;
+    supersedeTransform() = mat;
 }
 
 /**
   @brief    get a copy of the current transofrmation matrix
-  @return   transfromation matrix with current values
+  @return   transfromation matrix with current values, including manipulations not flushed yet
   **/
 optix::Matrix4x4 RT_object::transformationMatrix() {
-    return optix::Matrix4x4();
+    return currentTransform();
 }
 
 /**
   @brief    read position
-  @return   the t-part of the R|t - transformation matrix
-
-  @bug bad idea, not reliable? verify!
+  @return   the t-part of the R|t - transformation matrix, including manipulations not flushed yet
   **/
 const optix::float3 RT_object::position() const {
-    return optix::make_float3(m_transform[3], m_transform[7], m_transform[11]);
+    const optix::Matrix4x4 &transform = currentTransform();
+    return optix::make_float3(transform[3], transform[7], transform[11]);
+}
+
+/**
+  @brief    transformation matrix the object will have after the next flushPending()
+  **/
+const optix::Matrix4x4& RT_object::currentTransform() const {
+    return m_bTransformPending ? m_pendingTransform : m_transform;
+}
+
+/**
+  @brief    start buffering a manipulation of the transformation
+  @return   the pending transformation matrix, the manipulation is applied to it
+
+  Consecutive manipulations are composed into the single pending matrix, m_transform and the caches
+  are only changed when the scene flushes the object (see flushPending()).
+  **/
+optix::Matrix4x4& RT_object::bufferTransform() {
+    if (!m_bTransformPending) {
+        m_pendingTransform = m_transform;
+        m_bTransformPending = true;
+    }
+    m_pendingOps++;
+    m_bufferedOps++;
+    return m_pendingTransform;
+}
+
+/**
+  @brief    start buffering a manipulation that replaces the transformation, e.g. reset()
+  @return   the pending transformation matrix, to be overwritten
+
+  The manipulations buffered before are superseded and elided.
+  **/
+optix::Matrix4x4& RT_object::supersedeTransform() {
+    if (m_pendingOps > 0) {
+        RT_metrics::elidedCounter()->fetch_add(static_cast<quint64>(m_pendingOps), std::memory_order_relaxed);
+        m_pendingOps = 0;
+    }
+    return bufferTransform();
+}
+
+/**
+  @brief    drop a manipulation without effect, e.g. a translation by 0,0,0
+  **/
+void RT_object::elideOperation() {
+    m_bufferedOps++;
+    RT_metrics::elidedCounter()->fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+  @brief    apply the buffered manipulations of the transformation and the material
+  @return   1 if the object changed and its caches have to be uploaded, 0 otherwise
+
+  Called by the scene right before the caches are uploaded. A pending transformation that ends up
+  where the object already is (e.g. a translation and its inverse) is dropped, otherwise all buffered
+  manipulations but one count as elided.
+  **/
+int RT_object::flushPending() {
+    int changed = 0;
+    if (m_bTransformPending) {
+        int ops = m_pendingOps;
+        m_bTransformPending = false;
+        m_pendingOps = 0;
+        if (std::equal(m_transform.getData(), m_transform.getData() + 16, m_pendingTransform.getData())) {
+            RT_metrics::elidedCounter()->fetch_add(static_cast<quint64>(ops), std::memory_order_relaxed);
+        } else {
+            m_transform = m_pendingTransform;
+            m_bTransformCacheUpToDate = false;
+            RT_metrics::elidedCounter()->fetch_add(static_cast<quint64>(ops > 0 ? ops - 1 : 0), std::memory_order_relaxed);
+            changed = 1;
+        }
+    }
+    if (m_material != nullptr && m_material->flushPending() > 0) {
+        m_bTransformCacheUpToDate = false;
+        changed = 1;
+    }
+    return changed;
+}
+
+/**
+  @brief    add the state of the object that affects rendered images to a hash
+  @param    hash    hash of the scene state, see RT_scene::stateHash()
+
+  Covers the name, the creation type and parameters, the pose including buffered manipulations, the
+  visibility and the material. Subclasses add their own parameters after calling this implementation.
+  **/
+void RT_object::hashState(QCryptographicHash &hash) const {
+    rthelpers::hashString(hash, m_strName);
+    rthelpers::hashString(hash, m_createdType);
+    rthelpers::hashString(hash, m_createdParams);
+    rthelpers::hashData(hash, currentTransform().getData(), 16 * sizeof(float));
+    rthelpers::hashData(hash, &m_bVisible, sizeof(m_bVisible));
+    if (m_material != nullptr) {
+        m_material->hashState(hash);
+    }
+}
+
+/**
+  @brief    number of manipulations that went to the pending buffer (or were elided) since the object was created
+  @return   counter, compared before and after an action to see if the action needs flushPending()
+  **/
+unsigned int RT_object::bufferedOperations() const {
+    return m_bufferedOps + (m_material != nullptr ? m_material->bufferedOperations() : 0);
 }
 
 /*//////////////////////////////////
  Settings for material
 *//////////////////////////////////
 
+namespace {
+    /**
+      @brief    handler for actions taking a float triple, e.g. "1.0,2.0,3.0"
+      @param    setter  member called with the parsed values
+      **/
+    RT_object::ActionTable::Handler float3Action(void (RT_object::*setter)(float, float, float))
+    {
+        return [setter](RT_object &obj, const QString &parameters) {
+            float x, y, z;
+            if (0 != rthelpers::RT_parse_float3(parameters, &x, &y, &z)) {
+                spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1}", obj.m_strName.toUtf8().constData(), parameters.toUtf8().constData());
+                return -1;
+            }
+            (obj.*setter)(x, y, z);
+            return 0;
+        };
+    }
+}
+
+/**
+  @brief    actions of all scene objects
+  @return   the action table, derived classes start their tables with it
+  **/
+const RT_object::ActionTable& RT_object::actions() {
+    static const ActionTable table = [] {
+        ActionTable t;
+        t.add({"reset"}, [](RT_object &obj, const QString &) { obj.reset(); return 0; });
+        t.add({"move"}, float3Action(&RT_object::move));
+        t.add({"translate"}, float3Action(&RT_object::translate));
+        t.add({"setPosition"}, float3Action(&RT_object::setPosition));
+        t.add({"spin"}, float3Action(&RT_object::spin));
+        t.add({"rotate"}, float3Action(&RT_object::rotate));
+        t.add({"setName"}, [](RT_object &obj, const QString &parameters) {
+            if (parameters.isEmpty()) {
+                return -1;
+            }
+            obj.setName(parameters);
+            return 0;
+        });
+        t.add({"setVisible", "visible"}, [](RT_object &obj, const QString &parameters) {
+            bool ok;
+            bool visible = bool(parameters.toInt(&ok));
+            if (!ok) {
+                return -1;
+            }
+            obj.setVisible(visible);
+            return 0;
+        });
+        t.add({"transform"}, [](RT_object &obj, const QString &parameters) {
+            optix::Matrix4x4 mat;
+            rthelpers::RT_parse_matrix(parameters, &mat);
+            obj.transform(mat);  //matrix dimension check is performed by this fn
+            return 0;
+        });
+        t.add({"setTransformationMatrix"}, [](RT_object &obj, const QString &parameters) {
+            optix::Matrix4x4 mat = optix::Matrix4x4::identity();
+            rthelpers::RT_parse_matrix(parameters, &mat);
+            obj.setTransformationMatrix(mat);  //matrix dimension check is performed by this fn
+            return 0;
+        });
+        t.add({"setMaterialType", "setBRDF", "materialType", "brdf", "setMaterial", "Material"}, [](RT_object &obj, const QString &parameters) {
+            return obj.m_material->setMaterialTypeAction(parameters);
+        });
+        t.add({"setMaterialParameter", "materialParameter"}, [](RT_object &obj, const QString &parameters) {
+            return obj.m_material->setMaterialParameterAction(parameters);
+        });
+        return t;
+    }();
+    return table;
+}
+
 /**
   @brief    parse parameters
   @param    action  string describing action to perform
@@ -312,77 +521,5 @@ const optix::float3 RT_object::position() const {
   **/
 int RT_object::parseActions(const QString &action, const QString &parameters) {
     spdlog::debug("Parsing the following action to RT_object {0}: action={1}; parameters={2}", m_strName.toUtf8().constData(), action.toUtf8().constData(), parameters.toUtf8().constData());
-
-    if(0 == action.compare("reset", Qt::CaseInsensitive)) {
-        reset();
-    } else  if(0 == action.compare("move", Qt::CaseInsensitive)) {
-        float x,y,z;
-        if (0 == rthelpers::RT_parse_float3(parameters,&x,&y,&z)) {
-            move(x,y,z);
-        } else {
-            spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1} for action {2}", m_strName.toUtf8().constData(), parameters.toUtf8().constData(), action.toUtf8().constData());
-            return -1;
-        }
-    } else if(0 == action.compare("translate", Qt::CaseInsensitive)) {
-        float x,y,z;
-        if (0 == rthelpers::RT_parse_float3(parameters,&x,&y,&z)) {
-            translate(x,y,z);
-        } else {
-            spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1} for action {2}", m_strName.toUtf8().constData(), parameters.toUtf8().constData(), action.toUtf8().constData());
-            return -1;
-        }
-    } else if(0 == action.compare("setPosition", Qt::CaseInsensitive)) {
-        float x,y,z;
-        if (0 == rthelpers::RT_parse_float3(parameters,&x,&y,&z)) {
-            setPosition(x,y,z);
-        } else {
-            spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1} for action {2}", m_strName.toUtf8().constData(), parameters.toUtf8().constData(), action.toUtf8().constData());
-            return -1;
-        }
-    } else if(0 == action.compare("spin", Qt::CaseInsensitive)) {
-        float x,y,z;
-        if (0 == rthelpers::RT_parse_float3(parameters,&x,&y,&z)) {
-            spin(x,y,z);
-        } else {
-            spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1} for action {2}", m_strName.toUtf8().constData(), parameters.toUtf8().constData(), action.toUtf8().constData());
-            return -1;
-        }
-    } else if(0 == action.compare("rotate", Qt::CaseInsensitive)) {
-        float x, y, z;
-        if (0 == rthelpers::RT_parse_float3(parameters, &x, &y, &z)) {
-            rotate(x, y, z);
-        } else {
-            spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1} for action {2}", m_strName.toUtf8().constData(), parameters.toUtf8().constData(), action.toUtf8().constData());
-            return -1;
-        }
-    } else if(0 == action.compare("setName", Qt::CaseInsensitive)) {
-        if (!parameters.isEmpty()) {
-            setName(parameters);
-        } else {
-            spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1} for action {2}", m_strName.toUtf8().constData(), parameters.toUtf8().constData(), action.toUtf8().constData());
-            return -1;
-        }
-    } else if((0 == action.compare("setVisible", Qt::CaseInsensitive)) || (0 == action.compare("visible", Qt::CaseInsensitive))) {
-        bool ok;
-        bool visible = bool(parameters.toInt(&ok));
-        if (ok) {
-            setVisible(visible);
-        } else {
-            spdlog::debug("Error manipulating RT_object {0}, canot parse parameters {1} for action {2}", m_strName.toUtf8().constData(), parameters.toUtf8().constData(), action.toUtf8().constData());
-            return -1;
-        }
-    } else if(0 == action.compare("transform", Qt::CaseInsensitive)) {
-        optix::Matrix4x4 mat;
-        rthelpers::RT_parse_matrix(parameters, &mat);
-        transform(mat);  //matrix dimension check is performed by this fn
-    } else if(0 == action.compare("setTransformationMatrix", Qt::CaseInsensitive)) {
-        optix::Matrix4x4 mat = optix::Matrix4x4::identity();
-        rthelpers::RT_parse_matrix(parameters, &mat);
-        setTransformationMatrix(mat);  //matrix dimension check is performed by this fn
-    } else if (0 == action.compare("setMaterialType", Qt::CaseInsensitive) || 0 == action.compare("setBRDF", Qt::CaseInsensitive) || 0 == action.compare("materialType", Qt::CaseInsensitive) || 0 == action.compare("brdf", Qt::CaseInsensitive) || 0 == action.compare("setMaterial", Qt::CaseInsensitive) | 0 == action.compare("Material", Qt::CaseInsensitive)) {
-        return m_material->parseActions(action, parameters);
-    } else if (0 == action.compare("setMaterialParameter", Qt::CaseInsensitive) || 0 == action.compare("materialParameter", Qt::CaseInsensitive)) {
-        return m_material->parseActions(action, parameters);
-    }
-    return 0;
+    return actions().dispatch(action, *this, parameters);
 }
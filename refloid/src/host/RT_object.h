@@ -15,12 +15,17 @@
 #include <optixu/optixpp_namespace.h>
 #include <optixu/optixu_math_stream_namespace.h>
 #include <optixu_math_namespace.h>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QPair>
 #include <QString>
+#include <QVector>
 #include <spdlog.h>
 
 #include "RT_matrixHelpers.h"
 #include "RT_helper.h"
 #include "RT_material.h"
+#include "RT_actionTable.h"
 
 /**
   @brief    abstract base class for scene object
@@ -30,6 +35,8 @@
 class RT_object {
 
 public:
+    typedef RT_actionTable<RT_object, const QString&> ActionTable;
+
     // Object memory management
     RT_object(optix::Context &context, RT_object *parent = nullptr);
     virtual ~RT_object();
@@ -44,8 +51,13 @@ public:
     virtual bool isVisible() const;
 
     virtual int updateCache() = 0;                              //pure virtual function --> prevent base class init
+    virtual int updateTransformCache();                         //only upload a changed transformation, see sweeps
     virtual int parseActions(const QString& action, const QString& parameters);
+    static const ActionTable& actions();
     virtual bool upToDate() const;
+    virtual int flushPending();                                 //apply buffered manipulations, before uploading the caches
+    unsigned int bufferedOperations() const;
+    virtual void hashState(QCryptographicHash &hash) const;     //add everything that affects rendered images, see RT_scene::stateHash()
 
     virtual void reset();      //reset transformations to initial state (non-rotated at center)
 
@@ -67,15 +79,38 @@ public:
 
     virtual const optix::float3 position() const;
 
+protected:
+    const optix::Matrix4x4& currentTransform() const;
+    optix::Matrix4x4& bufferTransform();
+    optix::Matrix4x4& supersedeTransform();
+    void elideOperation();
+
 public:
     optix::Context &m_context;
     ///< transformation matrix of object
     optix::Matrix4x4 m_transform;
     ///< state if m_polyDataTransformed must be recalculated
     bool m_bTransformCacheUpToDate;
+    ///< transformation matrix after the manipulations buffered since the last flushPending()
+    optix::Matrix4x4 m_pendingTransform;
+    ///< state if m_pendingTransform holds manipulations not applied to m_transform yet
+    bool m_bTransformPending;
+    ///< number of manipulations composed into m_pendingTransform
+    int m_pendingOps;
+    ///< number of manipulations buffered or elided since construction, see bufferedOperations()
+    unsigned int m_bufferedOps;
 
     ///< readable name
     QString m_strName;
+    ///< object type and parameters the object was created with by RT_scene::createObject, e.g. "mesh" and a ply file
+    QString m_createdType;
+    QString m_createdParams;
+    ///< actions applied by the last RT_scene::syncScene, cleared when the object is manipulated otherwise
+    QVector< QPair<QString, QString> > m_syncedActions;
+    ///< hash of the triangles uploaded by the last RT_scene::syncScene, cleared like m_syncedActions
+    QByteArray m_syncedMesh;
+    ///< numeric handle assigned by the scene, used by the binary protocol (0 = not part of a scene)
+    unsigned int m_handle;
     ///< object material/color
     RT_material *m_material;
 
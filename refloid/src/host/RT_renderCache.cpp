@@ -0,0 +1,425 @@
+/**
+  @file     RT_renderCache.cpp
+  @brief    cache of rendered images keyed by the scene state they were rendered from
+
+  See RT_renderCache.h for the spill file layout
+**/
+
+#include "RT_renderCache.h"
+#include "RT_codec.h"
+#include "RT_metrics.h"
+
+#include <QDir>
+#include <QFile>
+#include <QtEndian>
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+
+namespace {
+    const char SpillMagic[4] = {'R', 'F', 'C', '1'};
+
+    ///< counters of the cache, resolved once so that lookups under m_mutex do not take the metrics mutex as well
+    struct CacheCounters {
+        std::atomic<quint64> *hits;
+        std::atomic<quint64> *misses;
+        std::atomic<quint64> *diskHits;
+        std::atomic<quint64> *spills;
+        std::atomic<quint64> *evictions;
+    };
+
+    const CacheCounters& counters()
+    {
+        static const CacheCounters c = {
+                RT_metrics::instance().counter("cache/hits"),
+                RT_metrics::instance().counter("cache/misses"),
+                RT_metrics::instance().counter("cache/diskHits"),
+                RT_metrics::instance().counter("cache/spills"),
+                RT_metrics::instance().counter("cache/evictions")
+        };
+        return c;
+    }
+
+    void appendUInt32(QByteArray &data, quint32 value)
+    {
+        uchar bytes[4];
+        qToLittleEndian<quint32>(value, bytes);
+        data.append(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    void appendString(QByteArray &data, const QString &str)
+    {
+        QByteArray utf8 = str.toUtf8();
+        appendUInt32(data, static_cast<quint32>(utf8.size()));
+        data.append(utf8);
+    }
+
+    ///< sequential little endian reader of a spill file, every read fails once the data is exhausted
+    class Reader
+    {
+    public:
+        explicit Reader(const QByteArray &data) : m_data(data), m_pos(0) {}
+
+        bool readUInt32(quint32 &value)
+        {
+            if (m_data.size() - m_pos < 4) {
+                return false;
+            }
+            value = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(m_data.constData()) + m_pos);
+            m_pos += 4;
+            return true;
+        }
+
+        bool readUInt64(quint64 &value)
+        {
+            if (m_data.size() - m_pos < 8) {
+                return false;
+            }
+            value = qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(m_data.constData()) + m_pos);
+            m_pos += 8;
+            return true;
+        }
+
+        bool readString(QString &str)
+        {
+            quint32 size = 0;
+            if (!readUInt32(size) || size > static_cast<quint32>(m_data.size() - m_pos)) {
+                return false;
+            }
+            str = QString::fromUtf8(m_data.constData() + m_pos, static_cast<int>(size));
+            m_pos += static_cast<int>(size);
+            return true;
+        }
+
+        ///< the next size bytes, nullptr if the data is shorter
+        const char* take(quint64 size)
+        {
+            if (size > static_cast<quint64>(m_data.size() - m_pos)) {
+                return nullptr;
+            }
+            const char *data = m_data.constData() + m_pos;
+            m_pos += static_cast<int>(size);
+            return data;
+        }
+
+    private:
+        const QByteArray &m_data;
+        int m_pos;
+    };
+}
+
+/**
+  @brief    memory held by the images of an entry
+  **/
+std::size_t RT_renderCache::Entry::bytes() const
+{
+    std::size_t size = 0;
+    for (int i=0; i<images.size(); i++) {
+        if (images.at(i)) {
+            size += images.at(i)->size();
+        }
+    }
+    return size;
+}
+
+RT_renderCache::RT_renderCache() :
+        m_memoryBudget(0),
+        m_memoryUsed(0),
+        m_diskBudget(0),
+        m_diskUsed(0)
+{
+}
+
+/**
+  @brief    set the budgets of the cache, all entries are dropped
+  @param    memory_budget   bytes of images kept in memory, 0 to disable the cache
+  @param    spill_directory directory entries pushed out of memory are written to, empty to drop them
+  @param    disk_budget     bytes of spill files, the oldest files are deleted beyond it
+  @return   0 on success, -1 if the spill directory cannot be created
+  **/
+int RT_renderCache::configure(std::size_t memory_budget, const QString &spill_directory, std::size_t disk_budget)
+{
+    clear();
+    if (memory_budget > 0 && !spill_directory.isEmpty() && !QDir().mkpath(spill_directory)) {
+        spdlog::error("Could not create the render cache spill directory {}", spill_directory.toUtf8().constData());
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_memoryBudget = memory_budget;
+    m_spillDirectory = (memory_budget > 0 && disk_budget > 0) ? spill_directory : QString();
+    m_diskBudget = m_spillDirectory.isEmpty() ? 0 : disk_budget;
+    spdlog::info("Render cache: {} MB in memory, {} MB spilled to \"{}\"", m_memoryBudget >> 20, m_diskBudget >> 20,
+                 m_spillDirectory.toUtf8().constData());
+    return 0;
+}
+
+bool RT_renderCache::isEnabled() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryBudget > 0;
+}
+
+/**
+  @brief    get the images rendered for a key
+  @param    key     scene state and job settings, see RT_renderThread::submit()
+  @param    entry   receives the images
+  @return   true on a hit; entries found on disk are moved back into memory
+  **/
+bool RT_renderCache::lookup(const QByteArray &key, Entry &entry)
+{
+    QString path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto slot = m_memory.find(key);
+        if (slot != m_memory.end()) {
+            m_memoryLru.splice(m_memoryLru.begin(), m_memoryLru, slot->lru);
+            entry = slot->entry;
+            counters().hits->fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        auto file = m_disk.find(key);
+        if (file == m_disk.end()) {
+            counters().misses->fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // The file belongs to this lookup from now on, it is read without holding the lock
+        m_diskUsed -= file->bytes;
+        m_diskLru.erase(file->lru);
+        m_disk.erase(file);
+        path = spillPath(m_spillDirectory, key);
+    }
+    int ret = readSpill(path, entry);
+    QFile::remove(path);
+    if (ret < 0) {
+        counters().misses->fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    counters().hits->fetch_add(1, std::memory_order_relaxed);
+    counters().diskHits->fetch_add(1, std::memory_order_relaxed);
+    insert(key, entry);
+    return true;
+}
+
+/**
+  @brief    add the images of a finished job
+  @param    key     scene state and job settings
+  @param    entry   the images, which must not be changed anymore
+
+  Entries larger than the memory budget are not cached. Entries pushed out of memory are written to
+  the spill directory after the lock is released, so lookups are not blocked by the disk.
+  **/
+void RT_renderCache::insert(const QByteArray &key, const Entry &entry)
+{
+    std::size_t bytes = entry.bytes();
+    QVector< QPair<QByteArray, Entry> > spilled;
+    QString spill_directory;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (bytes > m_memoryBudget) {
+            return;
+        }
+        auto slot = m_memory.find(key);
+        if (slot != m_memory.end()) {
+            m_memoryUsed -= slot->bytes;
+            m_memoryLru.erase(slot->lru);
+            m_memory.erase(slot);
+        }
+        dropDisk(key);
+        m_memoryLru.push_front(key);
+        MemorySlot added;
+        added.entry = entry;
+        added.bytes = bytes;
+        added.lru = m_memoryLru.begin();
+        m_memory.insert(key, added);
+        m_memoryUsed += bytes;
+        evict(spilled);
+        spill_directory = m_spillDirectory;
+    }
+
+    for (int i=0; i<spilled.size(); i++) {
+        const QByteArray &spilled_key = spilled.at(i).first;
+        QString path = spillPath(spill_directory, spilled_key);
+        std::size_t file_bytes = 0;
+        if (0 != writeSpill(path, spilled.at(i).second, file_bytes)) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // The cache may have been reconfigured or the key rendered again in the meantime
+        if (m_spillDirectory != spill_directory || file_bytes > m_diskBudget || m_memory.contains(spilled_key)) {
+            QFile::remove(path);
+            continue;
+        }
+        dropDisk(spilled_key);
+        m_diskLru.push_front(spilled_key);
+        DiskSlot slot;
+        slot.bytes = file_bytes;
+        slot.lru = m_diskLru.begin();
+        m_disk.insert(spilled_key, slot);
+        m_diskUsed += file_bytes;
+        counters().spills->fetch_add(1, std::memory_order_relaxed);
+        while (m_diskUsed > m_diskBudget && !m_diskLru.empty()) {
+            dropDisk(m_diskLru.back());
+        }
+    }
+}
+
+/**
+  @brief    drop all entries and delete the spill files
+  **/
+void RT_renderCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (!m_diskLru.empty()) {
+        dropDisk(m_diskLru.back());
+    }
+    m_memory.clear();
+    m_memoryLru.clear();
+    m_memoryUsed = 0;
+}
+
+QString RT_renderCache::spillPath(const QString &directory, const QByteArray &key)
+{
+    return directory + "/" + QString::fromLatin1(key.toHex()) + ".rfc";
+}
+
+/**
+  @brief    push the least recently used entries out of memory until the budget is kept
+  @param    spilled receives the entries to write to the spill directory
+
+  Must be called while holding m_mutex
+  **/
+void RT_renderCache::evict(QVector< QPair<QByteArray, Entry> > &spilled)
+{
+    while (m_memoryUsed > m_memoryBudget && !m_memoryLru.empty()) {
+        QByteArray key = m_memoryLru.back();
+        m_memoryLru.pop_back();
+        MemorySlot slot = m_memory.take(key);
+        m_memoryUsed -= slot.bytes;
+        counters().evictions->fetch_add(1, std::memory_order_relaxed);
+        if (!m_spillDirectory.isEmpty()) {
+            spilled.append(qMakePair(key, slot.entry));
+        }
+    }
+}
+
+/**
+  @brief    delete the spill file of a key, if there is one
+
+  Must be called while holding m_mutex
+  **/
+void RT_renderCache::dropDisk(const QByteArray &key)
+{
+    auto file = m_disk.find(key);
+    if (file == m_disk.end()) {
+        return;
+    }
+    m_diskUsed -= file->bytes;
+    m_diskLru.erase(file->lru);
+    m_disk.erase(file);
+    QFile::remove(spillPath(m_spillDirectory, key));
+}
+
+/**
+  @brief    write an entry to a spill file
+  @param    path    spill file
+  @param    entry   the images
+  @param    bytes   receives the size of the file
+  @return   0 on success, -1 if the file cannot be written
+  **/
+int RT_renderCache::writeSpill(const QString &path, const Entry &entry, std::size_t &bytes)
+{
+    QByteArray header(SpillMagic, sizeof(SpillMagic));
+    appendUInt32(header, static_cast<quint32>(entry.format));
+    appendUInt32(header, static_cast<quint32>(entry.cameras.size()));
+    appendUInt32(header, static_cast<quint32>(entry.imagePaths.size()));
+    appendUInt32(header, static_cast<quint32>(entry.images.size()));
+    for (int i=0; i<entry.cameras.size(); i++) {
+        appendString(header, entry.cameras.at(i).name);
+        appendUInt32(header, entry.cameras.at(i).width);
+        appendUInt32(header, entry.cameras.at(i).height);
+    }
+    for (int i=0; i<entry.imagePaths.size(); i++) {
+        appendString(header, entry.imagePaths.at(i));
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        spdlog::error("Could not write render cache spill file {}", path.toUtf8().constData());
+        return -1;
+    }
+    bool ok = (file.write(header) == header.size());
+    RT_codec::Layout layout = (entry.format == RT_renderJob::RGB32F) ? RT_codec::Rgb32f : RT_codec::Rgb8;
+    for (int i=0; ok && i<entry.images.size(); i++) {
+        std::vector<unsigned char> payload;
+        if (entry.images.at(i)) {
+            payload = RT_codec::compress(entry.images.at(i)->data(), entry.images.at(i)->size(), layout);
+        }
+        uchar size[8];
+        qToLittleEndian<quint64>(payload.size(), size);
+        ok = (file.write(reinterpret_cast<const char*>(size), 8) == 8)
+             && (file.write(reinterpret_cast<const char*>(payload.data()), static_cast<qint64>(payload.size())) == static_cast<qint64>(payload.size()));
+    }
+    bytes = static_cast<std::size_t>(file.size());
+    file.close();
+    if (!ok) {
+        spdlog::error("Could not write render cache spill file {}", path.toUtf8().constData());
+        QFile::remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+  @brief    read an entry from a spill file
+  @param    path    spill file
+  @param    entry   receives the images
+  @return   0 on success, -1 if the file cannot be read or is corrupt
+  **/
+int RT_renderCache::readSpill(const QString &path, Entry &entry)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    QByteArray data = file.readAll();
+    file.close();
+
+    Reader reader(data);
+    const char *magic = reader.take(sizeof(SpillMagic));
+    quint32 format = 0;
+    quint32 camera_count = 0;
+    quint32 path_count = 0;
+    quint32 image_count = 0;
+    bool ok = magic != nullptr && 0 == memcmp(magic, SpillMagic, sizeof(SpillMagic)) && reader.readUInt32(format)
+              && reader.readUInt32(camera_count) && reader.readUInt32(path_count) && reader.readUInt32(image_count);
+    entry = Entry();
+    entry.format = (format == RT_renderJob::RGB32F) ? RT_renderJob::RGB32F : RT_renderJob::RGB8;
+    for (quint32 i=0; ok && i<camera_count; i++) {
+        RT_renderJob::Camera cam;
+        cam.entryPoint = 0;
+        ok = reader.readString(cam.name) && reader.readUInt32(cam.width) && reader.readUInt32(cam.height);
+        entry.cameras.append(cam);
+    }
+    for (quint32 i=0; ok && i<path_count; i++) {
+        QString image_path;
+        ok = reader.readString(image_path);
+        entry.imagePaths << image_path;
+    }
+    for (quint32 i=0; ok && i<image_count; i++) {
+        quint64 size = 0;
+        const char *payload = reader.readUInt64(size) ? reader.take(size) : nullptr;
+        ok = (payload != nullptr);
+        if (!ok || size == 0) {
+            entry.images.append(RT_imageBufferPtr());
+            continue;
+        }
+        RT_imageBufferPtr image = std::make_shared<RT_imageBuffer>();
+        ok = (0 == RT_codec::decompress(payload, static_cast<std::size_t>(size), *image));
+        entry.images.append(image);
+    }
+    if (!ok) {
+        spdlog::error("Render cache spill file {} is corrupt", path.toUtf8().constData());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+  @file     RT_renderCache.h
+  @brief    cache of rendered images keyed by the scene state they were rendered from
+
+  Parameter searches often render the same scene state again. The render thread keys every job with
+  RT_scene::stateHash() and the job settings; a job whose key is cached finishes at once with the
+  cached images instead of being launched. Entries are kept in memory up to a budget, least recently
+  used first out. If a spill directory is set, entries pushed out of memory are written to it
+  (images compressed with RT_codec) up to a disk budget and loaded back on the next hit.
+
+  A spill file holds, all values little endian, strings as a uint32 byte count followed by UTF-8:
+
+    "RFC1", uint32 format, uint32 camera count, uint32 path count, uint32 image count,
+    per camera string name, uint32 width, uint32 height, per path string path,
+    per image uint64 payload size (0: not rendered) and the RT_codec payload
+**/
+
+#ifndef NSLAIFT_RT_RENDERCACHE_H
+#define NSLAIFT_RT_RENDERCACHE_H
+
+#include "RT_renderJob.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+
+class RT_renderCache
+{
+public:
+    ///< rendered output of one scene state
+    struct Entry {
+        RT_renderJob::Format format = RT_renderJob::RGB8;
+        QVector<RT_renderJob::Camera> cameras;
+        QVector<RT_imageBufferPtr> images;      ///< shared with the job that rendered them, never written again
+        QStringList imagePaths;                 ///< files of the job that rendered them, a hit saves the images to its own paths
+
+        std::size_t bytes() const;
+    };
+
+    RT_renderCache();
+
+    int configure(std::size_t memory_budget, const QString &spill_directory = QString(), std::size_t disk_budget = 0);
+    bool isEnabled() const;
+    bool lookup(const QByteArray &key, Entry &entry);
+    void insert(const QByteArray &key, const Entry &entry);
+    void clear();
+
+private:
+    typedef std::list<QByteArray> Lru;          ///< keys, most recently used first
+
+    struct MemorySlot {
+        Entry entry;
+        std::size_t bytes;
+        Lru::iterator lru;
+    };
+
+    struct DiskSlot {
+        std::size_t bytes;
+        Lru::iterator lru;
+    };
+
+    static QString spillPath(const QString &directory, const QByteArray &key);
+    static int writeSpill(const QString &path, const Entry &entry, std::size_t &bytes);
+    static int readSpill(const QString &path, Entry &entry);
+    void evict(QVector< QPair<QByteArray, Entry> > &spilled);
+    void dropDisk(const QByteArray &key);
+
+    mutable std::mutex m_mutex;                 ///< the session thread looks entries up, the render thread inserts them
+    std::size_t m_memoryBudget;
+    std::size_t m_memoryUsed;
+    std::size_t m_diskBudget;
+    std::size_t m_diskUsed;
+    QString m_spillDirectory;                   ///< empty to drop entries pushed out of memory
+    Lru m_memoryLru;
+    QHash<QByteArray, MemorySlot> m_memory;
+    Lru m_diskLru;
+    QHash<QByteArray, DiskSlot> m_disk;
+};
+
+#endif //NSLAIFT_RT_RENDERCACHE_H
@@ -0,0 +1,120 @@
+/**
+  @file     RT_renderJob.h
+  @brief    description and state of an asynchronous render job
+
+  Render jobs are created by the "render" and "sweep" commands and executed by RT_renderThread.
+  A time-boxed render ("renderFor") accumulates every camera as long as its share of the time budget
+  allows, the images then hold as many launches as fit (RT_renderJob::samples).
+  A sweep renders all cameras for every pose of one scene object, its images form a stack per camera.
+  A viewpoint search ("optimizeViewpoint") renders a single camera at low resolution and keeps no
+  images, only the scores of the poses it tried (RT_renderJob::result).
+  A batch render ("renderTrajectory") renders all cameras for every frame of a trajectory file and
+  writes the images as it goes, they are not kept with the job either.
+**/
+
+#ifndef NSLAIFT_RT_RENDERJOB_H
+#define NSLAIFT_RT_RENDERJOB_H
+
+#include "RT_imagePool.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+struct RT_viewpointSearch;
+
+struct RT_renderJob
+{
+    enum State {
+        Queued = 0,     ///< waiting for the render thread
+        Running = 1,    ///< launched on the gpu or writing images
+        Done = 2,       ///< all images are rendered and saved
+        Failed = 3,     ///< at least one camera could not be rendered or saved
+        Cancelled = 4   ///< cancelled before it finished, the images are dropped
+    };
+
+    enum Format {
+        RGB8 = 0,       ///< tone mapped output buffer, 3 bytes per pixel
+        RGB32F = 1      ///< accumulated radiance, 3 floats per pixel
+    };
+
+    ///< camera parameters captured when the job was submitted, the render thread never reads the scene objects
+    struct Camera {
+        QString name;
+        unsigned int entryPoint;
+        unsigned int width;
+        unsigned int height;
+        QString imagePath;              ///< tiff file the image (or the page per pose of a sweep) is saved to, empty if it is not saved
+    };
+
+    unsigned int id = 0;
+    State state = Queued;
+    int iterations = 1;             ///< accumulation launches per camera, the upper limit of a time-boxed render
+    int budgetMs = 0;               ///< time budget of a time-boxed render in milliseconds, 0 to always run all iterations
+    Format format = RGB8;
+    int streamEvery = 0;            ///< publish a preview every streamEvery iterations, 0 to not publish previews
+    int streamDownsample = 1;       ///< downsampling factor of the previews
+    bool stopRequested = false;     ///< accumulation is ended early, every camera still gets at least one launch
+    bool cancelRequested = false;   ///< the job ends after the current launch, nothing more is launched
+    QString sweepObject;            ///< object moved by a sweep, empty for a single render
+    QString sweepAction;            ///< manipulateObject action of the sweep, applied to the pose the object had before the sweep
+    QStringList poses;              ///< action parameters, one per pose of the sweep
+    QStringList cameraNames;        ///< cameras the job is limited to, all cameras of the scene if empty
+    std::shared_ptr<const RT_viewpointSearch> search;   ///< settings of a viewpoint search, null for renders and sweeps
+    QString trajectory;             ///< trajectory file of a batch render, see RT_trajectory; empty otherwise
+    QVector<Camera> cameras;
+    QVector<RT_imageBufferPtr> images;  ///< pixel data in the job format, rows from top to bottom, see image(); set when the job is done
+    QVector<int> samples;       ///< accumulation launches per image, in the order of images; set when the job is done
+    QStringList imagePaths;     ///< saved images, filled when the job is done
+    QByteArray cacheKey;        ///< scene state and settings the job renders, empty if the render cache is disabled
+    bool cached = false;        ///< the images were taken from the render cache, the job was never launched
+    bool saving = false;        ///< a cached job whose images are still saved, imagePaths is filled afterwards
+    QString result;             ///< JSON result of a viewpoint search or batch render, set when the job is done
+
+    bool isFinished() const { return state == Done || state == Failed || state == Cancelled; }
+    bool isSweep() const { return !sweepObject.isEmpty(); }
+    bool isSearch() const { return search != nullptr; }
+    bool isTrajectory() const { return !trajectory.isEmpty(); }
+    ///< poses whose images are kept with the job, 0 for searches and batch renders
+    int poseCount() const { return (isSearch() || isTrajectory()) ? 0 : (isSweep() ? poses.size() : 1); }
+
+    ///< image of a camera at a pose, null if it was not rendered
+    RT_imageBufferPtr image(int pose, int cam) const
+    {
+        int idx = pose * cameras.size() + cam;
+        return (idx >= 0 && idx < images.size()) ? images.at(idx) : RT_imageBufferPtr();
+    }
+
+    static const char* stateName(State state)
+    {
+        switch (state) {
+            case Queued: return "queued";
+            case Running: return "running";
+            case Done: return "done";
+            case Failed: return "failed";
+            case Cancelled: return "cancelled";
+        }
+        return "unknown";
+    }
+
+    static const int MaxTimedIterations = 65536;    ///< limit of the launches per camera of a time-boxed render
+
+    static const char* formatName(Format format)
+    {
+        return (format == RGB32F) ? "rgb32f" : "rgb8";
+    }
+
+    ///< format requested by a command, "rgb32f" or "float" for RGB32F, RGB8 otherwise
+    static Format formatFromName(const QString &name)
+    {
+        if (0 == name.compare("rgb32f", Qt::CaseInsensitive) || 0 == name.compare("float", Qt::CaseInsensitive)) {
+            return RGB32F;
+        }
+        return RGB8;
+    }
+};
+
+#endif //NSLAIFT_RT_RENDERJOB_H
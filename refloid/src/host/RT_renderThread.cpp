@@ -0,0 +1,1027 @@
+/**
+  @file     RT_renderThread.cpp
+  @brief    dedicated thread executing render jobs of a scene
+**/
+
+#include "RT_renderThread.h"
+#include "RT_scene.h"
+#include "RT_helper.h"
+#include "RT_metrics.h"
+#include "RT_viewpointSearch.h"
+#include "RT_trajectory.h"
+
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <tiffio.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+
+namespace {
+    const std::size_t FramesInFlight = 4;      ///< frames queued between two stages of a batch render
+
+    ///< bounded queue between two stages of a batch render, push() blocks while it is full and pop() while it is empty
+    template<class T>
+    class StageQueue
+    {
+    public:
+        explicit StageQueue(std::size_t capacity) : m_capacity(capacity), m_closed(false) {}
+
+        ///< @return false if the queue was closed, the value is dropped then
+        bool push(T value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notFull.wait(lock, [this]() { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed) {
+                return false;
+            }
+            m_items.push_back(std::move(value));
+            m_notEmpty.notify_one();
+            return true;
+        }
+
+        ///< @return false once the queue is closed and empty
+        bool pop(T &value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this]() { return m_closed || !m_items.empty(); });
+            if (m_items.empty()) {
+                return false;
+            }
+            value = std::move(m_items.front());
+            m_items.pop_front();
+            m_notFull.notify_one();
+            return true;
+        }
+
+        ///< no more values are accepted, the queued ones can still be popped
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_notFull.notify_all();
+            m_notEmpty.notify_all();
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_notFull;
+        std::condition_variable m_notEmpty;
+        std::deque<T> m_items;
+        std::size_t m_capacity;
+        bool m_closed;
+    };
+
+    ///< images of one frame of a batch render, handed from the launch stage to the writer stage
+    struct RenderedFrame {
+        int index = -1;
+        QVector<RT_imageBufferPtr> images;  ///< per camera of the job, null if the launch failed
+    };
+}
+
+/**
+  @brief    start the render thread
+  @param    scene           scene that is rendered
+  @param    zmq_context     context used for the event socket
+  @param    event_endpoint      inproc endpoint the owner of this thread has bound a ZMQ_PULL socket to
+  @param    preview_endpoint    inproc endpoint previews are pushed to, empty to not send previews
+  @param    preview_prefix      put in front of every preview header
+  **/
+RT_renderThread::RT_renderThread(RT_scene *scene, zmq::context_t &zmq_context, const std::string &event_endpoint,
+                                 const std::string &preview_endpoint, const QString &preview_prefix) :
+        m_scene(scene),
+        m_zmqContext(zmq_context),
+        m_eventEndpoint(event_endpoint),
+        m_previewEndpoint(preview_endpoint),
+        m_previewPrefix(preview_prefix),
+        m_launchTimes("camera/", "/launch"),
+        m_readbackTimes("camera/", "/readback"),
+        m_tiffTimes("camera/", "/tiff"),
+        m_nextJobId(1),
+        m_runningJob(0),
+        m_stop(false),
+        m_launchesPending(0),
+        m_stopRunning(false),
+        m_cancelRunning(false)
+{
+    m_thread = std::thread(&RT_renderThread::run, this);
+}
+
+/**
+  @brief    stop the render thread, queued jobs are dropped
+  **/
+RT_renderThread::~RT_renderThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        m_stop = true;
+    }
+    m_jobsCondition.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+/**
+  @brief    queue a render job for all cameras of the scene or the ones named in the settings (only the
+            scored camera for a viewpoint search)
+  @param    settings    iterations, format, preview, sweep and search settings of the job
+  @return   id of the new job
+
+  Must be called while holding RT_scene::m_mutex and after RT_scene::updateCaches(). The camera
+  parameters and image paths are captured here, later changes of the scene do not affect the job.
+  If the render cache holds the images of the same scene state and settings, the job is finished
+  right away with them (RT_renderJob::cached) and never launched. The render thread then saves the
+  images to the paths of this job (RT_renderJob::saving), so a hit does not wait for the tiff writer.
+  Time-boxed renders are not cached, their images depend on the speed of the launches.
+  **/
+unsigned int RT_renderThread::submit(const RT_renderJob &settings)
+{
+    RT_renderJob job;
+    job.iterations = settings.iterations;
+    job.budgetMs = settings.budgetMs;
+    job.format = settings.format;
+    job.streamEvery = settings.streamEvery;
+    job.streamDownsample = settings.streamDownsample;
+    job.sweepObject = settings.sweepObject;
+    job.sweepAction = settings.sweepAction;
+    job.poses = settings.poses;
+    job.cameraNames = settings.cameraNames;
+    job.search = settings.search;
+    job.trajectory = settings.trajectory;
+    for (int cam_idx=0; cam_idx<m_scene->countCameras(); cam_idx++) {
+        RT_camera *cam = m_scene->camera(cam_idx);
+        // A viewpoint search only launches the camera it scores and saves no images
+        if (job.isSearch() && cam->m_strName != job.search->camera) {
+            continue;
+        }
+        if (!settings.cameraNames.isEmpty() && !settings.cameraNames.contains(cam->m_strName)) {
+            continue;
+        }
+        RT_renderJob::Camera job_cam;
+        job_cam.name = cam->m_strName;
+        job_cam.entryPoint = cam->m_iCameraIdx;
+        job_cam.width = cam->m_iWidth;
+        job_cam.height = cam->m_iHeight;
+        if (job.isTrajectory()) {
+            // Pattern of the frame images, "%1" is replaced by the frame number
+            job_cam.imagePath = m_scene->imageDirectory().isEmpty() ? QString()
+                                : m_scene->imageDirectory() + "/frame_%1_" + cam->m_strName + ".tif";
+        } else {
+            job_cam.imagePath = job.isSearch() ? QString() : m_scene->nextImagePath(cam->m_strName);
+        }
+        job.cameras.push_back(job_cam);
+    }
+
+    if (m_cache.isEnabled() && !settings.isSearch() && !settings.isTrajectory() && settings.budgetMs <= 0) {
+        job.cacheKey = cacheKey(settings);
+        RT_renderCache::Entry entry;
+        // The same scene state and settings give the same cameras, the check only guards against hash collisions
+        if (m_cache.lookup(job.cacheKey, entry) && entry.cameras.size() == job.cameras.size()) {
+            job.state = RT_renderJob::Done;
+            job.cached = true;
+            job.format = entry.format;
+            job.images = entry.images;
+            job.samples = QVector<int>(entry.images.size(), settings.iterations);
+            // The render thread saves the cached images to the paths of this job, like those of a launched job
+            for (int i=0; i<job.cameras.size(); i++) {
+                job.saving = job.saving || (job.format == RT_renderJob::RGB8 && !job.cameras.at(i).imagePath.isEmpty());
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_jobsMutex);
+                job.id = m_nextJobId++;
+                m_jobs.insert(job.id, job);
+                retire(job.id);
+                if (job.saving) {
+                    m_saves.push_back(job.id);
+                }
+            }
+            if (job.saving) {
+                m_jobsCondition.notify_one();
+            }
+            static std::atomic<quint64> *const cached = RT_metrics::instance().counter("jobs/cached");
+            cached->fetch_add(1, std::memory_order_relaxed);
+            spdlog::info("Render job {} is served from the render cache", job.id);
+            return job.id;
+        }
+    }
+
+    m_launchesPending++;
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        job.id = m_nextJobId++;
+        m_jobs.insert(job.id, job);
+        m_queue.push_back(job.id);
+    }
+    m_jobsCondition.notify_one();
+    spdlog::info("Queued render job {} with {} cameras and {} poses", job.id, job.cameras.size(), job.poseCount());
+    return job.id;
+}
+
+/**
+  @brief    get a copy of the current state of a job
+  @param    id  job id as returned by submit()
+  @param    job target for the job state
+  @return   false if the job is not known (never submitted or already dropped)
+  **/
+bool RT_renderThread::job(unsigned int id, RT_renderJob &job) const
+{
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+    if (!m_jobs.contains(id)) {
+        return false;
+    }
+    job = m_jobs.value(id);
+    return true;
+}
+
+/**
+  @brief    end the accumulation of a job early
+  @param    id  job id as returned by submit()
+  @return   0 on success, -1 if the job is not known, -3 if it is already finished
+
+  The images of the iterations rendered so far are kept. Cameras that are not launched yet get a single launch,
+  the remaining poses of a sweep, candidates of a viewpoint search and frames of a batch render are not rendered.
+  **/
+int RT_renderThread::stop(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+    if (!m_jobs.contains(id)) {
+        return -1;
+    }
+    RT_renderJob &job = m_jobs[id];
+    if (job.isFinished()) {
+        return -3;
+    }
+    job.stopRequested = true;
+    if (id == m_runningJob) {
+        m_stopRunning = true;
+    }
+    spdlog::info("Stopping render job {}", id);
+    return 0;
+}
+
+/**
+  @brief    cancel a queued or running job
+  @param    id  job id as returned by submit()
+  @return   0 on success, -1 if the job is not known, -3 if it is already finished
+
+  A running job ends after the launch in progress, a single launch cannot be interrupted. A queued
+  job is never launched. Cancelled jobs keep no images; images a sweep has already saved stay on disk.
+  **/
+int RT_renderThread::cancel(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+    if (!m_jobs.contains(id)) {
+        return -1;
+    }
+    RT_renderJob &job = m_jobs[id];
+    if (job.isFinished()) {
+        return -3;
+    }
+    requestCancel(job);
+    return 0;
+}
+
+/**
+  @brief    cancel the running job and all queued jobs, see cancel()
+  @return   number of cancelled jobs
+  **/
+int RT_renderThread::cancelAll()
+{
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+    int count = 0;
+    if (m_runningJob != 0 && !m_jobs[m_runningJob].cancelRequested) {
+        requestCancel(m_jobs[m_runningJob]);
+        count++;
+    }
+    for (unsigned int id : m_queue) {
+        if (!m_jobs[id].cancelRequested) {
+            requestCancel(m_jobs[id]);
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+  @brief    mark a job as cancelled, the render thread drops it when it gets to it
+
+  Must be called while holding m_jobsMutex
+  **/
+void RT_renderThread::requestCancel(RT_renderJob &job)
+{
+    job.cancelRequested = true;
+    if (job.id == m_runningJob) {
+        m_cancelRunning = true;
+        m_stopRunning = true;
+    }
+    spdlog::info("Cancelling render job {}", job.id);
+}
+
+/**
+  @brief    check whether a submitted job still needs the optix context
+  @return   true from the submission of a job until its last launch was read back, scene commands
+            must not touch the scene until then
+  **/
+bool RT_renderThread::isLaunching() const
+{
+    return m_launchesPending > 0;
+}
+
+/**
+  @brief    render cache of the jobs, disabled until it is configured
+  **/
+RT_renderCache& RT_renderThread::cache()
+{
+    return m_cache;
+}
+
+/**
+  @brief    key of a job in the render cache: the scene state and the settings that change the images
+  @param    settings    iterations, format and sweep settings of the job
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+QByteArray RT_renderThread::cacheKey(const RT_renderJob &settings) const
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(m_scene->stateHash());
+    rthelpers::hashData(hash, &settings.iterations, sizeof(settings.iterations));
+    rthelpers::hashData(hash, &settings.format, sizeof(settings.format));
+    rthelpers::hashString(hash, settings.sweepObject);
+    rthelpers::hashString(hash, settings.sweepAction);
+    for (int i=0; i<settings.poses.size(); i++) {
+        rthelpers::hashString(hash, settings.poses.at(i));
+    }
+    for (int i=0; i<settings.cameraNames.size(); i++) {
+        rthelpers::hashString(hash, settings.cameraNames.at(i));
+    }
+    return hash.result();
+}
+
+/**
+  @brief    add a finished job to the finished jobs, the oldest ones are dropped with their images
+
+  Must be called while holding m_jobsMutex
+  **/
+void RT_renderThread::retire(unsigned int id)
+{
+    m_finished.push_back(id);
+    while (m_finished.size() > MaxFinishedJobs) {
+        m_jobs.remove(m_finished.front());
+        m_finished.pop_front();
+    }
+}
+
+void RT_renderThread::notify(zmq::socket_t &events, unsigned int id)
+{
+    zmq::message_t msg(sizeof(id));
+    memcpy(msg.data(), &id, sizeof(id));
+    events.send(msg);
+}
+
+/**
+  @brief    read back the current accumulation state of a camera and send it as preview
+  @param    previews    ZMQ_PUSH socket
+  @param    job         running job
+  @param    cam         camera that is launched
+  @param    iteration   number of finished launches of the camera
+
+  Must be called from within RT_scene::launchCamera()
+  **/
+void RT_renderThread::publishPreview(zmq::socket_t &previews, const RT_renderJob &job, const RT_renderJob::Camera &cam, int iteration)
+{
+    unsigned int factor = (job.streamDownsample > 1) ? static_cast<unsigned int>(job.streamDownsample) : 1;
+    unsigned int width = cam.width;
+    unsigned int height = cam.height;
+    RT_imageBufferPtr image = m_imagePool.acquire(3 * width * height);
+    m_scene->readOutput(*image);
+    if (factor > 1) {
+        RT_imageBufferPtr small = m_imagePool.acquire(3 * (width / factor) * (height / factor));
+        rthelpers::downsampleRGB8(*image, cam.width, cam.height, factor, *small, width, height);
+        image = small;
+    }
+
+    QByteArray header = QString("%1%2;%3;%4;%5;%6;rgb8").arg(m_previewPrefix).arg(cam.name).arg(job.id).arg(iteration)
+            .arg(width).arg(height).toUtf8();
+    zmq::message_t header_frame(header.constData(), header.size());
+    zmq::message_t pixel_frame(image->data(), image->size(), &RT_imagePool::zmqFree, RT_imagePool::zmqHint(image));
+    // Drop the preview if the queue is full, the launches are never blocked. Once the first
+    // frame is queued, ZMQ accepts the rest of the multipart message.
+    if (previews.send(header_frame, ZMQ_SNDMORE | ZMQ_DONTWAIT)) {
+        previews.send(pixel_frame);
+    }
+}
+
+/**
+  @brief    open the multi-page tiff files of a sweep, one per camera
+  @param    job     sweep job
+  @param    paths   the paths of the opened files are appended
+  @return   file handle per camera, nullptr if the camera is not saved
+  **/
+QVector<TIFF*> RT_renderThread::openStacks(const RT_renderJob &job, QStringList &paths)
+{
+    QVector<TIFF*> stacks(job.cameras.size(), nullptr);
+    if (!job.isSweep() || job.format != RT_renderJob::RGB8) {
+        return stacks;
+    }
+    for (int i=0; i<job.cameras.size(); i++) {
+        const QString &path = job.cameras.at(i).imagePath;
+        if (path.isEmpty()) {
+            continue;
+        }
+        stacks[i] = TIFFOpen(path.toStdString().c_str(), "w");
+        if (stacks[i] == nullptr) {
+            spdlog::error("Was not able to open tiff file with path: {}", path.toUtf8().constData());
+        } else {
+            paths << path;
+        }
+    }
+    return stacks;
+}
+
+/**
+  @brief    save the images of one pose of a job
+  @param    job     running job
+  @param    pose    pose the images were rendered for, 0 for single renders
+  @param    stacks  tiff files of a sweep as returned by openStacks()
+  @param    paths   the paths of saved single images are appended
+  @return   true on success
+
+  Runs in parallel to the launches of the next pose, it only reads the images of the given pose.
+  **/
+bool RT_renderThread::saveImages(const RT_renderJob &job, int pose, const QVector<TIFF*> &stacks, QStringList &paths)
+{
+    // Float images are only sent to clients, the tiff writer expects RGB8
+    if (job.format != RT_renderJob::RGB8) {
+        return true;
+    }
+    bool ok = true;
+    for (int i=0; i<job.cameras.size(); i++) {
+        const RT_renderJob::Camera &cam = job.cameras.at(i);
+        RT_imageBufferPtr image = job.image(pose, i);
+        if (!image || cam.imagePath.isEmpty()) {
+            continue;
+        }
+        RT_metrics::Timer timer(m_tiffTimes.histogram(cam.name));
+        if (job.isSweep()) {
+            if (stacks.at(i) == nullptr || 0 != rthelpers::writeTiffPage(stacks.at(i), *image, cam.width, cam.height, pose, job.poseCount())) {
+                ok = false;
+            }
+            continue;
+        }
+        spdlog::debug("Saving the rendered data from {} as tiff image in path: {}", cam.name.toUtf8().constData(), cam.imagePath.toUtf8().constData());
+        if (0 == rthelpers::writeTiff(cam.imagePath, *image, cam.width, cam.height)) {
+            paths << cam.imagePath;
+        } else {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+  @brief    save the images of a job served from the render cache to the paths of the job
+  @param    events  ZMQ_PUSH socket of the render thread, the job is announced once it is saved
+  @param    job     cached job, see submit()
+
+  Runs on the render thread between launched jobs, a failed write fails the job like for a launched job.
+  **/
+void RT_renderThread::saveCached(zmq::socket_t &events, const RT_renderJob &job)
+{
+    QStringList paths;
+    QVector<TIFF*> stacks = openStacks(job, paths);
+    bool ok = true;
+    for (int pose=0; pose<job.poseCount(); pose++) {
+        ok = saveImages(job, pose, stacks, paths) && ok;
+    }
+    for (int i=0; i<stacks.size(); i++) {
+        if (stacks.at(i) != nullptr) {
+            TIFFClose(stacks.at(i));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        if (m_jobs.contains(job.id)) {
+            RT_renderJob &stored = m_jobs[job.id];
+            stored.imagePaths = paths;
+            stored.saving = false;
+            stored.state = ok ? RT_renderJob::Done : RT_renderJob::Failed;
+        }
+    }
+    spdlog::info("Saved the cached images of render job {}{}", job.id, ok ? "" : ", some could not be written");
+    notify(events, job.id);
+}
+
+/**
+  @brief    run a viewpoint search, see RT_viewpointSearch
+  @param    job     running search job, receives the result
+  @return   true if every candidate could be applied and rendered
+
+  Like a sweep, RT_scene::m_mutex is only held while a candidate is applied and launched. The scored
+  camera renders at the low resolution of the search until the end, the object is moved back to the
+  pose it had before. The image of a candidate is scored while the next candidate is launched.
+  **/
+bool RT_renderThread::runSearch(RT_renderJob &job)
+{
+    const RT_viewpointSearch &search = *job.search;
+    if (job.cameras.size() != 1) {
+        spdlog::error("Render job {}: camera \"{}\" of the search not found", job.id, search.camera.toUtf8().constData());
+        return false;
+    }
+    const RT_renderJob::Camera &cam = job.cameras.at(0);
+    unsigned int factor = static_cast<unsigned int>(search.downsample);
+    unsigned int width = std::max(1u, cam.width / factor);
+    unsigned int height = std::max(1u, cam.height / factor);
+    RT_roi roi = search.roi;
+    roi.x /= factor;
+    roi.y /= factor;
+    roi.width = (roi.width + factor - 1) / factor;
+    roi.height = (roi.height + factor - 1) / factor;
+
+    RT_object *object = nullptr;
+    RT_camera *camera = nullptr;
+    optix::Matrix4x4 start_transform = optix::Matrix4x4::identity();
+    optix::Matrix4x4 full_K;
+    {
+        std::lock_guard<std::mutex> scene_lock(m_scene->m_mutex);
+        object = m_scene->findObject(search.object);
+        int cam_idx = m_scene->cameraIndex(cam.name);
+        if (object == nullptr || cam_idx < 0) {
+            spdlog::error("Render job {}: object \"{}\" of the search not found", job.id, search.object.toUtf8().constData());
+            return false;
+        }
+        camera = m_scene->camera(cam_idx);
+        start_transform = object->transformationMatrix();
+        full_K = camera->m_K;
+        if (factor > 1) {
+            // Scaling fx, fy, cx and cy with the resolution keeps the field of view
+            optix::Matrix4x4 K = full_K;
+            float *k = K.getData();
+            k[0] /= factor;
+            k[2] /= factor;
+            k[5] /= factor;
+            k[6] /= factor;
+            camera->setResolution(width, height);
+            camera->setIntrinsics(K);
+            camera->updateCache();
+        }
+    }
+
+    bool ok = true;
+    QVector<RT_viewpointSearch::Candidate> evaluated;
+    QHash<QString, int> known;          // every round revisits the center of its box
+    QVector<double> lower = search.lower;
+    QVector<double> upper = search.upper;
+    std::future<void> scoring;          // score of the previous candidate, computed while the next one is launched
+    for (int round=0; round<search.rounds && ok && !m_stopRunning; round++) {
+        QStringList poses = search.candidates(lower, upper);
+        for (int i=0; i<poses.size() && !m_stopRunning; i++) {
+            const QString &pose = poses.at(i);
+            if (known.contains(pose)) {
+                continue;
+            }
+            RT_imageBufferPtr image = m_imagePool.acquire(3 * width * height);
+            {
+                std::lock_guard<std::mutex> scene_lock(m_scene->m_mutex);
+                object->setTransformationMatrix(start_transform);
+                int ret = m_scene->manipulateObject(object, search.action, pose);
+                object->flushPending();
+                if (0 != ret || 0 != object->updateTransformCache()) {
+                    spdlog::error("Render job {}: could not apply candidate \"{}\"", job.id, pose.toUtf8().constData());
+                    ok = false;
+                    break;
+                }
+                try {
+                    if (m_scene->launchCamera(cam.entryPoint, width, height, job.iterations, *image, false,
+                                              [this](int) { return !m_stopRunning; },
+                                              m_launchTimes.histogram(cam.name), m_readbackTimes.histogram(cam.name)) <= 0) {
+                        ok = false;
+                    }
+                } catch (const std::exception &e) {
+                    spdlog::error("Render job {} failed for camera {}: {}", job.id, cam.name.toUtf8().constData(), e.what());
+                    ok = false;
+                }
+            }
+            if (!ok) {
+                break;
+            }
+            if (scoring.valid()) {
+                scoring.get();
+            }
+            int idx = evaluated.size();
+            evaluated.append(RT_viewpointSearch::Candidate());
+            evaluated[idx].pose = pose;
+            known.insert(pose, idx);
+            static std::atomic<quint64> *const candidates = RT_metrics::instance().counter("search/candidates");
+            candidates->fetch_add(1, std::memory_order_relaxed);
+            scoring = std::async(std::launch::async, [&, image, idx]() {
+                RT_viewpointSearch::Candidate &candidate = evaluated[idx];
+                candidate.stats = RT_imageStats::compute(*image, width, height, RT_renderJob::RGB8, roi, 1);
+                candidate.score = search.value(candidate.stats);
+            });
+        }
+        if (scoring.valid()) {
+            scoring.get();
+        }
+        if (evaluated.isEmpty()) {
+            break;
+        }
+        int best = 0;
+        for (int i=1; i<evaluated.size(); i++) {
+            if (evaluated.at(i).score < evaluated.at(best).score) {
+                best = i;
+            }
+        }
+        search.shrink(evaluated.at(best).pose, lower, upper);
+    }
+
+    {
+        std::lock_guard<std::mutex> scene_lock(m_scene->m_mutex);
+        object->setTransformationMatrix(start_transform);
+        object->flushPending();
+        object->updateTransformCache();
+        if (factor > 1) {
+            camera->setResolution(cam.width, cam.height);
+            camera->setIntrinsics(full_K);
+            camera->updateCache();
+        }
+    }
+    QJsonObject json = search.toJson(evaluated);
+    json.insert("job", static_cast<double>(job.id));
+    job.result = QString::fromUtf8(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    spdlog::info("Render job {}: evaluated {} candidates of the search", job.id, evaluated.size());
+    return ok;
+}
+
+/**
+  @brief    run a batch render of a trajectory file, see RT_trajectory
+  @param    job     running batch render, receives the summary of the frames
+  @return   true if every frame could be read, applied, rendered and written
+
+  The frames pass three stages on their own threads, connected by queues of FramesInFlight frames:
+  a reader thread parses the file, this thread applies the poses of a frame, uploads the changed
+  transforms and launches and reads back all cameras, and a writer thread encodes and writes the
+  tiff files. Reading and writing therefore overlap with the launches, which are serialized on the
+  optix context anyway. RT_scene::m_mutex is held for one frame at a time like in a sweep. The
+  objects are moved back to the poses they had before at the end.
+  **/
+bool RT_renderThread::runTrajectory(RT_renderJob &job)
+{
+    RT_trajectory trajectory;
+    if (0 != trajectory.open(job.trajectory)) {
+        return false;
+    }
+    StageQueue<RT_trajectory::Frame> frames(FramesInFlight);
+    StageQueue<RenderedFrame> rendered(FramesInFlight);
+    std::atomic<bool> read_failed(false);
+    std::thread reader([&]() {
+        RT_trajectory::Frame frame;
+        int ret = 0;
+        while ((ret = trajectory.next(frame)) > 0) {
+            if (!frames.push(frame)) {
+                break;
+            }
+        }
+        read_failed = (ret < 0);
+        frames.close();
+    });
+
+    int written = 0;
+    int write_failed = 0;
+    std::thread writer([&]() {
+        RenderedFrame frame;
+        while (rendered.pop(frame)) {
+            for (int i=0; i<job.cameras.size(); i++) {
+                const RT_renderJob::Camera &cam = job.cameras.at(i);
+                if (!frame.images.at(i) || cam.imagePath.isEmpty()) {
+                    continue;
+                }
+                static RT_histogram *const write_times = RT_metrics::instance().histogram("trajectory/write");
+                RT_metrics::Timer timer(write_times);
+                QString path = cam.imagePath.arg(frame.index, 6, 10, QChar('0'));
+                if (0 == rthelpers::writeTiff(path, *frame.images.at(i), cam.width, cam.height)) {
+                    written++;
+                } else {
+                    write_failed++;
+                }
+            }
+        }
+    });
+
+    bool ok = true;
+    int frame_count = 0;
+    QHash<RT_object*, optix::Matrix4x4> start_transforms;     // every object the trajectory moved
+    QVector<RT_object*> moved;                              // objects moved by the last frame
+    RT_trajectory::Frame frame;
+    while (!m_stopRunning && frames.pop(frame)) {
+        RenderedFrame output;
+        output.index = frame.index;
+        output.images.resize(job.cameras.size());
+        {
+            std::lock_guard<std::mutex> scene_lock(m_scene->m_mutex);
+            {
+                static RT_histogram *const apply_times = RT_metrics::instance().histogram("trajectory/apply");
+                RT_metrics::Timer timer(apply_times);
+                // Objects of the previous frame go back to their start pose, those of this frame are moved from there
+                QVector<RT_object*> touched = moved;
+                for (int i=0; i<moved.size(); i++) {
+                    moved.at(i)->setTransformationMatrix(start_transforms.value(moved.at(i)));
+                }
+                moved.clear();
+                for (int i=0; i<frame.actions.size(); i++) {
+                    const RT_trajectory::Action &action = frame.actions.at(i);
+                    RT_object *object = m_scene->findObject(action.object);
+                    if (object != nullptr && !start_transforms.contains(object)) {
+                        start_transforms.insert(object, object->transformationMatrix());
+                    }
+                    if (object == nullptr || 0 != m_scene->manipulateObject(object, action.action, action.parameters)) {
+                        spdlog::error("Render job {}: could not apply \"{};{}\" of frame {}", job.id, action.object.toUtf8().constData(),
+                                      action.action.toUtf8().constData(), frame.index);
+                        ok = false;
+                        continue;
+                    }
+                    if (!moved.contains(object)) {
+                        moved << object;
+                    }
+                    if (!touched.contains(object)) {
+                        touched << object;
+                    }
+                }
+                for (int i=0; i<touched.size(); i++) {
+                    touched.at(i)->flushPending();
+                    if (0 != touched.at(i)->updateTransformCache()) {
+                        ok = false;
+                    }
+                }
+            }
+            for (int i=0; i<job.cameras.size() && !m_cancelRunning; i++) {
+                const RT_renderJob::Camera &cam = job.cameras.at(i);
+                RT_imageBufferPtr image = m_imagePool.acquire(3 * cam.width * cam.height);
+                try {
+                    if (m_scene->launchCamera(cam.entryPoint, cam.width, cam.height, job.iterations, *image, false,
+                                              [this](int) { return !m_stopRunning; },
+                                              m_launchTimes.histogram(cam.name), m_readbackTimes.histogram(cam.name)) > 0) {
+                        output.images[i] = image;
+                    } else {
+                        ok = false;
+                    }
+                } catch (const std::exception &e) {
+                    spdlog::error("Render job {} failed for camera {}: {}", job.id, cam.name.toUtf8().constData(), e.what());
+                    ok = false;
+                }
+            }
+        }
+        frame_count++;
+        static std::atomic<quint64> *const frames = RT_metrics::instance().counter("trajectory/frames");
+        frames->fetch_add(1, std::memory_order_relaxed);
+        rendered.push(output);
+    }
+    // Stops the reader if the job was stopped, the writer finishes the frames already rendered
+    frames.close();
+    rendered.close();
+    reader.join();
+    writer.join();
+
+    {
+        std::lock_guard<std::mutex> scene_lock(m_scene->m_mutex);
+        for (auto it = start_transforms.begin(); it != start_transforms.end(); ++it) {
+            it.key()->setTransformationMatrix(it.value());
+            it.key()->flushPending();
+            it.key()->updateTransformCache();
+        }
+    }
+    if (read_failed) {
+        spdlog::error("Render job {}: the trajectory \"{}\" is malformed in line {}", job.id, job.trajectory.toUtf8().constData(),
+                      trajectory.line());
+    }
+    QJsonObject json;
+    json.insert("job", static_cast<double>(job.id));
+    json.insert("frames", frame_count);
+    json.insert("written", written);
+    json.insert("failed", write_failed);
+    job.result = QString::fromUtf8(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    spdlog::info("Render job {}: rendered {} frames of the trajectory, wrote {} images", job.id, frame_count, written);
+    return ok && !read_failed && write_failed == 0;
+}
+
+void RT_renderThread::run()
+{
+    zmq::socket_t events(m_zmqContext, ZMQ_PUSH);
+    events.connect(m_eventEndpoint);
+
+    std::unique_ptr<zmq::socket_t> previews;
+    if (!m_previewEndpoint.empty()) {
+        previews.reset(new zmq::socket_t(m_zmqContext, ZMQ_PUSH));
+        int hwm = 16;
+        previews->setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+        previews->connect(m_previewEndpoint);
+    }
+
+    while (true) {
+        RT_renderJob job;
+        bool save = false;
+        {
+            std::unique_lock<std::mutex> lock(m_jobsMutex);
+            while (!m_stop && m_queue.empty() && m_saves.empty()) {
+                m_jobsCondition.wait(lock);
+            }
+            if (m_stop) {
+                break;
+            }
+            if (!m_saves.empty()) {
+                save = true;
+                // A default job without id if it was dropped with the oldest finished jobs in the meantime
+                job = m_jobs.value(m_saves.front());
+                m_saves.pop_front();
+            } else {
+                unsigned int id = m_queue.front();
+                m_queue.pop_front();
+                job = m_jobs.value(id);
+                if (job.cancelRequested) {
+                    // Cancelled while queued: no images are acquired and no files are opened
+                    m_jobs[id].state = RT_renderJob::Cancelled;
+                    retire(id);
+                    m_launchesPending--;
+                } else {
+                    m_jobs[id].state = RT_renderJob::Running;
+                    job.state = RT_renderJob::Running;
+                    m_runningJob = id;
+                    m_stopRunning = job.stopRequested;
+                    m_cancelRunning = false;
+                }
+            }
+        }
+        if (save) {
+            if (job.id != 0) {
+                saveCached(events, job);
+            }
+            continue;
+        }
+        if (job.cancelRequested) {
+            static std::atomic<quint64> *const cancelled_jobs = RT_metrics::instance().counter("jobs/cancelled");
+            cancelled_jobs->fetch_add(1, std::memory_order_relaxed);
+            spdlog::info("Render job {} is cancelled", job.id);
+            notify(events, job.id);
+            continue;
+        }
+        notify(events, job.id);
+        auto job_start = std::chrono::steady_clock::now();
+
+        // Gpu part: the scene must not be changed until all cameras of all poses are read back
+        bool ok = true;
+        bool accumulated = (job.format == RT_renderJob::RGB32F);
+        std::size_t pixel_size = accumulated ? 3 * sizeof(float) : 3;
+        int cam_count = job.cameras.size();
+        job.images.resize(job.poseCount() * cam_count);
+        job.samples = QVector<int>(job.images.size(), 0);
+        for (int i=0; i<job.images.size(); i++) {
+            const RT_renderJob::Camera &cam = job.cameras.at(i % cam_count);
+            job.images[i] = m_imagePool.acquire(pixel_size * cam.width * cam.height);
+        }
+        // A time-boxed render splits the rest of its budget evenly over the cameras not launched yet
+        auto budget_end = job_start + std::chrono::milliseconds(job.budgetMs);
+        QStringList paths;
+        QVector<TIFF*> stacks = openStacks(job, paths);
+
+        RT_object *sweep_object = nullptr;
+        optix::Matrix4x4 start_transform = optix::Matrix4x4::identity();
+        std::future<bool> saving;       // images of the previous pose, saved while the next pose is launched
+        for (int pose=0; pose<job.poseCount() && !m_cancelRunning; pose++) {
+            if (pose > 0 && m_stopRunning) {
+                // A stopped sweep keeps the poses rendered so far
+                for (int i=pose*cam_count; i<job.images.size(); i++) {
+                    job.images[i].reset();
+                    job.samples[i] = 0;
+                }
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> scene_lock(m_scene->m_mutex);
+                if (job.isSweep()) {
+                    if (sweep_object == nullptr) {
+                        sweep_object = m_scene->findObject(job.sweepObject);
+                        if (sweep_object == nullptr) {
+                            spdlog::error("Render job {}: object \"{}\" of the sweep not found", job.id, job.sweepObject.toUtf8().constData());
+                            ok = false;
+                            break;
+                        }
+                        start_transform = sweep_object->transformationMatrix();
+                    }
+                    // Every pose is applied to the start pose, so "translate" gives offsets from where the object was
+                    sweep_object->setTransformationMatrix(start_transform);
+                    int ret = m_scene->manipulateObject(sweep_object, job.sweepAction, job.poses.at(pose));
+                    sweep_object->flushPending();
+                    if (0 != ret || 0 != sweep_object->updateTransformCache()) {
+                        spdlog::error("Render job {}: could not apply pose {} \"{}\"", job.id, pose, job.poses.at(pose).toUtf8().constData());
+                        ok = false;
+                        break;
+                    }
+                }
+                for (int i=0; i<cam_count && !m_cancelRunning; i++) {
+                    RT_renderJob::Camera &cam = job.cameras[i];
+                    RT_imageBufferPtr &image = job.images[pose * cam_count + i];
+                    int &samples = job.samples[pose * cam_count + i];
+                    auto now = std::chrono::steady_clock::now();
+                    auto deadline = now + (budget_end - now) / (cam_count - i);
+                    auto last_launch = now;
+                    auto progress = [&](int iteration) {
+                        samples = iteration;
+                        bool stop_now = m_stopRunning;
+                        if (job.budgetMs > 0) {
+                            // Stop if the next launch, taking as long as the last one, would end after the deadline
+                            auto launched = std::chrono::steady_clock::now();
+                            stop_now = stop_now || (launched + (launched - last_launch) > deadline);
+                            last_launch = launched;
+                        }
+                        if (previews && job.streamEvery > 0 && (iteration % job.streamEvery == 0 || iteration == job.iterations || stop_now)) {
+                            publishPreview(*previews, job, cam, iteration);
+                        }
+                        return !stop_now;
+                    };
+                    try {
+                        if (m_scene->launchCamera(cam.entryPoint, cam.width, cam.height, job.iterations, *image, accumulated, progress,
+                                                  m_launchTimes.histogram(cam.name), m_readbackTimes.histogram(cam.name)) <= 0) {
+                            image.reset();
+                            ok = false;
+                        }
+                    } catch (const std::exception &e) {
+                        spdlog::error("Render job {} failed for camera {}: {}", job.id, cam.name.toUtf8().constData(), e.what());
+                        image.reset();
+                        ok = false;
+                    }
+                }
+            }
+            if (saving.valid() && !saving.get()) {
+                ok = false;
+            }
+            saving = std::async(std::launch::async, [&, pose]() { return saveImages(job, pose, stacks, paths); });
+        }
+        if (job.isSearch() && !m_cancelRunning) {
+            ok = runSearch(job);
+        } else if (job.isTrajectory() && !m_cancelRunning) {
+            ok = runTrajectory(job);
+        }
+        if (sweep_object != nullptr) {
+            std::lock_guard<std::mutex> scene_lock(m_scene->m_mutex);
+            sweep_object->setTransformationMatrix(start_transform);
+            sweep_object->flushPending();
+            sweep_object->updateTransformCache();
+        }
+        m_launchesPending--;
+        notify(events, job.id);
+
+        // Host part: the last images are saved while the network thread may already set up the next job
+        if (saving.valid() && !saving.get()) {
+            ok = false;
+        }
+        for (int i=0; i<stacks.size(); i++) {
+            if (stacks.at(i) != nullptr) {
+                TIFFClose(stacks.at(i));
+            }
+        }
+
+        bool stopped = false;
+        bool cancelled = false;
+        {
+            std::lock_guard<std::mutex> lock(m_jobsMutex);
+            RT_renderJob &stored = m_jobs[job.id];
+            m_runningJob = 0;
+            m_cancelRunning = false;
+            cancelled = stored.cancelRequested;
+            if (!cancelled) {
+                stored.images = job.images;
+                stored.samples = job.samples;
+            }
+            stored.imagePaths = paths;
+            stored.result = job.result;
+            stored.state = cancelled ? RT_renderJob::Cancelled : (ok ? RT_renderJob::Done : RT_renderJob::Failed);
+            stopped = stored.stopRequested;
+            retire(job.id);
+        }
+        // Stopped jobs hold fewer iterations or poses than their key promises
+        if (ok && !stopped && !cancelled && !job.cacheKey.isEmpty()) {
+            RT_renderCache::Entry entry;
+            entry.format = job.format;
+            entry.cameras = job.cameras;
+            entry.images = job.images;
+            entry.imagePaths = paths;
+            m_cache.insert(job.cacheKey, entry);
+        }
+        static RT_histogram *const search_times = RT_metrics::instance().histogram("render/search");
+        static RT_histogram *const trajectory_times = RT_metrics::instance().histogram("render/trajectory");
+        static RT_histogram *const sweep_times = RT_metrics::instance().histogram("render/sweep");
+        static RT_histogram *const job_times = RT_metrics::instance().histogram("render/job");
+        static std::atomic<quint64> *const cancelled_jobs = RT_metrics::instance().counter("jobs/cancelled");
+        static std::atomic<quint64> *const done_jobs = RT_metrics::instance().counter("jobs/done");
+        static std::atomic<quint64> *const failed_jobs = RT_metrics::instance().counter("jobs/failed");
+        RT_histogram *timing = job.isSearch() ? search_times : (job.isTrajectory() ? trajectory_times : (job.isSweep() ? sweep_times : job_times));
+        timing->record(std::chrono::steady_clock::now() - job_start);
+        (cancelled ? cancelled_jobs : (ok ? done_jobs : failed_jobs))->fetch_add(1, std::memory_order_relaxed);
+        spdlog::info("Render job {} is {}", job.id, cancelled ? "cancelled" : (ok ? "done" : "failed"));
+        notify(events, job.id);
+    }
+}
@@ -0,0 +1,102 @@
+/**
+  @file     RT_renderThread.h
+  @brief    dedicated thread executing render jobs of a scene
+
+  The session thread submits jobs and returns immediately with a job id. The render thread
+  launches the cameras of a job while holding RT_scene::m_mutex. A scene has a single optix context
+  that cannot be snapshotted, so the context stays with a job until its GPU part is over: the last
+  pose of a sweep, candidate of a search or frame of a trajectory is read back. Until then, and while
+  more jobs are queued, isLaunching() is true and RT_session parks every scene command. Setting up
+  the next job is therefore serialized behind the running one; only writing the last images of a job
+  overlaps with it. Within a sweep the images of a pose are saved while the next pose is launched.
+  Every state change is announced with a message on a ZMQ_PUSH socket connected to the event endpoint
+  given to the constructor.
+  The images are read back into buffers of an RT_imagePool and stay with the job, so they can be sent
+  to clients without a copy.
+  If a preview endpoint is given, jobs with RT_renderJob::streamEvery set send RGB8 previews of the
+  accumulation to it, two frames each: "<prefix><camera>;<job>;<iteration>;<width>;<height>;rgb8"
+  and the pixels. Previews are dropped instead of blocking the launches if the receiver is behind.
+**/
+
+#ifndef NSLAIFT_RT_RENDERTHREAD_H
+#define NSLAIFT_RT_RENDERTHREAD_H
+
+#include "RT_renderJob.h"
+#include "RT_imagePool.h"
+#include "RT_renderCache.h"
+#include "RT_metrics.h"
+
+#include <zmq.hpp>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class RT_scene;
+typedef struct tiff TIFF;
+
+class RT_renderThread
+{
+public:
+    RT_renderThread(RT_scene *scene, zmq::context_t &zmq_context, const std::string &event_endpoint,
+                    const std::string &preview_endpoint = std::string(), const QString &preview_prefix = QString());
+    ~RT_renderThread();
+
+    unsigned int submit(const RT_renderJob &settings);
+    bool job(unsigned int id, RT_renderJob &job) const;
+    int stop(unsigned int id);
+    int cancel(unsigned int id);
+    int cancelAll();
+    bool isLaunching() const;
+    RT_renderCache& cache();
+
+    static const int MaxFinishedJobs = 16;     ///< finished jobs that can still be queried before they are dropped (with their images)
+
+private:
+    void run();
+    QVector<TIFF*> openStacks(const RT_renderJob &job, QStringList &paths);
+    bool saveImages(const RT_renderJob &job, int pose, const QVector<TIFF*> &stacks, QStringList &paths);
+    void saveCached(zmq::socket_t &events, const RT_renderJob &job);
+    bool runSearch(RT_renderJob &job);
+    bool runTrajectory(RT_renderJob &job);
+    QByteArray cacheKey(const RT_renderJob &settings) const;
+    void requestCancel(RT_renderJob &job);
+    void retire(unsigned int id);
+    void notify(zmq::socket_t &events, unsigned int id);
+    void publishPreview(zmq::socket_t &previews, const RT_renderJob &job, const RT_renderJob::Camera &cam, int iteration);
+
+    RT_scene *m_scene;
+    zmq::context_t &m_zmqContext;
+    std::string m_eventEndpoint;
+    std::string m_previewEndpoint;
+    QString m_previewPrefix;                        ///< put in front of the preview headers, e.g. the session name
+    RT_imagePool m_imagePool;
+    RT_renderCache m_cache;
+    RT_metrics::NameCache m_launchTimes;            ///< "camera/<camera>/launch", only used by the render thread
+    RT_metrics::NameCache m_readbackTimes;          ///< "camera/<camera>/readback", only used by the render thread
+    RT_metrics::NameCache m_tiffTimes;              ///< "camera/<camera>/tiff", only used by one saveImages() at a time
+
+    mutable std::mutex m_jobsMutex;                 ///< guards everything below up to m_stop
+    std::condition_variable m_jobsCondition;
+    std::deque<unsigned int> m_queue;               ///< ids of jobs waiting for the render thread
+    std::deque<unsigned int> m_saves;               ///< ids of cached jobs whose images the render thread still saves
+    std::deque<unsigned int> m_finished;            ///< ids of finished jobs, oldest first
+    QHash<unsigned int, RT_renderJob> m_jobs;
+    unsigned int m_nextJobId;
+    unsigned int m_runningJob;                      ///< job the render thread is working on, 0 if none
+    bool m_stop;
+
+    std::atomic<int> m_launchesPending;             ///< submitted jobs that did not yet release the optix context
+    std::atomic<bool> m_stopRunning;                ///< stop the accumulation of the running job
+    std::atomic<bool> m_cancelRunning;              ///< launch nothing more for the running job
+    std::thread m_thread;
+};
+
+#endif //NSLAIFT_RT_RENDERTHREAD_H
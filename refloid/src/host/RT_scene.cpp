@@ -1,6 +1,12 @@
 #include "RT_scene.h"
 #include "RT_lightPoint.h"
 #include "RT_helper.h"
+#include "RT_metrics.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+
+#include <algorithm>
 
 RT_scene::RT_scene()
 {
@@ -39,6 +45,8 @@ void RT_scene::setupContext()
     // Creating a top level group - this is the scenes root group
     m_rootGroup = m_context->createGroup();
     m_rootGroup->setAcceleration(m_context->createAcceleration("Trbvh"));
+    // Moving objects only changes the transforms below the root, refitting is enough for that
+    m_rootGroup->getAcceleration()->setProperty("refit", "1");
     m_context["sysTopObject"]->set(m_rootGroup);
 }
 
@@ -58,8 +66,12 @@ void RT_scene::initOutputBuffers()
     // Initializing buffer to size of 100x100 pixels. This will be overridden when a camera is initialized
     m_outputBuffer = m_context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_UNSIGNED_BYTE4, 100, 100);
     m_context["sysOutputBuffer"]->set(m_outputBuffer);
-    m_accumBuffer = m_context->createBuffer( RT_BUFFER_INPUT_OUTPUT | RT_BUFFER_GPU_LOCAL, RT_FORMAT_FLOAT4, 100, 100);
+    // Not gpu local, so the accumulated radiance can be mapped and sent to clients as float image
+    m_accumBuffer = m_context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT4, 100, 100);
     m_context["sysAccumBuffer"]->set(m_accumBuffer);
+    // Program ids of the light sources of this context, each scene has its own
+    m_context["sysLightBuffer"]->setBuffer(m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_PROGRAM_ID, MaxLightSources));
+    m_context["light_count"]->setUint(0u);
 }
 
 /**
@@ -115,6 +127,9 @@ RT_object *RT_scene::createObject(const QString &name, const QString &objType, c
         }
         cam->setName(name);
         addCamera(cam);
+        cam->m_createdType = objType.toLower();
+        cam->m_createdParams = objParams;
+        return cam;
     } else if (0 == objType.compare("sphere", Qt::CaseInsensitive)) {
         auto* sphere = new RT_sphere(m_context, m_rootGroup);
         if (!objParams.isEmpty()) {
@@ -124,6 +139,9 @@ RT_object *RT_scene::createObject(const QString &name, const QString &objType, c
         }
         sphere->setName(name);
         addObject(sphere);
+        sphere->m_createdType = objType.toLower();
+        sphere->m_createdParams = objParams;
+        return sphere;
     } else if (0 == objType.compare("cuboid", Qt::CaseInsensitive)) {
         auto* cuboid = new RT_cuboid(m_context, m_rootGroup);
         if (!objParams.isEmpty()) {
@@ -133,6 +151,20 @@ RT_object *RT_scene::createObject(const QString &name, const QString &objType, c
         }
         cuboid->setName(name);
         addObject(cuboid);
+        cuboid->m_createdType = objType.toLower();
+        cuboid->m_createdParams = objParams;
+        return cuboid;
+    } else if (0 == objType.compare("mesh", Qt::CaseInsensitive)) {
+        auto* mesh = new RT_mesh(m_context, m_rootGroup);
+        mesh->setName(name);
+        if (!objParams.isEmpty() && 0 != mesh->parseActions("load_mesh", objParams)) {
+            delete mesh;
+            return nullptr;
+        }
+        addObject(mesh);
+        mesh->m_createdType = objType.toLower();
+        mesh->m_createdParams = objParams;
+        return mesh;
     } else if (0 == objType.compare("lightpoint", Qt::CaseInsensitive)) {
         auto* lightpoint = new RT_lightPoint(m_context);
         if (!objParams.isEmpty()) {
@@ -141,7 +173,13 @@ RT_object *RT_scene::createObject(const QString &name, const QString &objType, c
             spdlog::debug("No object parameters were given for point light object: {}", lightpoint->m_strName.toUtf8().constData());
         }
         lightpoint->setName(name);
-        addLightSource(lightpoint);
+        if (addLightSource(lightpoint) < 0) {
+            delete lightpoint;
+            return nullptr;
+        }
+        lightpoint->m_createdType = objType.toLower();
+        lightpoint->m_createdParams = objParams;
+        return lightpoint;
     } else {
         spdlog::warn("No valid object type was entered. Object could not be created.");
     }
@@ -153,6 +191,45 @@ RT_object *RT_scene::createObject(const QString &name, const QString &objType)
     return createObject(name, objType, "");
 }
 
+/**
+  @brief    set the triangles of a mesh from client memory, the mesh is created if it does not exist
+  @param    name            mesh object name
+  @param    vertices        float triples (x, y, z), little endian
+  @param    vertex_bytes    size of the vertex array in bytes
+  @param    indices         uint32 triples, one per triangle
+  @param    index_bytes     size of the index array in bytes
+  @param    normals         float triples, one per vertex; nullptr to shade with the geometric normals
+  @param    normal_bytes    size of the normal array in bytes
+  @return   0 on success, -1 if the object cannot be created, -3 if it is no mesh, -18 if the arrays are malformed
+  **/
+int RT_scene::uploadMesh(const QString &name, const void *vertices, std::size_t vertex_bytes, const void *indices, std::size_t index_bytes,
+                         const void *normals, std::size_t normal_bytes)
+{
+    const std::size_t triple = 3 * sizeof(float);
+    if (vertex_bytes % triple != 0 || index_bytes % (3 * sizeof(quint32)) != 0 || (normals && normal_bytes != vertex_bytes)) {
+        spdlog::error("Mesh data of {} is malformed: {} vertex, {} index and {} normal bytes", name.toUtf8().constData(),
+                      vertex_bytes, index_bytes, normal_bytes);
+        return -18;
+    }
+    RT_object *obj = findObject(name);
+    if (obj == nullptr) {
+        obj = createObject(name, "mesh");
+        if (obj == nullptr) {
+            return -1;
+        }
+    }
+    RT_mesh *mesh = dynamic_cast<RT_mesh*>(obj);
+    if (mesh == nullptr) {
+        spdlog::error("Object {} is no mesh", name.toUtf8().constData());
+        return -3;
+    }
+    int ret = mesh->setMeshData(vertices, vertex_bytes / triple, indices, index_bytes / (3 * sizeof(quint32)), normals);
+    // The first upload creates the geometry of the mesh
+    markChanged(mesh);
+    m_structureChanged = true;
+    return ret;
+}
+
 /**
   @brief    delete some object from scene
   @param    name    object name
@@ -173,12 +250,16 @@ int RT_scene::deleteObject(const QString &name)
             for (int i=0; i<m_cameras.size(); i++) {
                 if (m_cameras.at(i)->m_iCameraIdx > entry_pt) {
                     m_cameras.at(i)->m_iCameraIdx--;
+                    // The ray generation program has to be set for the new entry point
+                    markChanged(m_cameras.at(i));
                 }
             }
             m_cameras.remove(cam_idx);
+            unregisterHandle(obj);
             delete obj;
         } else if (0 == obj->m_ObjType.compare("geometry")) {
             m_objects.remove(objectIndex(name));
+            unregisterHandle(obj);
             delete obj;
         }
         else if (0 == obj->m_ObjType.compare("light")) {
@@ -192,11 +273,16 @@ int RT_scene::deleteObject(const QString &name)
                 }
             }
             m_lights.remove(lightSourceIndex(name));
+            unregisterHandle(obj);
             delete obj;
+            m_lightsChanged = true;
         }
+        m_structureChanged = true;
     } else {
         spdlog::error("Could not find any scene object with name \"{}\". Not deleting anything.", name.toStdString());
+        return -1;
     }
+    return 0;
 }
 
 /**
@@ -204,7 +290,7 @@ int RT_scene::deleteObject(const QString &name)
   @param    name        name of object
   @param    action      action to perform, "translate", "rotate", "setVisible", etc...
   @param    parameters  parameter string, e.g. "0, -45,0"
-  @return   0 on success, error-code on failure
+  @return   0 on success, -1 if the object is not found, -3 if the object does not know the action
   **/
 int RT_scene::manipulateObject(const QString &name, const QString &action, const QString &parameters)
 {
@@ -222,11 +308,13 @@ int RT_scene::manipulateObject(const QString &name, const QString &action, const
   @param    obj         pointer to object
   @param    action      action to perform, "translate", "rotate", "setVisible", etc...
   @param    parameters  parameter string, e.g. "0, -45,0"
-  @return   0 on success, error-code on failure
+  @return   0 on success, -1 if obj is not an RT_object, -2 if no action is given,
+            -3 if the object does not know the action
 
   manipulators (action, parameters):
 
-  All objects implement their own manipulators via "parseActions"
+  All objects implement their own manipulators via "parseActions". An unknown
+  action is an error (-3); it used to be ignored and answered with 0.
   **/
 int RT_scene::manipulateObject(RT_object *object, const QString &action, const QString &parameters)
 {
@@ -238,7 +326,14 @@ int RT_scene::manipulateObject(RT_object *object, const QString &action, const Q
         spdlog::warn("No action given");
         return -2;
     }
+    unsigned int buffered = object->bufferedOperations();
     int ret = object->parseActions(action, parameters);
+    // syncScene() cannot tell any more what the properties set by its actions are
+    object->m_syncedActions.clear();
+    // Pose and material actions are buffered by the object and flushed by updateCaches()
+    if (object->bufferedOperations() == buffered) {
+        markChanged(object);
+    }
     if(ret > 0) { //action not found
         spdlog::error("action {0} erroneous/not known, cannot manipulate object {1} (retcode: {2})", action.toUtf8().constData(), object->m_strName.toUtf8().constData(), ret);
         return -3;
@@ -246,37 +341,383 @@ int RT_scene::manipulateObject(RT_object *object, const QString &action, const Q
     return 0;
 }
 
-int RT_scene::updateCaches(bool force)
+/**
+  @brief    execute a single ";"-separated text command on the scene
+  @param    sList   command split into its fields, e.g. {"manipulateObject", "sphere1", "translate", "0,0,1"}
+  @return   0 on success
+            -10 if the command is not known
+            -11 if the command has too few parameters
+            -13 (from RT_server) if the command threw an exception
+            any other negative value is the error code of the scene method that failed
+            "getHandle" returns the (positive) object handle used by the binary protocol instead
+            "setImageDirectory;<dir>" sets the tiff directory, without <dir> no tiffs are written
+            "createObject;<name>;mesh[;<ply file>]" creates an empty mesh or loads it from a server-side PLY file
+            "begin" and "commit" enclose a transaction, see beginTransaction()
+            "syncScene;<json>" returns the number of changed objects, see syncScene(); -21 if the JSON is malformed
+            "loadScene;<file>" does the same with a JSON or binary scene file on the server, see loadScene()
+
+  The commands are the ones of the ZMQ text protocol that only touch the scene. Must be called while
+  holding m_mutex if the scene is shared with a render thread.
+  **/
+int RT_scene::executeCommand(const QStringList &sList)
 {
-    // Updating background color in the miss program
-    m_miss_program["miss_color"]->setFloat(m_colBackground);
+    if (0 == sList.at(0).compare("createObject", Qt::CaseInsensitive)){
+        if (sList.size() < 3) {
+            return -11;
+        }
+        QString params = (sList.size() > 3) ? sList.at(3) : QString();
+        return (createObject(sList.at(1), sList.at(2), params) != nullptr) ? 0 : -1;
+    } else if (0 == sList.at(0).compare("manipulateObject", Qt::CaseInsensitive)){
+        if (sList.size() < 4) {
+            return -11;
+        }
+        if (0 == sList.at(2).compare("setMaterialParameter", Qt::CaseInsensitive)){
+            if (sList.size() < 5) {
+                return -11;
+            }
+            QString param_extended = sList.at(3);
+            param_extended.append(";");
+            param_extended.append(sList.at(4));
+            return manipulateObject(sList.at(1), sList.at(2), param_extended);
+        } else {
+            return manipulateObject(sList.at(1), sList.at(2), sList.at(3));
+        }
+    } else if (0 == sList.at(0).compare("deleteObject", Qt::CaseInsensitive)){
+        if (sList.size() < 2) {
+            return -11;
+        }
+        return deleteObject(sList.at(1));
+    } else if (0 == sList.at(0).compare("setMaterial", Qt::CaseInsensitive)){
+        if (sList.size() < 3) {
+            return -11;
+        }
+        return manipulateObject(sList.at(0), sList.at(1), sList.at(2));
+    } else if (0 == sList.at(0).compare("getHandle", Qt::CaseInsensitive)) {
+        if (sList.size() < 2) {
+            return -11;
+        }
+        RT_object* obj = findObject(sList.at(1));
+        return (obj != nullptr) ? static_cast<int>(obj->m_handle) : -1;
+    } else if (0 == sList.at(0).compare("clear", Qt::CaseInsensitive)) {
+        return clear();
+    } else if (0 == sList.at(0).compare("begin", Qt::CaseInsensitive)) {
+        return beginTransaction();
+    } else if (0 == sList.at(0).compare("commit", Qt::CaseInsensitive)) {
+        return commitTransaction();
+    } else if (0 == sList.at(0).compare("syncScene", Qt::CaseInsensitive)) {
+        if (sList.size() < 2) {
+            return -11;
+        }
+        // The JSON may contain ";" itself, e.g. in the parameters of setMaterialParameter
+        RT_sceneDescription desc;
+        int ret = RT_sceneDescription::fromJson(sList.mid(1).join(";").toUtf8(), desc);
+        return (ret < 0) ? ret : syncScene(desc);
+    } else if (0 == sList.at(0).compare("loadScene", Qt::CaseInsensitive)) {
+        if (sList.size() < 2) {
+            return -11;
+        }
+        return loadScene(sList.at(1));
+    } else if (0 == sList.at(0).compare("setImageDirectory", Qt::CaseInsensitive)) {
+        setImageDirectory((sList.size() > 1) ? sList.at(1) : QString());
+        return 0;
+    }
+    spdlog::error("Command \"{}\" is not known", sList.at(0).toUtf8().constData());
+    return -10;
+}
 
+/**
+  @brief    upload the changes of the scene to the optix context before rendering
+  @param    force   upload the caches of all objects, not only of the changed ones
+  @return   0 on success, -1 if the scene has no camera, -19 while a transaction is open
+  **/
+int RT_scene::updateCaches(bool force)
+{
+    if (m_transactionOpen) {
+        spdlog::error("Cannot render while a transaction is open, \"commit\" it first");
+        return -19;
+    }
     if (m_cameras.empty()) {
         spdlog::error("No cameras were specified! Could not render scene!");
         return -1;
     }
+    return uploadCaches(force);
+}
+
+/**
+  @brief    upload the caches of all objects changed since the last upload
+  @param    force   upload the caches of all objects
+  @return   0
+
+  The manipulations buffered by the objects are flushed first. Only changed objects mark their
+  acceleration structures dirty, the light buffer is written in a single map and the context is
+  validated only if anything was uploaded at all.
+  **/
+int RT_scene::uploadCaches(bool force)
+{
+    // Updating background color in the miss program
+    m_miss_program["miss_color"]->setFloat(m_colBackground);
 
+    int updated = 0;
+    auto update = [&](RT_object *obj) {
+        obj->flushPending();
+        if (force) {
+            obj->m_bTransformCacheUpToDate = false;
+        }
+        if (!obj->upToDate()) {
+            obj->updateCache();
+            obj->m_bTransformCacheUpToDate = true;
+            updated++;
+        }
+    };
     for (int cam_idx=0; cam_idx<m_cameras.size(); cam_idx++){
-        m_cameras[cam_idx]->updateCache();
+        update(m_cameras[cam_idx]);
     }
     for (int obj_idx=0; obj_idx<m_objects.size(); obj_idx++){
-        m_objects[obj_idx]->updateCache();
+        update(m_objects[obj_idx]);
     }
-    if (!m_lights.empty())
-    {
+    for (int light_idx=0; light_idx<m_lights.size(); light_idx++){
+        update(m_lights[light_idx]);
+    }
+    if (force || m_lightsChanged) {
+        optix::Buffer light_buffer = m_context["sysLightBuffer"]->getBuffer();
+        int *program_ids = static_cast<int*>(light_buffer->map(0, RT_BUFFER_MAP_WRITE_DISCARD));
         for (int light_idx=0; light_idx<m_lights.size(); light_idx++){
-            m_lights[light_idx]->updateCache();
+            program_ids[m_lights[light_idx]->m_light_idx] = m_lights[light_idx]->programId();
         }
-    } else {
-        m_context["light_count"]->setUint(0);
+        light_buffer->unmap();
+        m_context["light_count"]->setUint(static_cast<unsigned int>(m_lights.size()));
+        updated++;
+    }
+    if (updated == 0 && !m_structureChanged) {
+        spdlog::debug("Scene caches are up to date");
+        return 0;
+    }
+    spdlog::debug("Uploaded the caches of {} scene objects", updated);
+    m_lightsChanged = false;
+
+    // Checking if everything was configured correctly in the optix context, it needs an entry point
+    if (!m_cameras.empty()) {
+        static RT_histogram *const validate_times = RT_metrics::instance().histogram("render/validate");
+        RT_metrics::Timer timer(validate_times);
+        m_context->validate();
+        m_structureChanged = false;
+        spdlog::info("Context was successfully validated");
     }
+    return 0;
+}
 
-    // Checking if everything was configured correctly in the optix context
-    m_context->validate();
-    spdlog::info("Context was successfully validated");
+/**
+  @brief    start a transaction, the caches of all following changes are uploaded at once by commitTransaction()
+  @return   0 on success, -19 if a transaction is already open
+
+  Scene commands are applied to the scene objects right away, but acceleration structures are not
+  marked dirty, the light buffer is not written and the context is not validated before the commit.
+  Renders are refused with -19 while the transaction is open, so no image shows a half applied change.
+  **/
+int RT_scene::beginTransaction()
+{
+    if (m_transactionOpen) {
+        spdlog::error("A transaction is already open");
+        return -19;
+    }
+    m_transactionOpen = true;
     return 0;
 }
 
+/**
+  @brief    end a transaction and upload the caches of everything changed in it
+  @return   0 on success, -19 if no transaction is open
+  **/
+int RT_scene::commitTransaction()
+{
+    if (!m_transactionOpen) {
+        spdlog::error("No transaction is open");
+        return -19;
+    }
+    m_transactionOpen = false;
+    return uploadCaches(false);
+}
+
+bool RT_scene::inTransaction() const
+{
+    return m_transactionOpen;
+}
+
+/**
+  @brief    mark the caches of an object outdated, they are uploaded with the next updateCaches()
+  @param    obj object that was changed
+  **/
+void RT_scene::markChanged(RT_object *obj)
+{
+    obj->m_bTransformCacheUpToDate = false;
+    obj->m_syncedActions.clear();
+    obj->m_syncedMesh.clear();
+}
+
+/**
+  @brief    turn the scene into the described one, only the differences are applied
+  @param    desc    complete scene, objects of the scene that are not described are deleted
+  @return   number of objects created, deleted or changed (0 if the scene already matched),
+            the negative error code of the first create or action that failed otherwise
+
+  Objects are matched by name. An object whose type or creation parameters differ is created again,
+  otherwise only a changed pose (compared with the current transformation matrix), a changed
+  visibility and the actions that differ from the ones applied by the previous sync are applied. The
+  actions should set properties (e.g. "setRadius") rather than change them relatively, actions dropped
+  from the description are not undone. After an object was manipulated by other commands all its
+  actions are applied again. The triangles of meshes from a binary description are uploaded when
+  they differ from the ones uploaded by the previous sync.
+  **/
+int RT_scene::syncScene(const RT_sceneDescription &desc)
+{
+    QHash<QString, const RT_objectDescription*> described;
+    for (int i=0; i<desc.objects.size(); i++) {
+        described.insert(desc.objects.at(i).name, &desc.objects.at(i));
+    }
+
+    QStringList obsolete;
+    auto collect = [&](RT_object *obj) {
+        const RT_objectDescription *d = described.value(obj->name(), nullptr);
+        if (d == nullptr || 0 != obj->m_createdType.compare(d->type, Qt::CaseInsensitive) || obj->m_createdParams != d->params) {
+            obsolete << obj->name();
+        }
+    };
+    for (int i=0; i<m_cameras.size(); i++) {
+        collect(m_cameras.at(i));
+    }
+    for (int i=0; i<m_objects.size(); i++) {
+        collect(m_objects.at(i));
+    }
+    for (int i=0; i<m_lights.size(); i++) {
+        collect(m_lights.at(i));
+    }
+    for (int i=0; i<obsolete.size(); i++) {
+        deleteObject(obsolete.at(i));
+    }
+
+    int ret = 0;
+    int created = 0;
+    int changed = 0;
+    for (int i=0; i<desc.objects.size(); i++) {
+        const RT_objectDescription &d = desc.objects.at(i);
+        RT_object *obj = findObject(d.name);
+        bool is_new = (obj == nullptr);
+        if (is_new) {
+            obj = createObject(d.name, d.type, d.params);
+            if (obj == nullptr) {
+                ret = (ret < 0) ? ret : -1;
+                continue;
+            }
+            created++;
+        }
+        // Uploading triangles or changing the visibility drops the record, so it is read first
+        QVector< QPair<QString, QString> > applied = obj->m_syncedActions;
+        bool updated = false;
+        if (!d.vertices.isEmpty()) {
+            QByteArray mesh_hash = meshHash(d);
+            if (mesh_hash != obj->m_syncedMesh) {
+                int mesh_ret = uploadMesh(d.name, d.vertices.constData(), static_cast<std::size_t>(d.vertices.size()),
+                                          d.indices.constData(), static_cast<std::size_t>(d.indices.size()),
+                                          d.normals.isEmpty() ? nullptr : d.normals.constData(), static_cast<std::size_t>(d.normals.size()));
+                if (mesh_ret < 0) {
+                    ret = (ret < 0) ? ret : mesh_ret;
+                } else {
+                    obj->m_syncedMesh = mesh_hash;
+                }
+                updated = true;
+            }
+        }
+        optix::Matrix4x4 current = obj->transformationMatrix();
+        if (!std::equal(current.getData(), current.getData() + 16, d.transform.getData())) {
+            obj->setTransformationMatrix(d.transform);
+            updated = true;
+        }
+        if (obj->isVisible() != d.visible) {
+            obj->setVisible(d.visible);
+            markChanged(obj);
+            updated = true;
+        }
+        if (applied != d.actions) {
+            bool failed = false;
+            for (int a=0; a<d.actions.size(); a++) {
+                if (applied.contains(d.actions.at(a))) {
+                    continue;
+                }
+                int action_ret = manipulateObject(obj, d.actions.at(a).first, d.actions.at(a).second);
+                if (action_ret < 0) {
+                    ret = (ret < 0) ? ret : action_ret;
+                    failed = true;
+                }
+                updated = true;
+            }
+            // After a failed action all actions are applied again by the next sync
+            obj->m_syncedActions = failed ? QVector< QPair<QString, QString> >() : d.actions;
+        } else {
+            obj->m_syncedActions = applied;
+        }
+        if (updated && !is_new) {
+            changed++;
+        }
+    }
+    if (desc.hasBackground) {
+        setBackgroundColor(desc.background);
+    }
+
+    RT_metrics &metrics = RT_metrics::instance();
+    metrics.increment("sync/created", static_cast<quint64>(created));
+    metrics.increment("sync/deleted", static_cast<quint64>(obsolete.size()));
+    metrics.increment("sync/changed", static_cast<quint64>(changed));
+    spdlog::info("Synchronized the scene: {} objects created, {} deleted, {} changed, {} unchanged", created, obsolete.size(), changed,
+                 desc.objects.size() - created - changed);
+    return (ret < 0) ? ret : created + obsolete.size() + changed;
+}
+
+/**
+  @brief    hash of the triangles of a mesh description, to tell if they changed since the last sync
+  **/
+QByteArray RT_scene::meshHash(const RT_objectDescription &desc)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(desc.vertices);
+    hash.addData(desc.indices);
+    hash.addData(desc.normals);
+    return hash.result();
+}
+
+/**
+  @brief    load a scene file, the scene is synchronized with it like by syncScene()
+  @param    path    JSON or binary scene description, see RT_sceneDescription.h
+  @return   number of created, deleted or changed objects, -1 if the file cannot be read,
+            -21 if it is malformed, otherwise the first error of syncScene()
+
+  All objects are created before any cache is uploaded. Outside of a transaction the caches are
+  uploaded right after loading, so the acceleration structures are built and the context is
+  validated once for the whole file instead of at the first render.
+  **/
+int RT_scene::loadScene(const QString &path)
+{
+    RT_metrics::Timer timer("scene/load");
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        spdlog::error("Could not open the scene file {}", path.toUtf8().constData());
+        return -1;
+    }
+    QByteArray data = file.readAll();
+    RT_sceneDescription desc;
+    int ret = RT_sceneDescription::isBinary(data) ? RT_sceneDescription::fromBinary(data, desc)
+                                                  : RT_sceneDescription::fromJson(data, desc);
+    if (ret < 0) {
+        spdlog::error("Could not load the scene file {}", path.toUtf8().constData());
+        return ret;
+    }
+    ret = syncScene(desc);
+    if (!m_transactionOpen && !m_cameras.empty()) {
+        uploadCaches(false);
+    }
+    spdlog::info("Loaded {} objects from the scene file {}", desc.objects.size(), path.toUtf8().constData());
+    return ret;
+}
+
 void RT_scene::setBackgroundColor(const optix::float3 &col)
 {
     spdlog::debug("Setting background color to r:{}, g:{}, b:{}", col.x, col.y, col.z);
@@ -289,62 +730,129 @@ void RT_scene::setBackgroundColor(float x, float y, float z)
     setBackgroundColor(background);
 }
 
+/**
+  @brief    render the scene with all cameras and save the images as tiff
+  @param    iterations  number of accumulation launches per camera
+  @return   0 on success, non-zero on error
+
+  updateCaches() has to be called before
+  **/
 int RT_scene::render(int iterations)
 {
     spdlog::info("Starting to render the entire scene");
 
-
+    int ret = 0;
     for (int cam_idx=0; cam_idx < m_cameras.size(); cam_idx++)
     {
-        // Adjusting the size of the output buffer for the currently activated camera
-        m_outputBuffer->setSize(m_cameras[cam_idx]->m_iWidth, m_cameras[cam_idx]->m_iHeight);
-        m_accumBuffer->setSize(m_cameras[cam_idx]->m_iWidth, m_cameras[cam_idx]->m_iHeight);
-        spdlog::debug("Rendering with {0} with a resolution of {1}x{2}", m_cameras[cam_idx]->m_strName.toUtf8().constData(), m_cameras[cam_idx]->m_iWidth,m_cameras[cam_idx]->m_iHeight);
-        for (int iter=0; iter<iterations; iter++)
-        {
-            m_context->launch(cam_idx, m_cameras[cam_idx]->m_iWidth, m_cameras[cam_idx]->m_iHeight);
-        }
-        spdlog::info("Rendering with {0} with a resolution of {1}x{2} is DONE!", m_cameras[cam_idx]->m_strName.toUtf8().constData(), m_cameras[cam_idx]->m_iWidth,m_cameras[cam_idx]->m_iHeight);
-        optix::Buffer output_buffer = m_context["sysOutputBuffer"]->getBuffer();
-        // Writing the rendered data to char vector
-        std::vector<unsigned char> img_data = rthelpers::writeBufferToPipe(output_buffer);
-
-        // TODO: Put the saving part as a method in RT_helper.cpp
-        // Saving data as tiff image
-//        QString img_path = "/tmp/render_";
-        QString img_path = "/home/melchert/Desktop/rendered_images/render_";
-        img_path.append(QString::number(m_render_counter)).append("_");
-        img_path.append(camera(cam_idx)->m_strName).append(".tif");
-        spdlog::debug("Saving the rendered data from {} as tiff image in path: {}", m_cameras[cam_idx]->m_strName.toUtf8().constData(), img_path.toUtf8().constData());
-        TIFF* out = TIFFOpen(img_path.toStdString().c_str(), "w");
-        int sampleperpixel = 3;
-        if (out) {
-            TIFFSetField(out, TIFFTAG_IMAGEWIDTH, m_cameras[cam_idx]->m_iWidth);
-            TIFFSetField(out, TIFFTAG_IMAGELENGTH, m_cameras[cam_idx]->m_iHeight);
-            TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, sampleperpixel);
-            TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 8);
-            TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_BOTLEFT);
-            TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-            TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-            tsize_t linebytes = 3 * m_cameras[cam_idx]->m_iWidth;
-            unsigned char *buf_out = nullptr;
-            buf_out =(unsigned char *)_TIFFmalloc(linebytes);
-            TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(out, m_cameras[cam_idx]->m_iWidth * 3));
-            int h = m_cameras[cam_idx]->m_iHeight;
-            for (uint32 row = 0; row < h; row++) {
-                memcpy(buf_out, &img_data[(h - row - 1) * linebytes], linebytes);    // check the index here, and figure out why not using h*linebytes
-                if (TIFFWriteScanline(out, buf_out, row, 0) < 0)
-                    break;
-            }
-            TIFFClose(out);
-            if (buf_out)
-                _TIFFfree(buf_out);
-        } else {
-            spdlog::error("Was not able to open tiff file with path: {}", img_path.toUtf8().constData());
+        RT_camera *cam = m_cameras[cam_idx];
+        std::vector<unsigned char> img_data;
+        launchCamera(cam->m_iCameraIdx, cam->m_iWidth, cam->m_iHeight, iterations, img_data);
+
+        QString img_path = nextImagePath(cam->m_strName);
+        if (img_path.isEmpty()) {
+            continue;
+        }
+        spdlog::debug("Saving the rendered data from {} as tiff image in path: {}", cam->m_strName.toUtf8().constData(), img_path.toUtf8().constData());
+        if (0 != rthelpers::writeTiff(img_path, img_data, cam->m_iWidth, cam->m_iHeight)) {
+            ret = -1;
         }
-        m_render_counter++;
     }
-    return 0;
+    return ret;
+}
+
+/**
+  @brief    launch a single camera entry point and read back the output buffer
+  @param    entry_point camera entry point index (RT_camera::m_iCameraIdx)
+  @param    width       image width in pixels
+  @param    height      image height in pixels
+  @param    iterations  number of accumulation launches
+  @param    img_data    pixel data of the rendered image, rows from top to bottom
+  @param    accumulated read back the accumulated radiance as RGB floats instead of the RGB8 output buffer
+  @param    progress    called with the number of finished launches after each launch, may read the
+                        intermediate image with readOutput(); accumulation ends early if it returns false
+  @param    launch_times    receives the duration of the launches, e.g. "camera/cam1/launch" of RT_metrics;
+                            nullptr to not record the timings
+  @param    readback_times  receives the duration of the readback, e.g. "camera/cam1/readback"
+  @return   bytes per pixel of img_data (3 or 12)
+
+  Only touches the optix context, not the host side scene objects
+  **/
+int RT_scene::launchCamera(unsigned int entry_point, unsigned int width, unsigned int height, int iterations, std::vector<unsigned char> &img_data,
+                           bool accumulated, const std::function<bool(int)> &progress, RT_histogram *launch_times, RT_histogram *readback_times)
+{
+    // Adjusting the size of the output buffer for the currently activated camera
+    m_outputBuffer->setSize(width, height);
+    m_accumBuffer->setSize(width, height);
+    spdlog::debug("Rendering entry point {0} with a resolution of {1}x{2}", entry_point, width, height);
+    auto start = std::chrono::steady_clock::now();
+    for (int iter=0; iter<iterations; iter++)
+    {
+        // frame 0 restarts the accumulation, later frames are blended in with weight 1/(frame+1)
+        m_context["frame"]->setUint(static_cast<unsigned int>(iter));
+        m_context->launch(entry_point, width, height);
+        if (progress && !progress(iter + 1)) {
+            spdlog::info("Accumulation of entry point {0} stopped after {1} of {2} iterations", entry_point, iter + 1, iterations);
+            break;
+        }
+    }
+    spdlog::info("Rendering entry point {0} with a resolution of {1}x{2} is DONE!", entry_point, width, height);
+    if (launch_times == nullptr || readback_times == nullptr) {
+        return readOutput(img_data, accumulated);
+    }
+    auto launched = std::chrono::steady_clock::now();
+    int ret = readOutput(img_data, accumulated);
+    launch_times->record(launched - start);
+    readback_times->record(std::chrono::steady_clock::now() - launched);
+    return ret;
+}
+
+/**
+  @brief    read back the image of the last launch
+  @param    img_data    pixel data of the image, rows from top to bottom
+  @param    accumulated read the accumulated radiance as RGB floats instead of the RGB8 output buffer
+  @return   bytes per pixel of img_data (3 or 12)
+  **/
+int RT_scene::readOutput(std::vector<unsigned char> &img_data, bool accumulated)
+{
+    optix::Buffer output_buffer = accumulated ? m_accumBuffer : m_context["sysOutputBuffer"]->getBuffer();
+    // Writing the rendered data to char vector
+    return rthelpers::readBuffer(output_buffer->get(), img_data);
+}
+
+/**
+  @brief    get the path the next rendered image of a camera is written to
+  @param    cam_name    name of the camera
+  @return   tiff file path, unique for each call; empty if no image directory is set
+  **/
+QString RT_scene::nextImagePath(const QString &cam_name)
+{
+    if (m_imageDirectory.isEmpty()) {
+        return QString();
+    }
+    QString img_path = m_imageDirectory;
+    img_path.append("/render_");
+    img_path.append(QString::number(m_render_counter)).append("_");
+    img_path.append(cam_name).append(".tif");
+    m_render_counter++;
+    return img_path;
+}
+
+/**
+  @brief    set the directory rendered images are saved to as tiff
+  @param    dir directory, an empty string disables writing images (they can still be fetched over ZMQ)
+  **/
+void RT_scene::setImageDirectory(const QString &dir)
+{
+    m_imageDirectory = dir;
+    while (m_imageDirectory.size() > 1 && m_imageDirectory.endsWith("/")) {
+        m_imageDirectory.chop(1);
+    }
+    spdlog::info("Saving rendered images to \"{}\"", m_imageDirectory.toUtf8().constData());
+}
+
+QString RT_scene::imageDirectory() const
+{
+    return m_imageDirectory;
 }
 
 optix::float3 RT_scene::backgroundColor()
@@ -352,6 +860,31 @@ optix::float3 RT_scene::backgroundColor()
     return m_colBackground;
 }
 
+/**
+  @brief    hash of everything that affects rendered images: the background, the cameras, the objects and the light sources
+  @return   MD5 digest, equal for scenes that render equal images, see RT_renderCache
+
+  Buffered manipulations are included, so the hash does not depend on whether the caches are uploaded.
+  Must be called while holding m_mutex
+  **/
+QByteArray RT_scene::stateHash() const
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    rthelpers::hashData(hash, &m_colBackground, sizeof(m_colBackground));
+    int counts[3] = {m_cameras.size(), m_objects.size(), m_lights.size()};
+    rthelpers::hashData(hash, counts, sizeof(counts));
+    for (int i=0; i<m_cameras.size(); i++) {
+        m_cameras.at(i)->hashState(hash);
+    }
+    for (int i=0; i<m_objects.size(); i++) {
+        m_objects.at(i)->hashState(hash);
+    }
+    for (int i=0; i<m_lights.size(); i++) {
+        m_lights.at(i)->hashState(hash);
+    }
+    return hash.result();
+}
+
 /**
   @return   find object (of any kind) within scene and return pointer to it
   @param    name    object name
@@ -372,6 +905,36 @@ RT_object*   RT_scene::findObject(const QString& name) const
     return nullptr;
 }
 
+/**
+  @brief    find object (of any kind) within scene by its numeric handle
+  @param    handle  object handle as assigned when the object was added to the scene
+  @return   pointer to object, or nullptr if no object with this handle exists
+  **/
+RT_object*   RT_scene::findObject(unsigned int handle) const
+{
+    return m_handles.value(handle, nullptr);
+}
+
+/**
+  @brief    assign the next free handle to an object that was just added to the scene
+  @param    obj pointer to the object
+  **/
+void RT_scene::registerHandle(RT_object *obj)
+{
+    obj->m_handle = m_nextHandle++;
+    m_handles.insert(obj->m_handle, obj);
+}
+
+/**
+  @brief    release the handle of an object that is removed from the scene
+  @param    obj pointer to the object
+  **/
+void RT_scene::unregisterHandle(RT_object *obj)
+{
+    m_handles.remove(obj->m_handle);
+    obj->m_handle = 0;
+}
+
 ///////////////// begin: camera handlers ////////////////
 
 /**
@@ -397,6 +960,8 @@ int RT_scene::addCamera(RT_camera *cam)
         }
 
         m_cameras.push_back(cam);                   //it's really a new one; add its
+        registerHandle(cam);
+        m_structureChanged = true;
         if (m_cameras.size() == 1)                  //the first added camera will automatically be the active camera
             m_activeCamera = cam;
 
@@ -529,6 +1094,8 @@ int RT_scene::addObject(RT_object *obj)
         }
 
         m_objects.push_back(obj);                   //it's really a new one; add its
+        registerHandle(obj);
+        m_structureChanged = true;
         return m_objects.size() - 1;
     } else {
         return -1;
@@ -546,8 +1113,10 @@ int RT_scene::removeObject(int idx)
     if (idx < 0)
         return -1;
     if (idx < m_objects.size()) {
-            delete m_objects.at(idx);
+        unregisterHandle(m_objects.at(idx));
+        delete m_objects.at(idx);
         m_objects.remove(idx);
+        m_structureChanged = true;
         return idx;
     } else
         return -1;
@@ -651,7 +1220,15 @@ int RT_scene::addLightSource(RT_lightSource *obj)
             return lightSourceIndex(obj);
         }
 
+        if (m_lights.size() >= MaxLightSources) {
+            spdlog::error("Cannot add light source \"{}\", the scene already holds {} light sources", obj->m_strName.toUtf8().constData(), MaxLightSources);
+            return -1;
+        }
+        obj->m_light_idx = static_cast<unsigned int>(m_lights.size());   //light buffer slots are dense, see deleteObject()
         m_lights.push_back(obj);                   //it's really a new one; add it
+        registerHandle(obj);
+        m_structureChanged = true;
+        m_lightsChanged = true;
         return m_lights.size() - 1;
     } else {
         return -1;
@@ -678,8 +1255,11 @@ int RT_scene::removeLightSource(int idx)
     if (idx < 0)
         return -1;
     if (idx < m_lights.size()) {
+        unregisterHandle(m_lights.at(idx));
         delete m_lights.at(idx);
         m_lights.remove(idx);
+        m_structureChanged = true;
+        m_lightsChanged = true;
         return idx;
     } else
         return -1;
@@ -7,11 +7,9 @@
 #include "RT_lightSource.h"
 #include "RT_cuboid.h"
 #include "RT_mesh.h"
+#include "RT_sceneDescription.h"
 
 #include <zmq.hpp>
-#include <tiff.h>
-#include <tiffio.h>
-
 #include <sutil.h>
 #include <OptiXMesh.h>
 #include <optix.h>
@@ -19,8 +17,14 @@
 #include <optixu/optixu_math_stream_namespace.h>
 #include <optixu_math_namespace.h>
 #include <QString>
+#include <QStringList>
 #include <QVector>
+#include <QHash>
 #include <spdlog/spdlog.h>
+#include <functional>
+#include <mutex>
+
+class RT_histogram;
 
 class RT_scene
 {
@@ -35,10 +39,15 @@ public:
     RT_object* createObject(const QString &name, const QString &objType, const QString &objParams);
     RT_object* createObject(const QString &name, const QString &objType);
     int deleteObject(const QString &name);
+    int uploadMesh(const QString &name, const void *vertices, std::size_t vertex_bytes, const void *indices, std::size_t index_bytes,
+                   const void *normals = nullptr, std::size_t normal_bytes = 0);
 
     ///< for dynamic interaction! enable the expression manipulate("sphere1", "translate", "43,2,-5");
     int manipulateObject(const QString &name,const QString &action,const QString &parameters);
     int manipulateObject(RT_object *object, const QString &action, const QString &parameters);
+    int syncScene(const RT_sceneDescription &desc);
+    int loadScene(const QString &path);
+    int executeCommand(const QStringList &sList);
 
     int addCamera(RT_camera *cam);
     int countCameras() const;
@@ -67,14 +76,20 @@ public:
     QString     lightSourceName(int idx) const;
 
     RT_object*   findObject(const QString& name) const;
+    RT_object*   findObject(unsigned int handle) const;
 //    int         deleteObject(const QString& name);
 //
     void setBackgroundColor(const optix::float3 &col);
     void setBackgroundColor(float x, float y, float z);
     optix::float3 backgroundColor();
+    QByteArray stateHash() const;
 //
 //    bool    checkScene();
     int     updateCaches(bool force = false);
+    int     beginTransaction();
+    int     commitTransaction();
+    bool    inTransaction() const;
+    void    markChanged(RT_object *obj);
 //
 //public:
     bool                          m_bSceneOk;        ///<   is scene ok, set up properly? can we render???
@@ -87,20 +102,43 @@ public:
     QVector< RT_lightSource* >       m_lights;          ///<   list of all light sources within scene
 public:
     int render(int iterations=1);
+    int launchCamera(unsigned int entry_point, unsigned int width, unsigned int height, int iterations, std::vector<unsigned char> &img_data,
+                     bool accumulated = false, const std::function<bool(int)> &progress = std::function<bool(int)>(),
+                     RT_histogram *launch_times = nullptr, RT_histogram *readback_times = nullptr);
+    int readOutput(std::vector<unsigned char> &img_data, bool accumulated = false);
+    QString nextImagePath(const QString &cam_name);
+    void setImageDirectory(const QString &dir);
+    QString imageDirectory() const;
     optix::Group m_rootGroup;
 
+    std::mutex m_mutex;     ///<   guards the scene and its optix context between the network and the render thread
+
+    static const int MaxLightSources = 1000;        ///<   size of the light buffer of the context
+
 private:
     optix::Context m_context;
     optix::Group m_top_group;
     void setupContext();
     void initPrograms();
     void initOutputBuffers();
+    int uploadCaches(bool force);
+    static QByteArray meshHash(const RT_objectDescription &desc);
 
     optix::Program m_miss_program;
     optix::Buffer m_outputBuffer;
     optix::Buffer m_accumBuffer;
 
     unsigned int m_render_counter=0;
+    QString m_imageDirectory = "/tmp";             ///<   directory rendered images are saved to, empty to not save them
+
+    void registerHandle(RT_object *obj);
+    void unregisterHandle(RT_object *obj);
+    unsigned int m_nextHandle = 1;                  ///<   next free object handle (0 is reserved for "no object")
+    QHash< unsigned int, RT_object* > m_handles;    ///<   lookup of all scene objects by their handle
+
+    bool m_transactionOpen = false;                 ///<   "begin" was executed, caches are uploaded at "commit"
+    bool m_structureChanged = true;                 ///<   objects were added or removed since the context was validated
+    bool m_lightsChanged = true;                    ///<   light sources were added or removed since the light buffer was written
 };
 
 #endif //NSLAIFT_RT_SCENE_H
@@ -0,0 +1,341 @@
+/**
+  @file     RT_sceneDescription.cpp
+  @brief    declarative description of a complete scene
+
+  See RT_sceneDescription.h for the JSON and the binary layout
+**/
+
+#include "RT_sceneDescription.h"
+#include "RT_matrixHelpers.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QSet>
+#include <QtEndian>
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+
+namespace {
+    const char Magic[4] = {'R', 'F', 'S', '1'};
+
+    /**
+      @brief    read a JSON array of numbers
+      @param    value   the array
+      @param    count   expected number of elements
+      @param    dst     target array (at least count elements)
+      @return   false if value is no array of count numbers
+      **/
+    bool readFloats(const QJsonValue &value, int count, float *dst)
+    {
+        QJsonArray array = value.toArray();
+        if (!value.isArray() || array.size() != count) {
+            return false;
+        }
+        for (int i=0; i<count; i++) {
+            if (!array.at(i).isDouble()) {
+                return false;
+            }
+            dst[i] = static_cast<float>(array.at(i).toDouble());
+        }
+        return true;
+    }
+
+    ///< sequential little endian reader of the binary form, every read fails once the data is exhausted
+    class Reader
+    {
+    public:
+        explicit Reader(const QByteArray &data) : m_data(data), m_pos(0) {}
+
+        bool skip(int size)
+        {
+            if (size < 0 || size > m_data.size() - m_pos) {
+                return false;
+            }
+            m_pos += size;
+            return true;
+        }
+
+        bool readUInt32(quint32 &value)
+        {
+            if (m_data.size() - m_pos < 4) {
+                return false;
+            }
+            value = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(m_data.constData()) + m_pos);
+            m_pos += 4;
+            return true;
+        }
+
+        bool readFloats(float *dst, int count)
+        {
+            for (int i=0; i<count; i++) {
+                quint32 raw;
+                if (!readUInt32(raw)) {
+                    return false;
+                }
+                memcpy(&dst[i], &raw, sizeof(float));
+            }
+            return true;
+        }
+
+        bool readString(QString &str)
+        {
+            quint32 size = 0;
+            if (!readUInt32(size) || size > static_cast<quint32>(m_data.size() - m_pos)) {
+                return false;
+            }
+            str = QString::fromUtf8(m_data.constData() + m_pos, static_cast<int>(size));
+            m_pos += static_cast<int>(size);
+            return true;
+        }
+
+        ///< count elements of element_size bytes, copied without conversion like the uploadMesh frames
+        bool readBytes(QByteArray &dst, std::size_t element_size, quint32 count)
+        {
+            if (static_cast<quint64>(count) * element_size > static_cast<quint64>(m_data.size() - m_pos)) {
+                return false;
+            }
+            int size = static_cast<int>(count * element_size);
+            dst = m_data.mid(m_pos, size);
+            m_pos += size;
+            return true;
+        }
+
+    private:
+        const QByteArray &m_data;
+        int m_pos;
+    };
+
+    int checkNames(const RT_sceneDescription &desc)
+    {
+        QSet<QString> names;
+        for (int i=0; i<desc.objects.size(); i++) {
+            if (names.contains(desc.objects.at(i).name)) {
+                spdlog::error("Scene description names the object {} twice", desc.objects.at(i).name.toUtf8().constData());
+                return -21;
+            }
+            names.insert(desc.objects.at(i).name);
+        }
+        return 0;
+    }
+
+    ///< numbers of a shorthand property as action parameters, e.g. "0.5,0.5,1"
+    QString joinFloats(const float *values, int count, const QString &delimiter = QString(","))
+    {
+        QStringList fields;
+        for (int i=0; i<count; i++) {
+            fields << QString::number(static_cast<double>(values[i]), 'g', 9);
+        }
+        return fields.join(delimiter);
+    }
+
+    /**
+      @brief    turn the shorthand properties of an object into the actions that set them
+      @param    json    the entry of the "objects" array
+      @param    obj     receives the actions
+      @return   0 on success, -21 if a property has the wrong number of values
+      **/
+    int readProperties(const QJsonObject &json, RT_objectDescription &obj)
+    {
+        struct Property {
+            const char *name;
+            int count;
+            const char *action;
+        };
+        static const Property Properties[] = {
+            {"K", 9, "setIntrinsics"},
+            {"distortion", 5, "setDistortion"},
+            {"radius", 1, "setRadius"},
+            {"color", 3, "setColor"},
+            {"power", 1, "setPower"}
+        };
+        float values[9];
+        if (json.contains("resolution")) {
+            if (!readFloats(json.value("resolution"), 2, values)) {
+                spdlog::error("Scene description: \"resolution\" of {} is no array of 2 numbers", obj.name.toUtf8().constData());
+                return -21;
+            }
+            obj.actions.append(qMakePair(QString("setResolution"), joinFloats(values, 2, "x")));
+        }
+        for (const Property &property : Properties) {
+            if (!json.contains(property.name)) {
+                continue;
+            }
+            QJsonValue value = json.value(property.name);
+            bool ok = (property.count == 1) ? value.isDouble() : readFloats(value, property.count, values);
+            if (!ok) {
+                spdlog::error("Scene description: \"{}\" of {} needs {} numbers", property.name, obj.name.toUtf8().constData(), property.count);
+                return -21;
+            }
+            if (property.count == 1) {
+                values[0] = static_cast<float>(value.toDouble());
+            }
+            obj.actions.append(qMakePair(QString(property.action), joinFloats(values, property.count)));
+        }
+        if (json.contains("material")) {
+            QJsonObject material = json.value("material").toObject();
+            if (material.contains("type")) {
+                obj.actions.append(qMakePair(QString("setMaterialType"), material.value("type").toString()));
+            }
+            static const char *const Colors[] = {"color", "Kd", "Ks"};
+            for (const char *color : Colors) {
+                if (!material.contains(color)) {
+                    continue;
+                }
+                if (!readFloats(material.value(color), 3, values)) {
+                    spdlog::error("Scene description: material \"{}\" of {} is no array of 3 numbers", color, obj.name.toUtf8().constData());
+                    return -21;
+                }
+                obj.actions.append(qMakePair(QString("setMaterialParameter"), QString(color) + ";" + joinFloats(values, 3)));
+            }
+            if (material.contains("spec_exp")) {
+                values[0] = static_cast<float>(material.value("spec_exp").toDouble());
+                obj.actions.append(qMakePair(QString("setMaterialParameter"), "spec_exp;" + joinFloats(values, 1)));
+            }
+        }
+        return 0;
+    }
+
+    /**
+      @brief    read one entry of the "objects" array
+      @return   0 on success, -21 if the entry is malformed
+      **/
+    int readObject(const QJsonObject &json, RT_objectDescription &obj)
+    {
+        obj.name = json.value("name").toString();
+        obj.type = json.value("type").toString();
+        obj.params = json.value("params").toString();
+        if (obj.name.isEmpty() || obj.type.isEmpty()) {
+            spdlog::error("Scene description: every object needs a \"name\" and a \"type\"");
+            return -21;
+        }
+        if (json.contains("transform")) {
+            float values[16];
+            if (!readFloats(json.value("transform"), 16, values)) {
+                spdlog::error("Scene description: \"transform\" of {} is no array of 16 numbers", obj.name.toUtf8().constData());
+                return -21;
+            }
+            obj.transform = optix::Matrix4x4(values);
+        } else {
+            float position[3] = {0.0f, 0.0f, 0.0f};
+            float rotation[3] = {0.0f, 0.0f, 0.0f};
+            if ((json.contains("position") && !readFloats(json.value("position"), 3, position))
+                || (json.contains("rotation") && !readFloats(json.value("rotation"), 3, rotation))) {
+                spdlog::error("Scene description: \"position\" or \"rotation\" of {} is no array of 3 numbers", obj.name.toUtf8().constData());
+                return -21;
+            }
+            obj.transform = optix::Matrix4x4::translate(optix::make_float3(position[0], position[1], position[2]))
+                          * mhelpers::rotation(rotation[0] * M_PIf / 180.0f, rotation[1] * M_PIf / 180.0f, rotation[2] * M_PIf / 180.0f);
+        }
+        obj.visible = json.value("visible").toBool(true);
+        int ret = readProperties(json, obj);
+        if (ret < 0) {
+            return ret;
+        }
+        QJsonArray actions = json.value("actions").toArray();
+        for (int i=0; i<actions.size(); i++) {
+            QJsonArray action = actions.at(i).toArray();
+            if (action.isEmpty() || action.size() > 2 || !action.at(0).isString()) {
+                spdlog::error("Scene description: action {} of {} is no [action, parameters] pair", i, obj.name.toUtf8().constData());
+                return -21;
+            }
+            obj.actions.append(qMakePair(action.at(0).toString(), (action.size() > 1) ? action.at(1).toString() : QString()));
+        }
+        return 0;
+    }
+}
+
+/**
+  @brief    parse the JSON form of a scene description
+  @param    json    UTF-8 JSON document, see RT_sceneDescription.h
+  @param    desc    receives the description
+  @return   0 on success, -21 if the document is malformed or names an object twice
+  **/
+int RT_sceneDescription::fromJson(const QByteArray &json, RT_sceneDescription &desc)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(json, &error);
+    if (!doc.isObject()) {
+        spdlog::error("Scene description is no JSON object: {}", error.errorString().toUtf8().constData());
+        return -21;
+    }
+    QJsonObject root = doc.object();
+    desc = RT_sceneDescription();
+    if (root.contains("background")) {
+        float color[3];
+        if (!readFloats(root.value("background"), 3, color)) {
+            spdlog::error("Scene description: \"background\" is no array of 3 numbers");
+            return -21;
+        }
+        desc.hasBackground = true;
+        desc.background = optix::make_float3(color[0], color[1], color[2]);
+    }
+    QJsonArray objects = root.value("objects").toArray();
+    desc.objects.resize(objects.size());
+    for (int i=0; i<objects.size(); i++) {
+        int ret = readObject(objects.at(i).toObject(), desc.objects[i]);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return checkNames(desc);
+}
+
+/**
+  @brief    state if data holds the binary form of a scene description
+  **/
+bool RT_sceneDescription::isBinary(const QByteArray &data)
+{
+    return data.size() >= 4 && 0 == memcmp(data.constData(), Magic, 4);
+}
+
+/**
+  @brief    parse the binary form of a scene description
+  @param    data    file content, see RT_sceneDescription.h
+  @param    desc    receives the description
+  @return   0 on success, -21 if the data is truncated or malformed or names an object twice
+  **/
+int RT_sceneDescription::fromBinary(const QByteArray &data, RT_sceneDescription &desc)
+{
+    desc = RT_sceneDescription();
+    Reader reader(data);
+    quint32 flags = 0;
+    quint32 count = 0;
+    float background[3];
+    if (!isBinary(data) || !reader.skip(4) || !reader.readUInt32(flags) || !reader.readFloats(background, 3) || !reader.readUInt32(count)) {
+        spdlog::error("Scene description has no valid binary header");
+        return -21;
+    }
+    desc.hasBackground = (flags & 1) != 0;
+    desc.background = optix::make_float3(background[0], background[1], background[2]);
+    for (quint32 i=0; i<count; i++) {
+        RT_objectDescription obj;
+        float transform[16];
+        quint32 visible = 0;
+        quint32 action_count = 0;
+        bool ok = reader.readString(obj.name) && reader.readString(obj.type) && reader.readString(obj.params)
+                  && reader.readFloats(transform, 16) && reader.readUInt32(visible) && reader.readUInt32(action_count);
+        for (quint32 a=0; ok && a<action_count; a++) {
+            QPair<QString, QString> action;
+            ok = reader.readString(action.first) && reader.readString(action.second);
+            obj.actions.append(action);
+        }
+        quint32 vertex_count = 0;
+        quint32 triangle_count = 0;
+        quint32 has_normals = 0;
+        ok = ok && reader.readUInt32(vertex_count) && reader.readUInt32(triangle_count) && reader.readUInt32(has_normals)
+             && reader.readBytes(obj.vertices, 3 * sizeof(float), vertex_count)
+             && reader.readBytes(obj.indices, 3 * sizeof(quint32), triangle_count)
+             && (!has_normals || reader.readBytes(obj.normals, 3 * sizeof(float), vertex_count));
+        if (!ok || obj.name.isEmpty() || obj.type.isEmpty()) {
+            spdlog::error("Object {} of the binary scene description is truncated or has no name or type", i);
+            return -21;
+        }
+        obj.transform = optix::Matrix4x4(transform);
+        obj.visible = (visible != 0);
+        desc.objects.append(obj);
+    }
+    return checkNames(desc);
+}
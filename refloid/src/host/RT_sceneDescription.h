@@ -0,0 +1,71 @@
+/**
+  @file     RT_sceneDescription.h
+  @brief    declarative description of a complete scene
+
+  A description lists every object of a scene with its creation type, its pose, its visibility and
+  the actions that set its remaining properties. RT_scene::syncScene() turns the current scene into
+  the described one with as few changes as possible, RT_scene::loadScene() reads it from a file.
+  The JSON form is
+
+    {"background": [r, g, b],
+     "objects": [{"name": "cam1", "type": "camera", "transform": [16 floats, row major],
+                  "resolution": [1280, 960], "K": [9 floats, row major], "distortion": [k1, k2, p1, p2, k3]},
+                 {"name": "part", "type": "mesh", "params": "/data/part.ply",
+                  "position": [x, y, z], "rotation": [rX, rY, rZ], "visible": false,
+                  "material": {"type": "phong", "Kd": [r, g, b], "Ks": [r, g, b], "spec_exp": 2}},
+                 {"name": "ball", "type": "sphere", "radius": 0.5, "actions": [["spin", "0,0,45"]]},
+                 {"name": "light1", "type": "lightpoint", "position": [0, 10, 0], "color": [1, 1, 1], "power": 2}]}
+
+  "params" is the parameter of createObject, the pose is either "transform" or "position" and
+  "rotation" (degrees, rotated first), both default to the identity. The properties "resolution",
+  "K", "distortion", "radius", "color", "power" and "material" are shorthands for the actions that
+  set them, "actions" lists any further manipulateObject actions and is applied last.
+
+  The binary form holds the same description plus the triangles of meshes, so no PLY file is needed
+  on the server. All values are little endian, strings are a uint32 byte count followed by UTF-8:
+
+    header  "RFS1", uint32 flags (1 = has background), float background[3], uint32 object count
+    object  string name, string type, string params, float transform[16] (row major), uint32 visible,
+            uint32 action count, per action string action and string parameters,
+            uint32 vertex count, uint32 triangle count, uint32 has normals,
+            float vertices[3 * vertex count], uint32 indices[3 * triangle count],
+            float normals[3 * vertex count] if it has normals
+**/
+
+#ifndef NSLAIFT_RT_SCENEDESCRIPTION_H
+#define NSLAIFT_RT_SCENEDESCRIPTION_H
+
+#include <optix.h>
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_stream_namespace.h>
+#include <optixu_math_namespace.h>
+#include <QByteArray>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+struct RT_objectDescription
+{
+    QString name;
+    QString type;                                   ///< object type of createObject, e.g. "sphere"
+    QString params;                                 ///< creation parameters of createObject, e.g. the ply file of a mesh
+    optix::Matrix4x4 transform = optix::Matrix4x4::identity();
+    bool visible = true;
+    QVector< QPair<QString, QString> > actions;     ///< manipulateObject actions and their parameters, in order
+    QByteArray vertices;                            ///< triangles of a mesh (binary form only), see RT_scene::uploadMesh()
+    QByteArray indices;
+    QByteArray normals;
+};
+
+struct RT_sceneDescription
+{
+    bool hasBackground = false;
+    optix::float3 background = {0.0f, 0.0f, 0.0f};
+    QVector<RT_objectDescription> objects;
+
+    static int fromJson(const QByteArray &json, RT_sceneDescription &desc);
+    static int fromBinary(const QByteArray &data, RT_sceneDescription &desc);
+    static bool isBinary(const QByteArray &data);
+};
+
+#endif //NSLAIFT_RT_SCENEDESCRIPTION_H
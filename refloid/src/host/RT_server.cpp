@@ -0,0 +1,241 @@
+/**
+  @file     RT_server.cpp
+  @brief    ZMQ front end of the raytracer
+**/
+
+#include "RT_server.h"
+#include "RT_metrics.h"
+
+#include <iostream>
+
+namespace {
+    const char *const ReplyEndpoint = "inproc://refloid-replies";
+    const char *const PreviewEndpoint = "inproc://refloid-previews";
+}
+
+/**
+  @brief    bind the client sockets and start the worker threads
+  @param    endpoint        ZMQ endpoint clients connect to, e.g. "tcp://*:5555"
+  @param    stream_endpoint ZMQ endpoint render previews are published on, empty to not publish previews
+  @param    workers         number of worker threads the sessions are distributed over
+  @param    queue_capacity  number of requests that can wait in the queue of each worker
+  @param    back_pressure   what happens to requests for a worker whose queue is full
+  @param    ack_mode        when requests of sessions that did not send "setAck" are answered
+  @param    scene_file      scene file every new session starts with (see RT_scene::loadScene), empty for an empty scene
+  **/
+RT_server::RT_server(const std::string &endpoint, const std::string &stream_endpoint, int workers,
+                     std::size_t queue_capacity, BackPressure back_pressure, AckMode ack_mode,
+                     const std::string &scene_file) :
+        m_zmqContext(1),
+        m_socket(m_zmqContext, ZMQ_ROUTER),
+        m_replies(m_zmqContext, ZMQ_PULL),
+        m_nextWorker(0),
+        m_backPressure(back_pressure),
+        m_ackMode(ack_mode),
+        m_heldWorker(-1)
+{
+    // inproc endpoints have to be bound before the workers and render threads connect
+    m_replies.bind(ReplyEndpoint);
+    std::string preview_endpoint;
+    if (!stream_endpoint.empty()) {
+        m_previews.reset(new zmq::socket_t(m_zmqContext, ZMQ_PULL));
+        m_previews->bind(PreviewEndpoint);
+        m_stream.reset(new zmq::socket_t(m_zmqContext, ZMQ_PUB));
+        m_stream->bind(stream_endpoint);
+        preview_endpoint = PreviewEndpoint;
+        spdlog::info("Publishing render previews on {}", stream_endpoint);
+    }
+
+    workers = (workers > 0) ? workers : 1;
+    for (int i=0; i<workers; i++) {
+        std::string doorbell_endpoint = "inproc://refloid-worker-" + std::to_string(i);
+        m_doorbellSockets.emplace_back(new zmq::socket_t(m_zmqContext, ZMQ_PAIR));
+        m_doorbellSockets.back()->bind(doorbell_endpoint);
+        m_workers.emplace_back(new RT_worker(i, m_zmqContext, doorbell_endpoint, ReplyEndpoint, preview_endpoint, queue_capacity,
+                                                scene_file));
+    }
+
+    m_socket.bind(endpoint);
+    spdlog::info("Listening for commands on {} with {} workers", endpoint, workers);
+}
+
+/**
+  @brief    close all sessions and stop the workers
+  **/
+RT_server::~RT_server()
+{
+    for (std::size_t i=0; i<m_workers.size(); i++) {
+        m_workers[i]->stop(*m_doorbellSockets[i]);
+    }
+    // Joins the worker threads
+    m_workers.clear();
+}
+
+/**
+  @brief    serve requests until stdin is closed
+  @return   0
+
+  While a request is held back (BackPressure Hold) the client socket is not read and the queue of
+  its worker is checked every millisecond.
+  **/
+int RT_server::run()
+{
+    while (std::cin.good()) {
+        zmq::pollitem_t items[] = {
+                {static_cast<void*>(m_socket), 0, static_cast<short>(m_held ? 0 : ZMQ_POLLIN), 0},
+                {static_cast<void*>(m_replies), 0, ZMQ_POLLIN, 0},
+                {m_previews ? static_cast<void*>(*m_previews) : nullptr, 0, ZMQ_POLLIN, 0}
+        };
+        zmq::poll(items, m_previews ? 3 : 2, m_held ? 1 : -1);
+
+        if (items[1].revents & ZMQ_POLLIN) {
+            forward(m_replies, m_socket);
+        }
+        if (m_previews && (items[2].revents & ZMQ_POLLIN)) {
+            forward(*m_previews, *m_stream);
+        }
+        if (m_held && submit(m_held, m_heldWorker)) {
+            m_held.reset();
+        }
+        if (!m_held && (items[0].revents & ZMQ_POLLIN)) {
+            route(receiveRequest());
+        }
+    }
+    return 0;
+}
+
+/**
+  @brief    receive all frames of the next request on the client socket
+  @return   the request with its routing envelope, its command frame, its data frames and its session
+  **/
+std::unique_ptr<RT_session::Request> RT_server::receiveRequest()
+{
+    auto received = std::chrono::steady_clock::now();
+    std::vector<zmq::message_t> frames;
+    do {
+        frames.emplace_back();
+        m_socket.recv(&frames.back());
+    } while (frames.back().more());
+
+    // REQ clients put an empty delimiter between routing id and payload, DEALER clients may not
+    std::size_t body = 1;
+    for (std::size_t i=0; i<frames.size(); i++) {
+        if (frames[i].size() == 0) {
+            body = i + 1;
+            break;
+        }
+    }
+
+    std::unique_ptr<RT_session::Request> req(new RT_session::Request);
+    req->received = received;
+    for (std::size_t i=0; i<body && i<frames.size(); i++) {
+        req->envelope << QByteArray(static_cast<const char*>(frames[i].data()), static_cast<int>(frames[i].size()));
+    }
+    if (body < frames.size()) {
+        req->payload = std::move(frames[body]);
+    }
+    for (std::size_t i=body+1; i<frames.size(); i++) {
+        req->frames.push_back(std::move(frames[i]));
+    }
+    req->session = RT_session::sessionName(req->payload.data(), req->payload.size(), req->prefixSize);
+    return req;
+}
+
+/**
+  @brief    hand a request over to the worker of its session
+  @param    req the request, owned by the worker afterwards
+
+  New sessions are assigned to the workers round robin. The assignment is kept when a session is
+  closed, so a reopened session ends up on the same worker.
+  **/
+void RT_server::route(std::unique_ptr<RT_session::Request> req)
+{
+    if (setAckMode(*req)) {
+        return;
+    }
+    int worker = m_sessionWorkers.value(req->session, -1);
+    if (worker < 0) {
+        worker = m_nextWorker;
+        m_nextWorker = (m_nextWorker + 1) % static_cast<int>(m_workers.size());
+        m_sessionWorkers.insert(req->session, worker);
+    }
+    if (submit(req, worker)) {
+        return;
+    }
+    if (m_backPressure == Hold) {
+        static std::atomic<quint64> *const held = RT_metrics::instance().counter("queue/held");
+        held->fetch_add(1, std::memory_order_relaxed);
+        m_held = std::move(req);
+        m_heldWorker = worker;
+    } else {
+        spdlog::warn("Request queue of worker {} is full, rejecting a request of session \"{}\"", worker, req->session.toUtf8().constData());
+        static std::atomic<quint64> *const rejected = RT_metrics::instance().counter("queue/rejected");
+        rejected->fetch_add(1, std::memory_order_relaxed);
+        RT_session::reject(m_socket, *req, -20);
+    }
+}
+
+/**
+  @brief    push a request into the queue of a worker, it is acknowledged first if its session asked for it
+  @param    req     the request, owned by the worker afterwards unless the queue is full
+  @param    worker  index of the worker
+  @return   false if the queue of the worker is full
+  **/
+bool RT_server::submit(std::unique_ptr<RT_session::Request> &req, int worker)
+{
+    if (!m_workers[worker]->canSubmit()) {
+        return false;
+    }
+    // The worker may delete the request as soon as it is queued, so the acknowledgement goes first
+    if (m_sessionAcks.value(req->session, m_ackMode) == AckOnEnqueue) {
+        RT_session::reject(m_socket, *req, 0);
+        req->acked = true;
+    }
+    return m_workers[worker]->submit(req, *m_doorbellSockets[worker]);
+}
+
+/**
+  @brief    execute "setAck;enqueue" and "setAck;apply", which have to be sent in a frame of their own
+  @param    req the request
+  @return   true if the request was such a command and was answered (0, or -11 for another mode)
+
+  The setting is kept by the server and not by the session, as it decides when the server replies.
+  It is kept when the session is closed.
+  **/
+bool RT_server::setAckMode(RT_session::Request &req)
+{
+    static const char Command[] = "setAck;";
+    const std::size_t command_size = sizeof(Command) - 1;
+    const char *data = static_cast<const char*>(req.payload.data()) + req.prefixSize;
+    std::size_t size = req.payload.size() - req.prefixSize;
+    if (size < command_size || 0 != qstrnicmp(data, Command, static_cast<uint>(command_size))) {
+        return false;
+    }
+    QString mode = QString::fromUtf8(data + command_size, static_cast<int>(size - command_size)).trimmed();
+    if (0 == mode.compare("enqueue", Qt::CaseInsensitive)) {
+        m_sessionAcks.insert(req.session, AckOnEnqueue);
+    } else if (0 == mode.compare("apply", Qt::CaseInsensitive)) {
+        m_sessionAcks.insert(req.session, AckOnApply);
+    } else {
+        RT_session::reject(m_socket, req, -11);
+        return true;
+    }
+    RT_session::reject(m_socket, req, 0);
+    return true;
+}
+
+/**
+  @brief    forward one multipart message, the frames are moved and not copied
+  @param    from    socket to receive from
+  @param    to      socket to send to
+  **/
+void RT_server::forward(zmq::socket_t &from, zmq::socket_t &to)
+{
+    bool more = true;
+    while (more) {
+        zmq::message_t frame;
+        from.recv(&frame);
+        more = frame.more();
+        to.send(frame, more ? ZMQ_SNDMORE : 0);
+    }
+}
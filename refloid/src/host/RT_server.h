@@ -0,0 +1,80 @@
+/**
+  @file     RT_server.h
+  @brief    ZMQ front end of the raytracer
+
+  Serves text and binary scene commands on a ZMQ_ROUTER socket, so several clients (REQ or DEALER)
+  can be connected at the same time. Every client works in a named session with its own scene,
+  selected by the prefix "@<session>;" in front of its commands; commands without prefix go to the
+  default session "". Sessions are distributed over a pool of worker threads (RT_worker), so clients
+  of different sessions do not wait for each other. This thread only routes requests to the workers
+  through their lock-free request queues and forwards their replies and the render previews, it never
+  touches a scene.
+
+  If the queue of a worker is full, the request is either rejected with -20 right away (Reject) or
+  the server stops reading from the client socket until there is room again (Hold), so the ZMQ high
+  water marks push back on the clients. A session can ask for its requests to be acknowledged when
+  they are queued instead of when they are executed ("setAck;enqueue"): the reply then carries 0 for
+  every command (or binary record) and errors only show up in the log and in "stats".
+**/
+
+#ifndef NSLAIFT_RT_SERVER_H
+#define NSLAIFT_RT_SERVER_H
+
+#include "RT_session.h"
+#include "RT_worker.h"
+
+#include <zmq.hpp>
+#include <QHash>
+#include <QString>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class RT_server
+{
+public:
+    ///< what happens to a request if the queue of its worker is full
+    enum BackPressure {
+        Reject,         ///< reply -20 for every command of the request
+        Hold            ///< keep the request and stop reading from the client socket until it fits
+    };
+
+    ///< when a request is answered
+    enum AckMode {
+        AckOnApply,     ///< with the results, once the worker executed it
+        AckOnEnqueue    ///< with status 0 for every command, as soon as it is queued
+    };
+
+    RT_server(const std::string &endpoint, const std::string &stream_endpoint = std::string(), int workers = 4,
+              std::size_t queue_capacity = 1024, BackPressure back_pressure = Reject, AckMode ack_mode = AckOnApply,
+              const std::string &scene_file = std::string());
+    ~RT_server();
+
+    int run();
+
+private:
+    std::unique_ptr<RT_session::Request> receiveRequest();
+    void route(std::unique_ptr<RT_session::Request> req);
+    bool submit(std::unique_ptr<RT_session::Request> &req, int worker);
+    bool setAckMode(RT_session::Request &req);
+    void forward(zmq::socket_t &from, zmq::socket_t &to);
+
+    zmq::context_t m_zmqContext;
+    zmq::socket_t m_socket;                         ///< ZMQ_ROUTER socket the clients connect to
+    zmq::socket_t m_replies;                        ///< ZMQ_PULL socket receiving the replies of all workers
+    std::unique_ptr<zmq::socket_t> m_previews;      ///< ZMQ_PULL socket receiving the previews of all render threads
+    std::unique_ptr<zmq::socket_t> m_stream;        ///< ZMQ_PUB socket the previews are published on
+    std::vector< std::unique_ptr<zmq::socket_t> > m_doorbellSockets;    ///< ZMQ_PAIR doorbell socket per worker
+    std::vector< std::unique_ptr<RT_worker> > m_workers;
+    QHash<QString, int> m_sessionWorkers;           ///< worker each session is assigned to
+    int m_nextWorker;
+    BackPressure m_backPressure;
+    AckMode m_ackMode;                              ///< default of sessions that did not send "setAck"
+    QHash<QString, AckMode> m_sessionAcks;
+    std::unique_ptr<RT_session::Request> m_held;    ///< request waiting for room in the queue of m_heldWorker (Hold)
+    int m_heldWorker;
+};
+
+#endif //NSLAIFT_RT_SERVER_H
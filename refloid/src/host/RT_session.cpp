@@ -0,0 +1,1069 @@
+/**
+  @file     RT_session.cpp
+  @brief    named client session with its own scene and render thread
+**/
+
+#include "RT_session.h"
+#include "RT_binaryProtocol.h"
+#include "RT_codec.h"
+#include "RT_metrics.h"
+#include "RT_viewpointSearch.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <atomic>
+#include <unistd.h>
+
+namespace {
+    std::atomic<unsigned int> shmCounter(0);    ///< makes the shared memory names of all sessions unique
+}
+
+/**
+  @brief    create the scene of the session and start its render thread
+  @param    name                session name, "" for the default session
+  @param    zmq_context         context used for the sockets of the render thread
+  @param    reply_socket        socket of the owning worker replies are sent to
+  @param    event_endpoint      inproc endpoint the owning worker has bound a ZMQ_PULL socket to
+  @param    preview_endpoint    inproc endpoint render previews are pushed to, empty to not send previews
+  @param    scene_file          scene file loaded into the new scene, empty for an empty scene
+  **/
+RT_session::RT_session(const QString &name, zmq::context_t &zmq_context, zmq::socket_t &reply_socket,
+                       const std::string &event_endpoint, const std::string &preview_endpoint, const QString &scene_file) :
+        m_name(name),
+        m_replySocket(reply_socket),
+        m_sceneBlocked(false),
+        m_closeRequested(false),
+        m_streamEvery(0),
+        m_streamDownsample(1),
+        m_commandTimes("command/"),
+        m_commandErrors("command/", "/errors")
+{
+    spdlog::info("Opening session \"{}\"", name.toUtf8().constData());
+    m_scene = new RT_scene();
+    if (!scene_file.isEmpty()) {
+        m_scene->loadScene(scene_file);
+    }
+    // Previews of named sessions are tagged like their commands, so subscribers can filter by session
+    QString preview_prefix = name.isEmpty() ? QString() : QString("@%1;").arg(name);
+    m_renderThread = new RT_renderThread(m_scene, zmq_context, event_endpoint, preview_endpoint, preview_prefix);
+}
+
+RT_session::~RT_session()
+{
+    spdlog::info("Closing session \"{}\"", m_name.toUtf8().constData());
+    delete m_renderThread;
+    delete m_scene;
+}
+
+QString RT_session::name() const
+{
+    return m_name;
+}
+
+/**
+  @brief    queue a request behind the parked ones and execute what can be executed
+  @param    req request routed to this session
+  **/
+void RT_session::enqueue(std::unique_ptr<Request> req)
+{
+    const char *data = static_cast<const char*>(req->payload.data());
+    req->binary = rtbinary::isBinaryFrame(data + req->prefixSize, req->payload.size() - req->prefixSize);
+    if (!req->binary) {
+        req->commands = splitCommands(*req);
+    }
+    // New requests queue up behind the parked ones to keep the order in which scene commands arrived
+    m_parked.push_back(std::move(req));
+    resumeParked();
+}
+
+/**
+  @brief    check whether the session can be dropped
+  @return   true after "closeSession" once all requests are answered
+  **/
+bool RT_session::isClosed() const
+{
+    return m_closeRequested && m_parked.empty();
+}
+
+/**
+  @brief    get the session a request is routed to
+  @param    data        request payload
+  @param    size        payload size in bytes
+  @param    prefix_size size of the session prefix "@<session>;", 0 if there is none
+  @return   session name, "" for the default session
+
+  Only the start of the payload is looked at, the session of a frame is the one of its first command
+  **/
+QString RT_session::sessionName(const void *data, std::size_t size, std::size_t &prefix_size)
+{
+    const char *bytes = static_cast<const char*>(data);
+    prefix_size = 0;
+    if (size == 0 || bytes[0] != '@') {
+        return QString();
+    }
+    std::size_t end = 1;
+    while (end < size && bytes[end] != ';' && bytes[end] != '\n' && bytes[end] != '\r') {
+        end++;
+    }
+    prefix_size = (end < size) ? end + 1 : end;
+    return QString::fromUtf8(bytes + 1, static_cast<int>(end - 1)).trimmed();
+}
+
+/**
+  @brief    reply to a request without executing it, e.g. because it cannot be executed at all or to
+            acknowledge it before it is executed
+  @param    reply_socket    socket the reply is sent to
+  @param    req             the request, it is not changed except for its attachments
+  @param    status          status reported for every command (or binary record)
+  **/
+void RT_session::reject(zmq::socket_t &reply_socket, Request &req, int status)
+{
+    QByteArray reply;
+    const char *data = static_cast<const char*>(req.payload.data());
+    if (rtbinary::isBinaryFrame(data + req.prefixSize, req.payload.size() - req.prefixSize)) {
+        rtbinary::reject(data + req.prefixSize, req.payload.size() - req.prefixSize, status, reply);
+    } else {
+        int count = splitCommands(req).size();
+        QStringList replies;
+        for (int i=0; i<count; i++) {
+            replies << QString::number(status);
+        }
+        reply = replies.join("\n").toUtf8();
+    }
+    sendReply(reply_socket, req, reply);
+}
+
+/**
+  @brief    name a command is recorded under in the "command/<name>" metrics
+  @param    command first field of the command as sent by the client
+  @param    reply   reply of the command
+  @return   the command; "unknown" if it was answered with -10, the names of unknown commands come
+            from the client and would use up RT_metrics::MaxMetrics
+  **/
+const QString& RT_session::metricsName(const QString &command, const QString &reply)
+{
+    static const QString unknown("unknown");
+    return (reply == QLatin1String("-10")) ? unknown : command;
+}
+
+/**
+  @brief    split a text payload into its newline separated commands
+  @param    req the request
+  @return   the commands, lines holding only a session prefix are dropped
+  **/
+QStringList RT_session::splitCommands(const Request &req)
+{
+    QStringList commands;
+    QString text = QString::fromUtf8(static_cast<const char*>(req.payload.data()), static_cast<int>(req.payload.size()));
+    spdlog::debug("Received String via ZMQ: \"{}\"", text.toUtf8().constData());
+    // One frame may carry several newline separated commands
+    QStringList lines = text.split("\n");
+    for (int i=0; i<lines.size(); i++) {
+        QString command = lines.at(i).trimmed();
+        // A line holding only the session prefix just selects the session
+        std::size_t prefix_size = 0;
+        QByteArray utf8 = command.toUtf8();
+        sessionName(utf8.constData(), utf8.size(), prefix_size);
+        if (!command.isEmpty() && prefix_size < static_cast<std::size_t>(utf8.size())) {
+            commands << command;
+        }
+    }
+    return commands;
+}
+
+/**
+  @brief    continue all parked requests that are able to make progress
+  **/
+void RT_session::resumeParked()
+{
+    m_sceneBlocked = false;
+    for (auto it = m_parked.begin(); it != m_parked.end(); ) {
+        if (process(**it)) {
+            it = m_parked.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+  @brief    execute a request as far as possible
+  @param    req the request
+  @return   true if the reply was sent; false if the request has to be parked
+
+  Text commands are executed in order, every command gets its own reply line:
+    - the status code of scene commands (0 on success, negative on error, see executeSceneCommand)
+    - the status code of "uploadMesh", see uploadMesh()
+    - the number of changed objects for "syncScene[;<json>]", see syncScene()
+    - the job id for "render[;iterations[;format[;<cameras>]]]" and "sweep;<object>;<action>;<poses>[;iterations[;format]]",
+      see submitCameras() and submitSweep(),
+      followed by ";cached" if the job was finished from the render cache
+    - the job id for "renderFor;<ms>[;format[;<cameras>]]", a render that accumulates as many iterations as fit
+      into <ms> milliseconds (-11 if <ms> is missing or not positive)
+    - the job id for "optimizeViewpoint;<object>;<action>;<from>:<to>;<camera>[;...]", see submitSearch()
+    - the job id for "renderTrajectory;<file>[;iterations]", see submitTrajectory()
+    - the job state for "status;<job>" and "wait;<job>[;timeout_ms]" ("timeout" if the wait timed out)
+    - the ";"-separated image paths for "fetch;<job>" (one multi-page tiff per camera for sweeps; -2 until the
+      images of a cached job are saved, "wait" returns then), the best poses
+      as one line of JSON for viewpoint searches, see RT_viewpointSearch::toJson(), and the summary of batch renders
+    - the number of attached images for "fetch;<job>;data[;lz]" and "fetch;<job>;shm"
+    - the ";"-separated accumulation launches per image for "fetch;<job>;samples", "<camera>=<launches>" in the
+      order the images are sent
+    - the image statistics as one line of JSON for "imageStats;<job>[;<rois>[;<bins>]]", see imageStats()
+    - the shared memory name for "openShm[;size_mb]", "<offset>;<size>;<sequence>" for "shmAlloc;<size>",
+      the status code for "closeShm" and "shmRelease;<sequence>[;<sequence>...]", see executeShmCommand()
+    - 0 for "stop;<job>" and "cancel;<job>", -3 if the job is already finished
+    - the number of cancelled jobs for "cancel" without a job in a request that queued none, which cancels every
+      queued and running job of the session
+    - the metrics as one line of JSON for "stats[;reset]", see executeStatsCommand()
+    - the ";"-separated camera names in entry point order for "cameras"
+    - -14 if the command has a session prefix "@<session>;" naming another session than the first command of the frame
+  <job> may be omitted to refer to the last job queued by the same request.
+  "render;<iterations>;rgb32f" reads back the accumulated radiance as floats instead of RGB8.
+  **/
+bool RT_session::process(Request &req)
+{
+    if (req.binary) {
+        if (sceneBusy()) {
+            m_sceneBlocked = true;
+            return false;
+        }
+        QByteArray reply;
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(m_scene->m_mutex);
+            rtbinary::execute(m_scene, static_cast<const char*>(req.payload.data()) + req.prefixSize, req.payload.size() - req.prefixSize, reply,
+                              [this](int iterations) { return submitRender(iterations); });
+        }
+        auto duration = std::chrono::steady_clock::now() - start;
+        m_journal.append(RT_journal::Binary, static_cast<const char*>(req.payload.data()) + req.prefixSize, static_cast<int>(req.payload.size() - req.prefixSize),
+                         start, duration);
+        static RT_histogram *const binary_times = RT_metrics::instance().histogram("command/binary");
+        binary_times->record(duration);
+        sendReply(m_replySocket, req, reply);
+        return true;
+    }
+
+    while (req.next < req.commands.size()) {
+        QString command = req.commands.at(req.next);
+        std::size_t prefix_size = 0;
+        QByteArray utf8 = command.toUtf8();
+        QString session = sessionName(utf8.constData(), utf8.size(), prefix_size);
+        if (prefix_size > 0) {
+            if (session != m_name) {
+                spdlog::error("Command \"{}\" does not belong to session \"{}\"", utf8.constData(), m_name.toUtf8().constData());
+                req.replies << QString::number(-14);
+                req.next++;
+                continue;
+            }
+            command = QString::fromUtf8(utf8.constData() + prefix_size, static_cast<int>(utf8.size() - prefix_size));
+        }
+        QStringList sList = command.split(";");
+        auto start = std::chrono::steady_clock::now();
+        bool parked = false;
+        QString reply = executeJobCommand(req, sList, parked);
+        if (parked) {
+            return false;
+        }
+        if (reply.isNull()) {
+            reply = executeShmCommand(sList);
+        }
+        if (reply.isNull()) {
+            reply = executeStatsCommand(sList);
+        }
+        if (reply.isNull()) {
+            if (sceneBusy()) {
+                m_sceneBlocked = true;
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(m_scene->m_mutex);
+            try {
+                bool is_render = (0 == sList.at(0).compare("render", Qt::CaseInsensitive));
+                bool is_timed = (0 == sList.at(0).compare("renderFor", Qt::CaseInsensitive));
+                bool is_search = (0 == sList.at(0).compare("optimizeViewpoint", Qt::CaseInsensitive));
+                bool is_trajectory = (0 == sList.at(0).compare("renderTrajectory", Qt::CaseInsensitive));
+                if (is_render || is_timed || is_search || is_trajectory || 0 == sList.at(0).compare("sweep", Qt::CaseInsensitive)) {
+                    int job_id = 0;
+                    if (is_render || is_timed) {
+                        RT_renderJob settings;
+                        if (is_timed) {
+                            bool ok = false;
+                            settings.budgetMs = (sList.size() > 1) ? sList.at(1).toInt(&ok) : 0;
+                            settings.iterations = RT_renderJob::MaxTimedIterations;
+                            job_id = (ok && settings.budgetMs > 0) ? 0 : -11;
+                        } else {
+                            int iterations = (sList.size() > 1) ? sList.at(1).toInt() : 1;
+                            settings.iterations = (iterations > 0) ? iterations : 1;
+                        }
+                        settings.format = (sList.size() > 2) ? RT_renderJob::formatFromName(sList.at(2)) : RT_renderJob::RGB8;
+                        if (job_id == 0) {
+                            job_id = (sList.size() > 3) ? submitCameras(settings, sList.at(3)) : submitRender(settings);
+                        }
+                    } else if (is_search) {
+                        job_id = submitSearch(sList);
+                    } else if (is_trajectory) {
+                        job_id = submitTrajectory(sList);
+                    } else {
+                        job_id = submitSweep(sList);
+                    }
+                    reply = QString::number(job_id);
+                    if (job_id > 0) {
+                        req.lastJob = static_cast<unsigned int>(job_id);
+                        RT_renderJob job;
+                        if (m_renderThread->job(req.lastJob, job) && job.cached) {
+                            reply += ";cached";
+                        }
+                    }
+                } else if (0 == sList.at(0).compare("cameras", Qt::CaseInsensitive) && sList.size() == 1) {
+                    QStringList names;
+                    for (int i=0; i<m_scene->countCameras(); i++) {
+                        names << m_scene->cameraName(i);
+                    }
+                    reply = names.join(";");
+                } else if (0 == sList.at(0).compare("uploadMesh", Qt::CaseInsensitive)) {
+                    reply = QString::number(uploadMesh(req, sList));
+                } else if (0 == sList.at(0).compare("syncScene", Qt::CaseInsensitive) && sList.size() == 1) {
+                    reply = QString::number(syncScene(req));
+                } else {
+                    reply = QString::number(executeSceneCommand(sList));
+                }
+            } catch (const std::exception &e) {
+                spdlog::error("Command \"{}\" failed: {}", command.toUtf8().constData(), e.what());
+                reply = QString::number(-13);
+            }
+        }
+        auto duration = std::chrono::steady_clock::now() - start;
+        if (0 != sList.at(0).compare("setJournal", Qt::CaseInsensitive)) {
+            QByteArray journal_command = command.toUtf8();
+            m_journal.append(RT_journal::Text, journal_command.constData(), journal_command.size(), start, duration);
+        }
+        const QString &metrics_name = metricsName(sList.at(0), reply);
+        m_commandTimes.histogram(metrics_name)->record(duration);
+        if (reply.startsWith("-")) {
+            m_commandErrors.counter(metrics_name)->fetch_add(1, std::memory_order_relaxed);
+        }
+        req.replies << reply;
+        req.next++;
+    }
+    sendReply(m_replySocket, req, req.replies.join("\n").toUtf8());
+    return true;
+}
+
+/**
+  @brief    execute the job commands "status", "wait", "fetch", "stop", "cancel" and "imageStats", which never touch the scene
+  @param    req     request the command belongs to
+  @param    sList   command split into its fields
+  @param    parked  set to true if the request has to wait for the job
+  @return   reply of the command, a null string if it is no job command
+  **/
+QString RT_session::executeJobCommand(Request &req, const QStringList &sList, bool &parked)
+{
+    bool is_status = (0 == sList.at(0).compare("status", Qt::CaseInsensitive));
+    bool is_wait = (0 == sList.at(0).compare("wait", Qt::CaseInsensitive));
+    bool is_fetch = (0 == sList.at(0).compare("fetch", Qt::CaseInsensitive));
+    bool is_stop = (0 == sList.at(0).compare("stop", Qt::CaseInsensitive));
+    bool is_cancel = (0 == sList.at(0).compare("cancel", Qt::CaseInsensitive));
+    bool is_image_stats = (0 == sList.at(0).compare("imageStats", Qt::CaseInsensitive));
+    if (!is_status && !is_wait && !is_fetch && !is_stop && !is_cancel && !is_image_stats) {
+        return QString();
+    }
+    // Without a job id the last job queued by the same request is meant, e.g. "render\nwait"
+    unsigned int id = (sList.size() > 1 && !sList.at(1).isEmpty()) ? sList.at(1).toUInt() : req.lastJob;
+    if (id == 0 && is_cancel) {
+        return QString::number(m_renderThread->cancelAll());
+    }
+    if (id == 0) {
+        return QString::number(-11);
+    }
+
+    if (is_stop) {
+        return QString::number(m_renderThread->stop(id));
+    }
+    if (is_cancel) {
+        return QString::number(m_renderThread->cancel(id));
+    }
+
+    RT_renderJob job;
+    if (!m_renderThread->job(id, job)) {
+        spdlog::error("Render job {} is not known", id);
+        return QString::number(-1);
+    }
+
+    // A cached job is done at once, but its image files exist only once the render thread saved them
+    if (is_wait && (!job.isFinished() || job.saving)) {
+        if (req.waitJob != id) {
+            req.waitJob = id;
+            req.waitTimed = (sList.size() > 2);
+            if (req.waitTimed) {
+                req.waitDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(sList.at(2).toInt());
+            }
+        }
+        if (!req.waitTimed || std::chrono::steady_clock::now() < req.waitDeadline) {
+            parked = true;
+            return QString();
+        }
+        req.waitJob = 0;
+        return QString("timeout");
+    }
+    req.waitJob = 0;
+
+    if (is_image_stats) {
+        if (!job.isFinished()) {
+            return QString::number(-2);
+        }
+        return imageStats(job, sList);
+    }
+    if (is_fetch) {
+        if (!job.isFinished()) {
+            return QString::number(-2);
+        }
+        if (sList.size() > 2 && 0 == sList.at(2).compare("data", Qt::CaseInsensitive)) {
+            bool compressed = (sList.size() > 3 && 0 == sList.at(3).compare("lz", Qt::CaseInsensitive));
+            return QString::number(attachImages(req, job, compressed));
+        }
+        if (sList.size() > 2 && 0 == sList.at(2).compare("shm", Qt::CaseInsensitive)) {
+            return QString::number(attachShmImages(req, job));
+        }
+        if (sList.size() > 2 && 0 == sList.at(2).compare("samples", Qt::CaseInsensitive)) {
+            QStringList samples;
+            for (int i=0; i<job.images.size() && i<job.samples.size(); i++) {
+                if (job.images.at(i)) {
+                    samples << QString("%1=%2").arg(job.cameras.at(i % job.cameras.size()).name).arg(job.samples.at(i));
+                }
+            }
+            return samples.join(";");
+        }
+        if (job.isSearch() || job.isTrajectory()) {
+            return job.result;
+        }
+        if (job.saving) {
+            return QString::number(-2);
+        }
+        return job.imagePaths.join(";");
+    }
+    return QString(RT_renderJob::stateName(job.state));
+}
+
+/**
+  @brief    "imageStats;<job>[;<rois>[;<bins>]]", statistics of the images of a finished job
+  @param    job     finished job
+  @param    sList   command split into its fields, see RT_imageStats::parseRois() for <rois>
+  @return   one line of JSON {"job", "images": [{"camera", "pose", "samples", "rois": [statistics]}]}, see
+            RT_imageStats::toJson(); -11 if the regions or the bin count are malformed
+
+  The statistics are computed on the pixels the job read back from the output buffer, so the job
+  does not have to save or send its images.
+  **/
+QString RT_session::imageStats(const RT_renderJob &job, const QStringList &sList)
+{
+    QVector<RT_roi> rois;
+    if (0 != RT_imageStats::parseRois((sList.size() > 2) ? sList.at(2) : QString(), rois)) {
+        return QString::number(-11);
+    }
+    int bins = RT_imageStats::DefaultBins;
+    if (sList.size() > 3) {
+        bool ok = false;
+        bins = sList.at(3).toInt(&ok);
+        if (!ok || bins < 1 || bins > RT_imageStats::MaxBins) {
+            return QString::number(-11);
+        }
+    }
+    QJsonArray images;
+    for (int pose=0; pose<job.poseCount(); pose++) {
+        for (int i=0; i<job.cameras.size(); i++) {
+            const RT_renderJob::Camera &cam = job.cameras.at(i);
+            RT_imageBufferPtr image = job.image(pose, i);
+            if (!image) {
+                continue;
+            }
+            QJsonArray results;
+            for (int r=0; r<rois.size(); r++) {
+                results.append(RT_imageStats::compute(*image, cam.width, cam.height, job.format, rois.at(r), bins).toJson());
+            }
+            QJsonObject entry;
+            entry.insert("camera", cam.name);
+            entry.insert("pose", pose);
+            entry.insert("samples", job.samples.value(pose * job.cameras.size() + i));
+            entry.insert("rois", results);
+            images.append(entry);
+        }
+    }
+    QJsonObject json;
+    json.insert("job", static_cast<double>(job.id));
+    json.insert("images", images);
+    return QString::fromUtf8(QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+/**
+  @brief    append the images of a finished job to the reply of a request
+  @param    req     request the images are sent with
+  @param    job     finished job
+  @param    compressed  compress the pixels with RT_codec ("fetch;<job>;data;lz")
+  @return   number of attached images
+
+  Every image is sent as two frames: a header "<camera>;<width>;<height>;<format>" with format
+  "rgb8" or "rgb32f", followed by the pixels, rows from top to bottom. Sweeps send the images pose
+  by pose, their headers get the pose index as fifth field. The pixel frame references the pooled
+  job buffer (zmq_msg_init_data), which is kept alive until ZMQ has sent it.
+  Compressed images always have the header "<camera>;<width>;<height>;<format>;<pose>;lz", their
+  pixel frame holds the RT_codec payload.
+  **/
+int RT_session::attachImages(Request &req, const RT_renderJob &job, bool compressed)
+{
+    int count = 0;
+    for (int pose=0; pose<job.poseCount(); pose++) {
+        for (int i=0; i<job.cameras.size(); i++) {
+            const RT_renderJob::Camera &cam = job.cameras.at(i);
+            RT_imageBufferPtr image = job.image(pose, i);
+            if (!image) {
+                continue;
+            }
+            QString header = QString("%1;%2;%3;%4").arg(cam.name).arg(cam.width).arg(cam.height).arg(RT_renderJob::formatName(job.format));
+            if (compressed) {
+                header += QString(";%1;lz").arg(pose);
+                static RT_histogram *const compress_times = RT_metrics::instance().histogram("codec/compress");
+                static std::atomic<quint64> *const raw_bytes = RT_metrics::instance().counter("codec/rawBytes");
+                static std::atomic<quint64> *const compressed_bytes = RT_metrics::instance().counter("codec/compressedBytes");
+                RT_metrics::Timer timer(compress_times);
+                RT_codec::Layout layout = (job.format == RT_renderJob::RGB32F) ? RT_codec::Rgb32f : RT_codec::Rgb8;
+                raw_bytes->fetch_add(image->size(), std::memory_order_relaxed);
+                image = std::make_shared<RT_imageBuffer>(RT_codec::compress(image->data(), image->size(), layout));
+                compressed_bytes->fetch_add(image->size(), std::memory_order_relaxed);
+            } else if (job.isSweep()) {
+                header += QString(";%1").arg(pose);
+            }
+            QByteArray header_data = header.toUtf8();
+            req.attachments.emplace_back(header_data.constData(), header_data.size());
+            req.attachments.emplace_back(image->data(), image->size(), &RT_imagePool::zmqFree, RT_imagePool::zmqHint(image));
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+  @brief    copy the images of a finished job into the shared memory ring and attach their descriptors
+  @param    req     request the descriptors are sent with
+  @param    job     finished job
+  @return   number of attached descriptors, -16 if the ring is not open, -17 if it has no room for all images
+
+  Every image gets one frame "<camera>;<width>;<height>;<format>;<pose>;<offset>;<size>;<sequence>"
+  (pose 0 for single renders). The client has to give the regions back with "shmRelease".
+  **/
+int RT_session::attachShmImages(Request &req, const RT_renderJob &job)
+{
+    if (!m_shm.isOpen()) {
+        return -16;
+    }
+    QVector<RT_shmRing::Region> regions;
+    for (int pose=0; pose<job.poseCount(); pose++) {
+        for (int i=0; i<job.cameras.size(); i++) {
+            const RT_renderJob::Camera &cam = job.cameras.at(i);
+            RT_imageBufferPtr image = job.image(pose, i);
+            if (!image) {
+                continue;
+            }
+            RT_shmRing::Region region;
+            if (0 != m_shm.allocate(image->size(), region)) {
+                spdlog::error("Shared memory ring of session \"{}\" is full", m_name.toUtf8().constData());
+                for (int r=0; r<regions.size(); r++) {
+                    m_shm.release(regions.at(r).sequence);
+                }
+                req.attachments.clear();
+                return -17;
+            }
+            memcpy(m_shm.data(region), image->data(), image->size());
+            regions << region;
+            QByteArray header = QString("%1;%2;%3;%4;%5;%6;%7;%8").arg(cam.name).arg(cam.width).arg(cam.height)
+                    .arg(RT_renderJob::formatName(job.format)).arg(pose).arg(region.offset).arg(region.size)
+                    .arg(region.sequence).toUtf8();
+            req.attachments.emplace_back(header.constData(), header.size());
+        }
+    }
+    return regions.size();
+}
+
+/**
+  @brief    execute the shared memory commands, which never touch the scene
+  @param    sList   command split into its fields
+  @return   reply of the command, a null string if it is no shared memory command
+            "openShm[;size_mb]" creates the ring (256 MB by default) and replies with its POSIX name
+            "closeShm" unlinks the ring, regions still mapped by the client stay readable for it
+            "shmAlloc;<size>" reserves a region the client can write a payload to, replies "<offset>;<size>;<sequence>",
+                -11 if <size> is 0 or larger than the ring
+            "shmRelease;<sequence>[;<sequence>...]" gives regions back, -1 if one of them is not allocated
+            the ring commands reply -16 if no ring is open and -17 if there is no room left
+  **/
+QString RT_session::executeShmCommand(const QStringList &sList)
+{
+    if (0 == sList.at(0).compare("openShm", Qt::CaseInsensitive)) {
+        std::size_t size_mb = (sList.size() > 1 && sList.at(1).toUInt() > 0) ? sList.at(1).toUInt() : 256;
+        QString name = QString("/refloid-%1-%2").arg(static_cast<long long>(getpid())).arg(++shmCounter);
+        int ret = m_shm.open(name, size_mb << 20);
+        return (ret < 0) ? QString::number(ret) : m_shm.name();
+    } else if (0 == sList.at(0).compare("closeShm", Qt::CaseInsensitive)) {
+        m_shm.close();
+        return QString::number(0);
+    } else if (0 == sList.at(0).compare("shmAlloc", Qt::CaseInsensitive)) {
+        if (sList.size() < 2) {
+            return QString::number(-11);
+        }
+        if (!m_shm.isOpen()) {
+            return QString::number(-16);
+        }
+        RT_shmRing::Region region;
+        int ret = m_shm.allocate(sList.at(1).toULongLong(), region);
+        if (ret == -3) {
+            return QString::number(-11);
+        }
+        if (ret != 0) {
+            return QString::number(-17);
+        }
+        return QString("%1;%2;%3").arg(region.offset).arg(region.size).arg(region.sequence);
+    } else if (0 == sList.at(0).compare("shmRelease", Qt::CaseInsensitive)) {
+        if (sList.size() < 2) {
+            return QString::number(-11);
+        }
+        if (!m_shm.isOpen()) {
+            return QString::number(-16);
+        }
+        int ret = 0;
+        for (int i=1; i<sList.size(); i++) {
+            if (0 != m_shm.release(sList.at(i).toULongLong())) {
+                ret = -1;
+            }
+        }
+        return QString::number(ret);
+    }
+    return QString();
+}
+
+/**
+  @brief    execute the metrics commands, which never touch the scene
+  @param    sList   command split into its fields
+  @return   reply of the command, a null string if it is no metrics command
+            "stats[;reset]" replies the metrics of all sessions as one line of JSON (see RT_metrics::toJson()),
+            "reset" starts a new recording afterwards
+            "setStatsDump;<path>[;<interval_s>]" appends the metrics to <path> every <interval_s> seconds
+            (10 by default), without <path> the dump is stopped; -1 if the file cannot be opened
+  **/
+QString RT_session::executeStatsCommand(const QStringList &sList)
+{
+    if (0 == sList.at(0).compare("stats", Qt::CaseInsensitive)) {
+        bool reset = (sList.size() > 1 && 0 == sList.at(1).compare("reset", Qt::CaseInsensitive));
+        return QString::fromUtf8(RT_metrics::instance().dump(reset));
+    } else if (0 == sList.at(0).compare("setStatsDump", Qt::CaseInsensitive)) {
+        QString path = (sList.size() > 1) ? sList.at(1) : QString();
+        double interval = (sList.size() > 2) ? sList.at(2).toDouble() : 10.0;
+        int interval_ms = static_cast<int>(((interval > 0.0) ? interval : 10.0) * 1000.0);
+        return QString::number(RT_metrics::instance().setDump(path, interval_ms));
+    }
+    return QString();
+}
+
+/**
+  @brief    send a reply to the client a request came from
+  @param    reply_socket    socket of the worker, RT_server forwards all frames to the client
+  @param    req             the request, its attachments are sent after the reply frame
+  @param    reply           reply frame, not sent for requests acknowledged on enqueue
+  **/
+void RT_session::sendReply(zmq::socket_t &reply_socket, Request &req, const QByteArray &reply)
+{
+    if (req.acked) {
+        // The client got its reply when the request was queued
+        req.attachments.clear();
+        return;
+    }
+    for (int i=0; i<req.envelope.size(); i++) {
+        zmq::message_t frame(req.envelope.at(i).constData(), req.envelope.at(i).size());
+        reply_socket.send(frame, ZMQ_SNDMORE);
+    }
+    zmq::message_t frame(reply.constData(), reply.size());
+    reply_socket.send(frame, req.attachments.empty() ? 0 : ZMQ_SNDMORE);
+    for (std::size_t i=0; i<req.attachments.size(); i++) {
+        reply_socket.send(req.attachments[i], (i + 1 < req.attachments.size()) ? ZMQ_SNDMORE : 0);
+    }
+    req.attachments.clear();
+}
+
+/**
+  @brief    execute a single ";"-separated scene or session setting command
+  @param    sList   command split into its fields, e.g. {"manipulateObject", "sphere1", "translate", "0,0,1"}
+  @return   0 on success, negative on error, see RT_scene::executeCommand()
+            "setStream;<every>[;<downsample>]" makes new render jobs publish a preview every <every> iterations (0 to disable)
+            "setJournal;<path>" appends all following commands to a journal, without <path> the journal is closed
+            "setCache;<memory_mb>[;<spill_dir>;<disk_mb>]" configures the render cache and drops its entries
+            (0 MB to disable it), -1 if the spill directory cannot be created
+            "closeSession" drops the session with its scene once all its requests are answered
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::executeSceneCommand(const QStringList &sList)
+{
+    if (0 == sList.at(0).compare("setStream", Qt::CaseInsensitive)) {
+        if (sList.size() < 2) {
+            return -11;
+        }
+        int every = sList.at(1).toInt();
+        int downsample = (sList.size() > 2) ? sList.at(2).toInt() : 1;
+        m_streamEvery = (every > 0) ? every : 0;
+        m_streamDownsample = (downsample > 1) ? downsample : 1;
+        return 0;
+    } else if (0 == sList.at(0).compare("setJournal", Qt::CaseInsensitive)) {
+        m_journal.close();
+        if (sList.size() > 1 && !sList.at(1).isEmpty()) {
+            return m_journal.open(sList.at(1));
+        }
+        return 0;
+    } else if (0 == sList.at(0).compare("setCache", Qt::CaseInsensitive)) {
+        if (sList.size() < 2) {
+            return -11;
+        }
+        std::size_t memory_mb = sList.at(1).toULongLong();
+        QString spill_directory = (sList.size() > 2) ? sList.at(2) : QString();
+        std::size_t disk_mb = (sList.size() > 3) ? sList.at(3).toULongLong() : 0;
+        return m_renderThread->cache().configure(memory_mb << 20, spill_directory, disk_mb << 20);
+    } else if (0 == sList.at(0).compare("closeSession", Qt::CaseInsensitive)) {
+        m_closeRequested = true;
+        return 0;
+    }
+    return m_scene->executeCommand(sList);
+}
+
+/**
+  @brief    set the triangles of a mesh from arrays sent by the client
+  @param    req     request carrying the data frames
+  @param    sList   {"uploadMesh", object[, "normals"][, "lz"]} or {"uploadMesh", object, "shm", vertices, indices[, normals]}
+  @return   0 on success, -11 if data is missing, -16 if a shared memory descriptor is not valid,
+            -22 if a compressed frame is corrupt, otherwise the error code of RT_scene::uploadMesh()
+
+  The arrays are little endian: float x, y, z per vertex, uint32 triples per triangle and
+  optionally float x, y, z normals per vertex. They are either the next data frames of the request
+  (vertices, indices, normals), consumed in the order of the commands, or regions of the shared memory
+  ring given as "<offset>:<size>:<sequence>" (see "shmAlloc"). With "lz" every data frame holds an
+  RT_codec payload of its array. The mesh is created if it does not exist.
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::uploadMesh(Request &req, const QStringList &sList)
+{
+    if (sList.size() < 2) {
+        return -11;
+    }
+    bool from_shm = (sList.size() > 2 && 0 == sList.at(2).compare("shm", Qt::CaseInsensitive));
+    bool with_normals = from_shm ? (sList.size() > 5) : sList.mid(2).contains("normals", Qt::CaseInsensitive);
+    bool compressed = !from_shm && sList.mid(2).contains("lz", Qt::CaseInsensitive);
+    if (from_shm && sList.size() < 5) {
+        return -11;
+    }
+    const void *arrays[3] = {nullptr, nullptr, nullptr};
+    std::size_t sizes[3] = {0, 0, 0};
+    std::vector<unsigned char> raw[3];
+    int ret = 0;
+    // All frames of the command are consumed even on errors, so the next command gets its own frames
+    for (int i=0; i<(with_normals ? 3 : 2); i++) {
+        if (from_shm) {
+            QStringList descriptor = sList.at(3 + i).split(":");
+            if (descriptor.size() != 3) {
+                ret = -16;
+                continue;
+            }
+            sizes[i] = descriptor.at(1).toULongLong();
+            arrays[i] = m_shm.payload(descriptor.at(0).toULongLong(), sizes[i], descriptor.at(2).toULongLong());
+            if (arrays[i] == nullptr) {
+                ret = -16;
+            }
+        } else if (req.nextFrame < req.frames.size()) {
+            zmq::message_t &frame = req.frames[req.nextFrame++];
+            arrays[i] = frame.data();
+            sizes[i] = frame.size();
+            if (compressed) {
+                if (0 != RT_codec::decompress(frame.data(), frame.size(), raw[i])) {
+                    ret = -22;
+                    continue;
+                }
+                arrays[i] = raw[i].data();
+                sizes[i] = raw[i].size();
+            }
+        } else {
+            ret = -11;
+        }
+    }
+    if (ret < 0) {
+        spdlog::error("Mesh data of {} is missing or not valid", sList.at(1).toUtf8().constData());
+        return ret;
+    }
+    return m_scene->uploadMesh(sList.at(1), arrays[0], sizes[0], arrays[1], sizes[1], arrays[2], sizes[2]);
+}
+
+/**
+  @brief    "syncScene" with the scene description in the next data frame of the request
+  @param    req     request carrying the data frame
+  @return   number of created, deleted or changed objects, -11 if the frame is missing,
+            otherwise the error code of RT_sceneDescription::fromJson() or RT_scene::syncScene()
+
+  Large descriptions are sent as a frame of their own, "syncScene;<json>" is handled by
+  RT_scene::executeCommand() and can be replayed from a journal.
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::syncScene(Request &req)
+{
+    if (req.nextFrame >= req.frames.size()) {
+        spdlog::error("The scene description of syncScene is missing");
+        return -11;
+    }
+    zmq::message_t &frame = req.frames[req.nextFrame++];
+    RT_sceneDescription desc;
+    int ret = RT_sceneDescription::fromJson(QByteArray(static_cast<const char*>(frame.data()), static_cast<int>(frame.size())), desc);
+    return (ret < 0) ? ret : m_scene->syncScene(desc);
+}
+
+/**
+  @brief    update the optix caches and queue a render job
+  @param    iterations  number of accumulation launches per camera
+  @param    format      pixel format the images are read back in
+  @return   id of the queued job (> 0) or the negative error code of RT_scene::updateCaches()
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::submitRender(int iterations, RT_renderJob::Format format)
+{
+    RT_renderJob settings;
+    settings.iterations = iterations;
+    settings.format = format;
+    return submitRender(settings);
+}
+
+/**
+  @brief    update the optix caches and queue a render job with the preview settings of the session
+  @param    settings    iterations, format and sweep settings of the job
+  @return   id of the queued job (> 0) or the negative error code of RT_scene::updateCaches()
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::submitRender(RT_renderJob settings)
+{
+    static RT_histogram *const update_times = RT_metrics::instance().histogram("render/updateCaches");
+    static std::atomic<quint64> *const searches = RT_metrics::instance().counter("jobs/searches");
+    static std::atomic<quint64> *const trajectories = RT_metrics::instance().counter("jobs/trajectories");
+    static std::atomic<quint64> *const sweeps = RT_metrics::instance().counter("jobs/sweeps");
+    static std::atomic<quint64> *const renders = RT_metrics::instance().counter("jobs/renders");
+    int ret = 0;
+    {
+        RT_metrics::Timer timer(update_times);
+        ret = m_scene->updateCaches();
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    std::atomic<quint64> *jobs = settings.isSearch() ? searches : (settings.isTrajectory() ? trajectories : (settings.isSweep() ? sweeps : renders));
+    jobs->fetch_add(1, std::memory_order_relaxed);
+    settings.streamEvery = m_streamEvery;
+    settings.streamDownsample = m_streamDownsample;
+    return static_cast<int>(m_renderThread->submit(settings));
+}
+
+/**
+  @brief    queue a render job limited to some of the cameras of the scene
+  @param    settings    iterations and format of the job
+  @param    cameras     ","-separated camera names, empty for all cameras
+  @return   id of the queued job (> 0), -1 if a camera is not known, or the negative error code of RT_scene::updateCaches()
+
+  RT_coordinator shards renders over several processes this way, every process renders a part of the cameras.
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::submitCameras(RT_renderJob settings, const QString &cameras)
+{
+    QStringList names = cameras.split(",");
+    for (int i=0; i<names.size(); i++) {
+        QString name = names.at(i).trimmed();
+        if (name.isEmpty()) {
+            continue;
+        }
+        if (m_scene->cameraIndex(name) < 0) {
+            spdlog::error("Camera you specified by name \"{}\" not found", name.toUtf8().constData());
+            return -1;
+        }
+        settings.cameraNames << name;
+    }
+    return submitRender(settings);
+}
+
+/**
+  @brief    queue a sweep, which renders all cameras for a series of poses of one object
+  @param    sList   command split into its fields: {"sweep", object, action, poses[, iterations[, format]]}
+  @return   id of the queued job (> 0), -1 if the object is not known, -11 if parameters are missing,
+            -15 if the poses cannot be parsed, or the negative error code of RT_scene::updateCaches()
+
+  <action> is a manipulateObject action such as "setPosition", "translate" or "rotate". It is applied
+  to the pose the object had before the sweep, which is restored afterwards. <poses> is either a
+  list of action parameters "p1|p2|..." or a range "<from>:<to>:<steps>" of linearly interpolated
+  vectors, e.g. "0,0,0:0,0,10:11". The loop over the poses runs on the render thread, only the
+  transform of the object is uploaded per pose and its acceleration structure is kept.
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::submitSweep(const QStringList &sList)
+{
+    if (sList.size() < 4) {
+        return -11;
+    }
+    if (m_scene->findObject(sList.at(1)) == nullptr) {
+        spdlog::error("Object you specified by name \"{}\" not found", sList.at(1).toUtf8().constData());
+        return -1;
+    }
+    RT_renderJob settings;
+    settings.sweepObject = sList.at(1);
+    settings.sweepAction = sList.at(2);
+    if (parsePoses(sList.at(3), settings.poses) < 0) {
+        spdlog::error("Could not parse the poses \"{}\" of the sweep", sList.at(3).toUtf8().constData());
+        return -15;
+    }
+    int iterations = (sList.size() > 4) ? sList.at(4).toInt() : 1;
+    settings.iterations = (iterations > 0) ? iterations : 1;
+    settings.format = (sList.size() > 5) ? RT_renderJob::formatFromName(sList.at(5)) : RT_renderJob::RGB8;
+    return submitRender(settings);
+}
+
+/**
+  @brief    queue a viewpoint search, which looks for the pose of an object that minimizes a score of one camera image
+  @param    sList   command split into its fields, see RT_viewpointSearch::parse()
+  @return   id of the queued job (> 0), -1 if the object or the camera is not known, -11 if parameters are
+            missing or malformed, -15 if the bounds cannot be parsed, or the negative error code of RT_scene::updateCaches()
+
+  The candidates are rendered and scored on the render thread, see RT_renderThread::runSearch(); only
+  the best poses with their scores are kept and returned by "fetch;<job>".
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::submitSearch(const QStringList &sList)
+{
+    std::shared_ptr<RT_viewpointSearch> search = std::make_shared<RT_viewpointSearch>();
+    int ret = RT_viewpointSearch::parse(sList, *search);
+    if (ret < 0) {
+        spdlog::error("Malformed viewpoint search \"{}\"", sList.join(";").toUtf8().constData());
+        return ret;
+    }
+    if (m_scene->findObject(search->object) == nullptr || m_scene->cameraIndex(search->camera) < 0) {
+        spdlog::error("Object \"{}\" or camera \"{}\" of the search not found", search->object.toUtf8().constData(),
+                      search->camera.toUtf8().constData());
+        return -1;
+    }
+    RT_renderJob settings;
+    settings.search = search;
+    return submitRender(settings);
+}
+
+/**
+  @brief    queue a batch render of every frame of a trajectory file
+  @param    sList   command split into its fields: {"renderTrajectory", file[, iterations]}
+  @return   id of the queued job (> 0), -1 if the file does not exist, -11 if it is missing, or the
+            negative error code of RT_scene::updateCaches()
+
+  See RT_trajectory for the file format and RT_renderThread::runTrajectory() for the pipeline. The
+  images of frame <n> are written to "<image directory>/frame_<n>_<camera>.tif", with <n> padded to
+  six digits. "fetch;<job>" returns {"job", "frames", "written", "failed"} as one line of JSON.
+
+  Must be called while holding RT_scene::m_mutex
+  **/
+int RT_session::submitTrajectory(const QStringList &sList)
+{
+    if (sList.size() < 2 || sList.at(1).isEmpty()) {
+        return -11;
+    }
+    if (!QFile::exists(sList.at(1))) {
+        spdlog::error("Trajectory file \"{}\" not found", sList.at(1).toUtf8().constData());
+        return -1;
+    }
+    RT_renderJob settings;
+    settings.trajectory = sList.at(1);
+    int iterations = (sList.size() > 2) ? sList.at(2).toInt() : 1;
+    settings.iterations = (iterations > 0) ? iterations : 1;
+    return submitRender(settings);
+}
+
+/**
+  @brief    expand the poses of a sweep
+  @param    str     "p1|p2|..." or "<from>:<to>:<steps>" with ","-separated vectors <from> and <to>
+  @param    poses   target for the action parameters of every pose
+  @return   0 on success, -1 if the range is malformed or there are no poses
+  **/
+int RT_session::parsePoses(const QString &str, QStringList &poses)
+{
+    poses.clear();
+    QStringList range = str.split(":");
+    if (range.size() == 1) {
+        QStringList list = str.split("|");
+        for (int i=0; i<list.size(); i++) {
+            if (!list.at(i).trimmed().isEmpty()) {
+                poses << list.at(i).trimmed();
+            }
+        }
+        return poses.isEmpty() ? -1 : 0;
+    }
+    if (range.size() != 3) {
+        return -1;
+    }
+    QStringList from = range.at(0).split(",");
+    QStringList to = range.at(1).split(",");
+    bool ok = false;
+    int steps = range.at(2).toInt(&ok);
+    if (!ok || steps < 1 || from.size() != to.size()) {
+        return -1;
+    }
+    QVector<double> start(from.size());
+    QVector<double> end(from.size());
+    for (int i=0; i<from.size(); i++) {
+        bool ok_from = false;
+        bool ok_to = false;
+        start[i] = from.at(i).toDouble(&ok_from);
+        end[i] = to.at(i).toDouble(&ok_to);
+        if (!ok_from || !ok_to) {
+            return -1;
+        }
+    }
+    for (int step=0; step<steps; step++) {
+        double t = (steps > 1) ? static_cast<double>(step) / (steps - 1) : 0.0;
+        QStringList values;
+        for (int i=0; i<start.size(); i++) {
+            values << QString::number(start.at(i) + t * (end.at(i) - start.at(i)), 'g', 9);
+        }
+        poses << values.join(",");
+    }
+    return 0;
+}
+
+/**
+  @brief    check whether scene commands have to be parked
+  @return   true while a render job still uses the optix context or an older request is parked on the scene
+  **/
+bool RT_session::sceneBusy() const
+{
+    return m_sceneBlocked || m_renderThread->isLaunching();
+}
+
+/**
+  @brief    time until the earliest "wait" timeout of the parked requests
+  @return   poll timeout in milliseconds, -1 to wait for the next message
+  **/
+long RT_session::pollTimeout() const
+{
+    long timeout = -1;
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_parked.begin(); it != m_parked.end(); ++it) {
+        if ((*it)->waitJob == 0 || !(*it)->waitTimed) {
+            continue;
+        }
+        long remaining = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>((*it)->waitDeadline - now).count());
+        remaining = (remaining > 0) ? remaining : 0;
+        if (timeout < 0 || remaining < timeout) {
+            timeout = remaining;
+        }
+    }
+    return timeout;
+}
@@ -0,0 +1,113 @@
+/**
+  @file     RT_session.h
+  @brief    named client session with its own scene and render thread
+
+  A session executes the text and binary commands routed to it by RT_server. "render" and "sweep"
+  only queue a job on the render thread of the session and reply with its id; "status", "wait", "fetch",
+  "stop" and "cancel" query or end the job and are answered even while rendering. Requests that need the scene while
+  the render thread is launching are parked and resumed in arrival order as soon as the optix
+  context is released. Sessions are owned by a worker thread (RT_worker) and never touched by
+  another thread, except for the scene that is shared with the render thread under RT_scene::m_mutex.
+  Clients on the render host can open a shared memory ring (RT_shmRing) with "openShm" and fetch
+  images through it, the reply then only carries the region descriptors.
+**/
+
+#ifndef NSLAIFT_RT_SESSION_H
+#define NSLAIFT_RT_SESSION_H
+
+#include "RT_scene.h"
+#include "RT_renderThread.h"
+#include "RT_journal.h"
+#include "RT_shmRing.h"
+#include "RT_imageStats.h"
+#include "RT_metrics.h"
+
+#include <zmq.hpp>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+class RT_session
+{
+public:
+    ///< a received request, kept alive while it is parked
+    struct Request {
+        QList<QByteArray> envelope;                 ///< routing frames including the empty delimiter frame
+        zmq::message_t payload;                     ///< command frame
+        std::vector<zmq::message_t> frames;         ///< data frames sent after the command frame, e.g. mesh arrays
+        std::size_t nextFrame = 0;                  ///< next data frame to be consumed by a command
+        QString session;                            ///< session the request is routed to, "" for the default session
+        std::size_t prefixSize = 0;                 ///< size of the "@<session>;" prefix of the payload
+        bool binary = false;
+        bool acked = false;                         ///< RT_server already replied when queuing the request ("setAck;enqueue")
+        std::chrono::steady_clock::time_point received;     ///< time RT_server received the request
+        QStringList commands;                       ///< remaining text commands are executed from index next
+        int next = 0;
+        QStringList replies;                        ///< one reply per executed text command
+        std::vector<zmq::message_t> attachments;    ///< frames sent after the reply frame, e.g. fetched images
+        unsigned int lastJob = 0;                   ///< last render job queued by this request
+        unsigned int waitJob = 0;                   ///< job a "wait" command is blocked on, 0 if none
+        bool waitTimed = false;
+        std::chrono::steady_clock::time_point waitDeadline;
+    };
+
+    RT_session(const QString &name, zmq::context_t &zmq_context, zmq::socket_t &reply_socket,
+               const std::string &event_endpoint, const std::string &preview_endpoint, const QString &scene_file = QString());
+    ~RT_session();
+
+    QString name() const;
+    void enqueue(std::unique_ptr<Request> req);
+    void resumeParked();
+    long pollTimeout() const;
+    bool isClosed() const;
+
+    static QString sessionName(const void *data, std::size_t size, std::size_t &prefix_size);
+    static void reject(zmq::socket_t &reply_socket, Request &req, int status);
+    static int parsePoses(const QString &str, QStringList &poses);
+    static QStringList splitCommands(const Request &req);
+    static const QString& metricsName(const QString &command, const QString &reply);
+    static void sendReply(zmq::socket_t &reply_socket, Request &req, const QByteArray &reply);
+
+private:
+    bool process(Request &req);
+    QString executeJobCommand(Request &req, const QStringList &sList, bool &parked);
+    int executeSceneCommand(const QStringList &sList);
+    int uploadMesh(Request &req, const QStringList &sList);
+    int syncScene(Request &req);
+    QString executeShmCommand(const QStringList &sList);
+    QString executeStatsCommand(const QStringList &sList);
+    QString imageStats(const RT_renderJob &job, const QStringList &sList);
+    int attachImages(Request &req, const RT_renderJob &job, bool compressed = false);
+    int attachShmImages(Request &req, const RT_renderJob &job);
+    int submitRender(int iterations, RT_renderJob::Format format = RT_renderJob::RGB8);
+    int submitRender(RT_renderJob settings);
+    int submitCameras(RT_renderJob settings, const QString &cameras);
+    int submitSweep(const QStringList &sList);
+    int submitSearch(const QStringList &sList);
+    int submitTrajectory(const QStringList &sList);
+    bool sceneBusy() const;
+
+    QString m_name;
+    zmq::socket_t &m_replySocket;                   ///< ZMQ_PUSH socket of the worker, replies are forwarded to the client by RT_server
+    RT_scene *m_scene;
+    RT_renderThread *m_renderThread;
+    std::deque< std::unique_ptr<Request> > m_parked;    ///< requests waiting for the scene or for a job, oldest first
+    bool m_sceneBlocked;                            ///< an older parked request waits for the scene, younger ones must not overtake it
+    bool m_closeRequested;                          ///< "closeSession" was executed, the session is dropped once nothing is parked
+    int m_streamEvery;                              ///< preview interval of new render jobs, set with "setStream"
+    int m_streamDownsample;
+    RT_journal m_journal;                           ///< records all executed commands if opened with "setJournal"
+    RT_shmRing m_shm;                               ///< shared memory of same-host clients, opened with "openShm"
+    RT_metrics::NameCache m_commandTimes;           ///< "command/<command>" histograms
+    RT_metrics::NameCache m_commandErrors;          ///< "command/<command>/errors" counters
+};
+
+#endif //NSLAIFT_RT_SESSION_H
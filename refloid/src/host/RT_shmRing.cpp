@@ -0,0 +1,217 @@
+/**
+  @file     RT_shmRing.cpp
+  @brief    POSIX shared memory ring for large payloads of clients on the render host
+**/
+
+#include "RT_shmRing.h"
+
+#include <QtEndian>
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char ShmMagic[4] = {'R', 'F', 'S', 'M'};
+    const quint32 ShmVersion = 1;
+}
+
+RT_shmRing::RT_shmRing() :
+        m_fd(-1),
+        m_data(nullptr),
+        m_size(0),
+        m_head(HeaderSize),
+        m_nextSequence(1)
+{
+}
+
+RT_shmRing::~RT_shmRing()
+{
+    close();
+}
+
+/**
+  @brief    create the shared memory object and map it, an opened ring is closed first
+  @param    name    POSIX name of the object, e.g. "/refloid-1234-1"
+  @param    size    size of the object in bytes, including the header
+  @return   0 on success, -1 if the object cannot be created, -2 if it cannot be sized or mapped
+  **/
+int RT_shmRing::open(const QString &name, std::size_t size)
+{
+    close();
+    if (size <= HeaderSize) {
+        return -2;
+    }
+    QByteArray name_data = name.toUtf8();
+    // Only clients of the same user may map the ring
+    m_fd = shm_open(name_data.constData(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (m_fd < 0) {
+        spdlog::error("Could not create shared memory object {}: {}", name_data.constData(), strerror(errno));
+        return -1;
+    }
+    m_name = name;
+    void *mapped = MAP_FAILED;
+    if (0 == ftruncate(m_fd, static_cast<off_t>(size))) {
+        mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    }
+    if (mapped == MAP_FAILED) {
+        spdlog::error("Could not map {} bytes of shared memory object {}: {}", size, name_data.constData(), strerror(errno));
+        close();
+        return -2;
+    }
+    m_data = static_cast<unsigned char*>(mapped);
+    m_size = size;
+
+    memcpy(m_data, ShmMagic, sizeof(ShmMagic));
+    qToLittleEndian<quint32>(ShmVersion, m_data + 4);
+    qToLittleEndian<quint64>(static_cast<quint64>(size), m_data + 8);
+    qToLittleEndian<quint64>(static_cast<quint64>(HeaderSize), m_data + 16);
+    spdlog::info("Opened shared memory ring {} with {} bytes", name_data.constData(), size);
+    return 0;
+}
+
+/**
+  @brief    unmap and unlink the shared memory object, all regions become invalid
+  **/
+void RT_shmRing::close()
+{
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        shm_unlink(m_name.toUtf8().constData());
+        m_fd = -1;
+    }
+    m_name.clear();
+    m_size = 0;
+    m_head = HeaderSize;
+    m_allocations.clear();
+}
+
+bool RT_shmRing::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+QString RT_shmRing::name() const
+{
+    return m_name;
+}
+
+std::size_t RT_shmRing::size() const
+{
+    return m_size;
+}
+
+/**
+  @brief    allocate a region behind the youngest one, wrapping around at the end of the ring
+  @param    size    payload size in bytes
+  @param    region  target for the allocated region
+  @return   0 on success, -1 if the ring is not open, -2 if there is not enough released space,
+            -3 if the size is 0 or larger than the ring
+  **/
+int RT_shmRing::allocate(std::size_t size, Region &region)
+{
+    if (!isOpen()) {
+        return -1;
+    }
+    // Checked before rounding up, sizes near SIZE_MAX would wrap around to small ones
+    if (size == 0 || size > m_size - HeaderSize) {
+        return -3;
+    }
+    std::size_t aligned = (size + Alignment - 1) / Alignment * Alignment;
+    std::size_t offset = 0;
+    if (m_allocations.empty()) {
+        m_head = HeaderSize;
+        if (aligned > m_size - m_head) {
+            return -2;
+        }
+        offset = m_head;
+    } else {
+        std::size_t tail = m_allocations.front().region.offset;
+        if (m_head > tail) {
+            // Free space at the end, and at the start in front of the oldest region
+            if (aligned <= m_size - m_head) {
+                offset = m_head;
+            } else if (aligned <= tail - HeaderSize) {
+                offset = HeaderSize;
+            } else {
+                return -2;
+            }
+        } else if (aligned <= tail - m_head) {
+            offset = m_head;
+        } else {
+            return -2;
+        }
+    }
+
+    region.offset = offset;
+    region.size = size;
+    region.sequence = m_nextSequence++;
+    m_head = offset + aligned;
+    Allocation allocation;
+    allocation.region = region;
+    allocation.released = false;
+    m_allocations.push_back(allocation);
+    return 0;
+}
+
+/**
+  @brief    give a region back to the ring
+  @param    sequence    sequence number of the region
+  @return   0 on success, -1 if there is no such region
+  **/
+int RT_shmRing::release(quint64 sequence)
+{
+    bool found = false;
+    for (auto it = m_allocations.begin(); it != m_allocations.end(); ++it) {
+        if (it->region.sequence == sequence && !it->released) {
+            it->released = true;
+            found = true;
+            break;
+        }
+    }
+    while (!m_allocations.empty() && m_allocations.front().released) {
+        m_allocations.pop_front();
+    }
+    if (m_allocations.empty()) {
+        m_head = HeaderSize;
+    }
+    return found ? 0 : -1;
+}
+
+/**
+  @brief    get the memory of an allocated region
+  @param    region  region returned by allocate()
+  @return   start of the region
+  **/
+unsigned char* RT_shmRing::data(const Region &region)
+{
+    return m_data + region.offset;
+}
+
+/**
+  @brief    validate a descriptor sent by a client and get the payload it refers to
+  @param    offset      offset of the region
+  @param    size        payload size, at most the size the region was allocated with
+  @param    sequence    sequence number of the region
+  @return   start of the payload, nullptr if the descriptor does not match an allocated region
+  **/
+const unsigned char* RT_shmRing::payload(std::size_t offset, std::size_t size, quint64 sequence) const
+{
+    for (auto it = m_allocations.begin(); it != m_allocations.end(); ++it) {
+        if (it->region.sequence == sequence && !it->released) {
+            if (it->region.offset != offset || size > it->region.size) {
+                return nullptr;
+            }
+            return m_data + offset;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,70 @@
+/**
+  @file     RT_shmRing.h
+  @brief    POSIX shared memory ring for large payloads of clients on the render host
+
+  Clients on the same machine open the shared memory object by the name returned by "openShm" and
+  exchange images and meshes through it; the ZMQ channel only carries descriptors
+  "<offset>;<size>;<sequence>". The object starts with a header, all values little endian:
+
+    char    magic[4]    "RFSM"
+    uint32  version     1
+    uint64  size        size of the shared memory object in bytes
+    uint64  dataOffset  start of the ring (64)
+
+  Regions are allocated in ring order behind the header and stay valid until they are released with
+  their sequence number ("shmRelease"). Space is reclaimed from the oldest region on, so a region
+  that is never released blocks the ring once it wrapped around.
+**/
+
+#ifndef NSLAIFT_RT_SHMRING_H
+#define NSLAIFT_RT_SHMRING_H
+
+#include <QString>
+#include <QtGlobal>
+
+#include <cstddef>
+#include <deque>
+
+class RT_shmRing
+{
+public:
+    ///< a region of the ring as described to clients
+    struct Region {
+        std::size_t offset;     ///< from the start of the shared memory object
+        std::size_t size;
+        quint64 sequence;
+    };
+
+    RT_shmRing();
+    ~RT_shmRing();
+
+    int open(const QString &name, std::size_t size);
+    void close();
+    bool isOpen() const;
+    QString name() const;
+    std::size_t size() const;
+
+    int allocate(std::size_t size, Region &region);
+    int release(quint64 sequence);
+    unsigned char* data(const Region &region);
+    const unsigned char* payload(std::size_t offset, std::size_t size, quint64 sequence) const;
+
+    static const std::size_t HeaderSize = 64;
+    static const std::size_t Alignment = 64;     ///< regions start on cache lines
+
+private:
+    struct Allocation {
+        Region region;
+        bool released;
+    };
+
+    QString m_name;
+    int m_fd;
+    unsigned char *m_data;
+    std::size_t m_size;
+    std::size_t m_head;                     ///< offset of the next allocation
+    quint64 m_nextSequence;
+    std::deque<Allocation> m_allocations;   ///< regions in ring order, oldest first
+};
+
+#endif //NSLAIFT_RT_SHMRING_H
@@ -48,6 +48,11 @@ void RT_sphere::setRadius(float r) {
     m_radius = r;
 }
 
+void RT_sphere::hashState(QCryptographicHash &hash) const {
+    RT_object::hashState(hash);
+    rthelpers::hashData(hash, &m_radius, sizeof(m_radius));
+}
+
 int RT_sphere::updateCache() {
     spdlog::debug("Updating caches of sphere object {}", m_strName.toUtf8().constData());
     m_transform_optix->setMatrix(false, m_transform.getData(), m_transform.inverse().getData());
@@ -58,30 +63,38 @@ int RT_sphere::updateCache() {
     m_geom_inst["Rt"]->setMatrix4x4fv(false, m_transform.getData());
 }
 
+/**
+  @brief    actions of sphere objects
+  @return   the action table, starting with all actions of RT_object
+  **/
+const RT_sphere::ActionTable& RT_sphere::actions() {
+    static const ActionTable table = [] {
+        ActionTable t(RT_object::actions());
+        t.add({"setRadius", "radius"}, [](RT_sphere &sphere, const QString &parameters) {
+            bool ok = false;
+            float radius = parameters.toFloat(&ok);
+            if (ok) {
+                sphere.setRadius(radius);
+            } else {
+                spdlog::error("Could not convert the entered radius to float for sphere object");
+            }
+            return 0;
+        });
+        return t;
+    }();
+    return table;
+}
+
 /**
   @brief    parse parameters
   @param    action  string describing action to perform
   @param    params  action parameters
   @return   0 on success, negative on error, positive if action not found (use child class action)
 
-  first all "local" actions are looked up, if none found then base class RTobject::parseActions() is called
+  the action table of the class also holds the actions of its base classes, see actions()
   **/
 int RT_sphere::parseActions(const QString &action, const QString &parameters) {
     spdlog::debug("Parsing parameter {0} for action {1} on sphere object {2}", parameters.toUtf8().constData(),
                   action.toUtf8().constData(), m_strName.toUtf8().constData());
-    if((0 == action.compare("setRadius", Qt::CaseInsensitive)) || (0 == action.compare("radius", Qt::CaseInsensitive)))
-    {
-        bool ok = false;
-        float radius = parameters.toFloat(&ok);
-        if (ok)
-        {
-            setRadius(radius);
-        } else {
-            spdlog::error("Could not convert the entered radius to float for sphere object");
-        }
-    } else {
-        int ret = RT_object::parseActions(action, parameters);
-        return ret;
-    }
-    return 0;
-}
\ No newline at end of file
+    return actions().dispatch(action, *this, parameters);
+}
@@ -9,12 +9,16 @@
 
 class RT_sphere : virtual  public RT_object {
 public:
+    typedef RT_actionTable<RT_sphere, const QString&> ActionTable;
+
     RT_sphere(optix::Context &context, optix::Group &root_group, RT_object *parent = nullptr);
     ~RT_sphere();
 
 public:
     int updateCache() override;
+    void hashState(QCryptographicHash &hash) const override;
     int parseActions(const QString &action, const QString &parameters) override;
+    static const ActionTable& actions();
 
     void setRadius(float r);
 
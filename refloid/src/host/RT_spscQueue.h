@@ -0,0 +1,101 @@
+/**
+  @file     RT_spscQueue.h
+  @brief    bounded lock-free single producer / single consumer queue
+
+  Used to hand requests from the network thread (RT_server) to a worker thread (RT_worker). The
+  producer only writes the tail index and the consumer only writes the head index, both are padded
+  to their own cache line. Each side keeps a copy of the other side's index and only reloads it when
+  the queue looks full or empty, so a push or pop usually touches no shared cache line but its slot.
+**/
+
+#ifndef NSLAIFT_RT_SPSCQUEUE_H
+#define NSLAIFT_RT_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template<class T>
+class RT_spscQueue
+{
+public:
+    /**
+      @brief    create an empty queue
+      @param    capacity    maximum number of queued values, rounded up to a power of two
+      **/
+    explicit RT_spscQueue(std::size_t capacity) :
+            m_head(0),
+            m_cachedTail(0),
+            m_tail(0),
+            m_cachedHead(0)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    /**
+      @brief    append a value, only called by the producer thread
+      @return   false if the queue is full
+      **/
+    bool push(const T &value)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead > m_mask) {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+      @brief    remove the oldest value, only called by the consumer thread
+      @return   false if the queue is empty
+      **/
+    bool pop(T &value)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail) {
+                return false;
+            }
+        }
+        value = m_slots[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    ///< number of queued values, exact only if called by the producer or the consumer
+    std::size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    static const std::size_t CacheLine = 64;
+
+    std::vector<T> m_slots;
+    std::size_t m_mask;
+    char m_pad0[CacheLine];
+    std::atomic<std::size_t> m_head;        ///< next slot to pop, written by the consumer
+    std::size_t m_cachedTail;               ///< consumer's copy of m_tail
+    char m_pad1[CacheLine];
+    std::atomic<std::size_t> m_tail;        ///< next slot to push, written by the producer
+    std::size_t m_cachedHead;               ///< producer's copy of m_head
+    char m_pad2[CacheLine];
+};
+
+#endif //NSLAIFT_RT_SPSCQUEUE_H
@@ -0,0 +1,104 @@
+/**
+  @file     RT_trajectory.cpp
+  @brief    reader of pose trajectory files for batch renders
+**/
+
+#include "RT_trajectory.h"
+
+#include <spdlog/spdlog.h>
+
+#include <QByteArray>
+#include <QStringList>
+
+/**
+  @brief    open a trajectory file
+  @param    path    path of the file on the server
+  @return   0 on success, -1 if the file cannot be opened
+  **/
+int RT_trajectory::open(const QString &path)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        spdlog::error("Could not open the trajectory file \"{}\"", path.toUtf8().constData());
+        return -1;
+    }
+    m_line = 0;
+    m_pending = false;
+    return 0;
+}
+
+/**
+  @brief    read the next frame
+  @param    frame   receives the frame number and its actions
+  @return   1 if a frame was read, 0 at the end of the file, -15 if a line is malformed or the frame numbers do not increase
+  **/
+int RT_trajectory::next(Frame &frame)
+{
+    frame.index = -1;
+    frame.actions.clear();
+    if (m_pending) {
+        frame.index = m_pendingIndex;
+        frame.actions.append(m_pendingAction);
+        m_pending = false;
+    }
+    int index = -1;
+    Action action;
+    int ret = 0;
+    while ((ret = readAction(index, action)) > 0) {
+        if (frame.index < 0 || index == frame.index) {
+            frame.index = index;
+            frame.actions.append(action);
+            continue;
+        }
+        if (index < frame.index) {
+            spdlog::error("Frame {} in line {} of the trajectory is out of order", index, m_line);
+            return -15;
+        }
+        m_pending = true;
+        m_pendingIndex = index;
+        m_pendingAction = action;
+        break;
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    return (frame.index < 0) ? 0 : 1;
+}
+
+/**
+  @brief    number of lines read so far, for error messages
+  **/
+int RT_trajectory::line() const
+{
+    return m_line;
+}
+
+/**
+  @brief    read the next action, skipping empty lines and comments
+  @param    index   receives the frame number
+  @param    action  receives the action
+  @return   1 if an action was read, 0 at the end of the file, -15 if the line is malformed
+  **/
+int RT_trajectory::readAction(int &index, Action &action)
+{
+    while (!m_file.atEnd()) {
+        QByteArray line = m_file.readLine().trimmed();
+        m_line++;
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        QStringList fields = QString::fromUtf8(line).split(";");
+        bool ok = false;
+        index = (fields.size() >= 3) ? fields.at(0).trimmed().toInt(&ok) : -1;
+        if (!ok || index < 0) {
+            spdlog::error("Line {} of the trajectory is malformed: \"{}\"", m_line, line.constData());
+            return -15;
+        }
+        action.object = fields.at(1).trimmed();
+        action.action = fields.at(2).trimmed();
+        // The parameters may hold ";" themselves, e.g. "setMaterialParameter;Ks;0,0,0"
+        action.parameters = fields.mid(3).join(";");
+        return 1;
+    }
+    return 0;
+}
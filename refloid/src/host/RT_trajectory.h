@@ -0,0 +1,52 @@
+/**
+  @file     RT_trajectory.h
+  @brief    reader of pose trajectory files for batch renders
+
+  A trajectory file describes a series of frames, e.g. of a robot moving cameras and lights through
+  an inspection cell. Every line holds one manipulateObject action of one frame:
+
+    <frame>;<object>;<action>;<parameters>
+
+  e.g. "12;cam1;setTransformationMatrix;1,0,0,0,0,1,0,0,0,0,1,0,0,0,0.5,1". The lines of a frame are
+  consecutive and the frame numbers increase. Like in a sweep, the actions of a frame are applied to
+  the pose each object had before the batch render; objects without actions in a frame stay there.
+  Empty lines and lines starting with "#" are skipped. The file is read line by line, so it may be
+  larger than the memory.
+**/
+
+#ifndef NSLAIFT_RT_TRAJECTORY_H
+#define NSLAIFT_RT_TRAJECTORY_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+class RT_trajectory
+{
+public:
+    struct Action {
+        QString object;
+        QString action;
+        QString parameters;
+    };
+
+    struct Frame {
+        int index = -1;
+        QVector<Action> actions;
+    };
+
+    int open(const QString &path);
+    int next(Frame &frame);
+    int line() const;
+
+private:
+    int readAction(int &index, Action &action);
+
+    QFile m_file;
+    int m_line = 0;                 ///< number of lines read so far
+    bool m_pending = false;         ///< m_pendingAction starts the next frame
+    int m_pendingIndex = -1;
+    Action m_pendingAction;
+};
+
+#endif //NSLAIFT_RT_TRAJECTORY_H
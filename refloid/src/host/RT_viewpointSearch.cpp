@@ -0,0 +1,203 @@
+/**
+  @file     RT_viewpointSearch.cpp
+  @brief    settings and candidate grid of a server-side viewpoint optimization
+**/
+
+#include "RT_viewpointSearch.h"
+
+#include <QJsonArray>
+
+#include <algorithm>
+
+namespace {
+    QString formatPose(const QVector<double> &values)
+    {
+        QStringList fields;
+        for (int i=0; i<values.size(); i++) {
+            fields << QString::number(values.at(i), 'g', 9);
+        }
+        return fields.join(",");
+    }
+
+    bool parseVector(const QString &str, QVector<double> &values)
+    {
+        QStringList fields = str.split(",");
+        values.resize(fields.size());
+        for (int i=0; i<fields.size(); i++) {
+            bool ok = false;
+            values[i] = fields.at(i).trimmed().toDouble(&ok);
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+const int RT_viewpointSearch::MaxCandidatesPerRound;
+const int RT_viewpointSearch::MaxResults;
+
+/**
+  @brief    read the settings of "optimizeViewpoint"
+  @param    sList   command split into its fields: {"optimizeViewpoint", object, action, "<from>:<to>", camera[, roi[, score[, downsample[, grid[, rounds]]]]]}
+  @param    search  receives the settings
+  @return   0 on success, -11 if fields are missing or malformed, -15 if the bounds cannot be parsed
+
+  <roi> is one rectangle "x,y,w,h" (empty for the whole image), <score> one of "saturated", "mean" and "max".
+  **/
+int RT_viewpointSearch::parse(const QStringList &sList, RT_viewpointSearch &search)
+{
+    if (sList.size() < 5 || sList.at(1).isEmpty() || sList.at(2).isEmpty() || sList.at(4).isEmpty()) {
+        return -11;
+    }
+    search.object = sList.at(1);
+    search.action = sList.at(2);
+    search.camera = sList.at(4);
+
+    QStringList bounds = sList.at(3).split(":");
+    if (bounds.size() != 2 || !parseVector(bounds.at(0), search.lower) || !parseVector(bounds.at(1), search.upper)
+            || search.lower.size() != search.upper.size()) {
+        return -15;
+    }
+    for (int i=0; i<search.lower.size(); i++) {
+        if (search.lower.at(i) > search.upper.at(i)) {
+            std::swap(search.lower[i], search.upper[i]);
+        }
+    }
+
+    if (sList.size() > 5) {
+        QVector<RT_roi> rois;
+        if (0 != RT_imageStats::parseRois(sList.at(5), rois) || rois.size() != 1) {
+            return -11;
+        }
+        search.roi = rois.at(0);
+    }
+    if (sList.size() > 6 && !sList.at(6).isEmpty()) {
+        if (0 == sList.at(6).compare("saturated", Qt::CaseInsensitive)) {
+            search.score = Saturated;
+        } else if (0 == sList.at(6).compare("mean", Qt::CaseInsensitive)) {
+            search.score = Mean;
+        } else if (0 == sList.at(6).compare("max", Qt::CaseInsensitive)) {
+            search.score = Max;
+        } else {
+            return -11;
+        }
+    }
+    int *numbers[] = {&search.downsample, &search.grid, &search.rounds};
+    for (int i=0; i<3 && sList.size() > 7 + i; i++) {
+        bool ok = false;
+        int value = sList.at(7 + i).toInt(&ok);
+        if (!ok || value < 1) {
+            return -11;
+        }
+        *numbers[i] = value;
+    }
+    if (search.grid < 2) {
+        return -11;
+    }
+
+    long long per_round = 1;
+    for (int i=0; i<search.lower.size(); i++) {
+        if (search.lower.at(i) < search.upper.at(i)) {
+            per_round *= search.grid;
+            if (per_round > MaxCandidatesPerRound) {
+                return -11;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+  @brief    grid over a box of action parameters
+  @param    lower   lower corner of the box
+  @param    upper   upper corner of the box
+  @return   action parameters of every grid point; parameters with lower == upper are not varied
+  **/
+QStringList RT_viewpointSearch::candidates(const QVector<double> &lower, const QVector<double> &upper) const
+{
+    QStringList poses;
+    int dims = lower.size();
+    QVector<int> steps(dims);
+    int count = 1;
+    for (int i=0; i<dims; i++) {
+        steps[i] = (lower.at(i) < upper.at(i)) ? grid : 1;
+        count *= steps.at(i);
+    }
+    QVector<double> values(dims);
+    for (int n=0; n<count; n++) {
+        int rest = n;
+        for (int i=0; i<dims; i++) {
+            int step = rest % steps.at(i);
+            rest /= steps.at(i);
+            values[i] = (steps.at(i) > 1) ? lower.at(i) + (upper.at(i) - lower.at(i)) * step / (steps.at(i) - 1) : lower.at(i);
+        }
+        poses << formatPose(values);
+    }
+    return poses;
+}
+
+/**
+  @brief    shrink the box of the next round to one grid step around the best candidate
+  @param    best    action parameters of the best candidate so far
+  @param    lower   lower corner of the current box, replaced by the next one
+  @param    upper   upper corner of the current box, replaced by the next one
+
+  The box never grows beyond the bounds of the search.
+  **/
+void RT_viewpointSearch::shrink(const QString &best, QVector<double> &lower, QVector<double> &upper) const
+{
+    QVector<double> center;
+    if (!parseVector(best, center) || center.size() != lower.size()) {
+        return;
+    }
+    for (int i=0; i<lower.size(); i++) {
+        double step = (upper.at(i) - lower.at(i)) / (grid - 1);
+        lower[i] = std::max(this->lower.at(i), center.at(i) - step);
+        upper[i] = std::min(this->upper.at(i), center.at(i) + step);
+    }
+}
+
+/**
+  @brief    score of an image region, lower is better
+  **/
+double RT_viewpointSearch::value(const RT_imageStats &stats) const
+{
+    switch (score) {
+        case Mean: return stats.mean;
+        case Max: return stats.max;
+        case Saturated: break;
+    }
+    return static_cast<double>(stats.saturated);
+}
+
+/**
+  @brief    result of the search as JSON
+  @param    evaluated   every evaluated candidate, in any order
+  @return   {"camera", "score", "evaluated", "best": [{"pose", "score", "pixels", "saturated", "mean", "max"}]}
+            with at most MaxResults candidates, best first
+  **/
+QJsonObject RT_viewpointSearch::toJson(const QVector<Candidate> &evaluated) const
+{
+    QVector<Candidate> sorted = evaluated;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Candidate &a, const Candidate &b) { return a.score < b.score; });
+    QJsonArray best;
+    for (int i=0; i<sorted.size() && i<MaxResults; i++) {
+        const Candidate &candidate = sorted.at(i);
+        QJsonObject entry;
+        entry.insert("pose", candidate.pose);
+        entry.insert("score", candidate.score);
+        entry.insert("pixels", static_cast<double>(candidate.stats.pixels));
+        entry.insert("saturated", static_cast<double>(candidate.stats.saturated));
+        entry.insert("mean", candidate.stats.mean);
+        entry.insert("max", candidate.stats.max);
+        best.append(entry);
+    }
+    const char *names[] = {"saturated", "mean", "max"};
+    QJsonObject json;
+    json.insert("camera", camera);
+    json.insert("score", QString(names[score]));
+    json.insert("evaluated", sorted.size());
+    json.insert("best", best);
+    return json;
+}
@@ -0,0 +1,61 @@
+/**
+  @file     RT_viewpointSearch.h
+  @brief    settings and candidate grid of a server-side viewpoint optimization
+
+  "optimizeViewpoint" looks for the pose of one object (usually a camera or a light source) that
+  minimizes a score of the image of one camera, e.g. the number of saturated pixels that a specular
+  reflection leaves in a region of interest. The pose is given as the parameters of a
+  manipulateObject action, bounded per component by <from> and <to>. The search is coarse to fine:
+  every round evaluates a regular grid over the current box and shrinks the box to one grid step
+  around the best candidate. The render thread evaluates the candidates with low resolution renders
+  (the camera intrinsics are scaled with the resolution, so the field of view stays the same) and
+  scores each image while the next candidate is launched.
+**/
+
+#ifndef NSLAIFT_RT_VIEWPOINTSEARCH_H
+#define NSLAIFT_RT_VIEWPOINTSEARCH_H
+
+#include "RT_imageStats.h"
+
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct RT_viewpointSearch
+{
+    enum Score {
+        Saturated = 0,  ///< number of saturated pixels in the region
+        Mean = 1,       ///< mean intensity of the region
+        Max = 2         ///< maximum intensity of the region
+    };
+
+    ///< evaluated pose, ordered by score
+    struct Candidate {
+        QString pose;               ///< action parameters
+        double score = 0.0;
+        RT_imageStats stats;        ///< statistics of the low resolution image
+    };
+
+    QString object;                 ///< object that is moved
+    QString action;                 ///< manipulateObject action, applied to the pose the object had before the search
+    QString camera;                 ///< camera whose image is scored
+    QVector<double> lower;          ///< bounds of the action parameters
+    QVector<double> upper;
+    RT_roi roi;                     ///< scored region in full resolution pixels, see RT_imageStats::compute()
+    Score score = Saturated;
+    int downsample = 4;             ///< the camera renders width / downsample x height / downsample pixels
+    int grid = 5;                   ///< grid points per parameter and round
+    int rounds = 3;
+
+    static int parse(const QStringList &sList, RT_viewpointSearch &search);
+    QStringList candidates(const QVector<double> &lower, const QVector<double> &upper) const;
+    void shrink(const QString &best, QVector<double> &lower, QVector<double> &upper) const;
+    double value(const RT_imageStats &stats) const;
+    QJsonObject toJson(const QVector<Candidate> &evaluated) const;
+
+    static const int MaxCandidatesPerRound = 4096;
+    static const int MaxResults = 10;       ///< best candidates in the result
+};
+
+#endif //NSLAIFT_RT_VIEWPOINTSEARCH_H
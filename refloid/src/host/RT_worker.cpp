@@ -0,0 +1,196 @@
+/**
+  @file     RT_worker.cpp
+  @brief    worker thread serving a set of sessions
+**/
+
+#include "RT_worker.h"
+#include "RT_metrics.h"
+
+#include <memory>
+
+/**
+  @brief    start the worker thread
+  @param    index               worker number, used for logging and the inproc endpoint names
+  @param    zmq_context         context of the server
+  @param    doorbell_endpoint   inproc endpoint RT_server has bound the ZMQ_PAIR doorbell socket of this worker to
+  @param    reply_endpoint      inproc endpoint RT_server has bound its ZMQ_PULL reply socket to
+  @param    preview_endpoint    inproc endpoint render previews are pushed to, empty to not send previews
+  @param    queue_capacity      number of requests that can wait in the queue of the worker
+  @param    scene_file          scene file every new session of the worker starts with, empty for an empty scene
+  **/
+RT_worker::RT_worker(int index, zmq::context_t &zmq_context, const std::string &doorbell_endpoint,
+                     const std::string &reply_endpoint, const std::string &preview_endpoint, std::size_t queue_capacity,
+                     const std::string &scene_file) :
+        m_index(index),
+        m_zmqContext(zmq_context),
+        m_doorbellEndpoint(doorbell_endpoint),
+        m_replyEndpoint(reply_endpoint),
+        m_eventEndpoint("inproc://refloid-worker-" + std::to_string(index) + "-events"),
+        m_previewEndpoint(preview_endpoint),
+        m_sceneFile(QString::fromStdString(scene_file)),
+        m_queue(queue_capacity),
+        m_doorbellPending(false)
+{
+    m_thread = std::thread(&RT_worker::run, this);
+}
+
+RT_worker::~RT_worker()
+{
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+/**
+  @brief    queue a request, only called by the network thread
+  @param    req             the request, owned by the worker afterwards unless the queue is full
+  @param    doorbell_socket the doorbell socket of this worker, owned by the calling thread
+  @return   false if the queue is full, req is left untouched then
+  **/
+bool RT_worker::submit(std::unique_ptr<RT_session::Request> &req, zmq::socket_t &doorbell_socket)
+{
+    if (!m_queue.push(req.get())) {
+        return false;
+    }
+    req.release();
+    // One doorbell wakes the worker for all requests queued until it resets the flag
+    if (!m_doorbellPending.exchange(true)) {
+        zmq::message_t msg(1);
+        doorbell_socket.send(msg);
+    }
+    return true;
+}
+
+/**
+  @brief    ask the worker to close all its sessions and to exit
+  @param    doorbell_socket the doorbell socket of this worker, owned by the calling thread
+  **/
+void RT_worker::stop(zmq::socket_t &doorbell_socket)
+{
+    zmq::message_t msg(0);
+    doorbell_socket.send(msg);
+}
+
+/**
+  @brief    number of requests waiting in the queue of the worker
+  **/
+std::size_t RT_worker::queueSize() const
+{
+    return m_queue.size();
+}
+
+/**
+  @brief    check whether the queue has room, only the network thread fills it
+  @return   true if the next submit() succeeds when called by the network thread
+  **/
+bool RT_worker::canSubmit() const
+{
+    return m_queue.size() < m_queue.capacity();
+}
+
+/**
+  @brief    get a session, it is created on first use
+  @param    name    session name
+  @param    replies reply socket of the worker
+  @return   the session, nullptr if it could not be created
+  **/
+RT_session* RT_worker::session(const QString &name, zmq::socket_t &replies)
+{
+    RT_session *s = m_sessions.value(name, nullptr);
+    if (s == nullptr) {
+        try {
+            s = new RT_session(name, m_zmqContext, replies, m_eventEndpoint, m_previewEndpoint, m_sceneFile);
+            m_sessions.insert(name, s);
+            spdlog::debug("Session \"{}\" is served by worker {}", name.toUtf8().constData(), m_index);
+        } catch (const std::exception &e) {
+            spdlog::error("Could not create session \"{}\": {}", name.toUtf8().constData(), e.what());
+            return nullptr;
+        }
+    }
+    return s;
+}
+
+/**
+  @brief    hand all queued requests to their sessions
+  @param    replies reply socket of the worker
+  **/
+void RT_worker::drainQueue(zmq::socket_t &replies)
+{
+    static RT_histogram *const wait_times = RT_metrics::instance().histogram("queue/wait");
+    RT_session::Request *raw = nullptr;
+    while (m_queue.pop(raw)) {
+        std::unique_ptr<RT_session::Request> req(raw);
+        wait_times->record(std::chrono::steady_clock::now() - req->received);
+        RT_session *s = session(req->session, replies);
+        if (s == nullptr) {
+            RT_session::reject(replies, *req, -13);
+        } else {
+            s->enqueue(std::move(req));
+        }
+    }
+}
+
+void RT_worker::run()
+{
+    zmq::socket_t doorbell(m_zmqContext, ZMQ_PAIR);
+    doorbell.connect(m_doorbellEndpoint);
+    zmq::socket_t replies(m_zmqContext, ZMQ_PUSH);
+    replies.connect(m_replyEndpoint);
+    // inproc endpoints have to be bound before the render threads connect
+    zmq::socket_t events(m_zmqContext, ZMQ_PULL);
+    events.bind(m_eventEndpoint);
+
+    bool running = true;
+    while (running) {
+        long timeout = -1;
+        for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+            long t = it.value()->pollTimeout();
+            if (t >= 0 && (timeout < 0 || t < timeout)) {
+                timeout = t;
+            }
+        }
+        zmq::pollitem_t items[] = {
+                {static_cast<void*>(doorbell), 0, ZMQ_POLLIN, 0},
+                {static_cast<void*>(events), 0, ZMQ_POLLIN, 0}
+        };
+        zmq::poll(items, 2, timeout);
+
+        if (items[1].revents & ZMQ_POLLIN) {
+            // Only used as a wake up call, the job states are read from the render threads
+            zmq::message_t event;
+            while (events.recv(&event, ZMQ_DONTWAIT)) {
+            }
+        }
+        if (items[0].revents & ZMQ_POLLIN) {
+            zmq::message_t msg;
+            doorbell.recv(&msg);
+            if (msg.size() == 0) {
+                running = false;
+                break;
+            }
+            // Reset before draining, requests queued from now on ring again or are drained below
+            m_doorbellPending.store(false);
+        }
+        drainQueue(replies);
+
+        for (auto it = m_sessions.begin(); it != m_sessions.end(); ) {
+            it.value()->resumeParked();
+            if (it.value()->isClosed()) {
+                delete it.value();
+                it = m_sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+        delete it.value();
+    }
+    m_sessions.clear();
+    // Requests queued after the stop are dropped without reply
+    RT_session::Request *raw = nullptr;
+    while (m_queue.pop(raw)) {
+        delete raw;
+    }
+}
@@ -0,0 +1,61 @@
+/**
+  @file     RT_worker.h
+  @brief    worker thread serving a set of sessions
+
+  RT_server hands every request to the worker its session is assigned to by pushing a pointer to the
+  RT_session::Request into the lock-free request queue of the worker (RT_spscQueue, RT_server is the
+  only producer). An inproc ZMQ_PAIR socket is only used as a doorbell to wake the worker from its
+  poll; a doorbell is rung once for all requests pushed while the worker has not yet looked at the
+  queue. The worker creates sessions on their first request, executes the requests and pushes the
+  reply frames back to RT_server, which forwards them to the client. All sessions of a worker share
+  its thread, sessions of different workers run in parallel.
+**/
+
+#ifndef NSLAIFT_RT_WORKER_H
+#define NSLAIFT_RT_WORKER_H
+
+#include "RT_session.h"
+#include "RT_spscQueue.h"
+
+#include <zmq.hpp>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+
+class RT_worker
+{
+public:
+    RT_worker(int index, zmq::context_t &zmq_context, const std::string &doorbell_endpoint,
+              const std::string &reply_endpoint, const std::string &preview_endpoint, std::size_t queue_capacity = 1024,
+              const std::string &scene_file = std::string());
+    ~RT_worker();
+
+    bool submit(std::unique_ptr<RT_session::Request> &req, zmq::socket_t &doorbell_socket);
+    void stop(zmq::socket_t &doorbell_socket);
+    std::size_t queueSize() const;
+    bool canSubmit() const;
+
+private:
+    void run();
+    void drainQueue(zmq::socket_t &replies);
+    RT_session* session(const QString &name, zmq::socket_t &replies);
+
+    int m_index;
+    zmq::context_t &m_zmqContext;
+    std::string m_doorbellEndpoint;
+    std::string m_replyEndpoint;
+    std::string m_eventEndpoint;                    ///< render threads of all sessions notify the worker here
+    std::string m_previewEndpoint;
+    QString m_sceneFile;                            ///< loaded by every new session, see RT_scene::loadScene()
+    QHash<QString, RT_session*> m_sessions;         ///< only accessed by the worker thread
+    RT_spscQueue<RT_session::Request*> m_queue;     ///< requests pushed by RT_server, owned by the queue until popped
+    std::atomic<bool> m_doorbellPending;            ///< a doorbell was rung that the worker has not answered yet
+    std::thread m_thread;
+};
+
+#endif //NSLAIFT_RT_WORKER_H
@@ -1,3 +1,7 @@
+import itertools
+import json
+import mmap
+import struct
 import zmq
 
 
@@ -6,39 +10,269 @@ def send_zmq_msg(msg):
     return socket.recv()
 
 
+def send_zmq_batch(msgs):
+    # All commands travel in one frame; the reply holds one status code per command
+    socket.send("\n".join(msgs))
+    return [int(status) for status in socket.recv().split("\n")]
+
+
+def send_zmq_binary(records):
+    # records is a list of (opcode, handle, [floats]); handles are queried with "getHandle;<name>"
+    frame = struct.pack("<4sI", b"RFB1", len(records))
+    for opcode, handle, values in records:
+        frame += struct.pack("<HHI%df" % len(values), opcode, len(values), handle, *values)
+    socket.send(frame)
+    reply = socket.recv()
+    count = struct.unpack_from("<I", reply, 4)[0]
+    return list(struct.unpack_from("<%di" % count, reply, 8))
+
+
+def fetch_images(job):
+    # Returns {camera: (width, height, format, pixels)}; pixels are raw RGB8 or RGB32F rows, top to bottom.
+    # Sweeps return {(camera, pose): ...} instead.
+    socket.send("fetch;%s;data" % job)
+    frames = socket.recv_multipart()
+    images = {}
+    for header, pixels in zip(frames[1::2], frames[2::2]):
+        fields = header.split(";")
+        name, width, height, fmt = fields[:4]
+        key = (name, int(fields[4])) if len(fields) > 4 else name
+        images[key] = (int(width), int(height), fmt, pixels)
+    return images
+
+
+def fetch_images_lz(job):
+    # Like fetch_images, but the server compresses the pixels losslessly (see rfz_decode); pays off over slow links.
+    # Returns {(camera, pose): (width, height, format, pixels)}
+    socket.send("fetch;%s;data;lz" % job)
+    frames = socket.recv_multipart()
+    images = {}
+    for header, payload in zip(frames[1::2], frames[2::2]):
+        name, width, height, fmt, pose = header.split(";")[:5]
+        images[(name, int(pose))] = (int(width), int(height), fmt, rfz_decode(payload))
+    return images
+
+
+def rfz_decode(payload):
+    # Raw bytes of a payload compressed by the server, the layout is in refloid/src/host/RT_codec.h.
+    # The blocks are in the LZ4 block format, decoded with the lz4 package.
+    import lz4.block
+    element, stride, _, block_size, raw_size, count = struct.unpack_from("<BBHIQI", payload, 4)
+    sizes = struct.unpack_from("<%dI" % count, payload, 24)
+    out = bytearray()
+    pos = 24 + 4 * count
+    for b, size in enumerate(sizes):
+        raw = min(block_size, raw_size - b * block_size)
+        block = bytes(payload[pos:pos + (size & 0x7fffffff)])
+        pos += size & 0x7fffffff
+        data = bytearray(block if size & 0x80000000 else lz4.block.decompress(block, uncompressed_size=raw))
+        # Undo the filter: running sums over every stride-th byte of each byte plane
+        n = raw // element
+        plain = bytearray(raw)
+        for k in range(element):
+            plane = data[k * n:(k + 1) * n]
+            for j in range(min(stride, n)):
+                plane[j::stride] = bytearray(itertools.accumulate(plane[j::stride], lambda x, y: (x + y) & 0xff))
+            plain[k:n * element:element] = plane
+        plain[n * element:] = bytearray(itertools.accumulate(data[n * element:], lambda x, y: (x + y) & 0xff))
+        out += plain
+    return bytes(out)
+
+
+def upload_mesh(name, vertices, triangles, normals=None):
+    # vertices and normals are lists of (x, y, z), triangles lists of vertex index triples
+    frames = ["uploadMesh;%s%s" % (name, ";normals" if normals else "")]
+    frames.append(struct.pack("<%df" % (3 * len(vertices)), *[c for v in vertices for c in v]))
+    frames.append(struct.pack("<%dI" % (3 * len(triangles)), *[i for t in triangles for i in t]))
+    if normals:
+        frames.append(struct.pack("<%df" % (3 * len(normals)), *[c for n in normals for c in n]))
+    socket.send_multipart(frames)
+    return int(socket.recv())
+
+
+def open_shm(size_mb=256):
+    # Maps the shared memory ring of the session, only works on the render host
+    name = send_zmq_msg("openShm;%d" % size_mb)
+    with open("/dev/shm" + name, "r+b") as f:
+        return mmap.mmap(f.fileno(), 0)
+
+
+def fetch_images_shm(job, shm):
+    # Like fetch_images, but the pixels are views into the shared memory ring instead of copies off the socket.
+    # Returns ({(camera, pose): (width, height, format, pixels)}, sequences); release the sequences once done.
+    socket.send("fetch;%s;shm" % job)
+    frames = socket.recv_multipart()
+    images = {}
+    sequences = []
+    for header in frames[1:]:
+        name, width, height, fmt, pose, offset, size, sequence = header.split(";")
+        images[(name, int(pose))] = (int(width), int(height), fmt, memoryview(shm)[int(offset):int(offset) + int(size)])
+        sequences.append(sequence)
+    return images, sequences
+
+
+def image_stats(job, rois=None, bins=16):
+    # Intensity statistics of a finished job; rois is a list of (x, y, width, height), None for the whole images
+    rects = ":".join(",".join(str(v) for v in roi) for roi in rois or [])
+    return json.loads(send_zmq_msg("imageStats;%s;%s;%d" % (job, rects, bins)))
+
+
+def optimize_viewpoint(obj, action, lower, upper, camera, roi=None, score="saturated", downsample=4, grid=5, rounds=3):
+    # Server-side search for the pose of obj that minimizes the score of the camera image, returns the best poses
+    bounds = "%s:%s" % (",".join(str(v) for v in lower), ",".join(str(v) for v in upper))
+    rect = ",".join(str(v) for v in roi) if roi else ""
+    job = send_zmq_msg("optimizeViewpoint;%s;%s;%s;%s;%s;%s;%d;%d;%d" % (obj, action, bounds, camera, rect, score, downsample, grid, rounds))
+    send_zmq_msg("wait;" + job)
+    return json.loads(send_zmq_msg("fetch;" + job))["best"]
+
+
+def sync_scene(description):
+    # Turns the scene into the described one, returns the number of created, deleted or changed objects
+    socket.send_multipart(["syncScene", json.dumps(description)])
+    return int(socket.recv())
+
+
+def write_scene_binary(path, description, meshes=None):
+    # Binary form of a scene description for "loadScene"; meshes maps object names to (vertices, triangles)
+    def string(text):
+        data = text.encode("utf-8")
+        return struct.pack("<I", len(data)) + data
+
+    meshes = meshes or {}
+    background = description.get("background")
+    out = b"RFS1" + struct.pack("<I3fI", 1 if background else 0, *(background or [0.0, 0.0, 0.0]), len(description["objects"]))
+    for obj in description["objects"]:
+        x, y, z = obj.get("position", [0.0, 0.0, 0.0])
+        transform = obj.get("transform", [1, 0, 0, x, 0, 1, 0, y, 0, 0, 1, z, 0, 0, 0, 1])
+        out += string(obj["name"]) + string(obj["type"]) + string(obj.get("params", ""))
+        out += struct.pack("<16fI", *(transform + [1 if obj.get("visible", True) else 0]))
+        actions = obj.get("actions", [])
+        out += struct.pack("<I", len(actions)) + b"".join(string(a) + string(p) for a, p in actions)
+        vertices, triangles = meshes.get(obj["name"], ([], []))
+        out += struct.pack("<3I", len(vertices), len(triangles), 0)
+        out += struct.pack("<%df" % (3 * len(vertices)), *[c for v in vertices for c in v])
+        out += struct.pack("<%dI" % (3 * len(triangles)), *[i for t in triangles for i in t])
+    with open(path, "wb") as f:
+        f.write(out)
+
+
+def stats(reset=False):
+    # Counters and latency histograms of the whole server, durations in microseconds
+    return json.loads(send_zmq_msg("stats;reset" if reset else "stats"))
+
+
 if __name__ == '__main__':
     context = zmq.Context()
 
     # Socket to talk to server
     socket = context.socket(zmq.REQ)
     socket.connect("tcp://localhost:5555")
-    send_zmq_msg("clear")
-
-    send_zmq_msg("createObject;lightpoint1;lightpoint")
-    send_zmq_msg("manipulateObject;lightpoint1;translate;10.0,0.0,0.0")
-    send_zmq_msg("manipulateObject;lightpoint1;color;0.0,0.0,0.9")
-    send_zmq_msg("createObject;lightpoint2;lightpoint")
-    send_zmq_msg("manipulateObject;lightpoint2;translate;0.0,1.0,0.0")
-    send_zmq_msg("manipulateObject;lightpoint2;color;0.8,0.8,0.8")
-
-    send_zmq_msg("createObject;cam1;camera")
-    send_zmq_msg("manipulateObject;cam1;translate;0.0,0.0,0.0")
-
-    send_zmq_msg("createObject;sphere1;sphere")
-    send_zmq_msg("createObject;cuboid1;cuboid")
-    send_zmq_msg("manipulateObject;cuboid1;translate;0.0,0.0,8.0")
-    # send_zmq_msg("manipulateObject;cuboid1;brdf;normal")
-    # send_zmq_msg("manipulateObject;sphere1;brdf;normal")
-    send_zmq_msg("manipulateObject;cuboid1;spin;45.0,0.0,0.0")
-    send_zmq_msg("manipulateObject;cuboid1;spin;0.0,45.0,0.0")
-    send_zmq_msg("manipulateObject;sphere1;translate;0.0,-0.1,2.0")
-    send_zmq_msg("render")
+    # The scene is built in a transaction, its caches are uploaded once at "commit"
+    send_zmq_batch([
+        "begin",
+        "clear",
+        "createObject;lightpoint1;lightpoint",
+        "manipulateObject;lightpoint1;translate;10.0,0.0,0.0",
+        "manipulateObject;lightpoint1;color;0.0,0.0,0.9",
+        "createObject;lightpoint2;lightpoint",
+        "manipulateObject;lightpoint2;translate;0.0,1.0,0.0",
+        "manipulateObject;lightpoint2;color;0.8,0.8,0.8",
+        "createObject;cam1;camera",
+        "manipulateObject;cam1;translate;0.0,0.0,0.0",
+        "createObject;sphere1;sphere",
+        "createObject;cuboid1;cuboid",
+        "manipulateObject;cuboid1;translate;0.0,0.0,8.0",
+        # "manipulateObject;cuboid1;brdf;normal",
+        # "manipulateObject;sphere1;brdf;normal",
+        "manipulateObject;cuboid1;spin;45.0,0.0,0.0",
+        "manipulateObject;cuboid1;spin;0.0,45.0,0.0",
+        "manipulateObject;sphere1;translate;0.0,-0.1,2.0",
+        "commit",
+    ])
+    # A mesh generated in memory, sent as binary frames instead of a PLY file on the server
+    upload_mesh("quad1", [(-1, -1, 0), (1, -1, 0), (1, 1, 0), (-1, 1, 0)], [(0, 1, 2), (0, 2, 3)])
+    send_zmq_msg("manipulateObject;quad1;translate;0.0,0.0,10.0")
+    # render only queues a job and replies with its id, wait blocks until the job is done
+    job = send_zmq_msg("render")
+    send_zmq_msg("wait;" + job)
 
     send_zmq_msg("manipulateObject;lightpoint2;translate;0.0,-20.0,0.0")
 
 
     # send_zmq_msg("manipulateObject;sphere1;setMaterialParameter;Ks;0.0,0.0,0.0")
-    send_zmq_msg("render")
+    print(send_zmq_batch(["render", "wait"]))
+
+    # Get the pixels over the socket instead of reading the tiff files
+    job = send_zmq_msg("render")
+    send_zmq_msg("wait;" + job)
+    for name, (width, height, fmt, pixels) in fetch_images(job).items():
+        print(name, width, height, fmt, len(pixels))
+
+    # Move the sphere along z in 11 steps with a single command, the server loops over the poses
+    job = send_zmq_msg("sweep;sphere1;translate;0,0,0:0,0,1:11")
+    print(send_zmq_msg("wait;" + job), send_zmq_msg("fetch;" + job))
+
+    # Same host: fetch the sweep through shared memory instead of the socket
+    shm = open_shm()
+    images, sequences = fetch_images_shm(job, shm)
+    print(len(images), "images in shared memory")
+    del images
+    send_zmq_msg("shmRelease;" + ";".join(sequences))
+
+    # Watch the accumulation on the preview stream and stop it once the image is good enough
+    previews = context.socket(zmq.SUB)
+    previews.connect("tcp://localhost:5556")
+    previews.setsockopt(zmq.SUBSCRIBE, b"cam1;")
+    send_zmq_msg("setStream;10;4")
+    job = send_zmq_msg("render;1000")
+    while True:
+        header, pixels = previews.recv_multipart()
+        name, preview_job, iteration, width, height, fmt = header.split(";")
+        if preview_job == job and int(iteration) >= 100:
+            break
+    send_zmq_msg("stop;" + job)
+    send_zmq_msg("wait;" + job)
+    send_zmq_msg("setStream;0")
+
+    # Interactive check within 200 ms: as many iterations as fit, the reply tells how many each camera got
+    job = send_zmq_msg("renderFor;200")
+    send_zmq_msg("wait;" + job)
+    print(send_zmq_msg("fetch;%s;samples" % job))
+    # A render that is no longer needed is dropped, "cancel" without a job drops all jobs of the session
+    job = send_zmq_msg("render;10000")
+    print(send_zmq_msg("cancel;" + job), send_zmq_msg("wait;" + job))
+
+    # Declare the whole scene instead of rebuilding it; objects missing from the description are deleted
+    scene = {"objects": [
+        {"name": "cam1", "type": "camera"},
+        {"name": "lightpoint1", "type": "lightpoint", "position": [10.0, 0.0, 0.0], "actions": [["color", "0.0,0.0,0.9"]]},
+        {"name": "sphere1", "type": "sphere", "position": [0.0, -0.1, 2.0], "actions": [["setMaterialParameter", "Ks;0.0,0.0,0.0"]]},
+    ]}
+    print(sync_scene(scene))
+    scene["objects"][2]["position"] = [0.0, 0.0, 3.0]
+    # Only the pose of sphere1 is applied, unchanged objects cost nothing
+    print(sync_scene(scene))
+
+    # A scene file with an embedded mesh, loaded with one acceleration build and one validation
+    write_scene_binary("/tmp/cell.rfs", {"objects": scene["objects"] + [{"name": "quad1", "type": "mesh", "position": [0.0, 0.0, 10.0]}]},
+                       {"quad1": ([(-1, -1, 0), (1, -1, 0), (1, 1, 0), (-1, 1, 0)], [(0, 1, 2), (0, 2, 3)])})
+    print(send_zmq_msg("loadScene;/tmp/cell.rfs"))
+
+    # Parameter search: states rendered before come from the render cache (256 MB, spilled to /tmp/refloid-cache)
+    send_zmq_msg("setCache;256;/tmp/refloid-cache;2048")
+    for z in [3.0, 4.0, 3.0]:
+        send_zmq_msg("manipulateObject;sphere1;setPosition;0.0,0.0,%f" % z)
+        job, _, cached = send_zmq_msg("render").partition(";")
+        send_zmq_msg("wait;" + job)
+        print(z, "cached" if cached else "rendered")
+
+    # Place the light so that it leaves no highlight in the center of cam1, without a single image transfer
+    for candidate in optimize_viewpoint("lightpoint1", "setPosition", (5.0, -5.0, 0.0), (15.0, 5.0, 0.0), "cam1", roi=(100, 100, 200, 200))[:3]:
+        print(candidate["pose"], candidate["score"])
+
+    # Where did the time go? Median and tail latency of every command and render phase
+    for name, h in sorted(stats()["histograms"].items()):
+        print(name, h["count"], h["p50_us"], h["p99_us"])
 
     # send_zmq_msg("clear")
 